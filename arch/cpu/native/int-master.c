@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2018, RISE SICS.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*---------------------------------------------------------------------------*/
+/**
+ * \file
+ * Master interrupt manipulation for the native platform. The only
+ * "interrupt" on native is SIGALRM, which drives the rtimer, so the
+ * master interrupt maps to the blocked state of that signal.
+ */
+/*---------------------------------------------------------------------------*/
+#include "contiki.h"
+#include "sys/int-master.h"
+
+#include <stdbool.h>
+#ifndef _WIN32
+#include <signal.h>
+#endif /* !_WIN32 */
+/*---------------------------------------------------------------------------*/
+#ifndef _WIN32
+static void
+set_blocked(int how, sigset_t *old)
+{
+  sigset_t set;
+
+  sigemptyset(&set);
+  sigaddset(&set, SIGALRM);
+  sigprocmask(how, &set, old);
+}
+#endif /* !_WIN32 */
+/*---------------------------------------------------------------------------*/
+void
+int_master_enable(void)
+{
+#ifndef _WIN32
+  set_blocked(SIG_UNBLOCK, NULL);
+#endif /* !_WIN32 */
+}
+/*---------------------------------------------------------------------------*/
+int_master_status_t
+int_master_read_and_disable(void)
+{
+#ifndef _WIN32
+  sigset_t old;
+
+  set_blocked(SIG_BLOCK, &old);
+  return sigismember(&old, SIGALRM) ? 0 : 1;
+#else /* !_WIN32 */
+  return 1;
+#endif /* !_WIN32 */
+}
+/*---------------------------------------------------------------------------*/
+void
+int_master_status_set(int_master_status_t status)
+{
+#ifndef _WIN32
+  set_blocked(status ? SIG_UNBLOCK : SIG_BLOCK, NULL);
+#endif /* !_WIN32 */
+}
+/*---------------------------------------------------------------------------*/
+bool
+int_master_is_enabled(void)
+{
+#ifndef _WIN32
+  sigset_t cur;
+
+  sigprocmask(SIG_BLOCK, NULL, &cur);
+  return sigismember(&cur, SIGALRM) ? false : true;
+#else /* !_WIN32 */
+  return true;
+#endif /* !_WIN32 */
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,195 @@
+/*
+ * Copyright (c) 2018, RISE SICS.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * \file
+ *         Batched packet I/O on a tun device.
+ */
+
+#include "tun-batch.h"
+
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <err.h>
+
+/* Log configuration */
+#include "sys/log.h"
+#define LOG_MODULE "Tun6"
+#define LOG_LEVEL LOG_LEVEL_WARN
+
+/*---------------------------------------------------------------------------*/
+void
+tun_batch_init(struct tun_batch *b, int fd, void (*input)(void))
+{
+  int flags;
+
+  memset(b, 0, sizeof(*b));
+  b->fd = fd;
+  b->input = input;
+
+  /* Reads stop at an empty descriptor, instead of blocking the process */
+  flags = fcntl(fd, F_GETFL);
+  if(flags == -1 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+    err(1, "tun_batch_init: fcntl");
+  }
+}
+/*---------------------------------------------------------------------------*/
+int
+tun_batch_set_fd(struct tun_batch *b, fd_set *rset, fd_set *wset)
+{
+  FD_SET(b->fd, rset);
+  if(b->tx_count > 0) {
+    FD_SET(b->fd, wset);
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/* Write a packet; returns 1 if written, 0 if the descriptor is full */
+static int
+write_packet(struct tun_batch *b, const uint8_t *data, int len)
+{
+  if(write(b->fd, data, len) != len) {
+    if(errno == EAGAIN || errno == EWOULDBLOCK) {
+      return 0;
+    }
+    err(1, "tun_batch: write");
+  }
+  b->stats.packets_out++;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+void
+tun_batch_flush(struct tun_batch *b)
+{
+  if(b->tx_count == 0) {
+    return;
+  }
+
+  b->stats.flushes++;
+  while(b->tx_count > 0 &&
+        write_packet(b, b->tx[b->tx_first], b->tx_len[b->tx_first])) {
+    b->tx_first = (b->tx_first + 1) % TUN_BATCH_QUEUE;
+    b->tx_count--;
+  }
+}
+/*---------------------------------------------------------------------------*/
+int
+tun_batch_write(struct tun_batch *b, const uint8_t *data, int len)
+{
+  int last;
+
+  if(len > TUN_BATCH_MTU) {
+    LOG_WARN("Dropping packet of %d bytes\n", len);
+    b->stats.drops++;
+    return -1;
+  }
+
+  /* Outside of a batch, write through unless packets are waiting */
+  if(!b->in_batch && b->tx_count == 0 && write_packet(b, data, len)) {
+    return 0;
+  }
+
+  if(b->tx_count == TUN_BATCH_QUEUE) {
+    tun_batch_flush(b);
+    if(b->tx_count == TUN_BATCH_QUEUE) {
+      LOG_WARN("Write queue full, dropping packet\n");
+      b->stats.drops++;
+      return -1;
+    }
+  }
+
+  last = (b->tx_first + b->tx_count) % TUN_BATCH_QUEUE;
+  memcpy(b->tx[last], data, len);
+  b->tx_len[last] = len;
+  b->tx_count++;
+  if(b->tx_count > b->stats.max_queued) {
+    b->stats.max_queued = b->tx_count;
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+int
+tun_batch_handle_fd(struct tun_batch *b, fd_set *rset, fd_set *wset,
+                    int max)
+{
+  int count;
+  int i;
+  ssize_t size;
+
+  if(FD_ISSET(b->fd, wset)) {
+    tun_batch_flush(b);
+  }
+
+  if(!FD_ISSET(b->fd, rset)) {
+    return 0;
+  }
+
+  if(max > TUN_BATCH_SIZE) {
+    max = TUN_BATCH_SIZE;
+  }
+
+  /* Drain the descriptor first, so that the kernel can queue more
+     packets while these are processed */
+  for(count = 0; count < max; count++) {
+    size = read(b->fd, b->rx[count], TUN_BATCH_MTU);
+    if(size == -1) {
+      if(errno == EAGAIN || errno == EWOULDBLOCK) {
+        break;
+      }
+      err(1, "tun_batch: read");
+    }
+    if(size == 0) {
+      break;
+    }
+    b->rx_len[count] = size;
+  }
+
+  b->stats.wakeups++;
+  b->stats.packets_in += count;
+  if(count > b->stats.max_batch) {
+    b->stats.max_batch = count;
+  }
+
+  b->in_batch = 1;
+  for(i = 0; i < count; i++) {
+    memcpy(&uip_buf[UIP_LLH_LEN], b->rx[i], b->rx_len[i]);
+    uip_len = b->rx_len[i];
+    b->input();
+  }
+  b->in_batch = 0;
+
+  tun_batch_flush(b);
+
+  return count;
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2018, RISE SICS.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * \file
+ *         Batched packet I/O on a tun device, or on any file descriptor
+ *         that delivers one packet per read() and takes one packet per
+ *         write(), such as a SOCK_SEQPACKET socket.
+ *
+ *         On each select() wakeup, up to TUN_BATCH_SIZE packets are
+ *         drained from the descriptor into a ring, then passed to the
+ *         input function back-to-back. Packets written while a batch is
+ *         processed are queued and flushed together at the end of the
+ *         batch, or when the descriptor becomes writable again.
+ */
+
+#ifndef TUN_BATCH_H_
+#define TUN_BATCH_H_
+
+#include "contiki.h"
+#include "net/ipv6/uip.h"
+
+/** Number of packets read per select() wakeup */
+#ifdef TUN_BATCH_CONF_SIZE
+#define TUN_BATCH_SIZE TUN_BATCH_CONF_SIZE
+#else
+#define TUN_BATCH_SIZE 16
+#endif
+
+/** Number of packets the write queue holds */
+#ifdef TUN_BATCH_CONF_QUEUE
+#define TUN_BATCH_QUEUE TUN_BATCH_CONF_QUEUE
+#else
+#define TUN_BATCH_QUEUE 16
+#endif
+
+#define TUN_BATCH_MTU (UIP_BUFSIZE - UIP_LLH_LEN)
+
+struct tun_batch_stats {
+  unsigned long wakeups;     /* Wakeups with the descriptor readable */
+  unsigned long packets_in;  /* Packets read */
+  unsigned long max_batch;   /* Most packets read in a wakeup */
+  unsigned long packets_out; /* Packets written */
+  unsigned long flushes;     /* Flushes of a non-empty write queue */
+  unsigned long max_queued;  /* Most packets in the write queue */
+  unsigned long drops;       /* Packets dropped with the write queue full */
+};
+
+struct tun_batch {
+  int fd;
+  /* Called with each packet read in uip_buf and uip_len */
+  void (*input)(void);
+  uint8_t in_batch;
+  uint8_t tx_first;
+  uint8_t tx_count;
+  uint16_t rx_len[TUN_BATCH_SIZE];
+  uint16_t tx_len[TUN_BATCH_QUEUE];
+  uint8_t rx[TUN_BATCH_SIZE][TUN_BATCH_MTU];
+  uint8_t tx[TUN_BATCH_QUEUE][TUN_BATCH_MTU];
+  struct tun_batch_stats stats;
+};
+
+/**
+ * \brief      Start batched I/O on a file descriptor
+ * \param b    The batch state
+ * \param fd   The descriptor, which is made non-blocking
+ * \param input The function to call with each packet read, in uip_buf
+ */
+void tun_batch_init(struct tun_batch *b, int fd, void (*input)(void));
+
+/**
+ * \brief      Add the descriptor to the sets of a select() callback
+ * \return     1 if the descriptor was added, 0 otherwise
+ *
+ *             The descriptor is always watched for reading, and for
+ *             writing while the write queue is not empty.
+ */
+int tun_batch_set_fd(struct tun_batch *b, fd_set *rset, fd_set *wset);
+
+/**
+ * \brief      Handle the descriptor in a select() callback
+ * \param max  The number of packets to read at most, up to TUN_BATCH_SIZE
+ * \return     The number of packets read
+ */
+int tun_batch_handle_fd(struct tun_batch *b, fd_set *rset, fd_set *wset,
+                        int max);
+
+/**
+ * \brief      Write a packet, or queue it while a batch is processed
+ * \return     0 if the packet was written or queued, -1 if it was dropped
+ */
+int tun_batch_write(struct tun_batch *b, const uint8_t *data, int len);
+
+/**
+ * \brief      Write the queued packets, as long as the descriptor takes them
+ */
+void tun_batch_flush(struct tun_batch *b);
+
+#endif /* TUN_BATCH_H_ */
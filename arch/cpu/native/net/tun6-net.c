@@ -63,6 +63,8 @@
 #include <err.h>
 #include "net/netstack.h"
 #include "net/packetbuf.h"
+#include "tun6-net.h"
+#include "tun-batch.h"
 
 static const char *config_ipaddr = "fd00::1/64";
 /* Allocate some bytes in RAM and copy the string */
@@ -71,6 +73,7 @@ static char config_tundev[64] = "tun0";
 
 #ifndef __CYGWIN__
 static int tunfd = -1;
+static struct tun_batch tun_batch;
 
 static int set_fd(fd_set *rset, fd_set *wset);
 static void handle_fd(fd_set *rset, fd_set *wset);
@@ -217,6 +220,7 @@ tun_init()
 
   LOG_INFO("Tun open:%d\n", tunfd);
 
+  tun_batch_init(&tun_batch, tunfd, tcpip_input);
   select_set_callback(tunfd, &tun_select_callback);
 
   fprintf(stderr, "opened %s device ``/dev/%s''\n",
@@ -234,29 +238,11 @@ static int
 tun_output(uint8_t *data, int len)
 {
   /* fprintf(stderr, "*** Writing to tun...%d\n", len); */
-  if(tunfd != -1 && write(tunfd, data, len) != len) {
-    err(1, "serial_to_tun: write");
-    return -1;
+  if(tunfd != -1) {
+    return tun_batch_write(&tun_batch, data, len);
   }
   return 0;
 }
-/*---------------------------------------------------------------------------*/
-static int
-tun_input(unsigned char *data, int maxlen)
-{
-  int size;
-
-  if(tunfd == -1) {
-    /* tun is not open */
-    return 0;
-  }
-
-  if((size = read(tunfd, data, maxlen)) == -1) {
-    err(1, "tun_input: read");
-  }
-  return size;
-}
-
 /*---------------------------------------------------------------------------*/
 static uint8_t
 output(const linkaddr_t *localdest)
@@ -278,8 +264,7 @@ set_fd(fd_set *rset, fd_set *wset)
     return 0;
   }
 
-  FD_SET(tunfd, rset);
-  return 1;
+  return tun_batch_set_fd(&tun_batch, rset, wset);
 }
 
 /*---------------------------------------------------------------------------*/
@@ -287,7 +272,7 @@ set_fd(fd_set *rset, fd_set *wset)
 static void
 handle_fd(fd_set *rset, fd_set *wset)
 {
-  int size;
+  int count;
 
   if(tunfd == -1) {
     /* tun is not open */
@@ -296,12 +281,14 @@ handle_fd(fd_set *rset, fd_set *wset)
 
   LOG_INFO("Tun6-handle FD\n");
 
-  if(FD_ISSET(tunfd, rset)) {
-    size = tun_input(&uip_buf[UIP_LLH_LEN], sizeof(uip_buf));
-    LOG_DBG("TUN data incoming read:%d\n", size);
-    uip_len = size;
-    tcpip_input();
-  }
+  count = tun_batch_handle_fd(&tun_batch, rset, wset, TUN_BATCH_SIZE);
+  LOG_DBG("TUN data incoming packets:%d\n", count);
+}
+/*---------------------------------------------------------------------------*/
+const struct tun_batch_stats *
+tun6_net_stats(void)
+{
+  return &tun_batch.stats;
 }
 #endif /*  __CYGWIN_ */
 
@@ -82,6 +82,12 @@ rtimer_arch_schedule(rtimer_clock_t t)
   val.it_value.tv_sec = c / CLOCK_SECOND;
   val.it_value.tv_usec = (c % CLOCK_SECOND) * CLOCK_SECOND;
 
+  if(RTIMER_CLOCK_DIFF(t, (rtimer_clock_t)clock_time()) <= 0) {
+    /* Due now or in the past: a zero value would disarm the timer */
+    val.it_value.tv_sec = 0;
+    val.it_value.tv_usec = 1;
+  }
+
   PRINTF("rtimer_arch_schedule time %u %u in %d.%d seconds\n", t, c, val.it_value.tv_sec,
       val.it_value.tv_usec);
 
@@ -81,6 +81,14 @@ typedef unsigned int uip_stats_t;
 #define UIP_CONF_IPV6_QUEUE_PKT  1
 #define UIP_ARCH_IPCHKSUM        1
 
+#ifndef UIP_CONF_CHKSUM_BACKEND
+#if defined(__SSE2__)
+#define UIP_CONF_CHKSUM_BACKEND  uip_chksum_sse2
+#else
+#define UIP_CONF_CHKSUM_BACKEND  uip_chksum_acc64
+#endif
+#endif /* UIP_CONF_CHKSUM_BACKEND */
+
 #endif /* NETSTACK_CONF_WITH_IPV6 */
 
 #include <ctype.h>
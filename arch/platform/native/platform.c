@@ -43,11 +43,17 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <sys/select.h>
 #include <errno.h>
 
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#endif /* __linux__ */
+
 #ifdef __CYGWIN__
 #include "net/wpcap-drv.h"
 #endif /* __CYGWIN__ */
@@ -105,12 +111,41 @@
 #else
 #define SELECT_STDIN 1
 #endif
+
+/*
+ * Waits for file descriptors with epoll instead of select (Linux only).
+ * The main loop then sleeps until a descriptor is ready or the next etimer
+ * expires, instead of waking up every SELECT_TIMEOUT, and only calls the
+ * handle_fd callbacks of ready descriptors. Callbacks that need to run
+ * periodically must use etimers or ctimers to wake the main loop up.
+ */
+#ifdef SELECT_CONF_EPOLL
+#define SELECT_EPOLL SELECT_CONF_EPOLL
+#else
+#define SELECT_EPOLL 0
+#endif
 /** @} */
+
+#if SELECT_EPOLL && !defined(__linux__)
+#error "SELECT_CONF_EPOLL requires Linux"
+#endif
 /*---------------------------------------------------------------------------*/
 
 static const struct select_callback *select_callback[SELECT_MAX];
 static int select_max = 0;
 
+#if SELECT_EPOLL
+static int epoll_fd = -1;
+static int timer_fd = -1;
+/* Expiration time the timer is armed for, 0 if disarmed */
+static clock_time_t timer_armed;
+/* Events each descriptor is registered for with epoll */
+static uint32_t epoll_events[SELECT_MAX];
+/* Descriptors that epoll does not support, such as regular files, are
+   always ready, as with select() */
+static uint8_t epoll_always_ready[SELECT_MAX];
+#endif /* SELECT_EPOLL */
+
 #ifdef PLATFORM_CONF_MAC_ADDR
 static uint8_t mac_addr[] = PLATFORM_CONF_MAC_ADDR;
 #else /* PLATFORM_CONF_MAC_ADDR */
@@ -134,6 +169,15 @@ select_set_callback(int fd, const struct select_callback *callback)
 
     select_callback[fd] = callback;
 
+#if SELECT_EPOLL
+    if(callback == NULL && epoll_events[fd] != 0) {
+      /* The descriptor may be closed already */
+      epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+    }
+    epoll_events[fd] = 0;
+    epoll_always_ready[fd] = 0;
+#endif /* SELECT_EPOLL */
+
     /* Update fd max */
     if(callback != NULL) {
       if(fd > select_max) {
@@ -164,9 +208,14 @@ static void
 stdin_handle_fd(fd_set *rset, fd_set *wset)
 {
   char c;
+  int len;
   if(FD_ISSET(STDIN_FILENO, rset)) {
-    if(read(STDIN_FILENO, &c, 1) > 0) {
+    len = read(STDIN_FILENO, &c, 1);
+    if(len > 0) {
       serial_line_input_byte(c);
+    } else if(len == 0) {
+      /* End of file: stop watching stdin, which would stay readable */
+      select_set_callback(STDIN_FILENO, NULL);
     }
   }
 }
@@ -277,12 +326,184 @@ platform_init_stage_three()
   setvbuf(stdout, (char *)NULL, _IONBF, 0);
 }
 /*---------------------------------------------------------------------------*/
+#if SELECT_EPOLL
+static void
+epoll_init(void)
+{
+  struct epoll_event ev;
+
+  epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if(epoll_fd == -1 || timer_fd == -1) {
+    perror("epoll");
+    exit(1);
+  }
+
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.fd = timer_fd;
+  epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &ev);
+}
+/*---------------------------------------------------------------------------*/
+/* Arm the timer for the next etimer expiration, if it changed */
+static void
+epoll_set_timer(void)
+{
+  struct itimerspec its;
+  clock_time_t next;
+
+  next = etimer_next_expiration_time();
+  if(next == timer_armed) {
+    return;
+  }
+
+  /* clock_time() counts CLOCK_MONOTONIC time, and 0 disarms the timer */
+  memset(&its, 0, sizeof(its));
+  its.it_value.tv_sec = next / CLOCK_SECOND;
+  its.it_value.tv_nsec = (next % CLOCK_SECOND) * (1000000000 / CLOCK_SECOND);
+  if(timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, NULL) == -1) {
+    perror("timerfd_settime");
+  }
+  timer_armed = next;
+}
+/*---------------------------------------------------------------------------*/
+/* Register the events the callbacks want with epoll; returns the number
+   of descriptors that are always ready */
+static int
+epoll_update(void)
+{
+  fd_set fdr;
+  fd_set fdw;
+  struct epoll_event ev;
+  uint32_t events;
+  int always_ready;
+  int i;
+
+  FD_ZERO(&fdr);
+  FD_ZERO(&fdw);
+  always_ready = 0;
+  for(i = 0; i <= select_max; i++) {
+    if(select_callback[i] == NULL) {
+      continue;
+    }
+    events = 0;
+    if(select_callback[i]->set_fd(&fdr, &fdw)) {
+      if(FD_ISSET(i, &fdr)) {
+        events |= EPOLLIN;
+        FD_CLR(i, &fdr);
+      }
+      if(FD_ISSET(i, &fdw)) {
+        events |= EPOLLOUT;
+        FD_CLR(i, &fdw);
+      }
+    }
+
+    if(epoll_always_ready[i]) {
+      epoll_events[i] = events;
+      always_ready += events != 0;
+    } else if(events != epoll_events[i]) {
+      memset(&ev, 0, sizeof(ev));
+      ev.events = events;
+      ev.data.fd = i;
+      if(events == 0) {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, i, NULL);
+      } else if(epoll_ctl(epoll_fd, epoll_events[i] == 0 ?
+                          EPOLL_CTL_ADD : EPOLL_CTL_MOD, i, &ev) == -1 &&
+                /* A closed descriptor leaves epoll: add it again */
+                (errno != ENOENT ||
+                 epoll_ctl(epoll_fd, EPOLL_CTL_ADD, i, &ev) == -1)) {
+        if(errno == EPERM) {
+          epoll_always_ready[i] = 1;
+          always_ready++;
+        } else {
+          perror("epoll_ctl");
+          events = 0;
+        }
+      }
+      epoll_events[i] = events;
+    }
+  }
+  return always_ready;
+}
+/*---------------------------------------------------------------------------*/
+static void
+epoll_handle(int fd, uint32_t events)
+{
+  fd_set fdr;
+  fd_set fdw;
+  uint64_t expirations;
+
+  if(fd == timer_fd) {
+    if(read(timer_fd, &expirations, sizeof(expirations)) > 0) {
+      timer_armed = 0;
+    }
+    return;
+  }
+
+  if(fd < 0 || fd >= SELECT_MAX || select_callback[fd] == NULL) {
+    return;
+  }
+
+  FD_ZERO(&fdr);
+  FD_ZERO(&fdw);
+  /* Errors and hangups are reported to the callback as readable */
+  if(events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+    FD_SET(fd, &fdr);
+  }
+  if(events & EPOLLOUT) {
+    FD_SET(fd, &fdw);
+  }
+  select_callback[fd]->handle_fd(&fdr, &fdw);
+}
+/*---------------------------------------------------------------------------*/
+static void
+epoll_main_loop(void)
+{
+  struct epoll_event events[SELECT_MAX + 1];
+  int always_ready;
+  int retval;
+  int i;
+
+  epoll_init();
+
+  while(1) {
+    retval = process_run();
+
+    always_ready = epoll_update();
+    epoll_set_timer();
+
+    /* Sleep until a descriptor is ready or the next etimer expires */
+    retval = epoll_wait(epoll_fd, events, SELECT_MAX + 1,
+                        retval || always_ready ? 0 : -1);
+    if(retval < 0) {
+      if(errno != EINTR) {
+        perror("epoll_wait");
+      }
+      retval = 0;
+    }
+    for(i = 0; i < retval; i++) {
+      epoll_handle(events[i].data.fd, events[i].events);
+    }
+    for(i = 0; always_ready > 0 && i <= select_max; i++) {
+      if(epoll_always_ready[i] && epoll_events[i] != 0) {
+        epoll_handle(i, epoll_events[i]);
+      }
+    }
+
+    etimer_request_poll();
+  }
+}
+#endif /* SELECT_EPOLL */
+/*---------------------------------------------------------------------------*/
 void
 platform_main_loop()
 {
 #if SELECT_STDIN
   select_set_callback(STDIN_FILENO, &stdin_fd);
 #endif /* SELECT_STDIN */
+#if SELECT_EPOLL
+  epoll_main_loop();
+#else /* SELECT_EPOLL */
   while(1) {
     fd_set fdr;
     fd_set fdw;
@@ -321,6 +542,7 @@ platform_main_loop()
 
     etimer_request_poll();
   }
+#endif /* SELECT_EPOLL */
 
   return;
 }
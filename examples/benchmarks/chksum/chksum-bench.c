@@ -0,0 +1,185 @@
+/*
+ * Copyright (c) 2018, RISE SICS.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * \file
+ *         Native benchmark of the Internet checksum backends of uIP: time
+ *         per packet and throughput of each backend for small, medium and
+ *         full-size IPv6 packets, and the cost of an incremental update
+ *         (RFC 1624) against a full recomputation.
+ */
+
+#include "contiki.h"
+#include "net/ipv6/uip-chksum.h"
+#include "lib/random.h"
+
+#include <stdio.h>
+/*---------------------------------------------------------------------------*/
+/* Number of bytes checksummed per measurement */
+#define BYTES      (64UL * 1024 * 1024)
+#define MAX_LEN    1280
+/* Number of updates per measurement */
+#define UPDATES    4000000UL
+/*---------------------------------------------------------------------------*/
+struct backend {
+  const char *name;
+  uint16_t (*chksum)(uint16_t sum, const uint8_t *data, uint16_t len);
+};
+
+static const struct backend backends[] = {
+  { "bytes", uip_chksum_bytes },
+  { "acc32", uip_chksum_acc32 },
+  { "acc64", uip_chksum_acc64 },
+#ifdef __SSE2__
+  { "sse2", uip_chksum_sse2 },
+#endif /* __SSE2__ */
+#ifdef __ARM_NEON
+  { "neon", uip_chksum_neon },
+#endif /* __ARM_NEON */
+};
+
+static const uint16_t lengths[] = { 64, 256, MAX_LEN };
+
+/* One byte more, to also measure unaligned packets */
+static uint8_t packet[MAX_LEN + 1];
+static int errors;
+
+PROCESS(bench_process, "Checksum benchmark");
+AUTOSTART_PROCESSES(&bench_process);
+/*---------------------------------------------------------------------------*/
+static unsigned long
+ns_per_op(clock_time_t elapsed, unsigned long ops)
+{
+  return (unsigned long)((unsigned long long)elapsed *
+                         (1000000000ULL / CLOCK_SECOND) / ops);
+}
+/*---------------------------------------------------------------------------*/
+static unsigned long
+mb_per_s(clock_time_t elapsed)
+{
+  if(elapsed == 0) {
+    elapsed = 1;
+  }
+  return (unsigned long)(BYTES * CLOCK_SECOND / elapsed / (1024 * 1024));
+}
+/*---------------------------------------------------------------------------*/
+static void
+run(const struct backend *b, uint16_t len, int offset)
+{
+  unsigned long packets = BYTES / len;
+  unsigned long i;
+  clock_time_t start;
+  clock_time_t elapsed;
+  uint16_t sum = 0;
+
+  start = clock_time();
+  for(i = 0; i < packets; i++) {
+    /* Chain the sums, so that no call can be optimized away */
+    sum = b->chksum(sum, packet + offset, len);
+  }
+  elapsed = clock_time() - start;
+
+  /* All backends must agree with the reference implementation */
+  sum = 0;
+  for(i = 0; i < 3; i++) {
+    sum = b->chksum(sum, packet + offset, len);
+  }
+  if(sum != uip_chksum_bytes(uip_chksum_bytes(uip_chksum_bytes(
+            0, packet + offset, len), packet + offset, len),
+            packet + offset, len)) {
+    errors++;
+  }
+
+  printf("%-5s %4u bytes%s: %6lu ns per packet, %6lu MB/s\n",
+         b->name, len, offset ? " (unaligned)" : "",
+         ns_per_op(elapsed, packets), mb_per_s(elapsed));
+}
+/*---------------------------------------------------------------------------*/
+static void
+run_update(void)
+{
+  unsigned long i;
+  clock_time_t start;
+  clock_time_t update_time;
+  clock_time_t full_time;
+  uint16_t chksum;
+  uint16_t word;
+
+  /* Rewrite the type and code of an ICMPv6 message of MAX_LEN bytes,
+     as for an echo reply */
+  chksum = 0;
+  start = clock_time();
+  for(i = 0; i < UPDATES; i++) {
+    word = i;
+    chksum = uip_chksum_update16(chksum, word, word ^ 0x8000);
+  }
+  update_time = clock_time() - start;
+
+  start = clock_time();
+  for(i = 0; i < UPDATES / 100; i++) {
+    packet[0] = i;
+    chksum += uip_chksum_add(0, packet, MAX_LEN);
+  }
+  full_time = clock_time() - start;
+
+  printf("Checksum of %u bytes: update %lu ns, recompute %lu ns (%04x)\n",
+         MAX_LEN, ns_per_op(update_time, UPDATES),
+         ns_per_op(full_time, UPDATES / 100), chksum);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(bench_process, ev, data)
+{
+  unsigned i, j;
+
+  PROCESS_BEGIN();
+
+  printf("Checksum benchmark\n");
+
+  random_init(0x1234);
+  for(i = 0; i < sizeof(packet); i++) {
+    packet[i] = random_rand();
+  }
+
+  for(j = 0; j < sizeof(lengths) / sizeof(lengths[0]); j++) {
+    for(i = 0; i < sizeof(backends) / sizeof(backends[0]); i++) {
+      run(&backends[i], lengths[j], 0);
+    }
+  }
+  for(i = 0; i < sizeof(backends) / sizeof(backends[0]); i++) {
+    run(&backends[i], MAX_LEN, 1);
+  }
+  run_update();
+
+  printf("Benchmark done: %s\n", errors == 0 ? "OK" : "FAIL");
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,326 @@
+/*
+ * Copyright (c) 2018, RISE SICS.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * \file
+ *         Native benchmark of streaming block-wise transfers over a link
+ *         with a fixed latency: a download with Block2 and an upload
+ *         with Block1 between the CoAP client and a server resource of
+ *         the same node. The messages are looped back by the network
+ *         driver, and every byte is checked.
+ */
+
+#include "contiki.h"
+#include "coap-engine.h"
+#include "coap-block1.h"
+#include "coap-blockwise.h"
+#include "net/ipv6/uip.h"
+#include "net/netstack.h"
+
+#include <stdio.h>
+#include <string.h>
+/*---------------------------------------------------------------------------*/
+#define BODY_LEN        16384UL
+#define BLOCK_SIZE      256
+/* One-way latency of the link in ms, e.g. over a few 6LoWPAN hops */
+#define LATENCY         20
+#define QUEUE_LEN       16
+/*---------------------------------------------------------------------------*/
+static void res_get_handler(coap_message_t *request, coap_message_t *response,
+                            uint8_t *buffer, uint16_t preferred_size,
+                            int32_t *offset);
+static void res_put_handler(coap_message_t *request, coap_message_t *response,
+                            uint8_t *buffer, uint16_t preferred_size,
+                            int32_t *offset);
+
+RESOURCE(res_firmware, "title=\"Firmware\"",
+         res_get_handler, NULL, res_put_handler, NULL);
+
+/* Messages on the link */
+static struct {
+  clock_time_t due;
+  uint16_t len;
+  uint8_t data[COAP_MAX_PACKET_SIZE];
+} queue[QUEUE_LEN];
+static int queue_head;
+static int queue_count;
+
+static uint8_t received[BODY_LEN / BLOCK_SIZE / 8];
+static uint32_t uploaded;
+static coap_blockwise_status_t result;
+static int done;
+static int errors;
+
+PROCESS(bench_process, "CoAP block-wise benchmark");
+PROCESS(link_process, "Link");
+AUTOSTART_PROCESSES(&link_process, &bench_process);
+/*---------------------------------------------------------------------------*/
+static uint8_t
+body(uint32_t offset)
+{
+  return (offset * 31 + (offset >> 8)) & 0xff;
+}
+/*---------------------------------------------------------------------------*/
+static int
+check_body(uint32_t offset, const uint8_t *data, uint16_t len)
+{
+  uint16_t i;
+
+  for(i = 0; i < len; i++) {
+    if(data[i] != body(offset + i)) {
+      return 0;
+    }
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/* Blockwise-aware resource, without Size2 */
+static void
+res_get_handler(coap_message_t *request, coap_message_t *response,
+                uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
+{
+  uint16_t len;
+  uint16_t i;
+
+  if(*offset >= BODY_LEN) {
+    coap_set_status_code(response, BAD_OPTION_4_02);
+    coap_set_payload(response, "BlockOutOfScope", 15);
+    return;
+  }
+  len = MIN(preferred_size, BODY_LEN - *offset);
+  for(i = 0; i < len; i++) {
+    buffer[i] = body(*offset + i);
+  }
+  coap_set_payload(response, buffer, len);
+  *offset += len;
+  if(*offset >= BODY_LEN) {
+    *offset = -1;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Checks every Block1 block at its offset, without reassembling them */
+static void
+res_put_handler(coap_message_t *request, coap_message_t *response,
+                uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
+{
+  const uint8_t *payload;
+  int len = coap_get_payload(request, &payload);
+  int more;
+
+  more = coap_block1_handler(request, response, NULL, NULL, BODY_LEN);
+  if(more < 0) {
+    return;
+  }
+  if(request->block1_offset != uploaded
+     || !check_body(request->block1_offset, payload, len)) {
+    errors++;
+  }
+  uploaded += len;
+  if(more == 0) {
+    coap_set_status_code(response, CHANGED_2_04);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+init(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+static void
+input(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t
+output(const linkaddr_t *localdest)
+{
+  int i;
+
+  if(uip_len == 0) {
+    return 0;
+  }
+  if(queue_count == QUEUE_LEN) {
+    errors++;
+    return 0;
+  }
+  i = (queue_head + queue_count) % QUEUE_LEN;
+  queue[i].due = clock_time() + LATENCY;
+  queue[i].len = uip_len - UIP_IPUDPH_LEN;
+  memcpy(queue[i].data, &uip_buf[UIP_LLH_LEN + UIP_IPUDPH_LEN], queue[i].len);
+  queue_count++;
+  process_poll(&link_process);
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+const struct network_driver bench_net_driver = {
+  "bench",
+  init,
+  input,
+  output
+};
+/*---------------------------------------------------------------------------*/
+/* Deliver the messages on the link to the engine when they are due */
+PROCESS_THREAD(link_process, ev, data)
+{
+  static struct etimer et;
+  static coap_endpoint_t src;
+  static uint8_t buf[COAP_MAX_PACKET_SIZE];
+  uint16_t len;
+
+  PROCESS_BEGIN();
+
+  memset(&src, 0, sizeof(src));
+  uip_create_linklocal_allnodes_mcast(&src.ipaddr);
+  src.port = UIP_HTONS(COAP_DEFAULT_PORT);
+
+  while(1) {
+    while(queue_count > 0) {
+      if(queue[queue_head].due > clock_time()) {
+        etimer_set(&et, queue[queue_head].due - clock_time());
+        break;
+      }
+      len = queue[queue_head].len;
+      memcpy(buf, queue[queue_head].data, len);
+      queue_head = (queue_head + 1) % QUEUE_LEN;
+      queue_count--;
+      coap_receive(&src, buf, len);
+    }
+    PROCESS_WAIT_EVENT();
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+static int
+block_callback(coap_blockwise_transfer_t *transfer, uint32_t offset,
+               const uint8_t *data, uint16_t len)
+{
+  uint32_t num = offset / BLOCK_SIZE;
+
+  if(offset % BLOCK_SIZE != 0 || num >= BODY_LEN / BLOCK_SIZE
+     || (received[num / 8] & (1 << (num % 8)))
+     || len != MIN(BLOCK_SIZE, BODY_LEN - offset)
+     || !check_body(offset, data, len)) {
+    errors++;
+    return -1;
+  }
+  received[num / 8] |= 1 << (num % 8);
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+read_callback(coap_blockwise_transfer_t *transfer, uint32_t offset,
+              uint8_t *data, uint16_t len)
+{
+  uint16_t i;
+
+  for(i = 0; i < len; i++) {
+    data[i] = body(offset + i);
+  }
+  return len;
+}
+/*---------------------------------------------------------------------------*/
+static void
+done_callback(coap_blockwise_transfer_t *transfer,
+              coap_blockwise_status_t status)
+{
+  result = status;
+  done = 1;
+  process_poll(&bench_process);
+}
+/*---------------------------------------------------------------------------*/
+static void
+print_stats(const char *name, const coap_blockwise_stats_t *stats)
+{
+  printf("%s: %lu bytes, %lu blocks, %lu requests, %lu ms, %lu bytes/s\n",
+         name, (unsigned long)stats->bytes, (unsigned long)stats->blocks,
+         (unsigned long)stats->requests,
+         (unsigned long)(stats->end - stats->start),
+         (unsigned long)coap_blockwise_throughput(stats));
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(bench_process, ev, data)
+{
+  static coap_blockwise_transfer_t transfer;
+  static coap_message_t request[1];
+  static coap_endpoint_t server;
+  unsigned i;
+
+  PROCESS_BEGIN();
+
+  printf("CoAP block-wise benchmark: %lu bytes, blocks of %u, "
+         "window %u, latency %u ms\n", BODY_LEN, BLOCK_SIZE,
+         COAP_BLOCKWISE_WINDOW, LATENCY);
+
+  coap_engine_init();
+  coap_activate_resource(&res_firmware, "fw");
+  memset(&server, 0, sizeof(server));
+  uip_create_linklocal_allnodes_mcast(&server.ipaddr);
+  server.port = UIP_HTONS(COAP_DEFAULT_PORT);
+
+  coap_init_message(request, COAP_TYPE_CON, COAP_GET, 0);
+  coap_set_header_uri_path(request, "fw");
+  done = 0;
+  if(!coap_blockwise_get(&transfer, &server, request, BLOCK_SIZE,
+                         block_callback, done_callback)) {
+    errors++;
+  } else {
+    PROCESS_WAIT_EVENT_UNTIL(done);
+  }
+  print_stats("Download", &transfer.stats);
+  if(result != COAP_BLOCKWISE_DONE || transfer.stats.bytes != BODY_LEN) {
+    errors++;
+  }
+  for(i = 0; i < sizeof(received); i++) {
+    if(received[i] != 0xff) {
+      errors++;
+    }
+  }
+
+  coap_init_message(request, COAP_TYPE_CON, COAP_PUT, 0);
+  coap_set_header_uri_path(request, "fw");
+  done = 0;
+  if(!coap_blockwise_put(&transfer, &server, request, BODY_LEN, BLOCK_SIZE,
+                         read_callback, done_callback)) {
+    errors++;
+  } else {
+    PROCESS_WAIT_EVENT_UNTIL(done);
+  }
+  print_stats("Upload", &transfer.stats);
+  if(result != COAP_BLOCKWISE_DONE || uploaded != BODY_LEN) {
+    errors++;
+  }
+
+  printf("Benchmark done: %s\n", errors == 0 ? "OK" : "FAIL");
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
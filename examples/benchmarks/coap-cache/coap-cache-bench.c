@@ -0,0 +1,283 @@
+/*
+ * Copyright (c) 2018, RISE SICS.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * \file
+ *         Native benchmark of GET requests to a CoAP resource that is
+ *         polled by many clients and changes rarely: time per request
+ *         through the engine, handler calls, and a check of every
+ *         response that reaches the network driver.
+ */
+
+#include "contiki.h"
+#include "coap-engine.h"
+#include "net/ipv6/uip.h"
+#include "net/netstack.h"
+
+#include <stdio.h>
+#include <string.h>
+/*---------------------------------------------------------------------------*/
+#define REQUESTS        100000UL
+/* Number of requests between two changes of the resource */
+#define CHANGE_INTERVAL 1000
+#define VARIANTS        4
+/*---------------------------------------------------------------------------*/
+static void res_get_handler(coap_message_t *request, coap_message_t *response,
+                            uint8_t *buffer, uint16_t preferred_size,
+                            int32_t *offset);
+
+EVENT_RESOURCE(res_environment, "title=\"Environment\";obs",
+               res_get_handler, NULL, NULL, NULL, NULL);
+
+/* Uri-Query and Accept of the requests of the clients */
+static const char *queries[VARIANTS] = { NULL, "unit=K", NULL, "unit=K" };
+static const int accepts[VARIANTS] = { -1, -1, TEXT_PLAIN, TEXT_PLAIN };
+
+static uint8_t requests[VARIANTS][COAP_MAX_HEADER_SIZE];
+static size_t request_lens[VARIANTS];
+static uint8_t buffer[COAP_MAX_HEADER_SIZE];
+
+static unsigned long state;
+static char expected[VARIANTS][64];
+static int expected_lens[VARIANTS];
+static int variant;
+
+static unsigned long handler_calls;
+static unsigned long packets;
+static int errors;
+static coap_message_t response[1];
+static int response_code;
+
+PROCESS(bench_process, "CoAP response cache benchmark");
+AUTOSTART_PROCESSES(&bench_process);
+/*---------------------------------------------------------------------------*/
+/* Representation of the state in a unit and a content format */
+static int
+represent(char *buf, int kelvin, int text)
+{
+  unsigned long t = 2000 + state % 500;
+
+  if(kelvin) {
+    t += 27315;
+  }
+  if(text) {
+    return snprintf(buf, 64, "%lu.%02lu %s, %lu.%lu %%RH", t / 100, t % 100,
+                    kelvin ? "K" : "Cel", 40 + state % 20, state % 10);
+  }
+  return snprintf(buf, 64, "{\"t\":%lu.%02lu,\"u\":\"%s\",\"h\":%lu.%lu}",
+                  t / 100, t % 100, kelvin ? "K" : "Cel",
+                  40 + state % 20, state % 10);
+}
+/*---------------------------------------------------------------------------*/
+static void
+res_get_handler(coap_message_t *request, coap_message_t *response,
+                uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
+{
+  const char *unit = NULL;
+  unsigned int accept = APPLICATION_JSON;
+  int len;
+
+  handler_calls++;
+  coap_get_query_variable(request, "unit", &unit);
+  coap_get_header_accept(request, &accept);
+  len = represent((char *)buffer, unit != NULL && *unit == 'K',
+                  accept == TEXT_PLAIN);
+  coap_set_header_content_format(response, accept == TEXT_PLAIN ?
+                                 TEXT_PLAIN : APPLICATION_JSON);
+  coap_set_header_max_age(response, 60);
+  coap_set_payload(response, buffer, len);
+}
+/*---------------------------------------------------------------------------*/
+static void
+init(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+static void
+input(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+/* Check a response: current representation of the variant requested */
+static uint8_t
+output(const linkaddr_t *localdest)
+{
+  uint8_t *payload = &uip_buf[UIP_LLH_LEN + UIP_IPUDPH_LEN];
+  uint16_t len = uip_len - UIP_IPUDPH_LEN;
+
+  if(uip_len == 0) {
+    return 0;
+  }
+  packets++;
+  if(coap_parse_message(response, payload, len) != NO_ERROR) {
+    errors++;
+    return 0;
+  }
+  response_code = response->code;
+  if(response->code == CONTENT_2_05
+     && (response->payload_len != expected_lens[variant]
+         || memcmp(response->payload, expected[variant],
+                   expected_lens[variant]) != 0
+         || response->max_age == 0 || response->max_age > 60)) {
+    errors++;
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+const struct network_driver bench_net_driver = {
+  "bench",
+  init,
+  input,
+  output
+};
+/*---------------------------------------------------------------------------*/
+static unsigned long
+ns_per_op(clock_time_t elapsed, unsigned long ops)
+{
+  return (unsigned long)((unsigned long long)elapsed *
+                         (1000000000ULL / CLOCK_SECOND) / ops);
+}
+/*---------------------------------------------------------------------------*/
+static void
+change_state(void)
+{
+  int i;
+
+  state++;
+  for(i = 0; i < VARIANTS; i++) {
+    expected_lens[i] = represent(expected[i], i & 1, i & 2);
+  }
+  coap_notify_observers(&res_environment);
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+make_request(uint8_t *buf, int i, uint16_t mid, const uint8_t *etag,
+             size_t etag_len)
+{
+  coap_message_t request[1];
+
+  coap_init_message(request, COAP_TYPE_NON, COAP_GET, mid);
+  coap_set_header_uri_path(request, "sensors/environment");
+  if(queries[i] != NULL) {
+    coap_set_header_uri_query(request, queries[i]);
+  }
+  if(accepts[i] >= 0) {
+    coap_set_header_accept(request, accepts[i]);
+  }
+  if(etag_len > 0) {
+    coap_set_header_etag(request, etag, etag_len);
+  }
+  return coap_serialize_message(request, buf);
+}
+/*---------------------------------------------------------------------------*/
+static void
+receive(const coap_endpoint_t *src, const uint8_t *request, size_t len)
+{
+  memcpy(buffer, request, len);
+  coap_receive(src, buffer, len);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(bench_process, ev, data)
+{
+  static coap_endpoint_t src;
+  static unsigned long i;
+  clock_time_t start;
+  clock_time_t elapsed;
+
+  PROCESS_BEGIN();
+
+  printf("CoAP response cache benchmark: %lu requests, %u variants, "
+         "change every %u requests\n", REQUESTS, VARIANTS, CHANGE_INTERVAL);
+
+  coap_engine_init();
+  coap_activate_resource(&res_environment, "sensors/environment");
+  for(i = 0; i < VARIANTS; i++) {
+    request_lens[i] = make_request(requests[i], i, i, NULL, 0);
+  }
+  memset(&src, 0, sizeof(src));
+  uip_create_linklocal_allnodes_mcast(&src.ipaddr);
+  src.port = UIP_HTONS(COAP_DEFAULT_PORT + 1);
+  change_state();
+
+  start = clock_time();
+  for(i = 0; i < REQUESTS; i++) {
+    if(i % CHANGE_INTERVAL == 0) {
+      change_state();
+    }
+    variant = i % VARIANTS;
+    receive(&src, requests[variant], request_lens[variant]);
+  }
+  elapsed = clock_time() - start;
+
+  if(packets != REQUESTS) {
+    errors++;
+  }
+  printf("Request: %lu ns, handler calls: %lu\n",
+         ns_per_op(elapsed, REQUESTS), handler_calls);
+
+#if COAP_RESPONSE_CACHE_SIZE
+  {
+    const coap_cache_stats_t *stats = coap_cache_get_stats();
+    uint8_t validation[COAP_MAX_HEADER_SIZE];
+    uint8_t etag[COAP_ETAG_LEN];
+    size_t etag_len;
+
+    /* One handler call per variant and state */
+    if(handler_calls != VARIANTS * (REQUESTS / CHANGE_INTERVAL)) {
+      errors++;
+    }
+
+    /* A client that has the current representation gets 2.03 Valid */
+    variant = 0;
+    receive(&src, requests[0], request_lens[0]);
+    etag_len = response->etag_len;
+    memcpy(etag, response->etag, etag_len);
+    if(etag_len == 0) {
+      errors++;
+    }
+    receive(&src, validation,
+            make_request(validation, 0, 100, etag, etag_len));
+    if(response_code != VALID_2_03 || response->payload_len != 0) {
+      errors++;
+    }
+
+    printf("Cache: %lu hits, %lu validations, %lu misses, "
+           "%lu invalidations\n", (unsigned long)stats->hits,
+           (unsigned long)stats->validations, (unsigned long)stats->misses,
+           (unsigned long)stats->invalidations);
+  }
+#endif /* COAP_RESPONSE_CACHE_SIZE */
+
+  printf("Benchmark done: %s\n", errors == 0 ? "OK" : "FAIL");
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,243 @@
+/*
+ * Copyright (c) 2018, RISE SICS.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * \file
+ *         Native benchmark of the CoAP request path of the server: parsing
+ *         a corpus of requests and finding the resource that serves them,
+ *         as the engine does for every request it receives.
+ */
+
+#include "contiki.h"
+#include "coap-engine.h"
+
+#include <stdio.h>
+#include <string.h>
+/*---------------------------------------------------------------------------*/
+/* Number of requests per measurement */
+#define REQUESTS   2000000UL
+/*---------------------------------------------------------------------------*/
+static void
+res_get_handler(coap_message_t *request, coap_message_t *response,
+                uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
+{
+}
+/*---------------------------------------------------------------------------*/
+/* The resources of the example and plugtest servers, and of a LwM2M
+   server, in the order in which they are activated */
+static struct {
+  coap_resource_t resource;
+  const char *path;
+} resources[] = {
+  { { NULL, NULL, NO_FLAGS, "", res_get_handler }, ".well-known/core" },
+  { { NULL, NULL, NO_FLAGS, "", res_get_handler }, "test" },
+  { { NULL, NULL, NO_FLAGS, "", res_get_handler }, "validate" },
+  { { NULL, NULL, NO_FLAGS, "", res_get_handler }, "create1" },
+  { { NULL, NULL, NO_FLAGS, "", res_get_handler }, "create2" },
+  { { NULL, NULL, NO_FLAGS, "", res_get_handler }, "create3" },
+  { { NULL, NULL, NO_FLAGS, "", res_get_handler }, "seg1/seg2/seg3" },
+  { { NULL, NULL, NO_FLAGS, "", res_get_handler }, "query" },
+  { { NULL, NULL, NO_FLAGS, "", res_get_handler }, "location-query" },
+  { { NULL, NULL, NO_FLAGS, "", res_get_handler }, "multi-format" },
+  { { NULL, NULL, NO_FLAGS, "", res_get_handler }, "link1" },
+  { { NULL, NULL, NO_FLAGS, "", res_get_handler }, "link2" },
+  { { NULL, NULL, NO_FLAGS, "", res_get_handler }, "link3" },
+  { { NULL, NULL, HAS_SUB_RESOURCES, "", res_get_handler }, "path" },
+  { { NULL, NULL, NO_FLAGS, "", res_get_handler }, "separate" },
+  { { NULL, NULL, NO_FLAGS, "", res_get_handler }, "large" },
+  { { NULL, NULL, NO_FLAGS, "", res_get_handler }, "large-update" },
+  { { NULL, NULL, NO_FLAGS, "", res_get_handler }, "large-create" },
+  { { NULL, NULL, NO_FLAGS, "", res_get_handler }, "obs" },
+  { { NULL, NULL, NO_FLAGS, "", res_get_handler }, "mirror" },
+  { { NULL, NULL, NO_FLAGS, "", res_get_handler }, "test/hello" },
+  { { NULL, NULL, NO_FLAGS, "", res_get_handler }, "debug/mirror" },
+  { { NULL, NULL, NO_FLAGS, "", res_get_handler }, "test/chunks" },
+  { { NULL, NULL, NO_FLAGS, "", res_get_handler }, "test/separate" },
+  { { NULL, NULL, NO_FLAGS, "", res_get_handler }, "test/push" },
+  { { NULL, NULL, NO_FLAGS, "", res_get_handler }, "sensors/button" },
+  { { NULL, NULL, HAS_SUB_RESOURCES, "", res_get_handler }, "test/sub" },
+  { { NULL, NULL, NO_FLAGS, "", res_get_handler }, "test/b1sepb2" },
+  { { NULL, NULL, NO_FLAGS, "", res_get_handler }, "actuators/toggle" },
+  { { NULL, NULL, NO_FLAGS, "", res_get_handler }, "sensors/light" },
+  { { NULL, NULL, NO_FLAGS, "", res_get_handler }, "sensors/battery" },
+  { { NULL, NULL, NO_FLAGS, "", res_get_handler }, "sensors/temperature" },
+  { { NULL, NULL, NO_FLAGS, "", res_get_handler }, "sensors/radio" },
+  { { NULL, NULL, NO_FLAGS, "", res_get_handler }, "sensors/sht11" },
+  { { NULL, NULL, NO_FLAGS, "", res_get_handler }, "bs" },
+  { { NULL, NULL, HAS_SUB_RESOURCES, "", res_get_handler }, "rd" },
+};
+
+/* A request of the corpus and the resource that must serve it */
+struct request {
+  coap_message_type_t type;
+  coap_method_t method;
+  const char *path;
+  const char *query;
+  int observe;
+  int block2;
+  const char *expected;
+
+  uint8_t data[COAP_MAX_HEADER_SIZE];
+  size_t len;
+};
+
+static struct request corpus[] = {
+  { COAP_TYPE_CON, COAP_GET, ".well-known/core", NULL, -1, -1,
+    ".well-known/core" },
+  { COAP_TYPE_CON, COAP_GET, ".well-known/core", "rt=light-lux", -1, -1,
+    ".well-known/core" },
+  { COAP_TYPE_CON, COAP_GET, "sensors/temperature", NULL, 0, -1,
+    "sensors/temperature" },
+  { COAP_TYPE_NON, COAP_GET, "sensors/light", NULL, -1, -1,
+    "sensors/light" },
+  { COAP_TYPE_CON, COAP_GET, "test/hello", "len=10", -1, -1,
+    "test/hello" },
+  { COAP_TYPE_CON, COAP_GET, "test/chunks", NULL, -1, 2,
+    "test/chunks" },
+  { COAP_TYPE_CON, COAP_POST, "actuators/toggle", NULL, -1, -1,
+    "actuators/toggle" },
+  { COAP_TYPE_CON, COAP_GET, "test/sub/a/b", NULL, -1, -1,
+    "test/sub" },
+  { COAP_TYPE_CON, COAP_GET, "seg1/seg2/seg3", NULL, -1, -1,
+    "seg1/seg2/seg3" },
+  { COAP_TYPE_CON, COAP_GET, "path/sub1", NULL, -1, -1, "path" },
+  { COAP_TYPE_CON, COAP_GET, "query", "first=1&second=2&third=3", -1, -1,
+    "query" },
+  { COAP_TYPE_CON, COAP_GET, "obs", NULL, 0, -1, "obs" },
+  { COAP_TYPE_CON, COAP_GET, "large", NULL, -1, 1, "large" },
+  { COAP_TYPE_CON, COAP_POST, "rd", "ep=node-0123456789abcdef&lt=300&lwm2m=1.0&b=U",
+    -1, -1, "rd" },
+  { COAP_TYPE_CON, COAP_POST, "rd/4521", "lt=300", -1, -1, "rd" },
+  { COAP_TYPE_CON, COAP_POST, "bs", "ep=node-0123456789abcdef", -1, -1,
+    "bs" },
+  { COAP_TYPE_CON, COAP_GET, "sensors/unknown", NULL, -1, -1, NULL },
+  { COAP_TYPE_CON, COAP_GET, "3303/0/5700", NULL, 0, -1, NULL },
+};
+
+#define NUM_REQUESTS (sizeof(corpus) / sizeof(corpus[0]))
+
+static uint8_t buffer[COAP_MAX_HEADER_SIZE];
+static coap_message_t message[1];
+static int errors;
+
+PROCESS(bench_process, "CoAP dispatch benchmark");
+AUTOSTART_PROCESSES(&bench_process);
+/*---------------------------------------------------------------------------*/
+static unsigned long
+ns_per_op(clock_time_t elapsed, unsigned long ops)
+{
+  return (unsigned long)((unsigned long long)elapsed *
+                         (1000000000ULL / CLOCK_SECOND) / ops);
+}
+/*---------------------------------------------------------------------------*/
+static void
+serialize(struct request *r, uint16_t mid)
+{
+  static const uint8_t token[] = { 0x5a, 0x17, 0x03, 0xc1 };
+
+  coap_init_message(message, r->type, r->method, mid);
+  coap_set_token(message, token, sizeof(token));
+  coap_set_header_uri_path(message, r->path);
+  if(r->query != NULL) {
+    coap_set_header_uri_query(message, r->query);
+  }
+  if(r->observe >= 0) {
+    coap_set_header_observe(message, r->observe);
+  }
+  if(r->block2 >= 0) {
+    coap_set_header_block2(message, r->block2, 0, 64);
+  }
+  coap_set_header_accept(message, APPLICATION_LINK_FORMAT);
+  r->len = coap_serialize_message(message, r->data);
+}
+/*---------------------------------------------------------------------------*/
+/* Parse a request in place and find its resource, as the engine does */
+static coap_resource_t *
+dispatch(const struct request *r)
+{
+  const char *value;
+
+  memcpy(buffer, r->data, r->len);
+  if(coap_parse_message(message, buffer, r->len) != NO_ERROR) {
+    return NULL;
+  }
+  /* the handlers of the corpus read the queries */
+  coap_get_query_variable(message, "ep", &value);
+  return coap_find_resource(message);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(bench_process, ev, data)
+{
+  static coap_resource_t *resource;
+  unsigned long i;
+  clock_time_t start;
+  clock_time_t elapsed;
+  unsigned long matched = 0;
+
+  PROCESS_BEGIN();
+
+  printf("CoAP dispatch benchmark: %u resources, %u requests, "
+         "%u indexed options, %u tree nodes\n",
+         (unsigned)(sizeof(resources) / sizeof(resources[0])),
+         (unsigned)NUM_REQUESTS, COAP_MAX_INDEXED_OPTIONS,
+         COAP_DISPATCH_TREE_NODES);
+
+  for(i = 0; i < sizeof(resources) / sizeof(resources[0]); i++) {
+    coap_activate_resource(&resources[i].resource, resources[i].path);
+  }
+
+  for(i = 0; i < NUM_REQUESTS; i++) {
+    serialize(&corpus[i], i);
+    resource = dispatch(&corpus[i]);
+    if(corpus[i].expected == NULL ? resource != NULL
+       : resource == NULL || strcmp(resource->url, corpus[i].expected)) {
+      printf("/%s dispatched to /%s\n", corpus[i].path,
+             resource ? resource->url : "(none)");
+      errors++;
+    }
+  }
+
+  start = clock_time();
+  for(i = 0; i < REQUESTS; i++) {
+    if(dispatch(&corpus[i % NUM_REQUESTS]) != NULL) {
+      matched++;
+    }
+  }
+  elapsed = clock_time() - start;
+
+  printf("Parse and dispatch: %lu ns per request (%lu matched)\n",
+         ns_per_op(elapsed, REQUESTS), matched);
+
+  printf("Benchmark done: %s\n", errors == 0 ? "OK" : "FAIL");
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,221 @@
+/*
+ * Copyright (c) 2018, RISE SICS.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * \file
+ *         Native benchmark of the notifications of a CoAP resource with
+ *         many observers: time per notification, handler calls, and a
+ *         check of every message that reaches the network driver.
+ */
+
+#include "contiki.h"
+#include "coap-engine.h"
+#include "coap-observe.h"
+#include "net/ipv6/uip.h"
+#include "net/netstack.h"
+
+#include <stdio.h>
+#include <string.h>
+/*---------------------------------------------------------------------------*/
+#define OBSERVERS       COAP_MAX_OBSERVERS
+/* Number of state changes of the resource per measurement */
+#define NOTIFICATIONS   20000UL
+#define FIRST_PORT      20000
+
+#define UIP_IP_BUF      ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
+#define UIP_UDP_BUF     ((struct uip_udp_hdr *)&uip_buf[UIP_LLH_LEN + UIP_IPH_LEN])
+/*---------------------------------------------------------------------------*/
+static void res_get_handler(coap_message_t *request, coap_message_t *response,
+                            uint8_t *buffer, uint16_t preferred_size,
+                            int32_t *offset);
+
+EVENT_RESOURCE(res_temperature, "title=\"Temperature\";obs",
+               res_get_handler, NULL, NULL, NULL, NULL);
+
+static unsigned long state;
+static char representation[64];
+static int representation_len;
+
+static unsigned long handler_calls;
+static unsigned long packets;
+static int errors;
+
+PROCESS(bench_process, "CoAP observe benchmark");
+AUTOSTART_PROCESSES(&bench_process);
+/*---------------------------------------------------------------------------*/
+static void
+res_get_handler(coap_message_t *request, coap_message_t *response,
+                uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
+{
+  handler_calls++;
+  memcpy(buffer, representation, representation_len);
+  coap_set_header_content_format(response, APPLICATION_JSON);
+  coap_set_header_max_age(response, 30);
+  coap_set_payload(response, buffer, representation_len);
+}
+/*---------------------------------------------------------------------------*/
+static void
+make_token(uint8_t *token, unsigned observer)
+{
+  token[0] = 0xc0;
+  token[1] = observer;
+  token[2] = observer * 7;
+  token[3] = 0x5e;
+}
+/*---------------------------------------------------------------------------*/
+/* Check a notification: token of its observer, current representation */
+static void
+check_notification(void)
+{
+  static coap_message_t message[1];
+  uint8_t token[COAP_TOKEN_LEN];
+  unsigned observer;
+  uint8_t *payload;
+  uint16_t len;
+
+  payload = &uip_buf[UIP_LLH_LEN + UIP_IPUDPH_LEN];
+  len = uip_len - UIP_IPUDPH_LEN;
+  observer = UIP_HTONS(UIP_UDP_BUF->destport) - FIRST_PORT;
+  make_token(token, observer);
+
+  if(coap_parse_message(message, payload, len) != NO_ERROR
+     || message->type != COAP_TYPE_NON
+     || message->code != CONTENT_2_05
+     || message->token_len != 4
+     || memcmp(message->token, token, 4) != 0
+     || !coap_is_option(message, COAP_OPTION_OBSERVE)
+     || message->content_format != APPLICATION_JSON
+     || message->max_age != 30
+     || message->payload_len != representation_len
+     || memcmp(message->payload, representation, representation_len) != 0) {
+    errors++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+init(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+static void
+input(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t
+output(const linkaddr_t *localdest)
+{
+  if(uip_len > 0) {
+    packets++;
+    check_notification();
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+const struct network_driver bench_net_driver = {
+  "bench",
+  init,
+  input,
+  output
+};
+/*---------------------------------------------------------------------------*/
+static unsigned long
+ns_per_op(clock_time_t elapsed, unsigned long ops)
+{
+  return (unsigned long)((unsigned long long)elapsed *
+                         (1000000000ULL / CLOCK_SECOND) / ops);
+}
+/*---------------------------------------------------------------------------*/
+/* Register an observer from its own port of the all-nodes address */
+static void
+add_observer(unsigned observer)
+{
+  coap_message_t request[1];
+  coap_message_t response[1];
+  coap_endpoint_t endpoint;
+  uint8_t token[COAP_TOKEN_LEN];
+
+  memset(&endpoint, 0, sizeof(endpoint));
+  uip_create_linklocal_allnodes_mcast(&endpoint.ipaddr);
+  endpoint.port = UIP_HTONS(FIRST_PORT + observer);
+  make_token(token, observer);
+
+  coap_init_message(request, COAP_TYPE_CON, COAP_GET, observer);
+  coap_set_header_uri_path(request, res_temperature.url);
+  coap_set_header_observe(request, 0);
+  coap_set_token(request, token, 4);
+  coap_set_src_endpoint(request, &endpoint);
+  coap_init_message(response, COAP_TYPE_ACK, CONTENT_2_05, observer);
+  coap_observe_handler(&res_temperature, request, response);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(bench_process, ev, data)
+{
+  static unsigned long i;
+  clock_time_t start;
+  clock_time_t elapsed;
+
+  PROCESS_BEGIN();
+
+  printf("CoAP observe benchmark: %u observers, %lu notifications\n",
+         OBSERVERS, NOTIFICATIONS);
+
+  coap_engine_init();
+  coap_activate_resource(&res_temperature, "sensors/temperature");
+  for(i = 0; i < OBSERVERS; i++) {
+    add_observer(i);
+  }
+
+  start = clock_time();
+  for(i = 0; i < NOTIFICATIONS; i++) {
+    state++;
+    representation_len = snprintf(representation, sizeof(representation),
+                                  "{\"bn\":\"t\",\"v\":%lu.%lu,\"u\":\"Cel\"}",
+                                  20 + state % 10, state % 10);
+    coap_notify_observers(&res_temperature);
+  }
+  elapsed = clock_time() - start;
+
+  if(packets != NOTIFICATIONS * OBSERVERS) {
+    errors++;
+  }
+
+  printf("Notification: %lu ns, %lu ns per observer\n",
+         ns_per_op(elapsed, NOTIFICATIONS),
+         ns_per_op(elapsed, NOTIFICATIONS * OBSERVERS));
+  printf("Handler calls per notification: %lu, packets: %lu\n",
+         handler_calls / NOTIFICATIONS, packets);
+
+  printf("Benchmark done: %s\n", errors == 0 ? "OK" : "FAIL");
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
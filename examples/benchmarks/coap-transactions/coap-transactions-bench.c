@@ -0,0 +1,229 @@
+/*
+ * Copyright (c) 2018, RISE SICS.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * \file
+ *         Native benchmark of the CoAP transaction table with many open
+ *         confirmable transactions: time to open and send one, to find
+ *         it by MID, and to find and clear it when its acknowledgement
+ *         arrives, in random order.
+ */
+
+#include "contiki.h"
+#include "coap-engine.h"
+#include "coap-transactions.h"
+#include "net/ipv6/uip.h"
+#include "net/netstack.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+/*---------------------------------------------------------------------------*/
+#define TRANSACTIONS    COAP_MAX_OPEN_TRANSACTIONS
+#define ROUNDS          2000UL
+#define FIRST_PORT      20000
+/*---------------------------------------------------------------------------*/
+static uint16_t mids[TRANSACTIONS];
+static unsigned long packets;
+static int errors;
+
+PROCESS(bench_process, "CoAP transactions benchmark");
+AUTOSTART_PROCESSES(&bench_process);
+/*---------------------------------------------------------------------------*/
+static void
+init(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+static void
+input(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t
+output(const linkaddr_t *localdest)
+{
+  if(uip_len > 0) {
+    packets++;
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+const struct network_driver bench_net_driver = {
+  "bench",
+  init,
+  input,
+  output
+};
+/*---------------------------------------------------------------------------*/
+static unsigned long
+ns_per_op(clock_time_t elapsed, unsigned long ops)
+{
+  return (unsigned long)((unsigned long long)elapsed *
+                         (1000000000ULL / CLOCK_SECOND) / ops);
+}
+/*---------------------------------------------------------------------------*/
+/* Open and send a confirmable request to a port of the all-nodes address */
+static coap_transaction_t *
+send_request(uint16_t mid, uint16_t port)
+{
+  coap_message_t request[1];
+  coap_endpoint_t endpoint;
+  coap_transaction_t *t;
+
+  memset(&endpoint, 0, sizeof(endpoint));
+  uip_create_linklocal_allnodes_mcast(&endpoint.ipaddr);
+  endpoint.port = UIP_HTONS(port);
+
+  t = coap_new_transaction(mid, &endpoint);
+  if(t == NULL) {
+    return NULL;
+  }
+  coap_init_message(request, COAP_TYPE_CON, COAP_GET, mid);
+  coap_set_header_uri_path(request, "sensors/temperature");
+  t->message_len = coap_serialize_message(request, t->message);
+  coap_send_transaction(t);
+  return t;
+}
+/*---------------------------------------------------------------------------*/
+/* Find the open transactions in the order of mids */
+static void
+find(void)
+{
+  coap_transaction_t *t;
+  unsigned i;
+
+  for(i = 0; i < TRANSACTIONS; i++) {
+    t = coap_get_transaction_by_mid(mids[i]);
+    if(t == NULL || t->mid != mids[i]) {
+      errors++;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Clear the open transactions in the order of mids */
+static void
+acknowledge(void)
+{
+  unsigned i;
+
+  for(i = 0; i < TRANSACTIONS; i++) {
+    coap_clear_transaction(coap_get_transaction_by_mid(mids[i]));
+  }
+  if(coap_get_transaction_by_mid(mids[0]) != NULL) {
+    errors++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+shuffle(void)
+{
+  unsigned i, j;
+  uint16_t mid;
+
+  for(i = TRANSACTIONS - 1; i > 0; i--) {
+    j = rand() % (i + 1);
+    mid = mids[i];
+    mids[i] = mids[j];
+    mids[j] = mid;
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(bench_process, ev, data)
+{
+  static unsigned long round;
+  static struct etimer et;
+  clock_time_t start;
+  clock_time_t send_time = 0;
+  clock_time_t find_time = 0;
+  clock_time_t ack_time = 0;
+  unsigned i;
+
+  PROCESS_BEGIN();
+
+  printf("CoAP transactions benchmark: %u transactions, %lu rounds\n",
+         TRANSACTIONS, ROUNDS);
+
+  coap_engine_init();
+  srand(1);
+
+  for(round = 0; round < ROUNDS; round++) {
+    for(i = 0; i < TRANSACTIONS; i++) {
+      mids[i] = round * TRANSACTIONS + i;
+    }
+    shuffle();
+
+    start = clock_time();
+    for(i = 0; i < TRANSACTIONS; i++) {
+      if(send_request(mids[i], FIRST_PORT + i) == NULL) {
+        errors++;
+      }
+    }
+    send_time += clock_time() - start;
+    shuffle();
+    start = clock_time();
+    find();
+    find_time += clock_time() - start;
+    shuffle();
+    start = clock_time();
+    acknowledge();
+    ack_time += clock_time() - start;
+  }
+
+  if(packets != ROUNDS * TRANSACTIONS) {
+    errors++;
+  }
+  printf("Open and send: %lu ns, find: %lu ns, find and clear: %lu ns\n",
+         ns_per_op(send_time, ROUNDS * TRANSACTIONS),
+         ns_per_op(find_time, ROUNDS * TRANSACTIONS),
+         ns_per_op(ack_time, ROUNDS * TRANSACTIONS));
+
+  /* Every request is sent again once before its second timeout */
+  packets = 0;
+  for(i = 0; i < 4; i++) {
+    mids[i] = 10 + i;
+    send_request(mids[i], FIRST_PORT + i);
+  }
+  etimer_set(&et, CLOCK_SECOND * COAP_RESPONSE_TIMEOUT * 2);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+  for(i = 0; i < 4; i++) {
+    coap_clear_transaction(coap_get_transaction_by_mid(mids[i]));
+  }
+  printf("Retransmissions: %lu\n", packets - 4);
+  if(packets != 8) {
+    errors++;
+  }
+
+  printf("Benchmark done: %s\n", errors == 0 ? "OK" : "FAIL");
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
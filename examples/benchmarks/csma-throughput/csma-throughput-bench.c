@@ -0,0 +1,266 @@
+/*
+ * Copyright (c) 2018, RISE SICS.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * \file
+ *         Native benchmark of the CSMA output path: cost per transmitted
+ *         frame when queueing packets in csma-output.c and sending them
+ *         through a radio driver that copies the frame, as a radio
+ *         copies it to its FIFO. Every other transmission attempt
+ *         collides, so that half of the frames are retransmitted from
+ *         their queuebuf. Build with PACKETBUF_DESC=0 to compare against
+ *         copying packets into and out of the queuebufs.
+ */
+
+#include "contiki.h"
+#include "net/netstack.h"
+#include "net/packetbuf.h"
+#include "net/queuebuf.h"
+
+#include <stdio.h>
+#include <string.h>
+/*---------------------------------------------------------------------------*/
+/* Number of packets queued before letting CSMA send them */
+#define BATCH       QUEUEBUF_NUM
+/* Number of packets per measurement */
+#define PACKETS     200000UL
+/*---------------------------------------------------------------------------*/
+/* Payload of the packet with sequence number seq: pattern + seq */
+static uint8_t pattern[256 + PACKETBUF_SIZE];
+static uint8_t txbuf[PACKETBUF_SIZE];
+static unsigned short txlen;
+static int payload_len;
+static uint8_t next_seq;
+static uint8_t collide;
+static unsigned long transmitted;
+static unsigned long sent;
+static int errors;
+
+PROCESS(bench_process, "CSMA throughput benchmark");
+AUTOSTART_PROCESSES(&bench_process);
+/*---------------------------------------------------------------------------*/
+static int
+init(void)
+{
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+prepare(const void *payload, unsigned short payload_len)
+{
+  memcpy(txbuf, payload, payload_len);
+  txlen = payload_len;
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+transmit(unsigned short transmit_len)
+{
+  collide = !collide;
+  if(collide) {
+    return RADIO_TX_COLLISION;
+  }
+
+  /* The payload ends the frame and holds its sequence number */
+  if(transmit_len != txlen || txlen < payload_len ||
+     memcmp(txbuf + txlen - payload_len, pattern + next_seq,
+            payload_len) != 0) {
+    errors++;
+  }
+  next_seq++;
+  transmitted++;
+  return RADIO_TX_OK;
+}
+/*---------------------------------------------------------------------------*/
+static int
+send(const void *payload, unsigned short payload_len)
+{
+  prepare(payload, payload_len);
+  return transmit(payload_len);
+}
+/*---------------------------------------------------------------------------*/
+static int
+radio_read(void *buf, unsigned short buf_len)
+{
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+channel_clear(void)
+{
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static int
+receiving_packet(void)
+{
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+pending_packet(void)
+{
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+on(void)
+{
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+off(void)
+{
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static radio_result_t
+get_value(radio_param_t param, radio_value_t *value)
+{
+  return RADIO_RESULT_NOT_SUPPORTED;
+}
+/*---------------------------------------------------------------------------*/
+static radio_result_t
+set_value(radio_param_t param, radio_value_t value)
+{
+  return RADIO_RESULT_NOT_SUPPORTED;
+}
+/*---------------------------------------------------------------------------*/
+static radio_result_t
+get_object(radio_param_t param, void *dest, size_t size)
+{
+  return RADIO_RESULT_NOT_SUPPORTED;
+}
+/*---------------------------------------------------------------------------*/
+static radio_result_t
+set_object(radio_param_t param, const void *src, size_t size)
+{
+  return RADIO_RESULT_NOT_SUPPORTED;
+}
+/*---------------------------------------------------------------------------*/
+const struct radio_driver bench_radio_driver = {
+  init,
+  prepare,
+  transmit,
+  send,
+  radio_read,
+  channel_clear,
+  receiving_packet,
+  pending_packet,
+  on,
+  off,
+  get_value,
+  set_value,
+  get_object,
+  set_object
+};
+/*---------------------------------------------------------------------------*/
+static unsigned long
+ns_per_op(clock_time_t elapsed, unsigned long ops)
+{
+  return (unsigned long)((unsigned long long)elapsed *
+                         (1000000000ULL / CLOCK_SECOND) / ops);
+}
+/*---------------------------------------------------------------------------*/
+static void
+packet_sent(void *ptr, int status, int transmissions)
+{
+  if(status != MAC_TX_OK || transmissions != 1) {
+    errors++;
+  }
+  sent++;
+}
+/*---------------------------------------------------------------------------*/
+/* Run the processes until the CSMA queue is empty */
+static void
+drain(void)
+{
+  struct process *self = PROCESS_CURRENT();
+
+  while(process_run() > 0);
+  process_current = self;
+}
+/*---------------------------------------------------------------------------*/
+static void
+run(int len)
+{
+  unsigned long p;
+  uint8_t seq;
+  clock_time_t start;
+  int i;
+
+  payload_len = len;
+  transmitted = sent = 0;
+  next_seq = seq = 0;
+
+  start = clock_time();
+  for(p = 0; p < PACKETS; p += BATCH) {
+    for(i = 0; i < BATCH; i++) {
+      packetbuf_copyfrom(pattern + seq++, payload_len);
+      packetbuf_set_addr(PACKETBUF_ADDR_RECEIVER, &linkaddr_null);
+      NETSTACK_MAC.send(packet_sent, NULL);
+    }
+    drain();
+  }
+
+  printf("%3d bytes: %5lu ns per packet\n", payload_len,
+         ns_per_op(clock_time() - start, PACKETS));
+
+  if(sent != PACKETS || transmitted != PACKETS) {
+    printf("Error: %lu sent, %lu transmitted of %lu\n",
+           sent, transmitted, PACKETS);
+    errors++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(bench_process, ev, data)
+{
+  int i;
+
+  PROCESS_BEGIN();
+
+  for(i = 0; i < sizeof(pattern); i++) {
+    pattern[i] = i;
+  }
+
+  printf("CSMA throughput benchmark, %s\n",
+         PACKETBUF_WITH_DESCRIPTORS ? "packetbuf descriptors" : "copy");
+
+  run(16);
+  run(64);
+  run(100);
+
+  printf("Benchmark done: %s\n", errors == 0 ? "OK" : "FAIL");
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
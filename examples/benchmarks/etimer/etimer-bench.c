@@ -0,0 +1,223 @@
+/*
+ * Copyright (c) 2018, RISE SICS.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * \file
+ *         Native benchmark of the event timer backend: cost of setting,
+ *         stopping and expiring an event timer as a function of the
+ *         number of pending timers. Build with ETIMER_HEAP=0 to compare
+ *         against the unsorted timer list.
+ */
+
+#include "contiki.h"
+
+#include <stdio.h>
+/*---------------------------------------------------------------------------*/
+#define MAX_PENDING 512
+#define BATCH       64
+/* Number of timer operations per measurement */
+#define OPS         200000UL
+/*---------------------------------------------------------------------------*/
+PROCESS(bench_process, "Event timer benchmark");
+PROCESS(sink_process, "Timer event sink");
+AUTOSTART_PROCESSES(&sink_process, &bench_process);
+
+static struct etimer background[MAX_PENDING];
+static struct etimer batch[BATCH];
+static unsigned long expired_count;
+static unsigned long early_count;
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(sink_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+  while(1) {
+    PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_TIMER);
+    expired_count++;
+    if(!etimer_expired(data) ||
+       !timer_expired(&((struct etimer *)data)->timer)) {
+      early_count++;
+    }
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+/* Runs the scheduler until all events and polls have been handled. The
+ * native main loop sleeps in select() between events, which would
+ * dominate the measurements */
+static void
+drain(void)
+{
+  struct process *self = PROCESS_CURRENT();
+
+  while(process_run() > 0);
+  process_current = self;
+}
+/*---------------------------------------------------------------------------*/
+static void
+set_batch(clock_time_t interval)
+{
+  int i;
+
+  PROCESS_CONTEXT_BEGIN(&sink_process);
+  for(i = 0; i < BATCH; i++) {
+    etimer_set(&batch[i], interval);
+  }
+  PROCESS_CONTEXT_END(&sink_process);
+}
+/*---------------------------------------------------------------------------*/
+static void
+stop_batch(void)
+{
+  int i;
+
+  for(i = 0; i < BATCH; i++) {
+    etimer_stop(&batch[i]);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static unsigned long
+ns_per_op(clock_time_t elapsed, unsigned long ops)
+{
+  return (unsigned long)((unsigned long long)elapsed *
+                         (1000000000ULL / CLOCK_SECOND) / ops);
+}
+/*---------------------------------------------------------------------------*/
+static int
+run(int pending)
+{
+  unsigned long rounds = OPS / BATCH;
+  unsigned long r;
+  clock_time_t start;
+  clock_time_t set_time;
+  clock_time_t stop_time;
+  clock_time_t expire_time;
+  int i;
+
+  /* Long-running timers with distinct expiration times */
+  PROCESS_CONTEXT_BEGIN(&sink_process);
+  for(i = 0; i < pending; i++) {
+    etimer_set(&background[i], 3600 * CLOCK_SECOND + i);
+  }
+  PROCESS_CONTEXT_END(&sink_process);
+
+  set_time = stop_time = 0;
+  for(r = 0; r < rounds; r++) {
+    start = clock_time();
+    set_batch(CLOCK_SECOND + r % 100);
+    set_time += clock_time() - start;
+    start = clock_time();
+    stop_batch();
+    stop_time += clock_time() - start;
+  }
+
+  expired_count = 0;
+  start = clock_time();
+  for(r = 0; r < rounds; r++) {
+    set_batch(0);
+    drain();
+  }
+  expire_time = clock_time() - start;
+
+  printf("%4d pending: set %5lu ns, stop %5lu ns, set+expire %5lu ns\n",
+         pending, ns_per_op(set_time, rounds * BATCH),
+         ns_per_op(stop_time, rounds * BATCH),
+         ns_per_op(expire_time, rounds * BATCH));
+
+  for(i = 0; i < pending; i++) {
+    etimer_stop(&background[i]);
+  }
+
+  if(expired_count != rounds * BATCH) {
+    printf("Error: %lu of %lu timers expired\n", expired_count, rounds * BATCH);
+    return 0;
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/* Checks that every timer expires exactly once, not before its time, and
+ * that stopped timers never expire */
+static int
+self_check(void)
+{
+  clock_time_t start;
+  int i;
+
+  expired_count = 0;
+  early_count = 0;
+  PROCESS_CONTEXT_BEGIN(&sink_process);
+  for(i = 0; i < MAX_PENDING; i++) {
+    etimer_set(&background[i], (i * 7) % 50);
+  }
+  PROCESS_CONTEXT_END(&sink_process);
+  for(i = 0; i < MAX_PENDING; i += 3) {
+    etimer_stop(&background[i]);
+  }
+  for(i = 1; i < MAX_PENDING; i += 3) {
+    etimer_adjust(&background[i], 10);
+  }
+
+  start = clock_time();
+  while(etimer_pending() && clock_time() - start < CLOCK_SECOND) {
+    etimer_request_poll();
+    drain();
+  }
+
+  if(etimer_pending() || early_count != 0 ||
+     expired_count != MAX_PENDING - (MAX_PENDING + 2) / 3) {
+    printf("Self-check failed: %lu expired, %lu early, %s pending\n",
+           expired_count, early_count, etimer_pending() ? "some" : "none");
+    return 0;
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(bench_process, ev, data)
+{
+  int pending;
+  int ok;
+
+  PROCESS_BEGIN();
+
+  printf("Event timer benchmark, %s backend, %d timers per batch\n",
+         ETIMER_WITH_HEAP ? "heap" : "list", BATCH);
+
+  ok = self_check();
+  for(pending = 8; pending <= MAX_PENDING; pending *= 2) {
+    ok &= run(pending);
+  }
+
+  printf("Benchmark done: %s\n", ok ? "OK" : "FAIL");
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,203 @@
+/*
+ * Copyright (c) 2018, RISE SICS.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * \file
+ *         Native benchmark of the heapmem allocator. Replays a
+ *         pseudo-random trace of allocations resembling those of the
+ *         CoAP, LwM2M and JSON code: many short-lived small objects,
+ *         some medium-sized ones, a few large blockwise buffers, and
+ *         buffers that grow with heapmem_realloc(). Reports the time
+ *         per operation, failed allocations and the fragmentation of
+ *         the heap. Build with SIZE_CLASSES=0 to compare against the
+ *         plain first-fit free list.
+ */
+
+#include "contiki.h"
+#include "lib/heapmem.h"
+#include "lib/random.h"
+
+#include <stdio.h>
+#include <string.h>
+/*---------------------------------------------------------------------------*/
+#define OPERATIONS 2000000UL
+#define SLOTS      96
+/*---------------------------------------------------------------------------*/
+struct slot {
+  uint8_t *ptr;
+  size_t size;
+  uint8_t fill;
+};
+
+static struct slot slots[SLOTS];
+static unsigned long failures;
+static unsigned long corruptions;
+
+PROCESS(bench_process, "Heapmem benchmark");
+AUTOSTART_PROCESSES(&bench_process);
+/*---------------------------------------------------------------------------*/
+static size_t
+trace_size(void)
+{
+  unsigned r = random_rand() % 100;
+
+  if(r < 70) {
+    /* Options, URI paths, SenML names and values */
+    return 4 + random_rand() % 45;
+  } else if(r < 92) {
+    /* Messages and object instances */
+    return 64 + random_rand() % 65;
+  }
+  /* Blockwise transfer buffers */
+  return 256 + random_rand() % 257;
+}
+/*---------------------------------------------------------------------------*/
+static int
+check(struct slot *s)
+{
+  size_t i;
+
+  for(i = 0; i < s->size; i++) {
+    if(s->ptr[i] != s->fill) {
+      corruptions++;
+      return 0;
+    }
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+step(void)
+{
+  struct slot *s = &slots[random_rand() % SLOTS];
+  uint8_t *ptr;
+  size_t size;
+
+  if(s->ptr == NULL) {
+    size = trace_size();
+    s->ptr = heapmem_alloc(size);
+    if(s->ptr == NULL) {
+      failures++;
+      return;
+    }
+    s->size = size;
+    s->fill = random_rand();
+    memset(s->ptr, s->fill, size);
+  } else if(random_rand() % 8 == 0) {
+    /* Grow or shrink the buffer, e.g. while serializing */
+    check(s);
+    size = random_rand() % 2 ? s->size + 16 + random_rand() % 64 :
+      s->size / 2 + 1;
+    ptr = heapmem_realloc(s->ptr, size);
+    if(ptr == NULL) {
+      failures++;
+      return;
+    }
+    s->ptr = ptr;
+    if(size > s->size) {
+      memset(s->ptr + s->size, s->fill, size - s->size);
+    }
+    s->size = size;
+  } else {
+    check(s);
+    heapmem_free(s->ptr);
+    s->ptr = NULL;
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(bench_process, ev, data)
+{
+  unsigned long i;
+  clock_time_t start;
+  clock_time_t elapsed;
+  heapmem_stats_t stats;
+  size_t peak_footprint;
+  size_t allocated;
+
+  PROCESS_BEGIN();
+
+  printf("Heapmem benchmark, size classes %s\n",
+         HEAPMEM_CONF_WITH_SIZE_CLASSES ? "enabled" : "disabled");
+
+  random_init(0x1234);
+  peak_footprint = 0;
+  start = clock_time();
+  for(i = 0; i < OPERATIONS; i++) {
+    step();
+    if(i % 4096 == 0) {
+      heapmem_stats(&stats);
+      if(stats.footprint > peak_footprint) {
+        peak_footprint = stats.footprint;
+      }
+    }
+  }
+  elapsed = clock_time() - start;
+
+  printf("%lu operations in %lu ms, %lu ns/operation\n",
+         OPERATIONS, (unsigned long)(elapsed * 1000 / CLOCK_SECOND),
+         (unsigned long)((unsigned long long)elapsed *
+                         (1000000000ULL / CLOCK_SECOND) / OPERATIONS));
+  printf("Failed allocations: %lu\n", failures);
+
+  heapmem_stats(&stats);
+  printf("Heap: %lu allocated, %lu available, %lu overhead, %lu chunks, "
+         "footprint %lu (peak %lu) of %u bytes\n",
+         (unsigned long)stats.allocated, (unsigned long)stats.available,
+         (unsigned long)stats.overhead, (unsigned long)stats.chunks,
+         (unsigned long)stats.footprint, (unsigned long)peak_footprint,
+         HEAPMEM_CONF_ARENA_SIZE);
+
+  /* Self-check: contents intact, and all memory returned after freeing */
+  allocated = 0;
+  for(i = 0; i < SLOTS; i++) {
+    if(slots[i].ptr != NULL) {
+      allocated += slots[i].size;
+      check(&slots[i]);
+      heapmem_free(slots[i].ptr);
+      slots[i].ptr = NULL;
+    }
+  }
+  if(stats.allocated < allocated) {
+    corruptions++;
+  }
+  heapmem_stats(&stats);
+  printf("After freeing everything: %lu allocated, %lu available\n",
+         (unsigned long)stats.allocated, (unsigned long)stats.available);
+  if(stats.allocated != 0 || stats.available != HEAPMEM_CONF_ARENA_SIZE -
+     stats.overhead) {
+    corruptions++;
+  }
+
+  printf("Benchmark done: %s\n", corruptions == 0 ? "OK" : "FAIL");
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,372 @@
+/*
+ * Copyright (c) 2018, RISE SICS.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Native benchmark of batched LWM2M notifications and Send: a
+ *         sensor instance updates ten resources every round, with
+ *         observers of the instance and of each resource, and every
+ *         change also given to Send. The server and the observer are
+ *         simulated by the network driver.
+ */
+
+#include "contiki.h"
+#include "coap-engine.h"
+#include "coap-observe.h"
+#include "lwm2m-engine.h"
+#include "lwm2m-object.h"
+#include "lwm2m-rd-client.h"
+#include "lwm2m-send.h"
+#include "lwm2m-cbor.h"
+#include "net/ipv6/uip.h"
+#include "net/ipv6/uip-ds6-nbr.h"
+#include "net/ipv6/uiplib.h"
+#include "net/netstack.h"
+
+#include <stdio.h>
+#include <string.h>
+/*---------------------------------------------------------------------------*/
+#define SENSORS         10
+#define ROUNDS          50
+#define ROUND_INTERVAL  (CLOCK_SECOND / 50)
+
+#define SERVER_PORT     5683
+#define OBSERVER_PORT   5684
+#define INSTANCE_OBSERVER_PORT 5685
+
+#define REPLIES         4
+
+#define UIP_IP_BUF ((struct uip_udpip_hdr *)&uip_buf[UIP_LLH_LEN])
+/*---------------------------------------------------------------------------*/
+static const lwm2m_resource_id_t resources[SENSORS] = {
+  RO(5700), RO(5701), RO(5702), RO(5703), RO(5704),
+  RO(5705), RO(5706), RO(5707), RO(5708), RO(5709)
+};
+static lwm2m_object_instance_t sensor;
+static int32_t values[SENSORS];
+
+static coap_endpoint_t server_ep;
+static coap_endpoint_t observer_ep;
+/* Another endpoint, an observer of a resource replaces that of its parent */
+static coap_endpoint_t instance_observer_ep;
+
+/* Replies of the server and the observer, delivered by reply_process */
+static struct {
+  coap_endpoint_t *endpoint;
+  uint8_t message[COAP_MAX_HEADER_SIZE];
+  uint16_t len;
+} replies[REPLIES];
+static int reply_count;
+
+static coap_message_t message[1];
+static coap_message_t reply[1];
+static uint8_t buffer[COAP_MAX_PACKET_SIZE];
+
+static struct {
+  unsigned long packets;
+  unsigned long bytes;
+} notifications, instance_notifications, sends;
+static unsigned long send_records;
+static char last_instance_payload[COAP_MAX_CHUNK_SIZE + 1];
+static int errors;
+
+PROCESS(bench_process, "LWM2M batching benchmark");
+PROCESS(reply_process, "LWM2M batching replies");
+AUTOSTART_PROCESSES(&bench_process, &reply_process);
+/*---------------------------------------------------------------------------*/
+static lwm2m_status_t
+lwm2m_callback(lwm2m_object_instance_t *object, lwm2m_context_t *ctx)
+{
+  if(ctx->operation != LWM2M_OP_READ) {
+    return LWM2M_STATUS_NOT_IMPLEMENTED;
+  }
+  if(ctx->resource_id < 5700 || ctx->resource_id >= 5700 + SENSORS) {
+    return LWM2M_STATUS_NOT_FOUND;
+  }
+  lwm2m_object_write_int(ctx, values[ctx->resource_id - 5700]);
+  return LWM2M_STATUS_OK;
+}
+/*---------------------------------------------------------------------------*/
+static void
+init(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+static void
+input(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+static void
+add_reply(coap_endpoint_t *endpoint)
+{
+  if(reply_count == REPLIES) {
+    errors++;
+    return;
+  }
+  replies[reply_count].endpoint = endpoint;
+  replies[reply_count].len =
+    coap_serialize_message(reply, replies[reply_count].message);
+  reply_count++;
+  process_poll(&reply_process);
+}
+/*---------------------------------------------------------------------------*/
+/* Counts the SenML records of a Send */
+static int
+count_records(const uint8_t *payload, int len)
+{
+  int pos = 1;
+  int records = 0;
+  size_t size;
+
+  if(len < 2 || payload[0] != (LWM2M_CBOR_ARRAY | LWM2M_CBOR_INDEFINITE)) {
+    return -1;
+  }
+  while(pos < len && payload[pos] != LWM2M_CBOR_BREAK) {
+    size = lwm2m_cbor_item_size(&payload[pos], len - pos);
+    if(size == 0) {
+      return -1;
+    }
+    pos += size;
+    records++;
+  }
+  return pos == len - 1 ? records : -1;
+}
+/*---------------------------------------------------------------------------*/
+/* The server and the observer */
+static uint8_t
+output(const linkaddr_t *localdest)
+{
+  uint16_t len = uip_len - UIP_IPUDPH_LEN;
+  const char *path;
+  int path_len;
+  int records;
+
+  if(uip_len == 0 || UIP_IP_BUF->proto != UIP_PROTO_UDP) {
+    return 0;
+  }
+  memcpy(buffer, &uip_buf[UIP_LLH_LEN + UIP_IPUDPH_LEN], len);
+  if(coap_parse_message(message, buffer, len) != NO_ERROR) {
+    errors++;
+    return 0;
+  }
+
+  if(UIP_IP_BUF->destport == UIP_HTONS(SERVER_PORT)) {
+    if(message->code != COAP_POST) {
+      return 0;
+    }
+    coap_init_message(reply, COAP_TYPE_ACK, CHANGED_2_04, message->mid);
+    coap_set_token(reply, message->token, message->token_len);
+    path_len = coap_get_header_uri_path(message, &path);
+    if(path_len == 2 && strncmp(path, "rd", 2) == 0) {
+      /* Registration */
+      reply->code = CREATED_2_01;
+      coap_set_header_location_path(reply, "rd/bench");
+    } else if(path_len == 2 && strncmp(path, "dp", 2) == 0) {
+      sends.packets++;
+      sends.bytes += len;
+      records = count_records(message->payload, message->payload_len);
+      if(records != SENSORS) {
+        printf("Send with %d records\n", records);
+        errors++;
+      } else {
+        send_records += records;
+      }
+    }
+    add_reply(&server_ep);
+  } else if(UIP_IP_BUF->destport == UIP_HTONS(OBSERVER_PORT) ||
+            UIP_IP_BUF->destport == UIP_HTONS(INSTANCE_OBSERVER_PORT)) {
+    if(coap_is_option(message, COAP_OPTION_OBSERVE) &&
+       message->type != COAP_TYPE_ACK) {
+      notifications.packets++;
+      notifications.bytes += len;
+      if(UIP_IP_BUF->destport == UIP_HTONS(INSTANCE_OBSERVER_PORT)) {
+        instance_notifications.packets++;
+        instance_notifications.bytes += len;
+        memcpy(last_instance_payload, message->payload,
+               message->payload_len);
+        last_instance_payload[message->payload_len] = '\0';
+      }
+    }
+    if(message->type == COAP_TYPE_CON) {
+      coap_init_message(reply, COAP_TYPE_ACK, 0, message->mid);
+      add_reply(UIP_IP_BUF->destport == UIP_HTONS(OBSERVER_PORT) ?
+                &observer_ep : &instance_observer_ep);
+    }
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+const struct network_driver bench_net_driver = {
+  "bench",
+  init,
+  input,
+  output
+};
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(reply_process, ev, data)
+{
+  static uint8_t message[COAP_MAX_HEADER_SIZE];
+  int i;
+  uint16_t len;
+
+  PROCESS_BEGIN();
+
+  while(1) {
+    PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL);
+    /* A reply may make the client send more */
+    for(i = 0; i < reply_count; i++) {
+      len = replies[i].len;
+      memcpy(message, replies[i].message, len);
+      coap_receive(replies[i].endpoint, message, len);
+    }
+    reply_count = 0;
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+static void
+add_endpoint(coap_endpoint_t *endpoint, const char *address, uint16_t port)
+{
+  uip_lladdr_t lladdr;
+
+  uiplib_ipaddrconv(address, &endpoint->ipaddr);
+  endpoint->port = UIP_HTONS(port);
+  /* A reachable neighbor, so that no neighbor discovery is needed */
+  memset(&lladdr, 0, sizeof(lladdr));
+  lladdr.addr[0] = port & 0xff;
+  uip_ds6_nbr_add(&endpoint->ipaddr, &lladdr, 0, NBR_REACHABLE,
+                  NBR_TABLE_REASON_UNDEFINED, NULL);
+}
+/*---------------------------------------------------------------------------*/
+static void
+observe(coap_endpoint_t *endpoint, const char *path, uint8_t token)
+{
+  uint8_t request[COAP_MAX_HEADER_SIZE];
+  coap_message_t get[1];
+
+  coap_init_message(get, COAP_TYPE_CON, COAP_GET, coap_get_mid());
+  coap_set_token(get, &token, 1);
+  coap_set_header_uri_path(get, path);
+  coap_set_header_observe(get, 0);
+  coap_receive(endpoint, request, coap_serialize_message(get, request));
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(bench_process, ev, data)
+{
+  static struct etimer timer;
+  static int round;
+  static int waited;
+  char path[20];
+  int i;
+
+  PROCESS_BEGIN();
+
+  printf("LWM2M batching benchmark: %u resources changed every %u ms, "
+         "%u rounds, window %u ms\n", SENSORS,
+         (unsigned)(ROUND_INTERVAL * 1000 / CLOCK_SECOND), ROUNDS,
+         LWM2M_SEND_WINDOW);
+
+  add_endpoint(&server_ep, "fe80::1", SERVER_PORT);
+  add_endpoint(&observer_ep, "fe80::2", OBSERVER_PORT);
+  add_endpoint(&instance_observer_ep, "fe80::3", INSTANCE_OBSERVER_PORT);
+
+  lwm2m_engine_init();
+  sensor.object_id = 3303;
+  sensor.instance_id = 0;
+  sensor.resource_ids = resources;
+  sensor.resource_count = SENSORS;
+  sensor.callback = lwm2m_callback;
+  lwm2m_engine_add_object(&sensor);
+
+  lwm2m_rd_client_register_with_server(&server_ep);
+  lwm2m_rd_client_use_registration_server(1);
+  for(waited = 0; !lwm2m_rd_client_is_registered() && waited < 50; waited++) {
+    etimer_set(&timer, CLOCK_SECOND / 10);
+    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&timer));
+  }
+  if(!lwm2m_rd_client_is_registered()) {
+    printf("Registration failed\n");
+    errors++;
+  }
+
+  observe(&instance_observer_ep, "3303/0", 0);
+  for(i = 0; i < SENSORS; i++) {
+    snprintf(path, sizeof(path), "3303/0/%u", 5700 + i);
+    observe(&observer_ep, path, i + 1);
+  }
+  memset(&notifications, 0, sizeof(notifications));
+  memset(&instance_notifications, 0, sizeof(instance_notifications));
+
+  etimer_set(&timer, ROUND_INTERVAL);
+  for(round = 1; round <= ROUNDS; round++) {
+    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&timer));
+    etimer_reset(&timer);
+    for(i = 0; i < SENSORS; i++) {
+      values[i] = round * 100 + i;
+      lwm2m_notify_object_observers(&sensor, 5700 + i);
+      lwm2m_send_resource(&sensor, 5700 + i);
+    }
+  }
+  /* Until the last window has ended and the last Send is acknowledged */
+  etimer_set(&timer, CLOCK_SECOND / 2);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&timer));
+
+  printf("Changes: %u\n", ROUNDS * SENSORS);
+  printf("Notifications: %lu packets, %lu bytes, "
+         "of the instance: %lu packets\n",
+         notifications.packets, notifications.bytes,
+         instance_notifications.packets);
+  printf("Send: %lu packets, %lu bytes, %lu resource values\n",
+         sends.packets, sends.bytes, send_records);
+
+  if(send_records != lwm2m_send_get_stats()->resources ||
+     lwm2m_send_get_stats()->failures > 0) {
+    errors++;
+  }
+  /* Every resource observer was notified */
+  if(notifications.packets < SENSORS) {
+    errors++;
+  }
+#if LWM2M_ENGINE_CONF_NOTIFY_WINDOW
+  /* The instance observer has the last values */
+  snprintf(path, sizeof(path), "\"v\":%u}", ROUNDS * 100 + SENSORS - 1);
+  if(strstr(last_instance_payload, path) == NULL) {
+    printf("Last instance notification: %s\n", last_instance_payload);
+    errors++;
+  }
+#endif /* LWM2M_ENGINE_CONF_NOTIFY_WINDOW */
+
+  printf("Benchmark done: %s\n", errors == 0 ? "OK" : "FAIL");
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,312 @@
+/*
+ * Copyright (c) 2018, RISE SICS.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Native benchmark of the LWM2M content formats: payload size and
+ *         encoding time of a read of an IPSO-like object instance as TLV,
+ *         JSON and SenML CBOR, and a check of the CBOR readers by writes
+ *         back to the instance.
+ */
+
+#include "contiki.h"
+#include "coap-engine.h"
+#include "lwm2m-engine.h"
+#include "lwm2m-object.h"
+#include "lwm2m-cbor.h"
+
+#include <stdio.h>
+#include <string.h>
+/*---------------------------------------------------------------------------*/
+#define READS           20000UL
+
+#define OBJECT_ID       3303
+#define INSTANCE_ID     0
+/*---------------------------------------------------------------------------*/
+static const lwm2m_resource_id_t resources[] = {
+  RO(5700), /* Sensor value */
+  RO(5701), /* Units */
+  RO(5601), /* Min measured value */
+  RO(5602), /* Max measured value */
+  RO(5603), /* Min range value */
+  RO(5604), /* Max range value */
+  RO(5518), /* Timestamp */
+  RW(5750), /* Application type */
+  RW(5850), /* On/Off */
+  RW(5821), /* Current calibration */
+};
+
+static lwm2m_object_instance_t instance;
+
+static char application_type[32] = "Kitchen";
+static int on_off = 1;
+static int32_t calibration = 0;
+
+static coap_message_t request[1];
+static coap_message_t response[1];
+static uint8_t buffer[COAP_MAX_CHUNK_SIZE];
+static int errors;
+
+PROCESS(bench_process, "LWM2M content format benchmark");
+AUTOSTART_PROCESSES(&bench_process);
+/*---------------------------------------------------------------------------*/
+static lwm2m_status_t
+lwm2m_callback(lwm2m_object_instance_t *object, lwm2m_context_t *ctx)
+{
+  int32_t value;
+  size_t len;
+
+  if(ctx->operation == LWM2M_OP_WRITE) {
+    switch(ctx->resource_id) {
+    case 5750:
+      len = lwm2m_object_read_string(ctx, ctx->inbuf->buffer, ctx->inbuf->size,
+                                     (uint8_t *)application_type,
+                                     sizeof(application_type) - 1);
+      application_type[len] = '\0';
+      break;
+    case 5850:
+      if(lwm2m_object_read_boolean(ctx, ctx->inbuf->buffer, ctx->inbuf->size,
+                                   &on_off) == 0) {
+        return LWM2M_STATUS_READ_ERROR;
+      }
+      break;
+    case 5821:
+      if(lwm2m_object_read_float32fix(ctx, ctx->inbuf->buffer,
+                                      ctx->inbuf->size, &value,
+                                      LWM2M_FLOAT32_BITS) == 0) {
+        return LWM2M_STATUS_READ_ERROR;
+      }
+      calibration = value;
+      break;
+    default:
+      return LWM2M_STATUS_OPERATION_NOT_ALLOWED;
+    }
+  } else if(ctx->operation == LWM2M_OP_READ) {
+    switch(ctx->resource_id) {
+    case 5700:
+      lwm2m_object_write_float32fix(ctx, 22 * LWM2M_FLOAT32_FRAC
+                                    + LWM2M_FLOAT32_FRAC / 2,
+                                    LWM2M_FLOAT32_BITS);
+      break;
+    case 5701:
+      lwm2m_object_write_string(ctx, "Cel", 3);
+      break;
+    case 5601:
+      lwm2m_object_write_float32fix(ctx, 18 * LWM2M_FLOAT32_FRAC,
+                                    LWM2M_FLOAT32_BITS);
+      break;
+    case 5602:
+      lwm2m_object_write_float32fix(ctx, 26 * LWM2M_FLOAT32_FRAC
+                                    + LWM2M_FLOAT32_FRAC / 4,
+                                    LWM2M_FLOAT32_BITS);
+      break;
+    case 5603:
+      lwm2m_object_write_float32fix(ctx, -40 * LWM2M_FLOAT32_FRAC,
+                                    LWM2M_FLOAT32_BITS);
+      break;
+    case 5604:
+      lwm2m_object_write_float32fix(ctx, 125 * LWM2M_FLOAT32_FRAC,
+                                    LWM2M_FLOAT32_BITS);
+      break;
+    case 5518:
+      lwm2m_object_write_int(ctx, 1539000000);
+      break;
+    case 5750:
+      lwm2m_object_write_string(ctx, application_type,
+                                strlen(application_type));
+      break;
+    case 5850:
+      lwm2m_object_write_boolean(ctx, on_off);
+      break;
+    case 5821:
+      lwm2m_object_write_float32fix(ctx, calibration, LWM2M_FLOAT32_BITS);
+      break;
+    default:
+      return LWM2M_STATUS_NOT_FOUND;
+    }
+  } else {
+    return LWM2M_STATUS_NOT_IMPLEMENTED;
+  }
+  return LWM2M_STATUS_OK;
+}
+/*---------------------------------------------------------------------------*/
+static unsigned long
+ns_per_op(clock_time_t elapsed, unsigned long ops)
+{
+  return (unsigned long)((unsigned long long)elapsed *
+                         (1000000000ULL / CLOCK_SECOND) / ops);
+}
+/*---------------------------------------------------------------------------*/
+/* Handles a request by the LWM2M engine, the response is in response */
+static int
+handle(coap_method_t method, const char *path, int accept, int format,
+       const uint8_t *payload, size_t payload_len)
+{
+  int32_t offset = 0;
+
+  coap_init_message(request, COAP_TYPE_CON, method, 1);
+  coap_set_header_uri_path(request, path);
+  if(accept >= 0) {
+    coap_set_header_accept(request, accept);
+  }
+  if(format >= 0) {
+    coap_set_header_content_format(request, format);
+  }
+  if(payload_len > 0) {
+    coap_set_payload(request, payload, payload_len);
+  }
+  coap_init_message(response, COAP_TYPE_ACK, CONTENT_2_05, 1);
+  if(coap_call_handlers(request, response, buffer, COAP_MAX_CHUNK_SIZE,
+                        &offset) != COAP_HANDLER_STATUS_PROCESSED) {
+    return 0;
+  }
+  return response->code;
+}
+/*---------------------------------------------------------------------------*/
+static void
+bench_read(const char *name, const char *path, int accept)
+{
+  unsigned long i;
+  clock_time_t start;
+  clock_time_t elapsed;
+  unsigned int format;
+
+  start = clock_time();
+  for(i = 0; i < READS; i++) {
+    handle(COAP_GET, path, accept, -1, NULL, 0);
+  }
+  elapsed = clock_time() - start;
+
+  if(response->code != CONTENT_2_05 ||
+     !coap_get_header_content_format(response, &format) ||
+     format != accept) {
+    printf("%s: unexpected response %u\n", name, response->code);
+    errors++;
+    return;
+  }
+  printf("%-12s %-14s %4u bytes %6lu ns\n", name, path,
+         response->payload_len, ns_per_op(elapsed, READS));
+}
+/*---------------------------------------------------------------------------*/
+/* Encodes a SenML CBOR record with a text, boolean or float value */
+static size_t
+put_record(uint8_t *buf, size_t len, const char *base_name, const char *name,
+           int label, const char *text, int32_t value)
+{
+  size_t pos;
+
+  pos = lwm2m_cbor_write_head(buf, len, LWM2M_CBOR_MAP,
+                              base_name != NULL ? 3 : 2);
+  if(base_name != NULL) {
+    pos += lwm2m_cbor_write_int(&buf[pos], len - pos, -2);
+    pos += lwm2m_cbor_write_text(&buf[pos], len - pos, base_name,
+                                 strlen(base_name));
+  }
+  pos += lwm2m_cbor_write_int(&buf[pos], len - pos, 0);
+  pos += lwm2m_cbor_write_text(&buf[pos], len - pos, name, strlen(name));
+  pos += lwm2m_cbor_write_int(&buf[pos], len - pos, label);
+  if(label == 3) {
+    pos += lwm2m_cbor_write_text(&buf[pos], len - pos, text, strlen(text));
+  } else if(label == 4) {
+    buf[pos++] = value ? LWM2M_CBOR_TRUE : LWM2M_CBOR_FALSE;
+  } else {
+    pos += lwm2m_cbor_write_float32fix(&buf[pos], len - pos, value,
+                                       LWM2M_FLOAT32_BITS);
+  }
+  return pos;
+}
+/*---------------------------------------------------------------------------*/
+static void
+check_writes(void)
+{
+  uint8_t payload[96];
+  size_t len;
+
+  /* [{-2:"/3303/0/",0:"5750",3:"Hall"},{0:"5850",4:false},{0:"5821",2:-1.5}] */
+  len = lwm2m_cbor_write_head(payload, sizeof(payload), LWM2M_CBOR_ARRAY, 3);
+  len += put_record(&payload[len], sizeof(payload) - len, "/3303/0/", "5750",
+                    3, "Hall", 0);
+  len += put_record(&payload[len], sizeof(payload) - len, NULL, "5850",
+                    4, NULL, 0);
+  len += put_record(&payload[len], sizeof(payload) - len, NULL, "5821",
+                    2, NULL, -3 * LWM2M_FLOAT32_FRAC / 2);
+  if(handle(COAP_PUT, "3303/0", -1, LWM2M_SENML_CBOR, payload, len)
+     != CHANGED_2_04 || strcmp(application_type, "Hall") != 0 || on_off ||
+     calibration != -3 * LWM2M_FLOAT32_FRAC / 2) {
+    printf("SenML CBOR write failed\n");
+    errors++;
+  }
+
+  /* A single resource as a CBOR text string */
+  len = lwm2m_cbor_write_text(payload, sizeof(payload), "Attic", 5);
+  if(handle(COAP_PUT, "3303/0/5750", -1, LWM2M_CBOR, payload, len)
+     != CHANGED_2_04 || strcmp(application_type, "Attic") != 0) {
+    printf("CBOR write failed\n");
+    errors++;
+  }
+
+  /* Read back what was written */
+  if(handle(COAP_GET, "3303/0/5821", LWM2M_CBOR, -1, NULL, 0)
+     != CONTENT_2_05 || response->payload_len != 3 ||
+     memcmp(response->payload, "\xf9\xbe\x00", 3) != 0) {
+    printf("CBOR read failed\n");
+    errors++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(bench_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+  printf("LWM2M content format benchmark: %lu reads of %u resources\n",
+         READS, (unsigned)(sizeof(resources) / sizeof(lwm2m_resource_id_t)));
+
+  lwm2m_engine_init();
+  instance.object_id = OBJECT_ID;
+  instance.instance_id = INSTANCE_ID;
+  instance.resource_ids = resources;
+  instance.resource_count = sizeof(resources) / sizeof(lwm2m_resource_id_t);
+  instance.callback = lwm2m_callback;
+  lwm2m_engine_add_object(&instance);
+
+  bench_read("TLV", "3303/0", LWM2M_TLV);
+  bench_read("JSON", "3303/0", LWM2M_JSON);
+  bench_read("SenML CBOR", "3303/0", LWM2M_SENML_CBOR);
+  bench_read("Text", "3303/0/5700", LWM2M_TEXT_PLAIN);
+  bench_read("TLV", "3303/0/5700", LWM2M_TLV);
+  bench_read("CBOR", "3303/0/5700", LWM2M_CBOR);
+
+  check_writes();
+
+  printf("Benchmark done: %s\n", errors == 0 ? "OK" : "FAIL");
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,383 @@
+/*
+ * Copyright (c) 2018, RISE SICS.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Native benchmark of the object and instance lookups of the LWM2M
+ *         engine with a gateway-sized synthetic object tree: lookups,
+ *         reads through the engine and generation of the registration
+ *         links, with checks of their order and of removals.
+ */
+
+#include "contiki.h"
+#include "coap-engine.h"
+#include "lwm2m-engine.h"
+#include "lwm2m-object.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+/*---------------------------------------------------------------------------*/
+#define OBJECTS           16
+#define INSTANCES         32
+#define GENERIC_OBJECTS   3
+#define GENERIC_INSTANCES 4
+
+#define LOOKUPS           200000UL
+#define READS             20000UL
+#define RD_ROUNDS         1000
+
+/* Simple objects have even ids, generic objects odd ids in between */
+#define OBJECT_ID(i)      (3300 + 2 * (i))
+#define GENERIC_ID(i)     (3301 + 2 * (OBJECTS / GENERIC_OBJECTS) * (i))
+/*---------------------------------------------------------------------------*/
+static const lwm2m_resource_id_t resources[] = { RO(5700) };
+
+static lwm2m_object_instance_t instances[OBJECTS][INSTANCES];
+
+struct generic {
+  lwm2m_object_t object;
+  lwm2m_object_impl_t impl;
+  lwm2m_object_instance_t instances[GENERIC_INSTANCES];
+  int count;
+};
+static struct generic generics[GENERIC_OBJECTS];
+
+static coap_message_t request[1];
+static coap_message_t response[1];
+static uint8_t buffer[COAP_MAX_CHUNK_SIZE];
+static char rd_data[(OBJECTS * INSTANCES +
+                     GENERIC_OBJECTS * GENERIC_INSTANCES) * 16];
+static int errors;
+
+PROCESS(bench_process, "LWM2M lookup benchmark");
+AUTOSTART_PROCESSES(&bench_process);
+/*---------------------------------------------------------------------------*/
+static lwm2m_status_t
+lwm2m_callback(lwm2m_object_instance_t *object, lwm2m_context_t *ctx)
+{
+  if(ctx->operation != LWM2M_OP_READ) {
+    return LWM2M_STATUS_NOT_IMPLEMENTED;
+  }
+  lwm2m_object_write_int(ctx, ((int32_t)object->object_id << 16) |
+                         object->instance_id);
+  return LWM2M_STATUS_OK;
+}
+/*---------------------------------------------------------------------------*/
+static struct generic *
+get_generic(uint16_t object_id)
+{
+  int i;
+
+  for(i = 0; i < GENERIC_OBJECTS; i++) {
+    if(generics[i].impl.object_id == object_id) {
+      return &generics[i];
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static lwm2m_object_instance_t *
+get_by_index(uint16_t object_id, int index)
+{
+  struct generic *g = get_generic(object_id);
+
+  if(g == NULL || index >= g->count) {
+    return NULL;
+  }
+  return &g->instances[index];
+}
+/*---------------------------------------------------------------------------*/
+static lwm2m_object_instance_t *
+get_next(lwm2m_object_instance_t *instance, lwm2m_status_t *status)
+{
+  return get_by_index(instance->object_id, instance->instance_id + 1);
+}
+/*---------------------------------------------------------------------------*/
+/* The callbacks of the generic objects do not get the object id */
+#define GENERIC_FUNCTIONS(n)                                            \
+  static lwm2m_object_instance_t *                                      \
+  get_first_##n(lwm2m_status_t *status)                                 \
+  {                                                                     \
+    return get_by_index(GENERIC_ID(n), 0);                              \
+  }                                                                     \
+  static lwm2m_object_instance_t *                                      \
+  get_by_id_##n(uint16_t instance_id, lwm2m_status_t *status)           \
+  {                                                                     \
+    return get_by_index(GENERIC_ID(n), instance_id);                    \
+  }
+GENERIC_FUNCTIONS(0)
+GENERIC_FUNCTIONS(1)
+GENERIC_FUNCTIONS(2)
+
+static lwm2m_object_instance_t *(*const first_functions[GENERIC_OBJECTS])
+  (lwm2m_status_t *) = { get_first_0, get_first_1, get_first_2 };
+static lwm2m_object_instance_t *(*const by_id_functions[GENERIC_OBJECTS])
+  (uint16_t, lwm2m_status_t *) = { get_by_id_0, get_by_id_1, get_by_id_2 };
+/*---------------------------------------------------------------------------*/
+static unsigned long
+ns_per_op(clock_time_t elapsed, unsigned long ops)
+{
+  return (unsigned long)((unsigned long long)elapsed *
+                         (1000000000ULL / CLOCK_SECOND) / ops);
+}
+/*---------------------------------------------------------------------------*/
+/* Registers the instances in an order scattered over the tree */
+static void
+register_objects(void)
+{
+  int i, j, k;
+
+  for(k = 0; k < OBJECTS * INSTANCES; k++) {
+    i = (k * 7) % OBJECTS;
+    j = (k * 13 + k / OBJECTS) % INSTANCES;
+    if(instances[i][j].callback == NULL) {
+      instances[i][j].object_id = OBJECT_ID(i);
+      instances[i][j].instance_id = j;
+      instances[i][j].resource_ids = resources;
+      instances[i][j].resource_count = 1;
+      instances[i][j].callback = lwm2m_callback;
+      if(!lwm2m_engine_add_object(&instances[i][j])) {
+        errors++;
+      }
+    } else {
+      errors++;
+    }
+  }
+
+  for(i = GENERIC_OBJECTS - 1; i >= 0; i--) {
+    /* The last one has no instances */
+    generics[i].count = i < GENERIC_OBJECTS - 1 ? GENERIC_INSTANCES : 0;
+    for(j = 0; j < generics[i].count; j++) {
+      generics[i].instances[j].object_id = GENERIC_ID(i);
+      generics[i].instances[j].instance_id = j;
+      generics[i].instances[j].resource_ids = resources;
+      generics[i].instances[j].resource_count = 1;
+      generics[i].instances[j].callback = lwm2m_callback;
+    }
+    generics[i].impl.object_id = GENERIC_ID(i);
+    generics[i].impl.get_first = first_functions[i];
+    generics[i].impl.get_next = get_next;
+    generics[i].impl.get_by_id = by_id_functions[i];
+    generics[i].object.impl = &generics[i].impl;
+    if(!lwm2m_engine_add_generic_object(&generics[i].object)) {
+      errors++;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+bench_lookups(void)
+{
+  unsigned long i;
+  unsigned long found = 0;
+  unsigned int r = 1;
+  clock_time_t start;
+  clock_time_t elapsed;
+
+  start = clock_time();
+  for(i = 0; i < LOOKUPS; i++) {
+    r = r * 1103515245 + 12345;
+    /* One in eight lookups is for an instance that does not exist */
+    found += lwm2m_engine_has_instance(3300 + (r >> 8) % (2 * OBJECTS),
+                                       (r >> 16) % (INSTANCES + 4));
+  }
+  elapsed = clock_time() - start;
+  printf("Lookup: %lu ns, %lu found\n", ns_per_op(elapsed, LOOKUPS), found);
+  if(found == 0 || found == LOOKUPS) {
+    errors++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+bench_reads(void)
+{
+  unsigned long i;
+  unsigned int r = 1;
+  int32_t offset;
+  char path[24];
+  int object, instance;
+  clock_time_t start;
+  clock_time_t elapsed;
+  char expected[16];
+
+  start = clock_time();
+  for(i = 0; i < READS; i++) {
+    r = r * 1103515245 + 12345;
+    object = (r >> 8) % OBJECTS;
+    instance = (r >> 16) % INSTANCES;
+    snprintf(path, sizeof(path), "%u/%u/5700", OBJECT_ID(object), instance);
+    coap_init_message(request, COAP_TYPE_CON, COAP_GET, 1);
+    coap_set_header_uri_path(request, path);
+    coap_set_header_accept(request, LWM2M_TEXT_PLAIN);
+    coap_init_message(response, COAP_TYPE_ACK, CONTENT_2_05, 1);
+    offset = 0;
+    if(coap_call_handlers(request, response, buffer, sizeof(buffer),
+                          &offset) != COAP_HANDLER_STATUS_PROCESSED ||
+       response->code != CONTENT_2_05 ||
+       response->payload_len != snprintf(expected, sizeof(expected), "%ld",
+                                         ((long)OBJECT_ID(object) << 16) |
+                                         instance) ||
+       memcmp(response->payload, expected, response->payload_len) != 0) {
+      errors++;
+    }
+  }
+  elapsed = clock_time() - start;
+  printf("Read: %lu ns\n", ns_per_op(elapsed, READS));
+}
+/*---------------------------------------------------------------------------*/
+/* Checks that the links are in order and that all are there */
+static int
+check_rd_data(const char *p)
+{
+  long last = -1;
+  long key;
+  int links = 0;
+  char *end;
+
+  while(*p != '\0') {
+    if(strncmp(p, "</", 2) != 0) {
+      return 0;
+    }
+    key = strtol(p + 2, &end, 10) << 16;
+    if(*end == '/') {
+      key |= strtol(end + 1, &end, 10);
+    } else {
+      key |= 0xffff;
+    }
+    if(strncmp(end, ">", 1) != 0 || key <= last) {
+      return 0;
+    }
+    last = key;
+    links++;
+    p = end + 1;
+    if(*p == ',') {
+      p++;
+    }
+  }
+  return links == OBJECTS * INSTANCES +
+    (GENERIC_OBJECTS - 1) * GENERIC_INSTANCES + 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+bench_rd_data(void)
+{
+  static uint8_t block[COAP_MAX_BLOCK_SIZE];
+  lwm2m_buffer_t outbuf;
+  size_t len = 0;
+  int round;
+  int blocks = 0;
+  int more;
+  clock_time_t start;
+  clock_time_t elapsed;
+
+  start = clock_time();
+  for(round = 0; round < RD_ROUNDS; round++) {
+    len = 0;
+    blocks = 0;
+    do {
+      outbuf.buffer = block;
+      outbuf.size = sizeof(block);
+      outbuf.len = 0;
+      more = lwm2m_engine_set_rd_data(&outbuf, blocks++);
+      if(len + outbuf.len < sizeof(rd_data)) {
+        memcpy(&rd_data[len], block, outbuf.len);
+        len += outbuf.len;
+      }
+    } while(more);
+  }
+  elapsed = clock_time() - start;
+  rd_data[len] = '\0';
+
+  printf("Registration links: %lu ns, %u bytes in %d blocks\n",
+         ns_per_op(elapsed, RD_ROUNDS), (unsigned)len, blocks);
+  if(!check_rd_data(rd_data)) {
+    printf("Registration links out of order\n");
+    errors++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Removes and adds back an object's instances */
+static void
+check_remove(void)
+{
+  int i = OBJECTS / 2;
+  int j;
+
+  for(j = 0; j < INSTANCES; j += 2) {
+    lwm2m_engine_remove_object(&instances[i][j]);
+  }
+  for(j = 0; j < INSTANCES; j++) {
+    if(lwm2m_engine_has_instance(OBJECT_ID(i), j) != (j & 1)) {
+      errors++;
+    }
+  }
+  for(j = 0; j < INSTANCES; j += 2) {
+    if(!lwm2m_engine_add_object(&instances[i][j])) {
+      errors++;
+    }
+  }
+  for(j = 0; j < INSTANCES; j++) {
+    if(!lwm2m_engine_has_instance(OBJECT_ID(i), j)) {
+      errors++;
+    }
+  }
+  lwm2m_engine_remove_generic_object(&generics[0].object);
+  if(lwm2m_engine_has_instance(GENERIC_ID(0), 0)) {
+    errors++;
+  }
+  if(!lwm2m_engine_add_generic_object(&generics[0].object) ||
+     !lwm2m_engine_has_instance(GENERIC_ID(0), 0)) {
+    errors++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(bench_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+  printf("LWM2M lookup benchmark: %u objects, %u instances, "
+         "index of %u\n", OBJECTS + GENERIC_OBJECTS,
+         OBJECTS * INSTANCES + (GENERIC_OBJECTS - 1) * GENERIC_INSTANCES,
+         LWM2M_ENGINE_CONF_INSTANCE_INDEX_SIZE);
+
+  lwm2m_engine_init();
+
+  register_objects();
+  bench_lookups();
+  bench_reads();
+  bench_rd_data();
+  check_remove();
+
+  printf("Benchmark done: %s\n", errors == 0 ? "OK" : "FAIL");
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
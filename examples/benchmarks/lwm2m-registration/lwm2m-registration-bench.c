@@ -0,0 +1,320 @@
+/*
+ * Copyright (c) 2018, RISE SICS.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Native benchmark of LWM2M registration and updates: a client
+ *         with a large object list registers, then updates its
+ *         registration after object instances were removed and added
+ *         again, and after new instances were added. The server is
+ *         simulated by the network driver.
+ */
+
+#include "contiki.h"
+#include "coap-engine.h"
+#include "lwm2m-engine.h"
+#include "lwm2m-object.h"
+#include "lwm2m-rd-client.h"
+#include "net/ipv6/uip.h"
+#include "net/ipv6/uip-ds6-nbr.h"
+#include "net/ipv6/uiplib.h"
+#include "net/netstack.h"
+
+#include <stdio.h>
+#include <string.h>
+/*---------------------------------------------------------------------------*/
+#define INSTANCES       32
+#define ROUNDS          12
+/* Every CHANGE_INTERVAL round adds an instance, the others change nothing */
+#define CHANGE_INTERVAL 4
+#define ADDED           (ROUNDS / CHANGE_INTERVAL)
+
+#define SERVER_PORT     5683
+#define REPLIES         4
+#define MAX_LIST        1024
+
+#define UIP_IP_BUF ((struct uip_udpip_hdr *)&uip_buf[UIP_LLH_LEN])
+/*---------------------------------------------------------------------------*/
+static const lwm2m_resource_id_t resources[] = { RO(5700) };
+static lwm2m_object_instance_t instances[INSTANCES + ADDED];
+
+static coap_endpoint_t server_ep;
+
+/* Replies of the server, delivered by reply_process */
+static struct {
+  uint8_t message[COAP_MAX_HEADER_SIZE];
+  uint16_t len;
+} replies[REPLIES];
+static int reply_count;
+
+static coap_message_t message[1];
+static coap_message_t reply[1];
+static uint8_t buffer[COAP_MAX_PACKET_SIZE];
+
+/* The object list as received by the server */
+static char server_list[MAX_LIST + 1];
+static int server_list_len;
+static unsigned long server_updates;
+static int errors;
+
+PROCESS(bench_process, "LWM2M registration benchmark");
+PROCESS(reply_process, "LWM2M registration replies");
+AUTOSTART_PROCESSES(&bench_process, &reply_process);
+/*---------------------------------------------------------------------------*/
+static lwm2m_status_t
+lwm2m_callback(lwm2m_object_instance_t *object, lwm2m_context_t *ctx)
+{
+  if(ctx->operation != LWM2M_OP_READ) {
+    return LWM2M_STATUS_NOT_IMPLEMENTED;
+  }
+  lwm2m_object_write_int(ctx, object->instance_id);
+  return LWM2M_STATUS_OK;
+}
+/*---------------------------------------------------------------------------*/
+static void
+init(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+static void
+input(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+static void
+add_reply(void)
+{
+  if(reply_count == REPLIES) {
+    errors++;
+    return;
+  }
+  replies[reply_count].len =
+    coap_serialize_message(reply, replies[reply_count].message);
+  reply_count++;
+  process_poll(&reply_process);
+}
+/*---------------------------------------------------------------------------*/
+/* The server, that collects the object list of Register and Update */
+static uint8_t
+output(const linkaddr_t *localdest)
+{
+  uint16_t len = uip_len - UIP_IPUDPH_LEN;
+  const char *path;
+  int path_len;
+  uint32_t block = 0;
+  uint8_t more = 0;
+  uint16_t size = 0;
+  int has_block;
+
+  if(uip_len == 0 || UIP_IP_BUF->proto != UIP_PROTO_UDP ||
+     UIP_IP_BUF->destport != UIP_HTONS(SERVER_PORT)) {
+    return 0;
+  }
+  memcpy(buffer, &uip_buf[UIP_LLH_LEN + UIP_IPUDPH_LEN], len);
+  if(coap_parse_message(message, buffer, len) != NO_ERROR ||
+     message->code != COAP_POST) {
+    errors++;
+    return 0;
+  }
+
+  has_block = coap_get_header_block1(message, &block, &more, &size, NULL);
+  if(message->payload_len > 0) {
+    if(block == 0) {
+      server_list_len = 0;
+    }
+    if(server_list_len + message->payload_len > MAX_LIST) {
+      errors++;
+      return 0;
+    }
+    memcpy(&server_list[server_list_len], message->payload,
+           message->payload_len);
+    server_list_len += message->payload_len;
+    server_list[server_list_len] = '\0';
+  }
+
+  coap_init_message(reply, COAP_TYPE_ACK, CHANGED_2_04, message->mid);
+  coap_set_token(reply, message->token, message->token_len);
+  if(has_block) {
+    coap_set_header_block1(reply, block, more, size);
+  }
+  path_len = coap_get_header_uri_path(message, &path);
+  if(more) {
+    reply->code = CONTINUE_2_31;
+  } else if(path_len == 2 && strncmp(path, "rd", 2) == 0) {
+    reply->code = CREATED_2_01;
+    coap_set_header_location_path(reply, "rd/bench");
+  } else {
+    server_updates++;
+  }
+  add_reply();
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+const struct network_driver bench_net_driver = {
+  "bench",
+  init,
+  input,
+  output
+};
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(reply_process, ev, data)
+{
+  static uint8_t message[COAP_MAX_HEADER_SIZE];
+  int i;
+  uint16_t len;
+
+  PROCESS_BEGIN();
+
+  while(1) {
+    PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL);
+    for(i = 0; i < reply_count; i++) {
+      len = replies[i].len;
+      memcpy(message, replies[i].message, len);
+      coap_receive(&server_ep, message, len);
+    }
+    reply_count = 0;
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+static void
+add_instance(int i)
+{
+  instances[i].object_id = 3303;
+  instances[i].instance_id = i;
+  instances[i].resource_ids = resources;
+  instances[i].resource_count = 1;
+  instances[i].callback = lwm2m_callback;
+  lwm2m_engine_add_object(&instances[i]);
+}
+/*---------------------------------------------------------------------------*/
+/* The object list of the engine, as the server should have it */
+static int
+list_matches(void)
+{
+  static char list[MAX_LIST + 1];
+  lwm2m_buffer_t outbuf;
+  int len = 0;
+  int block = 0;
+  int more;
+
+  do {
+    outbuf.buffer = (uint8_t *)&list[len];
+    outbuf.size = COAP_MAX_BLOCK_SIZE;
+    outbuf.len = 0;
+    more = lwm2m_engine_set_rd_data(&outbuf, block++);
+    len += outbuf.len;
+  } while(more && len + COAP_MAX_BLOCK_SIZE <= MAX_LIST);
+  list[len] = '\0';
+
+  return strcmp(list, server_list) == 0;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(bench_process, ev, data)
+{
+  static struct etimer timer;
+  static int round;
+  static int waited;
+  static int added;
+  static lwm2m_rd_client_stats_t registration;
+  static const lwm2m_rd_client_stats_t *stats;
+  uip_lladdr_t lladdr;
+  int i;
+
+  PROCESS_BEGIN();
+
+  uiplib_ipaddrconv("fe80::1", &server_ep.ipaddr);
+  server_ep.port = UIP_HTONS(SERVER_PORT);
+  /* A reachable neighbor, so that no neighbor discovery is needed */
+  memset(&lladdr, 0, sizeof(lladdr));
+  lladdr.addr[0] = 1;
+  uip_ds6_nbr_add(&server_ep.ipaddr, &lladdr, 0, NBR_REACHABLE,
+                  NBR_TABLE_REASON_UNDEFINED, NULL);
+
+  lwm2m_engine_init();
+  for(i = 0; i < INSTANCES; i++) {
+    add_instance(i);
+  }
+
+  lwm2m_rd_client_register_with_server(&server_ep);
+  lwm2m_rd_client_use_registration_server(1);
+  for(waited = 0; !lwm2m_rd_client_is_registered() && waited < 100; waited++) {
+    etimer_set(&timer, CLOCK_SECOND / 20);
+    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&timer));
+  }
+  stats = lwm2m_rd_client_get_stats();
+  registration = *stats;
+  if(!lwm2m_rd_client_is_registered() || !list_matches()) {
+    printf("Registration failed\n");
+    errors++;
+  }
+
+  printf("LWM2M registration benchmark: %u instances, %u bytes of object "
+         "list\n", INSTANCES, server_list_len);
+  printf("Register: %lu packets, %lu bytes, %lu ms\n",
+         (unsigned long)registration.packets,
+         (unsigned long)registration.payload_bytes,
+         (unsigned long)registration.registration_time);
+
+  for(round = 1; round <= ROUNDS; round++) {
+    if(round % CHANGE_INTERVAL == 0) {
+      add_instance(INSTANCES + added++);
+    } else {
+      /* The same object list, but the engine does not know that */
+      lwm2m_engine_remove_object(&instances[0]);
+      lwm2m_engine_add_object(&instances[0]);
+    }
+    lwm2m_rd_client_update_triggered();
+    for(waited = 0; server_updates < round && waited < 100; waited++) {
+      etimer_set(&timer, CLOCK_SECOND / 20);
+      PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&timer));
+    }
+    /* Until the client has the response */
+    etimer_set(&timer, CLOCK_SECOND / 20);
+    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&timer));
+    if(server_updates < round || !list_matches()) {
+      printf("Update %d failed\n", round);
+      errors++;
+    }
+  }
+
+  printf("Updates: %lu, with the object list: %lu, %lu packets, "
+         "%lu bytes\n",
+         (unsigned long)stats->updates,
+         (unsigned long)stats->update_lists,
+         (unsigned long)(stats->packets - registration.packets),
+         (unsigned long)(stats->payload_bytes - registration.payload_bytes));
+
+  printf("Benchmark done: %s\n", errors == 0 ? "OK" : "FAIL");
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
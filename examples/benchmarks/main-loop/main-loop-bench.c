@@ -0,0 +1,208 @@
+/*
+ * Copyright (c) 2018, RISE SICS.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * \file
+ *         Native benchmark of the platform main loop: CPU time used while
+ *         waiting for an event timer, how late event timers expire, and
+ *         the round-trip time of a message through a socket pair watched
+ *         by the main loop. Set SELECT_CONF_EPOLL to 0 in project-conf.h
+ *         to compare against the select() main loop.
+ */
+
+#include "contiki.h"
+#include "lib/random.h"
+
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+/*---------------------------------------------------------------------------*/
+#define IDLE_TIME    (2 * CLOCK_SECOND)
+#define TIMERS       100
+#define ROUND_TRIPS  50000UL
+/*---------------------------------------------------------------------------*/
+static int fds[2];
+static unsigned long round_trips;
+static int errors;
+
+PROCESS(bench_process, "Main loop benchmark");
+AUTOSTART_PROCESSES(&bench_process);
+/*---------------------------------------------------------------------------*/
+static unsigned long long
+now_us(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+/*---------------------------------------------------------------------------*/
+static unsigned long long
+cpu_us(void)
+{
+  struct rusage usage;
+
+  getrusage(RUSAGE_SELF, &usage);
+  return (unsigned long long)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) *
+         1000000 + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+/*---------------------------------------------------------------------------*/
+static int
+set_fd(fd_set *rset, fd_set *wset)
+{
+  FD_SET(fds[0], rset);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/* Echo each byte back to the other end, until enough round trips */
+static void
+handle_fd(fd_set *rset, fd_set *wset)
+{
+  char c;
+
+  if(!FD_ISSET(fds[0], rset) || read(fds[0], &c, 1) != 1) {
+    return;
+  }
+  if(++round_trips < ROUND_TRIPS) {
+    if(write(fds[0], &c, 1) != 1) {
+      errors++;
+    }
+  } else {
+    process_poll(&bench_process);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static const struct select_callback callback = { set_fd, handle_fd };
+/*---------------------------------------------------------------------------*/
+/* The other end of the socket pair, answering right away */
+static int
+peer_set_fd(fd_set *rset, fd_set *wset)
+{
+  FD_SET(fds[1], rset);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+peer_handle_fd(fd_set *rset, fd_set *wset)
+{
+  char c;
+
+  if(FD_ISSET(fds[1], rset) && read(fds[1], &c, 1) == 1 &&
+     write(fds[1], &c, 1) != 1) {
+    errors++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static const struct select_callback peer_callback = {
+  peer_set_fd, peer_handle_fd
+};
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(bench_process, ev, data)
+{
+  static struct etimer et;
+  static unsigned long long start;
+  static unsigned long long cpu_start;
+  static unsigned long long late;
+  static unsigned long long max_late;
+  static clock_time_t interval;
+  static int i;
+  unsigned long long elapsed;
+
+  PROCESS_BEGIN();
+
+  printf("Main loop benchmark, %s\n", SELECT_CONF_EPOLL ? "epoll" : "select");
+
+  /* Wait for an event timer with nothing else to do */
+  cpu_start = cpu_us();
+  etimer_set(&et, IDLE_TIME);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+  printf("Idle: %llu us of CPU time per second\n",
+         (cpu_us() - cpu_start) * CLOCK_SECOND / IDLE_TIME);
+
+  /* Expiration of event timers of 1 to 20 ticks */
+  random_init(0x1234);
+  late = max_late = 0;
+  for(i = 0; i < TIMERS; i++) {
+    interval = 1 + random_rand() % 20;
+    /* Start on a tick, so that the timer expires on a tick */
+    etimer_set(&et, 1);
+    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+    start = now_us();
+    etimer_set(&et, interval);
+    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+    elapsed = now_us() - start;
+    if(elapsed + 1000000 / CLOCK_SECOND < interval * 1000000 / CLOCK_SECOND) {
+      /* Expired early, by more than a tick */
+      errors++;
+    } else if(elapsed > interval * 1000000 / CLOCK_SECOND) {
+      elapsed -= interval * 1000000 / CLOCK_SECOND;
+      late += elapsed;
+      if(elapsed > max_late) {
+        max_late = elapsed;
+      }
+    }
+  }
+  printf("Event timers: %llu us late on average, %llu us at most\n",
+         late / TIMERS, max_late);
+
+  /* Round trips through the main loop */
+  if(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1) {
+    perror("socketpair");
+    errors++;
+  } else {
+    select_set_callback(fds[0], &callback);
+    select_set_callback(fds[1], &peer_callback);
+    start = now_us();
+    cpu_start = cpu_us();
+    if(write(fds[0], "x", 1) != 1) {
+      errors++;
+    }
+    etimer_set(&et, 10 * CLOCK_SECOND);
+    PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL || etimer_expired(&et));
+    if(round_trips != ROUND_TRIPS) {
+      errors++;
+    }
+    printf("Socket pair: %llu ns per round trip, %llu ns of CPU time\n",
+           (now_us() - start) * 1000 / round_trips,
+           (cpu_us() - cpu_start) * 1000 / round_trips);
+    select_set_callback(fds[0], NULL);
+    select_set_callback(fds[1], NULL);
+    close(fds[0]);
+    close(fds[1]);
+  }
+
+  printf("Benchmark done: %s\n", errors == 0 ? "OK" : "FAIL");
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2018, RISE SICS.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * \file
+ *         Native benchmark of memory block allocation: cost of
+ *         memb_alloc() and memb_free() as a function of the pool size,
+ *         when filling and emptying a pool and when churning a mostly
+ *         full pool. Ends with the per-pool statistics. Build with
+ *         MEMB_BITMAP=0 to compare against the linear scan.
+ */
+
+#include "contiki.h"
+#include "lib/memb.h"
+#include "lib/random.h"
+
+#include <stdio.h>
+/*---------------------------------------------------------------------------*/
+#define MAX_BLOCKS 1024
+/* Number of allocations and deallocations per measurement */
+#define OPS        400000UL
+/*---------------------------------------------------------------------------*/
+struct block {
+  uint8_t data[32];
+};
+
+MEMB(pool_16, struct block, 16);
+MEMB(pool_64, struct block, 64);
+MEMB(pool_256, struct block, 256);
+MEMB(pool_1024, struct block, 1024);
+
+static struct block *blocks[MAX_BLOCKS];
+static int errors;
+
+PROCESS(bench_process, "Memb benchmark");
+AUTOSTART_PROCESSES(&bench_process);
+/*---------------------------------------------------------------------------*/
+static unsigned long
+ns_per_op(clock_time_t elapsed, unsigned long ops)
+{
+  return (unsigned long)((unsigned long long)elapsed *
+                         (1000000000ULL / CLOCK_SECOND) / ops);
+}
+/*---------------------------------------------------------------------------*/
+static void
+shuffle(int num)
+{
+  int i, j;
+  struct block *tmp;
+
+  for(i = num - 1; i > 0; i--) {
+    j = random_rand() % (i + 1);
+    tmp = blocks[i];
+    blocks[i] = blocks[j];
+    blocks[j] = tmp;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+run(struct memb *m)
+{
+  unsigned long rounds = OPS / m->num;
+  unsigned long r;
+  unsigned long churn;
+  clock_time_t start;
+  clock_time_t fill_time;
+  clock_time_t churn_time;
+  int i;
+
+  memb_init(m);
+
+  /* Fill the pool, then empty it in random order */
+  fill_time = 0;
+  for(r = 0; r < rounds; r++) {
+    start = clock_time();
+    for(i = 0; i < m->num; i++) {
+      blocks[i] = memb_alloc(m);
+    }
+    fill_time += clock_time() - start;
+    if(memb_alloc(m) != NULL) {
+      errors++;
+    }
+    shuffle(m->num);
+    start = clock_time();
+    for(i = 0; i < m->num; i++) {
+      if(memb_free(m, blocks[i]) != 0) {
+        errors++;
+      }
+    }
+    fill_time += clock_time() - start;
+  }
+  if(memb_numfree(m) != m->num) {
+    errors++;
+  }
+
+  /* Keep the pool 3/4 full, freeing and allocating random blocks */
+  for(i = 0; i < m->num * 3 / 4; i++) {
+    blocks[i] = memb_alloc(m);
+  }
+  start = clock_time();
+  for(churn = 0; churn < OPS; churn++) {
+    i = random_rand() % (m->num * 3 / 4);
+    memb_free(m, blocks[i]);
+    blocks[i] = memb_alloc(m);
+    if(blocks[i] == NULL) {
+      errors++;
+      break;
+    }
+  }
+  churn_time = clock_time() - start;
+  for(i = 0; i < m->num * 3 / 4; i++) {
+    memb_free(m, blocks[i]);
+  }
+
+  printf("%4u blocks: fill/empty %5lu ns, churn %5lu ns per alloc+free\n",
+         m->num, ns_per_op(fill_time, rounds * m->num),
+         ns_per_op(churn_time, OPS));
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(bench_process, ev, data)
+{
+  struct memb *m;
+
+  PROCESS_BEGIN();
+
+  printf("Memb benchmark, %s\n",
+         MEMB_WITH_BITMAP ? "bitmap" : "linear scan");
+
+  random_init(0x1234);
+  run(&pool_16);
+  run(&pool_64);
+  run(&pool_256);
+  run(&pool_1024);
+
+  printf("Pool statistics:\n");
+  for(m = memb_stats_list(); m != NULL; m = m->next) {
+    printf("-- %s: %u blocks of %u bytes, %u used, max %u, %lu failed\n",
+           m->name, m->num, m->size, m->nused, m->max_used,
+           (unsigned long)m->failures);
+    if(m->nused != 0 || m->max_used != m->num) {
+      errors++;
+    }
+  }
+
+  printf("Benchmark done: %s\n", errors == 0 ? "OK" : "FAIL");
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2018, RISE SICS.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * \file
+ *         Native micro-benchmark of neighbor table lookups. Grows a neighbor
+ *         table step by step and measures the cost of a successful and of a
+ *         failed nbr_table_get_from_lladdr() at each table size.
+ *         Build with NBR_TABLE_HASH=0 to compare against the list walk.
+ */
+
+#include "contiki.h"
+#include "net/nbr-table.h"
+#include "lib/random.h"
+
+#include <stdio.h>
+#include <string.h>
+/*---------------------------------------------------------------------------*/
+#define LOOKUPS 200000UL
+/*---------------------------------------------------------------------------*/
+typedef struct {
+  linkaddr_t addr;
+} bench_nbr_t;
+
+NBR_TABLE(bench_nbr_t, bench_nbrs);
+
+static linkaddr_t addrs[NBR_TABLE_MAX_NEIGHBORS];
+static unsigned errors;
+/*---------------------------------------------------------------------------*/
+PROCESS(nbr_table_bench_process, "Neighbor table benchmark");
+AUTOSTART_PROCESSES(&nbr_table_bench_process);
+/*---------------------------------------------------------------------------*/
+static void
+make_addr(linkaddr_t *addr, unsigned i, int missing)
+{
+  memset(addr, 0, sizeof(linkaddr_t));
+  addr->u8[0] = missing ? 0x80 : 0x02;
+  addr->u8[LINKADDR_SIZE - 2] = i >> 8;
+  addr->u8[LINKADDR_SIZE - 1] = i & 0xff;
+}
+/*---------------------------------------------------------------------------*/
+/* Returns the average lookup time in nanoseconds */
+static unsigned long
+bench_lookups(unsigned size, int missing)
+{
+  unsigned long i;
+  clock_time_t start;
+  clock_time_t elapsed;
+  linkaddr_t miss;
+  bench_nbr_t *nbr;
+
+  start = clock_time();
+  for(i = 0; i < LOOKUPS; i++) {
+    if(missing) {
+      make_addr(&miss, i % size, 1);
+      nbr = nbr_table_get_from_lladdr(bench_nbrs, &miss);
+      if(nbr != NULL) {
+        errors++;
+      }
+    } else {
+      const linkaddr_t *addr = &addrs[i % size];
+      nbr = nbr_table_get_from_lladdr(bench_nbrs, addr);
+      if(nbr == NULL || !linkaddr_cmp(&nbr->addr, addr)) {
+        errors++;
+      }
+    }
+  }
+  elapsed = clock_time() - start;
+
+  return (unsigned long)elapsed * (1000000000UL / CLOCK_SECOND) / LOOKUPS;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(nbr_table_bench_process, ev, data)
+{
+  unsigned size;
+  unsigned i;
+  bench_nbr_t *nbr;
+
+  PROCESS_BEGIN();
+
+  nbr_table_register(bench_nbrs, NULL);
+
+  printf("Neighbor table lookup benchmark, hash index %s\n",
+         NBR_TABLE_WITH_LLADDR_HASH ? "enabled" : "disabled");
+  printf("%8s %12s %12s\n", "size", "hit (ns)", "miss (ns)");
+
+  size = 0;
+  for(i = 8; i <= NBR_TABLE_MAX_NEIGHBORS; i *= 2) {
+    /* Grow the table to i entries */
+    for(; size < i; size++) {
+      make_addr(&addrs[size], random_rand() ^ (size << 8), 0);
+      addrs[size].u8[1] = size >> 8;
+      addrs[size].u8[2] = size & 0xff;
+      nbr = nbr_table_add_lladdr(bench_nbrs, &addrs[size],
+                                 NBR_TABLE_REASON_UNDEFINED, NULL);
+      if(nbr == NULL) {
+        printf("Failed to add neighbor %u\n", size);
+        errors++;
+        break;
+      }
+      linkaddr_copy(&nbr->addr, &addrs[size]);
+    }
+    printf("%8u %12lu %12lu\n", size,
+           bench_lookups(size, 0), bench_lookups(size, 1));
+  }
+
+  /* Drop every other neighbor, then add as many new ones: the table is
+   * full, so each insertion evicts a dropped entry from the index */
+  for(i = 0; i < size; i += 2) {
+    nbr_table_remove(bench_nbrs, nbr_table_get_from_lladdr(bench_nbrs, &addrs[i]));
+  }
+  for(i = 0; i < size; i += 2) {
+    make_addr(&addrs[i], i, 1);
+    nbr = nbr_table_add_lladdr(bench_nbrs, &addrs[i],
+                               NBR_TABLE_REASON_UNDEFINED, NULL);
+    if(nbr == NULL) {
+      errors++;
+      continue;
+    }
+    linkaddr_copy(&nbr->addr, &addrs[i]);
+  }
+  for(i = 0; i < size; i++) {
+    nbr = nbr_table_get_from_lladdr(bench_nbrs, &addrs[i]);
+    if(nbr == NULL || !linkaddr_cmp(&nbr->addr, &addrs[i])) {
+      errors++;
+    }
+  }
+
+  printf("Benchmark done, %u errors\n", errors);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2018, RISE SICS.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * \file
+ *         Native benchmark of the process event queue: event throughput,
+ *         number of events delivered ahead of a timer event posted behind
+ *         a burst, and coalescing of duplicate events.
+ *         Build with PRIORITIES=1 COALESCE=0 to compare against the plain
+ *         FIFO queue.
+ */
+
+#include "contiki.h"
+
+#include <stdio.h>
+/*---------------------------------------------------------------------------*/
+#define THROUGHPUT_EVENTS 1000000UL
+#define BURST             16
+/* Leave room in the queue for the events of the benchmark itself */
+#define FLOOD             (PROCESS_CONF_NUMEVENTS - 4)
+/*---------------------------------------------------------------------------*/
+PROCESS(bench_process, "Event queue benchmark");
+PROCESS(sink_process, "Event sink");
+PROCESS(timer_process, "Timer event receiver");
+AUTOSTART_PROCESSES(&sink_process, &timer_process, &bench_process);
+
+static process_event_t sink_event;
+static unsigned long sink_count;
+static unsigned long count_at_timer;
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(sink_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+  while(1) {
+    PROCESS_WAIT_EVENT_UNTIL(ev == sink_event);
+    sink_count++;
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(timer_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+  while(1) {
+    PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_TIMER);
+    count_at_timer = sink_count;
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+/* Delivers all queued events right away. The native main loop sleeps in
+ * select() between events, which would dominate the measurements */
+static void
+drain(void)
+{
+  struct process *self = PROCESS_CURRENT();
+
+  while(process_nevents() > 0) {
+    process_run();
+  }
+  process_current = self;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(bench_process, ev, data)
+{
+  unsigned long i;
+  unsigned long elapsed;
+  clock_time_t start;
+  int j;
+  struct process_stats stats;
+
+  PROCESS_BEGIN();
+
+  sink_event = process_alloc_event();
+
+  printf("Event queue benchmark, %u priority level(s), coalescing %s\n",
+         PROCESS_CONF_NUM_PRIORITIES,
+         PROCESS_CONF_COALESCE_EVENTS ? "enabled" : "disabled");
+
+  /* Throughput: distinct events posted in bursts and drained */
+  sink_count = 0;
+  start = clock_time();
+  for(i = 0; i < THROUGHPUT_EVENTS; i += BURST) {
+    for(j = 0; j < BURST; j++) {
+      process_post(&sink_process, sink_event, (process_data_t)(uintptr_t)j);
+    }
+    drain();
+  }
+  elapsed = clock_time() - start;
+  printf("Throughput: %lu events in %lu ms, %lu ns/event\n",
+         sink_count, elapsed * 1000 / CLOCK_SECOND,
+         elapsed * (1000000000UL / CLOCK_SECOND) / sink_count);
+
+  /* Latency: a timer event posted behind a flood of other events */
+  sink_count = 0;
+  process_stats_reset();
+  for(j = 0; j < FLOOD; j++) {
+    process_post(&sink_process, sink_event, (process_data_t)(uintptr_t)j);
+  }
+  process_post(&timer_process, PROCESS_EVENT_TIMER, NULL);
+  drain();
+  process_stats_get(&stats);
+  printf("Latency: %lu of %u events delivered before the timer event, queue high-water mark %u\n",
+         count_at_timer, FLOOD, stats.maxevents);
+
+  /* Coalescing: the same event posted repeatedly */
+  sink_count = 0;
+  process_stats_reset();
+  for(j = 0; j < FLOOD; j++) {
+    process_post(&sink_process, sink_event, NULL);
+  }
+  drain();
+  process_stats_get(&stats);
+  printf("Coalescing: %u identical events posted, %lu delivered, %lu coalesced, %lu dropped\n",
+         FLOOD, sink_count, (unsigned long)stats.coalesced,
+         (unsigned long)stats.dropped);
+
+  printf("Benchmark done\n");
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
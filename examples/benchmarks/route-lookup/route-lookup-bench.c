@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) 2018, RISE SICS.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * \file
+ *         Native micro-benchmark of uip_ds6_route_lookup(). Grows the
+ *         routing table with host routes and /64 prefixes, measures the
+ *         lookup cost at each table size and cross-checks every result
+ *         against a brute-force longest-prefix match over the route list.
+ *         Build with ROUTE_TRIE=0 to compare against the list walk.
+ */
+
+#include "contiki.h"
+#include "net/ipv6/uip-ds6.h"
+#include "net/ipv6/uip-ds6-route.h"
+#include "net/ipv6/uip-ds6-nbr.h"
+#include "lib/random.h"
+
+#include <stdio.h>
+#include <string.h>
+/*---------------------------------------------------------------------------*/
+#define LOOKUPS      100000UL
+#define NUM_NEXTHOPS 4
+#define BLOCK_SIZE   16
+/*---------------------------------------------------------------------------*/
+static uip_ipaddr_t nexthops[NUM_NEXTHOPS];
+static uip_ipaddr_t dests[UIP_DS6_ROUTE_NB];
+static unsigned errors;
+/*---------------------------------------------------------------------------*/
+PROCESS(route_lookup_bench_process, "Route lookup benchmark");
+AUTOSTART_PROCESSES(&route_lookup_bench_process);
+/*---------------------------------------------------------------------------*/
+static uip_ds6_route_t *
+reference_lookup(const uip_ipaddr_t *addr)
+{
+  uip_ds6_route_t *r;
+  uip_ds6_route_t *found_route = NULL;
+
+  for(r = uip_ds6_route_head(); r != NULL; r = uip_ds6_route_next(r)) {
+    if((found_route == NULL || r->length > found_route->length) &&
+       uip_ipaddr_prefixcmp(addr, &r->ipaddr, r->length)) {
+      found_route = r;
+    }
+  }
+  return found_route;
+}
+/*---------------------------------------------------------------------------*/
+/* Route i lives in /64 block i / BLOCK_SIZE. The last route of each block
+   is the /64 prefix itself, the others are host routes */
+static void
+add_route(unsigned i)
+{
+  uip_ipaddr_t *addr = &dests[i];
+  unsigned block = i / BLOCK_SIZE;
+  uint8_t length = 128;
+
+  uip_ip6addr(addr, 0xfd00, 0, block >> 8, block & 0xff,
+              random_rand(), random_rand(), random_rand(), i);
+  if(i % BLOCK_SIZE == BLOCK_SIZE - 1) {
+    memset(&addr->u8[8], 0, 8);
+    length = 64;
+  }
+  if(uip_ds6_route_add(addr, length, &nexthops[i % NUM_NEXTHOPS]) == NULL) {
+    printf("Failed to add route %u\n", i);
+    errors++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+random_dest(uip_ipaddr_t *addr, unsigned num_routes)
+{
+  unsigned block;
+
+  switch(random_rand() % 4) {
+  case 0:
+  case 1:
+    /* A known host, or the address of a /64 prefix */
+    uip_ipaddr_copy(addr, &dests[random_rand() % num_routes]);
+    break;
+  case 2:
+    /* Unknown host inside a known /64 */
+    block = random_rand() % (num_routes / BLOCK_SIZE);
+    uip_ip6addr(addr, 0xfd00, 0, block >> 8, block & 0xff,
+                random_rand(), random_rand(), random_rand(), random_rand());
+    break;
+  default:
+    /* No route */
+    uip_ip6addr(addr, 0x2001, 0xdb8, 0, random_rand(),
+                random_rand(), random_rand(), random_rand(), random_rand());
+    break;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+check_lookups(unsigned num_routes, unsigned count)
+{
+  uip_ipaddr_t addr;
+
+  while(count--) {
+    random_dest(&addr, num_routes);
+    if(uip_ds6_route_lookup(&addr) != reference_lookup(&addr)) {
+      errors++;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Returns the average lookup time in nanoseconds */
+static unsigned long
+bench_lookups(unsigned num_routes)
+{
+  static uip_ipaddr_t addrs[256];
+  unsigned long i;
+  clock_time_t start;
+
+  for(i = 0; i < 256; i++) {
+    random_dest(&addrs[i], num_routes);
+  }
+
+  start = clock_time();
+  for(i = 0; i < LOOKUPS; i++) {
+    uip_ds6_route_lookup(&addrs[i & 0xff]);
+  }
+  return (unsigned long)(clock_time() - start) *
+    (1000000000UL / CLOCK_SECOND) / LOOKUPS;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(route_lookup_bench_process, ev, data)
+{
+  unsigned num_routes;
+  unsigned size;
+  unsigned i;
+  uip_lladdr_t lladdr;
+  uip_ds6_route_t *r;
+
+  PROCESS_BEGIN();
+
+  for(i = 0; i < NUM_NEXTHOPS; i++) {
+    uip_ip6addr(&nexthops[i], 0xfe80, 0, 0, 0, 0, 0, 0, i + 1);
+    memset(&lladdr, 0, sizeof(lladdr));
+    lladdr.addr[sizeof(lladdr.addr) - 1] = i + 1;
+    uip_ds6_nbr_add(&nexthops[i], &lladdr, 1, NBR_REACHABLE,
+                    NBR_TABLE_REASON_UNDEFINED, NULL);
+  }
+
+  printf("Route lookup benchmark, trie index %s\n",
+         UIP_DS6_ROUTE_WITH_TRIE ? "enabled" : "disabled");
+  printf("%8s %12s\n", "routes", "lookup (ns)");
+
+  num_routes = 0;
+  for(size = 2 * BLOCK_SIZE; size <= UIP_DS6_ROUTE_NB; size *= 2) {
+    for(; num_routes < size; num_routes++) {
+      add_route(num_routes);
+    }
+    check_lookups(num_routes, 1000);
+    printf("%8u %12lu\n", uip_ds6_route_num_routes(), bench_lookups(num_routes));
+  }
+
+  /* Remove a third of the routes and check again */
+  for(i = 0; i < num_routes; i += 3) {
+    r = uip_ds6_route_lookup(&dests[i]);
+    if(r == NULL) {
+      errors++;
+    } else if(r->length == 128) {
+      uip_ds6_route_rm(r);
+    }
+  }
+  check_lookups(num_routes, 10000);
+
+  printf("Benchmark done, %u errors\n", errors);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2018, RISE SICS.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * \file
+ *         Native benchmark of the real-time scheduler: several periodic
+ *         real-time tasks share the rtimer, and the number of runs and
+ *         the lateness of each task are reported. Also checks that
+ *         tasks due at the same time run in the order they were set,
+ *         and that a pending task set again to an earlier time runs then.
+ *         Build with RTIMER_MULTIPLE=0 to compare against the
+ *         single-task rtimer.
+ */
+
+#include "contiki.h"
+
+#include <stdio.h>
+/*---------------------------------------------------------------------------*/
+#define DURATION (5 * CLOCK_SECOND)
+#define TICKS_TO_US(t) ((unsigned long)((unsigned long long)(t) * 1000000 / RTIMER_SECOND))
+/*---------------------------------------------------------------------------*/
+struct task {
+  struct rtimer timer;
+  rtimer_clock_t period;
+  unsigned long runs;
+  unsigned long total_lateness;
+  rtimer_clock_t max_lateness;
+};
+
+static struct task tasks[] = {
+  { .period = RTIMER_SECOND / 100 },
+  { .period = RTIMER_SECOND / 70 },
+  { .period = RTIMER_SECOND / 50 },
+  { .period = RTIMER_SECOND / 30 },
+};
+#define NUM_TASKS (sizeof(tasks) / sizeof(tasks[0]))
+
+static struct rtimer order_timers[3];
+static char order[sizeof(order_timers) / sizeof(order_timers[0]) + 1];
+static int order_len;
+
+static struct rtimer earlier_timer;
+static rtimer_clock_t earlier_run;
+
+PROCESS(bench_process, "Rtimer jitter benchmark");
+AUTOSTART_PROCESSES(&bench_process);
+/*---------------------------------------------------------------------------*/
+static void
+periodic(struct rtimer *t, void *ptr)
+{
+  struct task *task = ptr;
+  rtimer_clock_t lateness = RTIMER_NOW() - RTIMER_TIME(t);
+
+  task->runs++;
+  task->total_lateness += lateness;
+  if(lateness > task->max_lateness) {
+    task->max_lateness = lateness;
+  }
+  rtimer_set(t, RTIMER_TIME(t) + task->period, 1, periodic, task);
+}
+/*---------------------------------------------------------------------------*/
+static void
+record_order(struct rtimer *t, void *ptr)
+{
+  if(order_len < sizeof(order) - 1) {
+    order[order_len++] = *(char *)ptr;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+record_run(struct rtimer *t, void *ptr)
+{
+  earlier_run = RTIMER_NOW();
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(bench_process, ev, data)
+{
+  static struct etimer et;
+  static rtimer_clock_t start;
+  static int ok;
+  rtimer_clock_t elapsed;
+  rtimer_clock_t now;
+  unsigned long expected;
+  unsigned i;
+
+  PROCESS_BEGIN();
+
+  printf("Rtimer jitter benchmark, %s rtimer, %u periodic tasks\n",
+         RTIMER_MULTIPLE ? "multi-task" : "single-task", (unsigned)NUM_TASKS);
+
+  /* Ordering: A and B are due at the same time, C later but set first */
+  now = RTIMER_NOW();
+  rtimer_set(&order_timers[2], now + RTIMER_SECOND / 10 + 1, 1,
+             record_order, "C");
+  rtimer_set(&order_timers[0], now + RTIMER_SECOND / 10, 1,
+             record_order, "A");
+  rtimer_set(&order_timers[1], now + RTIMER_SECOND / 10, 1,
+             record_order, "B");
+  etimer_set(&et, CLOCK_SECOND / 2);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+  printf("Order of tasks: \"%s\", expected \"ABC\"\n", order);
+  ok = order_len == 3 && order[0] == 'A' && order[1] == 'B' && order[2] == 'C';
+
+#if RTIMER_MULTIPLE
+  /* Earlier: the only pending task, still at the head when set again */
+  now = RTIMER_NOW();
+  rtimer_set(&earlier_timer, now + RTIMER_SECOND, 1, record_run, NULL);
+  rtimer_set(&earlier_timer, now + RTIMER_SECOND / 20, 1, record_run, NULL);
+  etimer_set(&et, CLOCK_SECOND / 4);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+  printf("Task set again to 50000 us: %s\n",
+         earlier_run != 0 ? "ran on time" : "not run");
+  if(earlier_run == 0) {
+    ok = 0;
+  }
+  rtimer_cancel(&earlier_timer);
+#endif /* RTIMER_MULTIPLE */
+
+  /* Jitter: periodic tasks sharing the rtimer */
+  start = RTIMER_NOW();
+  for(i = 0; i < NUM_TASKS; i++) {
+    rtimer_set(&tasks[i].timer, start + tasks[i].period, 1,
+               periodic, &tasks[i]);
+  }
+  etimer_set(&et, DURATION);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+  for(i = 0; i < NUM_TASKS; i++) {
+    rtimer_cancel(&tasks[i].timer);
+  }
+  elapsed = RTIMER_NOW() - start;
+
+  for(i = 0; i < NUM_TASKS; i++) {
+    expected = elapsed / tasks[i].period;
+    printf("Task %u: period %lu us, %lu of %lu runs, lateness mean %lu us, max %lu us\n",
+           i, TICKS_TO_US(tasks[i].period), tasks[i].runs, expected,
+           tasks[i].runs ? TICKS_TO_US(tasks[i].total_lateness) / tasks[i].runs : 0,
+           TICKS_TO_US(tasks[i].max_lateness));
+    if(tasks[i].runs + 2 < expected || tasks[i].runs > expected + 1) {
+      ok = 0;
+    }
+  }
+
+  printf("Benchmark done: %s\n", ok ? "OK" : "FAIL");
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,265 @@
+/*
+ * Copyright (c) 2018, RISE SICS.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * \file
+ *         Native benchmark of batched tun I/O, without a tun device: the
+ *         node reads ICMPv6 echo requests from one end of a socket pair
+ *         and writes the replies back to it, while a peer on the other
+ *         end sends bursts of requests. Reports the throughput and the
+ *         number of select() wakeups for several batch sizes, a batch
+ *         size of 1 being one packet per wakeup.
+ */
+
+#include "contiki.h"
+#include "net/netstack.h"
+#include "net/ipv6/uip.h"
+#include "net/ipv6/uip-ds6.h"
+#include "net/ipv6/uip-icmp6.h"
+#include "tun-batch.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+/*---------------------------------------------------------------------------*/
+/* Requests sent at once by the peer */
+#define BURST       TUN_BATCH_SIZE
+#define PAYLOAD_LEN 256
+/* Requests per measurement */
+#define PACKETS     100000UL
+
+#define UIP_IP_BUF   ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
+#define UIP_ICMP_BUF ((struct uip_icmp_hdr *)&uip_buf[uip_l2_l3_hdr_len])
+/*---------------------------------------------------------------------------*/
+static const int batch_sizes[] = { 1, 4, TUN_BATCH_SIZE };
+
+/* The node end and the peer end of the socket pair */
+static int node_fd;
+static int peer_fd;
+static struct tun_batch batch;
+static int batch_max;
+
+static uint8_t request[UIP_IPH_LEN + UIP_ICMPH_LEN + PAYLOAD_LEN];
+static uint8_t reply[TUN_BATCH_MTU];
+static unsigned long replies;
+static unsigned long expected;
+static int errors;
+
+PROCESS(bench_process, "Tun loopback benchmark");
+AUTOSTART_PROCESSES(&bench_process);
+/*---------------------------------------------------------------------------*/
+static void
+init(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+static void
+input(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t
+output(const linkaddr_t *localdest)
+{
+  if(uip_len > 0) {
+    tun_batch_write(&batch, &uip_buf[UIP_LLH_LEN], uip_len);
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+const struct network_driver bench_net_driver = {
+  "bench",
+  init,
+  input,
+  output
+};
+/*---------------------------------------------------------------------------*/
+static int
+node_set_fd(fd_set *rset, fd_set *wset)
+{
+  return tun_batch_set_fd(&batch, rset, wset);
+}
+/*---------------------------------------------------------------------------*/
+static void
+node_handle_fd(fd_set *rset, fd_set *wset)
+{
+  tun_batch_handle_fd(&batch, rset, wset, batch_max);
+}
+/*---------------------------------------------------------------------------*/
+static const struct select_callback node_callback = {
+  node_set_fd,
+  node_handle_fd
+};
+/*---------------------------------------------------------------------------*/
+static int
+peer_set_fd(fd_set *rset, fd_set *wset)
+{
+  FD_SET(peer_fd, rset);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+peer_handle_fd(fd_set *rset, fd_set *wset)
+{
+  ssize_t size;
+
+  if(!FD_ISSET(peer_fd, rset)) {
+    return;
+  }
+
+  while((size = read(peer_fd, reply, sizeof(reply))) > 0) {
+    if(size != sizeof(request) ||
+       reply[UIP_IPH_LEN] != ICMP6_ECHO_REPLY ||
+       memcmp(&reply[UIP_IPH_LEN + UIP_ICMPH_LEN],
+              &request[UIP_IPH_LEN + UIP_ICMPH_LEN], PAYLOAD_LEN) != 0) {
+      errors++;
+    }
+    replies++;
+  }
+  if(replies == expected) {
+    process_poll(&bench_process);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static const struct select_callback peer_callback = {
+  peer_set_fd,
+  peer_handle_fd
+};
+/*---------------------------------------------------------------------------*/
+/* Build an echo request from the peer to the node in the request buffer */
+static void
+make_request(void)
+{
+  uip_ds6_addr_t *lladdr;
+  int i;
+
+  lladdr = uip_ds6_get_link_local(-1);
+
+  memset(UIP_IP_BUF, 0, UIP_IPH_LEN + UIP_ICMPH_LEN);
+  UIP_IP_BUF->vtc = 0x60;
+  UIP_IP_BUF->proto = UIP_PROTO_ICMP6;
+  UIP_IP_BUF->ttl = 64;
+  UIP_IP_BUF->len[0] = (UIP_ICMPH_LEN + PAYLOAD_LEN) >> 8;
+  UIP_IP_BUF->len[1] = (UIP_ICMPH_LEN + PAYLOAD_LEN) & 0xff;
+  uip_ip6addr(&UIP_IP_BUF->srcipaddr,
+              0xfe80, 0, 0, 0, 0x0212, 0x7401, 0x0001, 0x0101);
+  uip_ipaddr_copy(&UIP_IP_BUF->destipaddr, &lladdr->ipaddr);
+  uip_ext_len = 0;
+  UIP_ICMP_BUF->type = ICMP6_ECHO_REQUEST;
+  for(i = 0; i < PAYLOAD_LEN; i++) {
+    uip_buf[UIP_LLH_LEN + UIP_IPH_LEN + UIP_ICMPH_LEN + i] = i;
+  }
+  uip_len = sizeof(request);
+  UIP_ICMP_BUF->icmpchksum = ~uip_icmp6chksum();
+  memcpy(request, &uip_buf[UIP_LLH_LEN], sizeof(request));
+  uip_clear_buf();
+}
+/*---------------------------------------------------------------------------*/
+static void
+send_burst(void)
+{
+  int i;
+
+  expected += BURST;
+  for(i = 0; i < BURST; i++) {
+    if(write(peer_fd, request, sizeof(request)) != sizeof(request)) {
+      errors++;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(bench_process, ev, data)
+{
+  static struct etimer et;
+  static clock_time_t start;
+  static clock_time_t elapsed;
+  static int i;
+  int fds[2];
+
+  PROCESS_BEGIN();
+
+  printf("Tun loopback benchmark, %u-byte echo requests in bursts of %u\n",
+         (unsigned)sizeof(request), BURST);
+
+  if(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds) == -1) {
+    perror("socketpair");
+    printf("Benchmark done: FAIL\n");
+    PROCESS_EXIT();
+  }
+  node_fd = fds[0];
+  peer_fd = fds[1];
+  fcntl(peer_fd, F_SETFL, fcntl(peer_fd, F_GETFL) | O_NONBLOCK);
+  select_set_callback(node_fd, &node_callback);
+  select_set_callback(peer_fd, &peer_callback);
+  make_request();
+
+  for(i = 0; i < sizeof(batch_sizes) / sizeof(batch_sizes[0]); i++) {
+    batch_max = batch_sizes[i];
+    tun_batch_init(&batch, node_fd, tcpip_input);
+    replies = expected = 0;
+
+    start = clock_time();
+    while(expected < PACKETS) {
+      send_burst();
+      /* The replies to the burst poll the process */
+      etimer_set(&et, CLOCK_SECOND);
+      PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL || etimer_expired(&et));
+      if(replies != expected) {
+        printf("Lost %lu replies\n", expected - replies);
+        errors++;
+        break;
+      }
+    }
+    elapsed = clock_time() - start;
+    if(elapsed == 0) {
+      elapsed = 1;
+    }
+
+    printf("batch %2d: %7lu packets/s, %5lu ns per packet, "
+           "%lu wakeups (max batch %lu), %lu flushes\n",
+           batch_max, replies * CLOCK_SECOND / elapsed,
+           (unsigned long)((unsigned long long)elapsed *
+                           (1000000000ULL / CLOCK_SECOND) / replies),
+           batch.stats.wakeups, batch.stats.max_batch, batch.stats.flushes);
+    if(batch.stats.packets_in != replies ||
+       batch.stats.packets_out != replies || batch.stats.drops != 0) {
+      errors++;
+    }
+  }
+
+  printf("Benchmark done: %s\n", errors == 0 ? "OK" : "FAIL");
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
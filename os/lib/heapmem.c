@@ -101,6 +101,38 @@
 #define HEAPMEM_ALIGNMENT sizeof(int)
 #endif /* HEAPMEM_CONF_ALIGNMENT */
 
+/*
+ * The HEAPMEM_CONF_WITH_SIZE_CLASSES parameter enables segregated free
+ * lists for small chunks. Freed chunks of at most
+ * HEAPMEM_CONF_SIZE_CLASS_MAX bytes are kept on a list per size, and
+ * are handed out again in constant time to allocations of the same
+ * size. These chunks are not coalesced with their neighbors until an
+ * allocation would otherwise fail, at which point all of them are
+ * returned to the general free list. To limit fragmentation, chunks
+ * are not kept on these lists once the heap footprint exceeds 7/8 of
+ * the arena.
+ */
+#ifdef HEAPMEM_CONF_WITH_SIZE_CLASSES
+#define HEAPMEM_WITH_SIZE_CLASSES HEAPMEM_CONF_WITH_SIZE_CLASSES
+#else
+#define HEAPMEM_WITH_SIZE_CLASSES 0
+#endif /* HEAPMEM_CONF_WITH_SIZE_CLASSES */
+
+#ifdef HEAPMEM_CONF_SIZE_CLASS_MAX
+#define HEAPMEM_SIZE_CLASS_MAX HEAPMEM_CONF_SIZE_CLASS_MAX
+#else
+#define HEAPMEM_SIZE_CLASS_MAX 64
+#endif /* HEAPMEM_CONF_SIZE_CLASS_MAX */
+
+/* The maximum number of chunks kept on each size class list. Further
+   chunks are put on the general free list, which bounds the memory
+   that is kept away from coalescing. */
+#ifdef HEAPMEM_CONF_SIZE_CLASS_DEPTH
+#define HEAPMEM_SIZE_CLASS_DEPTH HEAPMEM_CONF_SIZE_CLASS_DEPTH
+#else
+#define HEAPMEM_SIZE_CLASS_DEPTH 4
+#endif /* HEAPMEM_CONF_SIZE_CLASS_DEPTH */
+
 #define ALIGN(size)						\
   (((size) + (HEAPMEM_ALIGNMENT - 1)) & ~(HEAPMEM_ALIGNMENT - 1))
 
@@ -125,6 +157,19 @@
 #define CHUNK_FREE(chunk)			\
   (~(chunk)->flags & CHUNK_FLAG_ALLOCATED)
 
+#if HEAPMEM_WITH_SIZE_CLASSES
+/* Chunks on a size class list are also flagged as allocated, so that
+   they are left alone by the coalescing of free chunks. */
+#define CHUNK_FLAG_CLASS		0x2
+
+#define CHUNK_IN_CLASS(chunk)			\
+  ((chunk)->flags & CHUNK_FLAG_CLASS)
+
+#define SIZE_CLASSES (HEAPMEM_SIZE_CLASS_MAX / HEAPMEM_ALIGNMENT)
+/* Chunk sizes are aligned, so each size class holds a single size. */
+#define SIZE_CLASS(size) ((size) / HEAPMEM_ALIGNMENT - 1)
+#endif /* HEAPMEM_WITH_SIZE_CLASSES */
+
 /*
  * We use a double-linked list of chunks, with a slight space overhead compared
  * to a single-linked list, but with the advantage of having much faster
@@ -149,6 +194,12 @@ static size_t heap_usage;
 static chunk_t *first_chunk = (chunk_t *)heap_base;
 static chunk_t *free_list;
 
+#if HEAPMEM_WITH_SIZE_CLASSES
+/* Single-linked lists of free chunks, one per small chunk size. */
+static chunk_t *size_classes[SIZE_CLASSES];
+static uint8_t size_class_len[SIZE_CLASSES];
+#endif /* HEAPMEM_WITH_SIZE_CLASSES */
+
 /* extend_space: Increases the current footprint used in the heap, and
    returns a pointer to the old end. */
 static void *
@@ -306,6 +357,80 @@ get_free_chunk(const size_t size)
   return best;
 }
 
+#if HEAPMEM_WITH_SIZE_CLASSES
+/* class_get: Take a chunk of exactly the requested size from its size
+   class list, if any. */
+static chunk_t *
+class_get(const size_t size)
+{
+  chunk_t *chunk;
+
+  if(size == 0 || size > HEAPMEM_SIZE_CLASS_MAX) {
+    return NULL;
+  }
+
+  chunk = size_classes[SIZE_CLASS(size)];
+  if(chunk != NULL) {
+    size_classes[SIZE_CLASS(size)] = chunk->next;
+    size_class_len[SIZE_CLASS(size)]--;
+  }
+  return chunk;
+}
+
+/* class_flush: Return all chunks on the size class lists to the
+   general free list, and coalesce all free chunks in the heap. This is
+   only done when the heap is exhausted. */
+static int
+class_flush(void)
+{
+  int i;
+  int flushed;
+  chunk_t *chunk;
+
+  flushed = 0;
+  for(i = 0; i < SIZE_CLASSES; i++) {
+    while((chunk = size_classes[i]) != NULL) {
+      size_classes[i] = chunk->next;
+      chunk->flags &= ~CHUNK_FLAG_CLASS;
+      free_chunk(chunk);
+      flushed = 1;
+    }
+    size_class_len[i] = 0;
+  }
+
+  if(flushed) {
+    for(chunk = first_chunk;
+        (char *)chunk < &heap_base[heap_usage];
+        chunk = NEXT_CHUNK(chunk)) {
+      if(CHUNK_FREE(chunk)) {
+        coalesce_chunks(chunk);
+      }
+    }
+  }
+  return flushed;
+}
+#endif /* HEAPMEM_WITH_SIZE_CLASSES */
+
+/* release_chunk: Deallocate a chunk, putting small chunks on their size
+   class list if enabled. */
+static void
+release_chunk(chunk_t * const chunk)
+{
+#if HEAPMEM_WITH_SIZE_CLASSES
+  if(chunk->size > 0 && chunk->size <= HEAPMEM_SIZE_CLASS_MAX &&
+     size_class_len[SIZE_CLASS(chunk->size)] < HEAPMEM_SIZE_CLASS_DEPTH &&
+     heap_usage < HEAPMEM_ARENA_SIZE - HEAPMEM_ARENA_SIZE / 8 &&
+     !IS_LAST_CHUNK(chunk)) {
+    chunk->flags |= CHUNK_FLAG_CLASS;
+    chunk->next = size_classes[SIZE_CLASS(chunk->size)];
+    size_classes[SIZE_CLASS(chunk->size)] = chunk;
+    size_class_len[SIZE_CLASS(chunk->size)]++;
+    return;
+  }
+#endif /* HEAPMEM_WITH_SIZE_CLASSES */
+  free_chunk(chunk);
+}
+
 /*
  * heapmem_alloc: Allocate an object of the specified size, returning
  * a pointer to it in case of success, and NULL in case of failure.
@@ -331,7 +456,20 @@ heapmem_alloc(size_t size)
 
   size = ALIGN(size);
 
+#if HEAPMEM_WITH_SIZE_CLASSES
+  chunk = class_get(size);
+  if(chunk == NULL) {
+    chunk = get_free_chunk(size);
+  }
+  if(chunk == NULL &&
+     heap_usage + sizeof(chunk_t) + size > HEAPMEM_ARENA_SIZE &&
+     class_flush()) {
+    /* Retry with the size class chunks back on the free list. */
+    chunk = get_free_chunk(size);
+  }
+#else
   chunk = get_free_chunk(size);
+#endif /* HEAPMEM_WITH_SIZE_CLASSES */
   if(chunk == NULL) {
     chunk = extend_space(sizeof(chunk_t) + size);
     if(chunk == NULL) {
@@ -379,7 +517,7 @@ heapmem_free(void *ptr)
     PRINTF("%s ptr %p, allocated at %s:%u\n", __func__, ptr,
            chunk->file, chunk->line);
 
-    free_chunk(chunk);
+    release_chunk(chunk);
   }
 }
 
@@ -477,7 +615,7 @@ heapmem_realloc(void *ptr, size_t size)
   }
 
   memcpy(newptr, ptr, chunk->size);
-  free_chunk(chunk);
+  release_chunk(chunk);
 
   return newptr;
 }
@@ -494,6 +632,11 @@ heapmem_stats(heapmem_stats_t *stats)
   for(chunk = first_chunk;
       (char *)chunk < &heap_base[heap_usage];
       chunk = NEXT_CHUNK(chunk)) {
+#if HEAPMEM_WITH_SIZE_CLASSES
+    if(CHUNK_IN_CLASS(chunk)) {
+      stats->available += chunk->size;
+    } else
+#endif /* HEAPMEM_WITH_SIZE_CLASSES */
     if(CHUNK_ALLOCATED(chunk)) {
       stats->allocated += chunk->size;
     } else {
@@ -43,42 +43,155 @@
  * \author Adam Dunkels <adam@sics.se>
  */
 #include <string.h>
+#include <stdint.h>
 
 #include "contiki.h"
 #include "lib/memb.h"
 
+#if MEMB_WITH_STATS
+static struct memb *stats_list;
+#endif /* MEMB_WITH_STATS */
+/*---------------------------------------------------------------------------*/
+#if MEMB_WITH_BITMAP
+/* Returns the index of the lowest zero bit of a word that is not all ones */
+static int
+first_zero_bit(uint32_t word)
+{
+#if defined(__GNUC__)
+  return __builtin_ctzl((unsigned long)~word);
+#else
+  int bit;
+
+  for(bit = 0; word & 1; bit++) {
+    word >>= 1;
+  }
+  return bit;
+#endif
+}
+/*---------------------------------------------------------------------------*/
+static int
+block_index(struct memb *m, void *ptr)
+{
+  unsigned long offset;
+
+  if(!memb_inmemb(m, ptr)) {
+    return -1;
+  }
+  offset = (char *)ptr - (char *)m->mem;
+  if(offset % m->size != 0) {
+    return -1;
+  }
+  return offset / m->size;
+}
+#endif /* MEMB_WITH_BITMAP */
 /*---------------------------------------------------------------------------*/
 void
 memb_init(struct memb *m)
 {
   memset(m->count, 0, m->num);
   memset(m->mem, 0, m->size * m->num);
+#if MEMB_WITH_BITMAP
+  memset(m->used, 0, MEMB_BITMAP_WORDS(m->num) * sizeof(uint32_t));
+#endif /* MEMB_WITH_BITMAP */
+#if MEMB_WITH_STATS
+  {
+    struct memb *s;
+
+    m->nused = 0;
+    memb_stats_reset(m);
+    for(s = stats_list; s != NULL && s != m; s = s->next);
+    if(s == NULL) {
+      m->next = stats_list;
+      stats_list = m;
+    }
+  }
+#endif /* MEMB_WITH_STATS */
 }
 /*---------------------------------------------------------------------------*/
-void *
-memb_alloc(struct memb *m)
+/* Finds a free block, returns its index or -1 if there is none */
+static int
+find_free_block(struct memb *m)
 {
   int i;
 
+#if MEMB_WITH_BITMAP
+  int w;
+
+  for(w = 0; w < MEMB_BITMAP_WORDS(m->num); ++w) {
+    if(m->used[w] != UINT32_MAX) {
+      i = w * 32 + first_zero_bit(m->used[w]);
+      if(i >= m->num) {
+        /* Only the unused bits past the last block were zero. */
+        return -1;
+      }
+      m->used[w] |= (uint32_t)1 << (i % 32);
+      return i;
+    }
+  }
+#else /* MEMB_WITH_BITMAP */
   for(i = 0; i < m->num; ++i) {
     if(m->count[i] == 0) {
-      /* If this block was unused, we increase the reference count to
-	 indicate that it now is used and return a pointer to the
-	 memory block. */
-      ++(m->count[i]);
-      return (void *)((char *)m->mem + (i * m->size));
+      return i;
     }
   }
+#endif /* MEMB_WITH_BITMAP */
+  return -1;
+}
+/*---------------------------------------------------------------------------*/
+void *
+memb_alloc(struct memb *m)
+{
+  int i;
+
+  i = find_free_block(m);
+  if(i < 0) {
+    /* No free block was found, so we return NULL to indicate failure
+       to allocate block. */
+#if MEMB_WITH_STATS
+    m->failures++;
+#endif /* MEMB_WITH_STATS */
+    return NULL;
+  }
 
-  /* No free block was found, so we return NULL to indicate failure to
-     allocate block. */
-  return NULL;
+  /* This block was unused, we increase the reference count to
+     indicate that it now is used and return a pointer to the memory
+     block. */
+  ++(m->count[i]);
+#if MEMB_WITH_STATS
+  if(++m->nused > m->max_used) {
+    m->max_used = m->nused;
+  }
+#endif /* MEMB_WITH_STATS */
+  return (void *)((char *)m->mem + (i * m->size));
+}
+/*---------------------------------------------------------------------------*/
+/* Decreases the reference count of block i, returns the new count */
+static char
+free_block(struct memb *m, int i)
+{
+  if(m->count[i] > 0) {
+    /* Make sure that we don't deallocate free memory. */
+    --(m->count[i]);
+    if(m->count[i] == 0) {
+#if MEMB_WITH_BITMAP
+      m->used[i / 32] &= ~((uint32_t)1 << (i % 32));
+#endif /* MEMB_WITH_BITMAP */
+#if MEMB_WITH_STATS
+      m->nused--;
+#endif /* MEMB_WITH_STATS */
+    }
+  }
+  return m->count[i];
 }
 /*---------------------------------------------------------------------------*/
 char
 memb_free(struct memb *m, void *ptr)
 {
   int i;
+#if MEMB_WITH_BITMAP
+  i = block_index(m, ptr);
+  return i < 0 ? -1 : free_block(m, i);
+#else /* MEMB_WITH_BITMAP */
   char *ptr2;
 
   /* Walk through the list of blocks and try to find the block to
@@ -89,15 +202,12 @@ memb_free(struct memb *m, void *ptr)
     if(ptr2 == (char *)ptr) {
       /* We've found to block to which "ptr" points so we decrease the
 	 reference count and return the new value of it. */
-      if(m->count[i] > 0) {
-	/* Make sure that we don't deallocate free memory. */
-	--(m->count[i]);
-      }
-      return m->count[i];
+      return free_block(m, i);
     }
     ptr2 += m->size;
   }
   return -1;
+#endif /* MEMB_WITH_BITMAP */
 }
 /*---------------------------------------------------------------------------*/
 int
@@ -121,4 +231,19 @@ memb_numfree(struct memb *m)
 
   return num_free;
 }
+/*---------------------------------------------------------------------------*/
+#if MEMB_WITH_STATS
+struct memb *
+memb_stats_list(void)
+{
+  return stats_list;
+}
+/*---------------------------------------------------------------------------*/
+void
+memb_stats_reset(struct memb *m)
+{
+  m->max_used = m->nused;
+  m->failures = 0;
+}
+#endif /* MEMB_WITH_STATS */
 /** @} */
@@ -65,6 +65,48 @@
 
 #include "sys/cc.h"
 
+#include <stdint.h>
+
+/**
+ * Keep a bitmap of the allocated blocks of each memory block, one bit
+ * per block. memb_alloc() then finds a free block a machine word at a
+ * time, and memb_free() locates the block from its address instead of
+ * scanning the memory block.
+ */
+#ifdef MEMB_CONF_WITH_BITMAP
+#define MEMB_WITH_BITMAP MEMB_CONF_WITH_BITMAP
+#else /* MEMB_CONF_WITH_BITMAP */
+#define MEMB_WITH_BITMAP 0
+#endif /* MEMB_CONF_WITH_BITMAP */
+
+/**
+ * Keep the number of blocks in use, its high-water mark and the number
+ * of failed allocations of each memory block. Memory blocks are
+ * registered when memb_init() is called, and can be listed with
+ * memb_stats_list().
+ */
+#ifdef MEMB_CONF_WITH_STATS
+#define MEMB_WITH_STATS MEMB_CONF_WITH_STATS
+#else /* MEMB_CONF_WITH_STATS */
+#define MEMB_WITH_STATS 0
+#endif /* MEMB_CONF_WITH_STATS */
+
+#if MEMB_WITH_BITMAP
+#define MEMB_BITMAP_WORDS(num) (((num) + 31) / 32)
+#define MEMB_BITMAP(name, num) \
+        static uint32_t CC_CONCAT(name,_memb_bitmap)[MEMB_BITMAP_WORDS(num)];
+#define MEMB_BITMAP_INIT(name) , CC_CONCAT(name,_memb_bitmap)
+#else /* MEMB_WITH_BITMAP */
+#define MEMB_BITMAP(name, num)
+#define MEMB_BITMAP_INIT(name)
+#endif /* MEMB_WITH_BITMAP */
+
+#if MEMB_WITH_STATS
+#define MEMB_STATS_INIT(name) , #name
+#else /* MEMB_WITH_STATS */
+#define MEMB_STATS_INIT(name)
+#endif /* MEMB_WITH_STATS */
+
 /**
  * Declare a memory block.
  *
@@ -88,16 +130,29 @@ MEMB(connections, struct connection, 16);
  */
 #define MEMB(name, structure, num) \
         static char CC_CONCAT(name,_memb_count)[num]; \
+        MEMB_BITMAP(name, num) \
         static structure CC_CONCAT(name,_memb_mem)[num]; \
         static struct memb name = {sizeof(structure), num, \
                                           CC_CONCAT(name,_memb_count), \
-                                          (void *)CC_CONCAT(name,_memb_mem)}
+                                          (void *)CC_CONCAT(name,_memb_mem) \
+                                          MEMB_BITMAP_INIT(name) \
+                                          MEMB_STATS_INIT(name)}
 
 struct memb {
   unsigned short size;
   unsigned short num;
   char *count;
   void *mem;
+#if MEMB_WITH_BITMAP
+  uint32_t *used;
+#endif /* MEMB_WITH_BITMAP */
+#if MEMB_WITH_STATS
+  const char *name;
+  struct memb *next;
+  unsigned short nused;
+  unsigned short max_used;
+  uint32_t failures;
+#endif /* MEMB_WITH_STATS */
 };
 
 /**
@@ -132,6 +187,21 @@ int memb_inmemb(struct memb *m, void *ptr);
 
 int  memb_numfree(struct memb *m);
 
+#if MEMB_WITH_STATS
+/**
+ * Get the memory blocks for which statistics are kept.
+ * \return The first memory block that has been initialized with
+ * memb_init(). The others follow through the next field.
+ */
+struct memb *memb_stats_list(void);
+
+/**
+ * Reset the high-water mark and the failure counter of a memory block.
+ * \param m A memory block previously declared with MEMB().
+ */
+void memb_stats_reset(struct memb *m);
+#endif /* MEMB_WITH_STATS */
+
 /** @} */
 /** @} */
 
@@ -0,0 +1,421 @@
+/*
+ * Copyright (c) 2018, RISE SICS.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * \file
+ *      Streaming block-wise transfers (RFC 7959) for CoAP clients.
+ */
+
+/**
+ * \addtogroup coap
+ * @{
+ */
+
+#include "coap-blockwise.h"
+#include <inttypes.h>
+#include <string.h>
+
+/* Log configuration */
+#include "coap-log.h"
+#define LOG_MODULE "coap-blockwise"
+#define LOG_LEVEL  LOG_LEVEL_COAP
+
+#define UNKNOWN 0xffffffffUL
+
+static void get_callback(void *callback_data, coap_message_t *response);
+static void put_callback(void *callback_data, coap_message_t *response);
+/*---------------------------------------------------------------------------*/
+static int
+is_valid_size(uint16_t size)
+{
+  return size >= 16 && size <= 1024 && (size & (size - 1)) == 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+init_transfer(coap_blockwise_transfer_t *transfer,
+              const coap_endpoint_t *endpoint, coap_message_t *request,
+              uint16_t size, coap_blockwise_done_callback_t done_callback)
+{
+  memset(transfer, 0, sizeof(*transfer));
+  coap_endpoint_copy(&transfer->endpoint, endpoint);
+  transfer->request = request;
+  transfer->size = size;
+  transfer->done_callback = done_callback;
+  transfer->end_num = UNKNOWN;
+  transfer->limit_num = UNKNOWN;
+  transfer->active = 1;
+  transfer->stats.start = coap_timer_uptime();
+  request->type = COAP_TYPE_CON;
+}
+/*---------------------------------------------------------------------------*/
+/* Open a transaction for a request in a free slot */
+static coap_transaction_t *
+new_request(coap_blockwise_transfer_t *transfer, uint32_t num,
+            coap_resource_response_handler_t callback)
+{
+  coap_transaction_t *t;
+  int i;
+
+  for(i = 0; i < COAP_BLOCKWISE_WINDOW; i++) {
+    if(transfer->slots[i].transaction == NULL) {
+      break;
+    }
+  }
+  if(i == COAP_BLOCKWISE_WINDOW) {
+    return NULL;
+  }
+
+  transfer->request->mid = coap_get_mid();
+  t = coap_new_transaction(transfer->request->mid, &transfer->endpoint);
+  if(t == NULL) {
+    LOG_WARN("No transaction for block %"PRIu32"\n", num);
+    return NULL;
+  }
+  t->callback = callback;
+  t->callback_data = transfer;
+  transfer->slots[i].transaction = t;
+  transfer->slots[i].num = num;
+  transfer->slots[i].mid = t->mid;
+  transfer->in_flight++;
+  transfer->stats.requests++;
+  return t;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Free the slot of the transaction that was just closed by a response or
+ * a timeout. Its block number is returned in num.
+ */
+static int
+close_request(coap_blockwise_transfer_t *transfer, uint32_t *num)
+{
+  int i;
+
+  for(i = 0; i < COAP_BLOCKWISE_WINDOW; i++) {
+    if(transfer->slots[i].transaction != NULL
+       && coap_get_transaction_by_mid(transfer->slots[i].mid)
+       != transfer->slots[i].transaction) {
+      *num = transfer->slots[i].num;
+      transfer->slots[i].transaction = NULL;
+      transfer->in_flight--;
+      return 1;
+    }
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+finish(coap_blockwise_transfer_t *transfer, coap_blockwise_status_t status)
+{
+  int i;
+
+  /* cancel the requests still in flight */
+  for(i = 0; i < COAP_BLOCKWISE_WINDOW; i++) {
+    if(transfer->slots[i].transaction != NULL) {
+      if(coap_get_transaction_by_mid(transfer->slots[i].mid)
+         == transfer->slots[i].transaction) {
+        coap_clear_transaction(transfer->slots[i].transaction);
+      }
+      transfer->slots[i].transaction = NULL;
+    }
+  }
+  transfer->in_flight = 0;
+  transfer->active = 0;
+  transfer->stats.end = coap_timer_uptime();
+
+  LOG_DBG("Transfer done (%u): %"PRIu32" bytes in %"PRIu32" blocks, "
+          "%"PRIu32" requests\n", status, transfer->stats.bytes,
+          transfer->stats.blocks, transfer->stats.requests);
+
+  if(transfer->done_callback) {
+    transfer->done_callback(transfer, status);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static int
+send_block2_request(coap_blockwise_transfer_t *transfer, uint32_t num)
+{
+  coap_transaction_t *t;
+
+  t = new_request(transfer, num, get_callback);
+  if(t == NULL) {
+    return 0;
+  }
+  coap_set_header_block2(transfer->request, num, 0, transfer->size);
+  t->message_len = coap_serialize_message(transfer->request, t->message);
+  LOG_DBG("Requesting block %"PRIu32" (MID %u)\n", num, t->mid);
+  coap_send_transaction(t);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/* Fill the window with requests for the next blocks */
+static void
+request_blocks(coap_blockwise_transfer_t *transfer)
+{
+  while(transfer->active && transfer->in_flight < COAP_BLOCKWISE_WINDOW
+        && transfer->next_num < transfer->end_num
+        && transfer->next_num < transfer->limit_num) {
+    if(!send_block2_request(transfer, transfer->next_num)) {
+      break;
+    }
+    transfer->next_num++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+get_callback(void *callback_data, coap_message_t *response)
+{
+  coap_blockwise_transfer_t *transfer = callback_data;
+  uint32_t num;
+  uint32_t res_num;
+  uint32_t size2;
+  uint16_t res_size;
+  uint8_t more;
+
+  if(!close_request(transfer, &num) || !transfer->active) {
+    return;
+  }
+
+  if(response == NULL) {
+    LOG_WARN("Block %"PRIu32" timed out\n", num);
+    finish(transfer, COAP_BLOCKWISE_TIMEOUT);
+    return;
+  }
+  transfer->response = response;
+
+  if(response->code >= BAD_REQUEST_4_00) {
+    if(response->code == BAD_OPTION_4_02 && num > 0) {
+      /* requested beyond the end of the body, answered without Block2 */
+      if(num < transfer->limit_num) {
+        transfer->limit_num = num;
+      }
+    } else {
+      LOG_WARN("Error %u for block %"PRIu32"\n", response->code, num);
+      finish(transfer, COAP_BLOCKWISE_ERROR);
+      return;
+    }
+  } else {
+    if(!coap_get_header_block2(response, &res_num, &more, &res_size, NULL)) {
+      if(num != 0) {
+        LOG_WARN("No block %"PRIu32" in response %u\n", num, response->code);
+        finish(transfer, COAP_BLOCKWISE_ERROR);
+        return;
+      }
+      /* the whole body in one response */
+      res_num = 0;
+      more = 0;
+      res_size = transfer->size;
+    }
+    if(num == 0 && res_size < transfer->size) {
+      /* the server chose a smaller block size */
+      transfer->size = res_size;
+    }
+    if(res_num != num || res_size != transfer->size) {
+      LOG_WARN("Got block %"PRIu32"/%u for %"PRIu32"/%u\n", res_num,
+               res_size, num, transfer->size);
+      finish(transfer, COAP_BLOCKWISE_ERROR);
+      return;
+    }
+    if(num == 0 && coap_get_header_size2(response, &size2)) {
+      transfer->limit_num = (size2 + transfer->size - 1) / transfer->size;
+    }
+    if(!more) {
+      transfer->end_num = num + 1;
+    }
+
+    transfer->stats.blocks++;
+    transfer->stats.bytes += response->payload_len;
+    if(transfer->block_callback
+       && transfer->block_callback(transfer, num * transfer->size,
+                                   response->payload,
+                                   response->payload_len) < 0) {
+      coap_blockwise_abort(transfer);
+    }
+  }
+  transfer->response = NULL;
+
+  if(!transfer->active) {
+    /* aborted by the callback */
+    return;
+  } else if(transfer->stats.blocks == transfer->end_num) {
+    finish(transfer, COAP_BLOCKWISE_DONE);
+  } else if(transfer->limit_num <= transfer->stats.blocks
+            && transfer->in_flight == 0) {
+    /* the block without more was lost in a malformed transfer */
+    finish(transfer, COAP_BLOCKWISE_ERROR);
+  } else {
+    request_blocks(transfer);
+  }
+}
+/*---------------------------------------------------------------------------*/
+int
+coap_blockwise_get(coap_blockwise_transfer_t *transfer,
+                   const coap_endpoint_t *endpoint,
+                   coap_message_t *request, uint16_t size,
+                   coap_blockwise_block_callback_t block_callback,
+                   coap_blockwise_done_callback_t done_callback)
+{
+  if(!is_valid_size(size)) {
+    return 0;
+  }
+  init_transfer(transfer, endpoint, request, size, done_callback);
+  transfer->block_callback = block_callback;
+
+  /* block 0 alone, the server may choose a smaller size */
+  if(!send_block2_request(transfer, 0)) {
+    transfer->active = 0;
+    return 0;
+  }
+  transfer->next_num = 1;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static int
+send_block1_request(coap_blockwise_transfer_t *transfer)
+{
+  coap_transaction_t *t;
+  uint32_t offset = transfer->next_num * transfer->size;
+  uint16_t len;
+  uint8_t *payload;
+
+  len = MIN(transfer->size, transfer->length - offset);
+  t = new_request(transfer, transfer->next_num, put_callback);
+  if(t == NULL) {
+    return 0;
+  }
+
+  payload = t->message + COAP_MAX_HEADER_SIZE;
+  if(transfer->read_callback(transfer, offset, payload, len) != len) {
+    coap_clear_transaction(t);
+    transfer->slots[0].transaction = NULL;
+    transfer->in_flight = 0;
+    return 0;
+  }
+  coap_set_header_block1(transfer->request, transfer->next_num,
+                         offset + len < transfer->length, transfer->size);
+  if(transfer->next_num == 0) {
+    coap_set_header_size1(transfer->request, transfer->length);
+  }
+  coap_set_payload(transfer->request, payload, len);
+  t->message_len = coap_serialize_message(transfer->request, t->message);
+  LOG_DBG("Sending block %"PRIu32" (MID %u)\n", transfer->next_num, t->mid);
+
+  transfer->stats.blocks++;
+  transfer->stats.bytes += len;
+  coap_send_transaction(t);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+put_callback(void *callback_data, coap_message_t *response)
+{
+  coap_blockwise_transfer_t *transfer = callback_data;
+  uint32_t num;
+  uint32_t res_num;
+  uint16_t res_size;
+  uint8_t more;
+  uint32_t sent;
+
+  if(!close_request(transfer, &num) || !transfer->active) {
+    return;
+  }
+
+  if(response == NULL) {
+    LOG_WARN("Block %"PRIu32" timed out\n", num);
+    finish(transfer, COAP_BLOCKWISE_TIMEOUT);
+    return;
+  }
+
+  transfer->response = response;
+  sent = MIN((num + 1) * transfer->size, transfer->length);
+  if(response->code >= BAD_REQUEST_4_00) {
+    LOG_WARN("Error %u for block %"PRIu32"\n", response->code, num);
+    finish(transfer, COAP_BLOCKWISE_ERROR);
+  } else if(sent == transfer->length) {
+    finish(transfer, COAP_BLOCKWISE_DONE);
+  } else if(response->code != CONTINUE_2_31
+            || !coap_get_header_block1(response, &res_num, &more, &res_size,
+                                       NULL)
+            || res_num != num || res_size > transfer->size) {
+    LOG_WARN("Unexpected response %u to block %"PRIu32"\n", response->code,
+             num);
+    finish(transfer, COAP_BLOCKWISE_ERROR);
+  } else {
+    /* the server may ask for smaller blocks, the body continues at sent */
+    transfer->size = res_size;
+    transfer->next_num = sent / res_size;
+    if(!send_block1_request(transfer)) {
+      finish(transfer, COAP_BLOCKWISE_ABORTED);
+    }
+  }
+  transfer->response = NULL;
+}
+/*---------------------------------------------------------------------------*/
+int
+coap_blockwise_put(coap_blockwise_transfer_t *transfer,
+                   const coap_endpoint_t *endpoint,
+                   coap_message_t *request, uint32_t length, uint16_t size,
+                   coap_blockwise_read_callback_t read_callback,
+                   coap_blockwise_done_callback_t done_callback)
+{
+  if(!is_valid_size(size) || size > COAP_MAX_CHUNK_SIZE) {
+    return 0;
+  }
+  init_transfer(transfer, endpoint, request, size, done_callback);
+  transfer->read_callback = read_callback;
+  transfer->length = length;
+
+  if(!send_block1_request(transfer)) {
+    transfer->active = 0;
+    return 0;
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+void
+coap_blockwise_abort(coap_blockwise_transfer_t *transfer)
+{
+  if(transfer->active) {
+    finish(transfer, COAP_BLOCKWISE_ABORTED);
+  }
+}
+/*---------------------------------------------------------------------------*/
+uint32_t
+coap_blockwise_throughput(const coap_blockwise_stats_t *stats)
+{
+  uint64_t elapsed = stats->end - stats->start;
+
+  if(elapsed == 0) {
+    elapsed = 1;
+  }
+  return (uint32_t)(stats->bytes * 1000ULL / elapsed);
+}
+/*---------------------------------------------------------------------------*/
+/** @} */
@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) 2018, RISE SICS.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * \file
+ *      Streaming block-wise transfers (RFC 7959) for CoAP clients.
+ *
+ *      A download requests up to COAP_BLOCKWISE_WINDOW Block2 blocks at
+ *      once and hands every block to a callback with its offset, so the
+ *      body is never buffered. Blocks are delivered in the order in which
+ *      they arrive. An upload reads the body block by block from a
+ *      callback and sends it with Block1, one block per round-trip.
+ */
+
+/**
+ * \addtogroup coap
+ * @{
+ */
+
+#ifndef COAP_BLOCKWISE_H_
+#define COAP_BLOCKWISE_H_
+
+#include "coap-engine.h"
+#include "coap-transactions.h"
+
+typedef enum {
+  COAP_BLOCKWISE_DONE,
+  COAP_BLOCKWISE_TIMEOUT,       /* the server did not respond */
+  COAP_BLOCKWISE_ERROR,         /* error response or malformed block */
+  COAP_BLOCKWISE_ABORTED        /* by a callback or coap_blockwise_abort() */
+} coap_blockwise_status_t;
+
+typedef struct coap_blockwise_stats {
+  uint64_t start;               /* uptime in ms */
+  uint64_t end;
+  uint32_t bytes;
+  uint32_t blocks;
+  uint32_t requests;
+} coap_blockwise_stats_t;
+
+typedef struct coap_blockwise_transfer coap_blockwise_transfer_t;
+
+/*
+ * Called with the payload of a Block2 response at its offset in the
+ * body. Returning a negative value aborts the download.
+ */
+typedef int (*coap_blockwise_block_callback_t)(coap_blockwise_transfer_t *transfer,
+                                               uint32_t offset,
+                                               const uint8_t *data,
+                                               uint16_t len);
+
+/*
+ * Called to read len bytes of the body of an upload at an offset.
+ * Returns len, or a negative value to abort the upload.
+ */
+typedef int (*coap_blockwise_read_callback_t)(coap_blockwise_transfer_t *transfer,
+                                              uint32_t offset,
+                                              uint8_t *data,
+                                              uint16_t len);
+
+typedef void (*coap_blockwise_done_callback_t)(coap_blockwise_transfer_t *transfer,
+                                               coap_blockwise_status_t status);
+
+struct coap_blockwise_transfer {
+  coap_endpoint_t endpoint;
+  coap_message_t *request;
+  coap_blockwise_block_callback_t block_callback;
+  coap_blockwise_read_callback_t read_callback;
+  coap_blockwise_done_callback_t done_callback;
+  void *user_data;
+
+  /* Last response, e.g. for its code. Only valid during callbacks. */
+  coap_message_t *response;
+  coap_blockwise_stats_t stats;
+
+  uint32_t length;              /* of the body of an upload */
+  uint32_t next_num;            /* next block to request */
+  uint32_t end_num;             /* number of blocks, once known */
+  uint32_t limit_num;           /* no block from here on */
+  uint16_t size;
+  uint8_t in_flight;
+  uint8_t active;
+  struct {
+    coap_transaction_t *transaction;
+    uint32_t num;
+    uint16_t mid;
+  } slots[COAP_BLOCKWISE_WINDOW];
+};
+
+/**
+ * \brief Download the body of a GET (or FETCH) response with Block2
+ *
+ * The requests are sent confirmable. The first one asks for block 0
+ * alone, so that the server can choose a smaller block size; the others
+ * fill the window.
+ * \param transfer The state of the transfer, kept until it is done
+ * \param endpoint The server
+ * \param request  The request, kept until the transfer is done
+ * \param size     The preferred block size (16 to 1024, power of two)
+ * \param block_callback Called with every block
+ * \param done_callback  Called once when the transfer ends
+ * \return 1 if the transfer was started, 0 otherwise
+ */
+int coap_blockwise_get(coap_blockwise_transfer_t *transfer,
+                       const coap_endpoint_t *endpoint,
+                       coap_message_t *request, uint16_t size,
+                       coap_blockwise_block_callback_t block_callback,
+                       coap_blockwise_done_callback_t done_callback);
+
+/**
+ * \brief Upload the body of a PUT or POST request with Block1
+ * \param transfer The state of the transfer, kept until it is done
+ * \param endpoint The server
+ * \param request  The request, kept until the transfer is done
+ * \param length   The length of the body
+ * \param size     The block size (16 to 1024, power of two, at most
+ *                 COAP_MAX_CHUNK_SIZE)
+ * \param read_callback Called to read every block
+ * \param done_callback Called once when the transfer ends, with the
+ *                      final response of the server in transfer->response
+ * \return 1 if the transfer was started, 0 otherwise
+ */
+int coap_blockwise_put(coap_blockwise_transfer_t *transfer,
+                       const coap_endpoint_t *endpoint,
+                       coap_message_t *request, uint32_t length,
+                       uint16_t size,
+                       coap_blockwise_read_callback_t read_callback,
+                       coap_blockwise_done_callback_t done_callback);
+
+/**
+ * \brief Stop a transfer. The done callback is called with
+ *        COAP_BLOCKWISE_ABORTED.
+ */
+void coap_blockwise_abort(coap_blockwise_transfer_t *transfer);
+
+/**
+ * \brief The throughput of a transfer in bytes per second
+ */
+uint32_t coap_blockwise_throughput(const coap_blockwise_stats_t *stats);
+
+#endif /* COAP_BLOCKWISE_H_ */
+/** @} */
@@ -0,0 +1,316 @@
+/*
+ * Copyright (c) 2018, RISE SICS.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * \file
+ *      Server-side cache of CoAP responses to GET requests.
+ *
+ *      Responses are keyed by resource, Uri-Query and Accept. They are
+ *      fresh for their Max-Age, and dropped when the resource notifies
+ *      its observers or receives an unsafe request (RFC 7252 5.9).
+ */
+
+/**
+ * \addtogroup coap
+ * @{
+ */
+
+#include "coap-cache.h"
+#include <inttypes.h>
+#include <string.h>
+
+/* Log configuration */
+#include "coap-log.h"
+#define LOG_MODULE "coap-cache"
+#define LOG_LEVEL  LOG_LEVEL_COAP
+
+#define ETAG_LEN 4
+
+typedef struct cache_entry {
+  coap_resource_t *resource;    /* NULL if the entry is free */
+  uint64_t expires;
+  uint64_t last_used;
+  uint16_t accept;
+  uint16_t content_format;
+  uint16_t payload_len;
+  uint8_t has_accept;
+  uint8_t has_content_format;
+  uint8_t query_len;
+  uint8_t etag_len;
+  char query[COAP_RESPONSE_CACHE_QUERY_LEN];
+  uint8_t etag[COAP_ETAG_LEN];
+  uint8_t payload[COAP_RESPONSE_CACHE_PAYLOAD_LEN];
+} cache_entry_t;
+
+#if COAP_RESPONSE_CACHE_SIZE
+static cache_entry_t cache[COAP_RESPONSE_CACHE_SIZE];
+#endif /* COAP_RESPONSE_CACHE_SIZE */
+static coap_cache_stats_t stats;
+/*---------------------------------------------------------------------------*/
+#if COAP_RESPONSE_CACHE_SIZE
+/* Whether a request can be answered from the cache */
+static int
+is_cacheable_request(coap_resource_t *resource, coap_message_t *request)
+{
+  return request->code == COAP_GET
+    && !(resource->flags & HAS_SUB_RESOURCES)
+    && !coap_is_option(request, COAP_OPTION_BLOCK1)
+    && !coap_is_option(request, COAP_OPTION_BLOCK2);
+}
+/*---------------------------------------------------------------------------*/
+static int
+is_cacheable_response(coap_message_t *response)
+{
+  uint8_t options[sizeof(response->options)];
+  int i;
+
+  if(response->code != CONTENT_2_05
+     || !coap_is_option(response, COAP_OPTION_MAX_AGE)
+     || response->max_age == 0
+     || response->payload_len > COAP_RESPONSE_CACHE_PAYLOAD_LEN) {
+    return 0;
+  }
+
+  /* no options but the ones restored from the cache */
+  memcpy(options, response->options, sizeof(options));
+  options[COAP_OPTION_CONTENT_FORMAT / COAP_OPTION_MAP_SIZE] &=
+    ~(1 << (COAP_OPTION_CONTENT_FORMAT % COAP_OPTION_MAP_SIZE));
+  options[COAP_OPTION_MAX_AGE / COAP_OPTION_MAP_SIZE] &=
+    ~(1 << (COAP_OPTION_MAX_AGE % COAP_OPTION_MAP_SIZE));
+  options[COAP_OPTION_ETAG / COAP_OPTION_MAP_SIZE] &=
+    ~(1 << (COAP_OPTION_ETAG % COAP_OPTION_MAP_SIZE));
+  for(i = 0; i < sizeof(options); i++) {
+    if(options[i] != 0) {
+      return 0;
+    }
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/* Key of a request; 0 if the query is too long to be cached */
+static int
+get_key(coap_message_t *request, const char **query, size_t *query_len,
+        unsigned int *accept, uint8_t *has_accept)
+{
+  *query_len = coap_get_header_uri_query(request, query);
+  *has_accept = coap_get_header_accept(request, accept);
+  if(!*has_accept) {
+    *accept = 0;
+  }
+  return *query_len <= COAP_RESPONSE_CACHE_QUERY_LEN;
+}
+/*---------------------------------------------------------------------------*/
+static cache_entry_t *
+find_entry(coap_resource_t *resource, const char *query, size_t query_len,
+           unsigned int accept, uint8_t has_accept)
+{
+  int i;
+
+  for(i = 0; i < COAP_RESPONSE_CACHE_SIZE; i++) {
+    if(cache[i].resource == resource
+       && cache[i].has_accept == has_accept
+       && cache[i].accept == accept
+       && cache[i].query_len == query_len
+       && memcmp(cache[i].query, query, query_len) == 0) {
+      return &cache[i];
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+/* A free or stale entry, else the least recently used one */
+static cache_entry_t *
+get_free_entry(uint64_t now)
+{
+  cache_entry_t *lru = &cache[0];
+  int i;
+
+  for(i = 0; i < COAP_RESPONSE_CACHE_SIZE; i++) {
+    if(cache[i].resource == NULL || cache[i].expires <= now) {
+      return &cache[i];
+    }
+    if(cache[i].last_used < lru->last_used) {
+      lru = &cache[i];
+    }
+  }
+  return lru;
+}
+/*---------------------------------------------------------------------------*/
+/* FNV-1a hash of the representation: equal representations get the
+   same ETag, also after they were dropped from the cache */
+static void
+make_etag(uint8_t *etag, uint16_t content_format, const uint8_t *payload,
+          uint16_t len)
+{
+  uint32_t hash = 2166136261UL;
+  uint16_t i;
+
+  hash = (hash ^ (content_format >> 8)) * 16777619UL;
+  hash = (hash ^ (content_format & 0xff)) * 16777619UL;
+  for(i = 0; i < len; i++) {
+    hash = (hash ^ payload[i]) * 16777619UL;
+  }
+  etag[0] = hash >> 24;
+  etag[1] = hash >> 16;
+  etag[2] = hash >> 8;
+  etag[3] = hash;
+}
+#endif /* COAP_RESPONSE_CACHE_SIZE */
+/*---------------------------------------------------------------------------*/
+int
+coap_cache_lookup(coap_resource_t *resource, coap_message_t *request,
+                  coap_message_t *response, uint8_t *buffer,
+                  uint16_t buffer_size)
+{
+#if COAP_RESPONSE_CACHE_SIZE
+  cache_entry_t *e;
+  const char *query;
+  size_t query_len;
+  unsigned int accept;
+  uint8_t has_accept;
+  const uint8_t *etag;
+  int etag_len;
+  uint64_t now;
+
+  if(!is_cacheable_request(resource, request)
+     || !get_key(request, &query, &query_len, &accept, &has_accept)) {
+    return 0;
+  }
+
+  now = coap_timer_uptime();
+  e = find_entry(resource, query, query_len, accept, has_accept);
+  if(e == NULL || e->expires <= now || e->payload_len > buffer_size) {
+    stats.misses++;
+    return 0;
+  }
+  e->last_used = now;
+  stats.hits++;
+
+  /* Max-Age is the time left until the response is stale */
+  coap_set_header_max_age(response, (e->expires - now + 999) / 1000);
+  coap_set_header_etag(response, e->etag, e->etag_len);
+
+  etag_len = coap_get_header_etag(request, &etag);
+  if(etag_len == e->etag_len && memcmp(etag, e->etag, etag_len) == 0) {
+    LOG_DBG("Validated /%s\n", resource->url);
+    stats.validations++;
+    coap_set_status_code(response, VALID_2_03);
+    return 1;
+  }
+
+  LOG_DBG("Serving /%s from the cache\n", resource->url);
+  coap_set_status_code(response, CONTENT_2_05);
+  if(e->has_content_format) {
+    coap_set_header_content_format(response, e->content_format);
+  }
+  memcpy(buffer, e->payload, e->payload_len);
+  coap_set_payload(response, buffer, e->payload_len);
+  return 1;
+#else /* COAP_RESPONSE_CACHE_SIZE */
+  return 0;
+#endif /* COAP_RESPONSE_CACHE_SIZE */
+}
+/*---------------------------------------------------------------------------*/
+void
+coap_cache_store(coap_resource_t *resource, coap_message_t *request,
+                 coap_message_t *response)
+{
+#if COAP_RESPONSE_CACHE_SIZE
+  cache_entry_t *e;
+  const char *query;
+  size_t query_len;
+  unsigned int accept;
+  uint8_t has_accept;
+  uint64_t now;
+
+  if(!is_cacheable_request(resource, request)
+     || !is_cacheable_response(response)
+     || !get_key(request, &query, &query_len, &accept, &has_accept)) {
+    return;
+  }
+
+  now = coap_timer_uptime();
+  e = find_entry(resource, query, query_len, accept, has_accept);
+  if(e == NULL) {
+    e = get_free_entry(now);
+  }
+
+  LOG_DBG("Caching /%s for %"PRIu32" s\n", resource->url, response->max_age);
+
+  e->resource = resource;
+  e->expires = now + response->max_age * 1000ULL;
+  e->last_used = now;
+  e->has_accept = has_accept;
+  e->accept = accept;
+  e->query_len = query_len;
+  memcpy(e->query, query, query_len);
+  e->has_content_format = coap_is_option(response,
+                                         COAP_OPTION_CONTENT_FORMAT);
+  e->content_format = e->has_content_format ? response->content_format : 0;
+  e->payload_len = response->payload_len;
+  memcpy(e->payload, response->payload, response->payload_len);
+
+  if(coap_is_option(response, COAP_OPTION_ETAG)) {
+    e->etag_len = response->etag_len;
+    memcpy(e->etag, response->etag, response->etag_len);
+  } else {
+    e->etag_len = ETAG_LEN;
+    make_etag(e->etag, e->content_format, e->payload, e->payload_len);
+    coap_set_header_etag(response, e->etag, e->etag_len);
+  }
+#endif /* COAP_RESPONSE_CACHE_SIZE */
+}
+/*---------------------------------------------------------------------------*/
+void
+coap_cache_invalidate(coap_resource_t *resource)
+{
+#if COAP_RESPONSE_CACHE_SIZE
+  uint64_t now = coap_timer_uptime();
+  int i;
+
+  for(i = 0; i < COAP_RESPONSE_CACHE_SIZE; i++) {
+    if(cache[i].resource == resource) {
+      if(cache[i].expires > now) {
+        stats.invalidations++;
+      }
+      cache[i].resource = NULL;
+    }
+  }
+#endif /* COAP_RESPONSE_CACHE_SIZE */
+}
+/*---------------------------------------------------------------------------*/
+const coap_cache_stats_t *
+coap_cache_get_stats(void)
+{
+  return &stats;
+}
+/*---------------------------------------------------------------------------*/
+/** @} */
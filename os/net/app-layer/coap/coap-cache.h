@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2018, RISE SICS.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * \file
+ *      Server-side cache of CoAP responses to GET requests.
+ */
+
+/**
+ * \addtogroup coap
+ * @{
+ */
+
+#ifndef COAP_CACHE_H_
+#define COAP_CACHE_H_
+
+#include "coap.h"
+#include "coap-engine.h"
+
+typedef struct coap_cache_stats {
+  uint32_t hits;          /* responses served from the cache */
+  uint32_t validations;   /* hits answered with 2.03 Valid */
+  uint32_t misses;        /* cacheable requests passed to the handler */
+  uint32_t invalidations; /* responses dropped before they were stale */
+} coap_cache_stats_t;
+
+/**
+ * \brief Answer a GET request from the cache
+ * \param resource The resource of the request
+ * \param request  The request
+ * \param response The response to fill in
+ * \param buffer   The buffer for the payload of the response
+ * \param buffer_size The size of the buffer
+ * \return 1 if the response was filled in, 0 if the handler must be called
+ */
+int coap_cache_lookup(coap_resource_t *resource, coap_message_t *request,
+                      coap_message_t *response, uint8_t *buffer,
+                      uint16_t buffer_size);
+
+/**
+ * \brief Keep the response of a resource handler to a GET request
+ *
+ * Only 2.05 responses that set Max-Age and no options but Content-Format
+ * and ETag are kept. An ETag is added to responses without one, so that
+ * clients can validate them.
+ */
+void coap_cache_store(coap_resource_t *resource, coap_message_t *request,
+                      coap_message_t *response);
+
+/**
+ * \brief Drop the cached responses of a resource, e.g. when it changes
+ */
+void coap_cache_invalidate(coap_resource_t *resource);
+
+const coap_cache_stats_t *coap_cache_get_stats(void);
+
+#endif /* COAP_CACHE_H_ */
+/** @} */
@@ -73,6 +73,27 @@
 #define COAP_PROXY_OPTION_PROCESSING   0
 #endif /* COAP_PROXY_OPTION_PROCESSING */
 
+/*
+ * Number of options the parser records in an index of the message. With an
+ * index, repeated options such as Uri-Path are joined in place only when
+ * their getter is first called, and the values can be read one by one with
+ * coap_get_option_value(). Messages with more options are rejected. 0
+ * disables the index.
+ */
+#ifndef COAP_MAX_INDEXED_OPTIONS
+#define COAP_MAX_INDEXED_OPTIONS       0
+#endif /* COAP_MAX_INDEXED_OPTIONS */
+
+/*
+ * Number of nodes of the prefix tree of resource paths, one per distinct
+ * path segment. Requests are dispatched by walking the tree instead of
+ * comparing the path with every resource. Resources that do not fit are
+ * still found by a linear scan. 0 disables the tree.
+ */
+#ifndef COAP_DISPATCH_TREE_NODES
+#define COAP_DISPATCH_TREE_NODES       0
+#endif /* COAP_DISPATCH_TREE_NODES */
+
 /* Listening port for the CoAP REST Engine */
 #ifndef COAP_SERVER_PORT
 #define COAP_SERVER_PORT               COAP_DEFAULT_PORT
@@ -83,6 +104,31 @@
 #define COAP_MAX_OPEN_TRANSACTIONS     4
 #endif /* COAP_MAX_OPEN_TRANSACTIONS */
 
+/* Number of buckets of the index of the open transactions by MID */
+#ifndef COAP_TRANSACTION_HASH_SIZE
+#define COAP_TRANSACTION_HASH_SIZE     8
+#endif /* COAP_TRANSACTION_HASH_SIZE */
+
+/*
+ * Maximum number of outstanding confirmable messages to an endpoint
+ * (NSTART, RFC 7252 4.7). Further messages wait until one of them is
+ * acknowledged or times out. 0, the default, removes the limit.
+ */
+#ifndef COAP_NSTART
+#define COAP_NSTART                    0
+#endif /* COAP_NSTART */
+
+/*
+ * Average rate in bytes per second to an endpoint that does not respond
+ * (PROBING_RATE, RFC 7252 4.7). After a timeout, the next confirmable
+ * message to the endpoint waits for its length divided by this rate.
+ * Only messages queued by COAP_NSTART wait. 0, the default, sends them
+ * at once.
+ */
+#ifndef COAP_PROBING_RATE
+#define COAP_PROBING_RATE              0
+#endif /* COAP_PROBING_RATE */
+
 /* Maximum number of failed request attempts before action */
 #ifndef COAP_MAX_ATTEMPTS
 #define COAP_MAX_ATTEMPTS              4
@@ -103,5 +149,67 @@
 #define COAP_OBSERVE_REFRESH_INTERVAL  20
 #endif /* COAP_OBSERVE_REFRESH_INTERVAL */
 
+/*
+ * Minimum time in milliseconds between two notifications to the same
+ * observer. A state that changes faster is sent when the interval has
+ * elapsed, and only the last state is sent. RFC 7641 asks for at most one
+ * notification per round-trip time, or one every 3 s when it is unknown.
+ * 0 sends every state at once.
+ */
+#ifndef COAP_OBSERVE_MIN_INTERVAL
+#define COAP_OBSERVE_MIN_INTERVAL      0
+#endif /* COAP_OBSERVE_MIN_INTERVAL */
+
+/*
+ * Number of GET responses kept by the server. A 2.05 response that sets
+ * Max-Age is served again from the cache, without calling the resource
+ * handler, until it is stale or the resource changes. 0 disables the
+ * cache.
+ */
+#ifndef COAP_RESPONSE_CACHE_SIZE
+#define COAP_RESPONSE_CACHE_SIZE       0
+#endif /* COAP_RESPONSE_CACHE_SIZE */
+
+/* Largest payload of a cached response */
+#ifndef COAP_RESPONSE_CACHE_PAYLOAD_LEN
+#define COAP_RESPONSE_CACHE_PAYLOAD_LEN 64
+#endif /* COAP_RESPONSE_CACHE_PAYLOAD_LEN */
+
+/* Longest Uri-Query of a cached response */
+#ifndef COAP_RESPONSE_CACHE_QUERY_LEN
+#define COAP_RESPONSE_CACHE_QUERY_LEN  16
+#endif /* COAP_RESPONSE_CACHE_QUERY_LEN */
+
+/*
+ * Number of Block2 requests of a block-wise download that are in flight
+ * at once. Requests beyond COAP_NSTART wait in the transaction layer, so
+ * the default follows it, and is one block per round-trip without it.
+ */
+#ifndef COAP_BLOCKWISE_WINDOW
+#if COAP_NSTART
+#define COAP_BLOCKWISE_WINDOW          COAP_NSTART
+#else /* COAP_NSTART */
+#define COAP_BLOCKWISE_WINDOW          1
+#endif /* COAP_NSTART */
+#endif /* COAP_BLOCKWISE_WINDOW */
+
+/*
+ * Number of concurrent DTLS sessions. An established session is reused
+ * by coap_endpoint_connect(), and the least recently used one is closed
+ * to make room for a new peer. On the server side, that happens once the
+ * new peer has passed the cookie exchange.
+ */
+#ifndef COAP_DTLS_MAX_PEERS
+#define COAP_DTLS_MAX_PEERS            2
+#endif /* COAP_DTLS_MAX_PEERS */
+
+/*
+ * Time in seconds after which coap_endpoint_connect() gives up on a
+ * handshake that has not completed, resets the peer and starts again.
+ */
+#ifndef COAP_DTLS_HANDSHAKE_TIMEOUT
+#define COAP_DTLS_HANDSHAKE_TIMEOUT    30
+#endif /* COAP_DTLS_HANDSHAKE_TIMEOUT */
+
 #endif /* COAP_CONF_H_ */
 /** @} */
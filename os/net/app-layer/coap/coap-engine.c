@@ -72,6 +72,30 @@ LIST(coap_handlers);
 LIST(coap_resource_services);
 static uint8_t is_initialized = 0;
 
+#if COAP_DISPATCH_TREE_NODES
+/* A path segment of the activated resources */
+struct dispatch_node {
+  struct dispatch_node *child;
+  struct dispatch_node *sibling;
+  coap_resource_t *resource;
+  const char *segment;
+  uint16_t segment_len;
+};
+
+/* Position of a request path in the tree */
+struct dispatch_walk {
+  const struct dispatch_node *node;
+  coap_resource_t *parent;
+};
+
+/* The root is the empty path */
+static struct dispatch_node dispatch_root;
+static struct dispatch_node dispatch_nodes[COAP_DISPATCH_TREE_NODES];
+static uint16_t dispatch_nodes_used;
+/* set when some resources did not fit in the tree */
+static uint8_t dispatch_incomplete;
+#endif /* COAP_DISPATCH_TREE_NODES */
+
 /*---------------------------------------------------------------------------*/
 /*- CoAP service handlers---------------------------------------------------*/
 /*---------------------------------------------------------------------------*/
@@ -159,9 +183,16 @@ coap_receive(const coap_endpoint_t *src,
 
     LOG_DBG("  Parsed: v %u, t %u, tkl %u, c %u, mid %u\n", message->version,
             message->type, message->token_len, message->code, message->mid);
-    LOG_DBG("  URL:");
-    LOG_DBG_COAP_STRING(message->uri_path, message->uri_path_len);
-    LOG_DBG_("\n");
+    if(LOG_DBG_ENABLED) {
+      const char *url = NULL;
+      int url_len;
+
+      /* joins the Uri-Path options, if not done yet */
+      url_len = coap_get_header_uri_path(message, &url);
+      LOG_DBG("  URL:");
+      LOG_DBG_COAP_STRING(url, url_len);
+      LOG_DBG_("\n");
+    }
     LOG_DBG("  Payload: ");
     LOG_DBG_COAP_STRING((const char *)message->payload, message->payload_len);
     LOG_DBG_("\n");
@@ -357,6 +388,97 @@ coap_receive(const coap_endpoint_t *src,
   /* if(new data) */
   return coap_status_code;
 }
+#if COAP_DISPATCH_TREE_NODES
+/*---------------------------------------------------------------------------*/
+static struct dispatch_node *
+dispatch_find_child(const struct dispatch_node *node, const char *segment,
+                    size_t segment_len)
+{
+  struct dispatch_node *child;
+
+  for(child = node->child; child != NULL; child = child->sibling) {
+    if(child->segment_len == segment_len
+       && memcmp(child->segment, segment, segment_len) == 0) {
+      return child;
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static void
+dispatch_tree_add(coap_resource_t *resource)
+{
+  struct dispatch_node *node = &dispatch_root;
+  struct dispatch_node *child;
+  const char *segment = resource->url;
+  const char *end;
+
+  if(*segment != '\0') {
+    do {
+      end = strchr(segment, '/');
+      if(end == NULL) {
+        end = segment + strlen(segment);
+      }
+      child = dispatch_find_child(node, segment, end - segment);
+      if(child == NULL) {
+        if(dispatch_nodes_used == COAP_DISPATCH_TREE_NODES) {
+          LOG_WARN("dispatch tree full, /%s is looked up linearly\n",
+                   resource->url);
+          dispatch_incomplete = 1;
+          return;
+        }
+        child = &dispatch_nodes[dispatch_nodes_used++];
+        child->segment = segment;
+        child->segment_len = end - segment;
+        child->resource = NULL;
+        child->child = NULL;
+        child->sibling = node->child;
+        node->child = child;
+      }
+      node = child;
+      segment = end + 1;
+    } while(*end == '/');
+  }
+
+  /* Like the list, the first resource activated for a path wins */
+  if(node->resource == NULL) {
+    node->resource = resource;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+dispatch_tree_build(void)
+{
+  coap_resource_t *resource;
+
+  memset(&dispatch_root, 0, sizeof(dispatch_root));
+  dispatch_nodes_used = 0;
+  dispatch_incomplete = 0;
+  for(resource = list_head(coap_resource_services);
+      resource; resource = resource->next) {
+    dispatch_tree_add(resource);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Descend into the next segment of the request path */
+static void
+dispatch_step(struct dispatch_walk *walk, const char *segment,
+              size_t segment_len)
+{
+  if(walk->node == NULL) {
+    return;
+  }
+  if(walk->node == &dispatch_root && segment_len == 0) {
+    /* leading empty segments are dropped when joining, do the same */
+    return;
+  }
+  if(walk->node != &dispatch_root && walk->node->resource != NULL
+     && (walk->node->resource->flags & HAS_SUB_RESOURCES)) {
+    walk->parent = walk->node->resource;
+  }
+  walk->node = dispatch_find_child(walk->node, segment, segment_len);
+}
+#endif /* COAP_DISPATCH_TREE_NODES */
 /*---------------------------------------------------------------------------*/
 void
 coap_engine_init(void)
@@ -372,6 +494,9 @@ coap_engine_init(void)
 
   list_init(coap_handlers);
   list_init(coap_resource_services);
+#if COAP_DISPATCH_TREE_NODES
+  dispatch_tree_build();
+#endif /* COAP_DISPATCH_TREE_NODES */
 
   coap_activate_resource(&res_well_known_core, ".well-known/core");
 
@@ -392,9 +517,29 @@ void
 coap_activate_resource(coap_resource_t *resource, const char *path)
 {
   coap_periodic_resource_t *periodic;
+#if COAP_DISPATCH_TREE_NODES
+  coap_resource_t *active;
+
+  for(active = list_head(coap_resource_services);
+      active != NULL; active = active->next) {
+    if(active == resource) {
+      break;
+    }
+  }
+#endif /* COAP_DISPATCH_TREE_NODES */
+
   resource->url = path;
   list_add(coap_resource_services, resource);
 
+#if COAP_DISPATCH_TREE_NODES
+  if(active != NULL) {
+    /* activated again, maybe under another path */
+    dispatch_tree_build();
+  } else {
+    dispatch_tree_add(resource);
+  }
+#endif /* COAP_DISPATCH_TREE_NODES */
+
   LOG_INFO("Activating: %s\n", resource->url);
 
   /* Only add periodic resources with a periodic_handler and a period > 0. */
@@ -425,14 +570,9 @@ coap_get_next_resource(coap_resource_t *resource)
   return list_item_next(resource);
 }
 /*---------------------------------------------------------------------------*/
-static int
-invoke_coap_resource_service(coap_message_t *request, coap_message_t *response,
-                             uint8_t *buffer, uint16_t buffer_size,
-                             int32_t *offset)
+static coap_resource_t *
+find_resource_linear(coap_message_t *request)
 {
-  uint8_t found = 0;
-  uint8_t allowed = 1;
-
   coap_resource_t *resource = NULL;
   const char *url = NULL;
   int url_len, res_url_len;
@@ -448,42 +588,120 @@ invoke_coap_resource_service(coap_message_t *request, coap_message_t *response,
             && (resource->flags & HAS_SUB_RESOURCES)
             && url[res_url_len] == '/'))
        && strncmp(resource->url, url, res_url_len) == 0) {
-      coap_resource_flags_t method = coap_get_method_type(request);
-      found = 1;
-
-      LOG_INFO("/%s, method %u, resource->flags %u\n", resource->url,
-               (uint16_t)method, resource->flags);
-
-      if((method & METHOD_GET) && resource->get_handler != NULL) {
-        /* call handler function */
-        resource->get_handler(request, response, buffer, buffer_size, offset);
-      } else if((method & METHOD_POST) && resource->post_handler != NULL) {
-        /* call handler function */
-        resource->post_handler(request, response, buffer, buffer_size,
-                               offset);
-      } else if((method & METHOD_PUT) && resource->put_handler != NULL) {
-        /* call handler function */
-        resource->put_handler(request, response, buffer, buffer_size, offset);
-      } else if((method & METHOD_DELETE) && resource->delete_handler != NULL) {
-        /* call handler function */
-        resource->delete_handler(request, response, buffer, buffer_size,
-                                 offset);
-      } else {
-        allowed = 0;
-        coap_set_status_code(response, METHOD_NOT_ALLOWED_4_05);
+      return resource;
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+coap_resource_t *
+coap_find_resource(coap_message_t *request)
+{
+#if COAP_DISPATCH_TREE_NODES
+  /*
+   * Walk the request path down the tree. A resource with exactly this path
+   * is preferred over the deepest parent that has sub-resources.
+   */
+  struct dispatch_walk walk = { &dispatch_root, NULL };
+  const char *url = NULL;
+  const char *end;
+  const char *separator;
+  int url_len;
+#if COAP_MAX_INDEXED_OPTIONS
+  const coap_option_ref_t *ref;
+
+  if(request->uri_path == NULL) {
+    /* not joined yet: read the segments in place */
+    for(ref = request->option_index;
+        ref < request->option_index + request->option_count && walk.node;
+        ref++) {
+      if(ref->number == COAP_OPTION_URI_PATH) {
+        dispatch_step(&walk, (const char *)request->buffer + ref->offset,
+                      ref->len);
       }
-      break;
     }
+  } else
+#endif /* COAP_MAX_INDEXED_OPTIONS */
+  {
+    url_len = coap_get_header_uri_path(request, &url);
+    if(url_len > 0) {
+      end = url + url_len;
+      do {
+        separator = memchr(url, '/', end - url);
+        if(separator == NULL) {
+          separator = end;
+        }
+        dispatch_step(&walk, url, separator - url);
+        url = separator + 1;
+      } while(separator != end && walk.node != NULL);
+    }
+  }
+
+  if(walk.node != NULL && walk.node->resource != NULL) {
+    return walk.node->resource;
+  }
+  if(dispatch_incomplete) {
+    /* the resource may be one that is missing from the tree */
+    return find_resource_linear(request);
   }
-  if(!found) {
+  return walk.parent;
+#else /* COAP_DISPATCH_TREE_NODES */
+  return find_resource_linear(request);
+#endif /* COAP_DISPATCH_TREE_NODES */
+}
+/*---------------------------------------------------------------------------*/
+static int
+invoke_coap_resource_service(coap_message_t *request, coap_message_t *response,
+                             uint8_t *buffer, uint16_t buffer_size,
+                             int32_t *offset)
+{
+  uint8_t allowed = 1;
+  coap_resource_t *resource;
+
+  resource = coap_find_resource(request);
+  if(resource == NULL) {
     coap_set_status_code(response, NOT_FOUND_4_04);
-  } else if(allowed) {
+    return 0;
+  }
+
+  coap_resource_flags_t method = coap_get_method_type(request);
+
+  LOG_INFO("/%s, method %u, resource->flags %u\n", resource->url,
+           (uint16_t)method, resource->flags);
+
+  if((method & METHOD_GET) && resource->get_handler != NULL) {
+    if(!coap_cache_lookup(resource, request, response, buffer, buffer_size)) {
+      /* call handler function */
+      resource->get_handler(request, response, buffer, buffer_size, offset);
+      if(*offset == 0) {
+        /* not a blockwise response */
+        coap_cache_store(resource, request, response);
+      }
+    }
+  } else if((method & METHOD_POST) && resource->post_handler != NULL) {
+    /* call handler function */
+    resource->post_handler(request, response, buffer, buffer_size, offset);
+    coap_cache_invalidate(resource);
+  } else if((method & METHOD_PUT) && resource->put_handler != NULL) {
+    /* call handler function */
+    resource->put_handler(request, response, buffer, buffer_size, offset);
+    coap_cache_invalidate(resource);
+  } else if((method & METHOD_DELETE) && resource->delete_handler != NULL) {
+    /* call handler function */
+    resource->delete_handler(request, response, buffer, buffer_size, offset);
+    coap_cache_invalidate(resource);
+  } else {
+    allowed = 0;
+    coap_set_status_code(response, METHOD_NOT_ALLOWED_4_05);
+  }
+
+  if(allowed) {
     /* final handler for special flags */
     if(resource->flags & IS_OBSERVABLE) {
       coap_observe_handler(resource, request, response);
     }
   }
-  return found & allowed;
+  return allowed;
 }
 /*---------------------------------------------------------------------------*/
 /* This callback occurs when t is expired */
@@ -167,10 +167,18 @@ coap_resource_t *coap_get_first_resource(void);
  */
 coap_resource_t *coap_get_next_resource(coap_resource_t *resource);
 /*---------------------------------------------------------------------------*/
+/**
+ * \brief      Returns the resource that serves the URI path of a request.
+ * \param request The parsed request
+ * \return     The resource or NULL if none matches.
+ */
+coap_resource_t *coap_find_resource(coap_message_t *request);
+/*---------------------------------------------------------------------------*/
 
 #include "coap-transactions.h"
 #include "coap-observe.h"
 #include "coap-separate.h"
+#include "coap-cache.h"
 #include "coap-observe-client.h"
 #include "coap-transport.h"
 
@@ -79,6 +79,10 @@ add_observer(const coap_endpoint_t *endpoint, const uint8_t *token,
     o->token_len = token_len;
     memcpy(o->token, token, token_len);
     o->last_mid = 0;
+    o->resource = NULL;
+    /* the response to the registration is the first notification */
+    o->last_notify = coap_timer_uptime();
+    coap_timer_stop(&o->notify_timer);
 
     LOG_INFO("Adding observer (%u/%u) for /%s [0x%02X%02X]\n",
              list_length(observers_list) + 1, COAP_MAX_OBSERVERS,
@@ -97,6 +101,7 @@ coap_remove_observer(coap_observer_t *o)
   LOG_INFO("Removing observer for /%s [0x%02X%02X]\n", o->url, o->token[0],
            o->token[1]);
 
+  coap_timer_stop(&o->notify_timer);
   memb_free(&observers_memb, o);
   list_remove(observers_list, o);
 }
@@ -180,6 +185,315 @@ coap_remove_observer_by_mid(const coap_endpoint_t *endpoint, uint16_t mid)
 /*---------------------------------------------------------------------------*/
 /*- Notification ------------------------------------------------------------*/
 /*---------------------------------------------------------------------------*/
+/* The unacknowledged confirmable notification to an observer, if any */
+static coap_transaction_t *
+get_notification_in_flight(const coap_observer_t *obs)
+{
+  coap_transaction_t *t = coap_get_transaction_by_mid(obs->last_mid);
+
+  if(t != NULL && coap_endpoint_cmp(&t->endpoint, &obs->endpoint)
+     && COAP_TYPE_CON ==
+     ((COAP_HEADER_TYPE_MASK & t->message[0]) >> COAP_HEADER_TYPE_POSITION)
+     && (t->message[0] & COAP_HEADER_TOKEN_LEN_MASK) == obs->token_len
+     && memcmp(&t->message[COAP_HEADER_LEN], obs->token, obs->token_len) == 0) {
+    return t;
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+/* Locate the Observe option, header included, in a serialized message */
+static int
+find_observe_option(const uint8_t *message, uint16_t len,
+                    uint16_t *start, uint16_t *end)
+{
+  uint16_t pos = COAP_HEADER_LEN + (message[0] & COAP_HEADER_TOKEN_LEN_MASK);
+  unsigned int number = 0;
+  unsigned int delta;
+  unsigned int option_len;
+  unsigned int header;
+
+  while(pos < len && message[pos] != 0xFF) {
+    delta = message[pos] >> 4;
+    option_len = message[pos] & COAP_HEADER_OPTION_SHORT_LENGTH_MASK;
+    header = 1;
+    if(delta == 13) {
+      delta += message[pos + header];
+      header++;
+    } else if(delta == 14) {
+      delta = 269 + (message[pos + header] << 8) + message[pos + header + 1];
+      header += 2;
+    }
+    if(option_len == 13) {
+      option_len += message[pos + header];
+      header++;
+    } else if(option_len == 14) {
+      option_len = 269 + (message[pos + header] << 8)
+        + message[pos + header + 1];
+      header += 2;
+    }
+    number += delta;
+    if(number == COAP_OPTION_OBSERVE) {
+      *start = pos;
+      *end = pos + header + option_len;
+      return 1;
+    }
+    if(number > COAP_OPTION_OBSERVE) {
+      break;
+    }
+    pos += header + option_len;
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Make the notification of another observer from a serialized one: only
+ * the type, the MID, the token and the Observe value differ.
+ */
+static uint16_t
+copy_notification(uint8_t *dst, const uint8_t *src, uint16_t src_len,
+                  coap_message_type_t type, uint16_t mid,
+                  const coap_observer_t *obs)
+{
+  uint16_t options = COAP_HEADER_LEN + (src[0] & COAP_HEADER_TOKEN_LEN_MASK);
+  uint16_t start;
+  uint16_t end;
+  uint16_t len;
+  uint8_t observe[3];
+  uint8_t observe_len = 0;
+  int has_observe;
+
+  has_observe = find_observe_option(src, src_len, &start, &end);
+  if(has_observe) {
+    if(obs->obs_counter & 0xFF0000) {
+      observe[observe_len++] = obs->obs_counter >> 16;
+    }
+    if(obs->obs_counter & 0xFFFF00) {
+      observe[observe_len++] = obs->obs_counter >> 8;
+    }
+    if(obs->obs_counter & 0xFFFFFF) {
+      observe[observe_len++] = obs->obs_counter;
+    }
+  } else {
+    /* error responses have no Observe option */
+    start = end = options;
+  }
+
+  len = COAP_HEADER_LEN + obs->token_len + (start - options)
+    + (has_observe ? 1 + observe_len : 0) + (src_len - end);
+  if(len > COAP_MAX_PACKET_SIZE) {
+    return 0;
+  }
+
+  dst[0] = (src[0] & COAP_HEADER_VERSION_MASK)
+    | (type << COAP_HEADER_TYPE_POSITION) | obs->token_len;
+  dst[1] = src[1];
+  dst[2] = mid >> 8;
+  dst[3] = mid;
+  memcpy(&dst[COAP_HEADER_LEN], obs->token, obs->token_len);
+  dst += COAP_HEADER_LEN + obs->token_len;
+  memcpy(dst, &src[options], start - options);
+  dst += start - options;
+  if(has_observe) {
+    /* the Observe option follows the same option: only its length changes */
+    *dst++ = (src[start] & COAP_HEADER_OPTION_DELTA_MASK) | observe_len;
+    memcpy(dst, observe, observe_len);
+    dst += observe_len;
+  }
+  memcpy(dst, &src[end], src_len - end);
+  return len;
+}
+/*---------------------------------------------------------------------------*/
+/* Run the handler of the resource and serialize the notification */
+static uint16_t
+build_notification(coap_resource_t *resource, coap_message_t *request,
+                   coap_transaction_t *transaction, coap_message_type_t type,
+                   const coap_observer_t *obs)
+{
+  coap_message_t notification[1]; /* this way the message can be treated as pointer as usual */
+  int32_t new_offset = 0;
+
+  coap_init_message(notification, type, CONTENT_2_05, transaction->mid);
+
+  /* Either old style get_handler or the full handler */
+  if(coap_call_handlers(request, notification, transaction->message +
+                        COAP_MAX_HEADER_SIZE, COAP_MAX_CHUNK_SIZE,
+                        &new_offset) > 0) {
+    LOG_DBG("Notification on new handlers\n");
+  } else {
+    if(resource != NULL) {
+      resource->get_handler(request, notification,
+                            transaction->message + COAP_MAX_HEADER_SIZE,
+                            COAP_MAX_CHUNK_SIZE, &new_offset);
+    } else {
+      /* What to do here? */
+      notification->code = BAD_REQUEST_4_00;
+    }
+  }
+
+  if(notification->code < BAD_REQUEST_4_00) {
+    coap_set_header_observe(notification, obs->obs_counter);
+  }
+  coap_set_token(notification, obs->token, obs->token_len);
+
+  if(new_offset != 0) {
+    coap_set_header_block2(notification,
+                           0,
+                           new_offset != -1,
+                           COAP_MAX_BLOCK_SIZE);
+    coap_set_payload(notification,
+                     notification->payload,
+                     MIN(notification->payload_len,
+                         COAP_MAX_BLOCK_SIZE));
+  }
+
+  return coap_serialize_message(notification, transaction->message);
+}
+/*---------------------------------------------------------------------------*/
+#if COAP_OBSERVE_MIN_INTERVAL
+static void notify(coap_resource_t *resource, const char *url,
+                   coap_observer_t *only, uint8_t sub);
+
+static void
+notify_deferred(coap_timer_t *timer)
+{
+  coap_observer_t *obs = coap_timer_get_user_data(timer);
+
+  LOG_DBG("Deferred notification for /%s\n", obs->url);
+  notify(obs->resource, obs->url, obs, 1);
+}
+/*---------------------------------------------------------------------------*/
+/* Keep to one notification per interval, the last state is sent later */
+static int
+defer_notification(coap_observer_t *obs)
+{
+  uint64_t elapsed = coap_timer_uptime() - obs->last_notify;
+
+  if(elapsed >= COAP_OBSERVE_MIN_INTERVAL) {
+    return 0;
+  }
+  if(coap_timer_expired(&obs->notify_timer)) {
+    coap_timer_set_callback(&obs->notify_timer, notify_deferred);
+    coap_timer_set_user_data(&obs->notify_timer, obs);
+    coap_timer_set(&obs->notify_timer, COAP_OBSERVE_MIN_INTERVAL - elapsed);
+  }
+  return 1;
+}
+#endif /* COAP_OBSERVE_MIN_INTERVAL */
+/*---------------------------------------------------------------------------*/
+/*
+ * Notify the observers of url, or only one observer. Unless sub is zero,
+ * the observers of sub-resources of url are also notified. The handler
+ * runs and the message is serialized once, for the first observer. A
+ * confirmable notification that is still unacknowledged is replaced by the
+ * new state and keeps its retransmission state (RFC 7641, 4.5.2).
+ */
+static void
+notify(coap_resource_t *resource, const char *url, coap_observer_t *only,
+       uint8_t sub)
+{
+  coap_message_t request[1]; /* this way the message can be treated as pointer as usual */
+  coap_observer_t *obs = NULL;
+  coap_transaction_t *transaction;
+  coap_transaction_t *first = NULL;
+  coap_message_type_t type;
+  uint8_t send_first = 0;
+  uint8_t in_flight;
+  int url_len, obs_url_len;
+  uint8_t sub_ok = 0;
+
+  /* create a "fake" request for the URI */
+  coap_init_message(request, COAP_TYPE_CON, COAP_GET, 0);
+  coap_set_header_uri_path(request, url);
+
+  /* iterate over observers */
+  url_len = strlen(url);
+  /* Assumes lazy evaluation... */
+  sub_ok = sub &&
+    ((resource == NULL) || (resource->flags & HAS_SUB_RESOURCES));
+  for(obs = only != NULL ? only : list_head(observers_list); obs;
+      obs = only != NULL ? NULL : obs->next) {
+    obs_url_len = strlen(obs->url);
+
+    /* Do a match based on the parent/sub-resource match so that it is
+       possible to do parent-node observe */
+    if(only == NULL
+       && !((obs_url_len == url_len
+             || (obs_url_len > url_len
+                 && sub_ok
+                 && obs->url[url_len] == '/'))
+            && strncmp(url, obs->url, url_len) == 0)) {
+      continue;
+    }
+
+    transaction = get_notification_in_flight(obs);
+    in_flight = transaction != NULL;
+    if(in_flight) {
+      LOG_DBG("           Replacing MID %u for ", transaction->mid);
+      coap_set_transaction_mid(transaction, coap_get_mid());
+      type = COAP_TYPE_CON;
+    } else {
+#if COAP_OBSERVE_MIN_INTERVAL
+      if(only == NULL && defer_notification(obs)) {
+        obs->resource = resource;
+        continue;
+      }
+#endif /* COAP_OBSERVE_MIN_INTERVAL */
+      transaction = coap_new_transaction(coap_get_mid(), &obs->endpoint);
+      if(transaction == NULL) {
+        LOG_WARN("No transaction for a notification\n");
+        continue;
+      }
+      if(obs->obs_counter % COAP_OBSERVE_REFRESH_INTERVAL == 0) {
+        LOG_DBG("           Force Confirmable for\n");
+        type = COAP_TYPE_CON;
+      } else {
+        type = COAP_TYPE_NON;
+      }
+    }
+
+    LOG_DBG("           Observer ");
+    LOG_DBG_COAP_EP(&obs->endpoint);
+    LOG_DBG_("\n");
+
+    /* update last MID for RST matching */
+    obs->last_mid = transaction->mid;
+    obs->resource = resource;
+    obs->last_notify = coap_timer_uptime();
+
+    if(first == NULL) {
+      transaction->message_len = build_notification(resource, request,
+                                                    transaction, type, obs);
+    } else {
+      transaction->message_len = copy_notification(transaction->message,
+                                                   first->message,
+                                                   first->message_len,
+                                                   type, transaction->mid,
+                                                   obs);
+    }
+    if(transaction->message_len == 0) {
+      coap_clear_transaction(transaction);
+      continue;
+    }
+
+    if(transaction->message[1] < BAD_REQUEST_4_00) {
+      /* mask out to keep the CoAP observe option length <= 3 bytes */
+      obs->obs_counter = (obs->obs_counter + 1) & 0xffffff;
+    }
+
+    if(first == NULL) {
+      /* sent last, the others are copied from it */
+      first = transaction;
+      send_first = !in_flight;
+    } else if(!in_flight) {
+      coap_send_transaction(transaction);
+    }
+  }
+
+  if(send_first) {
+    coap_send_transaction(first);
+  }
+}
+/*---------------------------------------------------------------------------*/
 void
 coap_notify_observers(coap_resource_t *resource)
 {
@@ -190,15 +504,11 @@ coap_notify_observers(coap_resource_t *resource)
 void
 coap_notify_observers_sub(coap_resource_t *resource, const char *subpath)
 {
-  /* build notification */
-  coap_message_t notification[1]; /* this way the message can be treated as pointer as usual */
-  coap_message_t request[1]; /* this way the message can be treated as pointer as usual */
-  coap_observer_t *obs = NULL;
-  int url_len, obs_url_len;
+  int url_len;
   char url[COAP_OBSERVER_URL_LEN];
-  uint8_t sub_ok = 0;
 
   if(resource != NULL) {
+    coap_cache_invalidate(resource);
     url_len = strlen(resource->url);
     strncpy(url, resource->url, COAP_OBSERVER_URL_LEN - 1);
     if(url_len < COAP_OBSERVER_URL_LEN - 1 && subpath != NULL) {
@@ -216,92 +526,13 @@ coap_notify_observers_sub(coap_resource_t *resource, const char *subpath)
   /* url now contains the notify URL that needs to match the observer */
   LOG_INFO("Notification from %s\n", url);
 
-  coap_init_message(notification, COAP_TYPE_NON, CONTENT_2_05, 0);
-  /* create a "fake" request for the URI */
-  coap_init_message(request, COAP_TYPE_CON, COAP_GET, 0);
-  coap_set_header_uri_path(request, url);
-
-  /* iterate over observers */
-  url_len = strlen(url);
-  /* Assumes lazy evaluation... */
-  sub_ok = (resource == NULL) || (resource->flags & HAS_SUB_RESOURCES);
-  for(obs = (coap_observer_t *)list_head(observers_list); obs;
-      obs = obs->next) {
-    obs_url_len = strlen(obs->url);
-
-    /* Do a match based on the parent/sub-resource match so that it is
-       possible to do parent-node observe */
-
-    /***** TODO fix here so that we handle the notofication correctly ******/
-    /* All the new-style ... is assuming that the URL might be within */
-    if((obs_url_len == url_len
-        || (obs_url_len > url_len
-            && sub_ok
-            && obs->url[url_len] == '/'))
-       && strncmp(url, obs->url, url_len) == 0) {
-      coap_transaction_t *transaction = NULL;
-
-      /*TODO implement special transaction for CON, sharing the same buffer to allow for more observers */
-
-      if((transaction = coap_new_transaction(coap_get_mid(), &obs->endpoint))) {
-        if(obs->obs_counter % COAP_OBSERVE_REFRESH_INTERVAL == 0) {
-          LOG_DBG("           Force Confirmable for\n");
-          notification->type = COAP_TYPE_CON;
-        }
-
-        LOG_DBG("           Observer ");
-        LOG_DBG_COAP_EP(&obs->endpoint);
-        LOG_DBG_("\n");
-
-        /* update last MID for RST matching */
-        obs->last_mid = transaction->mid;
-
-        /* prepare response */
-        notification->mid = transaction->mid;
-
-	int32_t new_offset = 0;
-
-        /* Either old style get_handler or the full handler */
-        if(coap_call_handlers(request, notification, transaction->message +
-                              COAP_MAX_HEADER_SIZE, COAP_MAX_CHUNK_SIZE,
-                              &new_offset) > 0) {
-          LOG_DBG("Notification on new handlers\n");
-        } else {
-          if(resource != NULL) {
-            resource->get_handler(request, notification,
-                                  transaction->message + COAP_MAX_HEADER_SIZE,
-                                  COAP_MAX_CHUNK_SIZE, &new_offset);
-          } else {
-            /* What to do here? */
-            notification->code = BAD_REQUEST_4_00;
-          }
-        }
-
-        if(notification->code < BAD_REQUEST_4_00) {
-          coap_set_header_observe(notification, (obs->obs_counter)++);
-          /* mask out to keep the CoAP observe option length <= 3 bytes */
-          obs->obs_counter &= 0xffffff;
-        }
-        coap_set_token(notification, obs->token, obs->token_len);
-
-	if(new_offset != 0) {
-	  coap_set_header_block2(notification,
-				 0,
-				 new_offset != -1,
-				 COAP_MAX_BLOCK_SIZE);
-	  coap_set_payload(notification,
-			   notification->payload,
-			   MIN(notification->payload_len,
-			       COAP_MAX_BLOCK_SIZE));
-	}
-
-        transaction->message_len =
-          coap_serialize_message(notification, transaction->message);
-
-        coap_send_transaction(transaction);
-      }
-    }
-  }
+  notify(resource, url, NULL, 1);
+}
+/*---------------------------------------------------------------------------*/
+void
+coap_notify_observers_url(const char *url)
+{
+  notify(NULL, url, NULL, 0);
 }
 /*---------------------------------------------------------------------------*/
 void
@@ -310,6 +541,8 @@ coap_observe_handler(coap_resource_t *resource, coap_message_t *coap_req,
 {
   const coap_endpoint_t *src_ep;
   coap_observer_t *obs;
+  const char *uri = NULL;
+  int uri_len;
 
   LOG_DBG("CoAP observer handler rsc: %d\n", resource != NULL);
 
@@ -319,9 +552,10 @@ coap_observe_handler(coap_resource_t *resource, coap_message_t *coap_req,
       if(src_ep == NULL) {
         /* No source endpoint, can not add */
       } else if(coap_req->observe == 0) {
+        uri_len = coap_get_header_uri_path(coap_req, &uri);
         obs = add_observer(src_ep,
                            coap_req->token, coap_req->token_len,
-                           coap_req->uri_path, coap_req->uri_path_len);
+                           uri, uri_len);
         if(obs) {
           coap_set_header_observe(coap_res, (obs->obs_counter)++);
           /* mask out to keep the CoAP observe option length <= 3 bytes */
@@ -61,8 +61,10 @@ typedef struct coap_observer {
 
   int32_t obs_counter;
 
-  coap_timer_t retrans_timer;
-  uint8_t retrans_counter;
+  /* for notifications deferred by COAP_OBSERVE_MIN_INTERVAL */
+  coap_resource_t *resource;
+  uint64_t last_notify;
+  coap_timer_t notify_timer;
 } coap_observer_t;
 
 void coap_remove_observer(coap_observer_t *o);
@@ -76,6 +78,8 @@ int coap_remove_observer_by_mid(const coap_endpoint_t *ep,
 
 void coap_notify_observers(coap_resource_t *resource);
 void coap_notify_observers_sub(coap_resource_t *resource, const char *subpath);
+/* Notify the observers of exactly url, not those of its sub-resources */
+void coap_notify_observers_url(const char *url);
 
 void coap_observe_handler(coap_resource_t *resource, coap_message_t *request,
                           coap_message_t *response);
@@ -87,9 +87,16 @@ coap_separate_accept(coap_message_t *coap_req, coap_separate_t *separate_store)
 {
   coap_transaction_t *const t = coap_get_transaction_by_mid(coap_req->mid);
 
-  LOG_DBG("Separate ACCEPT: /");
-  LOG_DBG_COAP_STRING(coap_req->uri_path, coap_req->uri_path_len);
-  LOG_DBG_(" MID %u\n", coap_req->mid);
+  if(LOG_DBG_ENABLED) {
+    const char *url = NULL;
+    int url_len;
+
+    /* joins the Uri-Path options, if not done yet */
+    url_len = coap_get_header_uri_path(coap_req, &url);
+    LOG_DBG("Separate ACCEPT: /");
+    LOG_DBG_COAP_STRING(url, url_len);
+    LOG_DBG_(" MID %u\n", coap_req->mid);
+  }
   if(t) {
     /* send separate ACK for CON */
     if(coap_req->type == COAP_TYPE_CON) {
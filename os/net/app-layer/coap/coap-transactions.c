@@ -53,62 +53,255 @@
 #define LOG_MODULE "coap-transactions"
 #define LOG_LEVEL  LOG_LEVEL_COAP
 
+/* States of a transaction */
+#define TRANSACTION_NEW         0  /* not sent yet */
+#define TRANSACTION_QUEUED      1  /* waiting for NSTART or PROBING_RATE */
+#define TRANSACTION_SENT        2
+
+#define NOT_SCHEDULED           0xffff
 /*---------------------------------------------------------------------------*/
 MEMB(transactions_memb, coap_transaction_t, COAP_MAX_OPEN_TRANSACTIONS);
 LIST(transactions_list);
 
+/* Open transactions by MID, in the order of the list in every bucket */
+static coap_transaction_t *mid_index[COAP_TRANSACTION_HASH_SIZE];
+
+/*
+ * Min-heap of the transactions waiting to be sent again, by send time.
+ * A single timer expires at the earliest one.
+ */
+static coap_transaction_t *heap[COAP_MAX_OPEN_TRANSACTIONS];
+static uint16_t heap_size;
+static coap_timer_t heap_timer;
+
+static void send_transaction(coap_transaction_t *t);
+/*---------------------------------------------------------------------------*/
+static void
+mid_index_add(coap_transaction_t *t)
+{
+  coap_transaction_t **p;
+
+  for(p = &mid_index[t->mid % COAP_TRANSACTION_HASH_SIZE]; *p != NULL;
+      p = &(*p)->mid_next);
+  t->mid_next = NULL;
+  *p = t;
+}
+/*---------------------------------------------------------------------------*/
+static void
+mid_index_remove(coap_transaction_t *t)
+{
+  coap_transaction_t **p;
+
+  for(p = &mid_index[t->mid % COAP_TRANSACTION_HASH_SIZE]; *p != NULL;
+      p = &(*p)->mid_next) {
+    if(*p == t) {
+      *p = t->mid_next;
+      return;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+heap_set(uint16_t i, coap_transaction_t *t)
+{
+  heap[i] = t;
+  t->heap_index = i;
+}
+/*---------------------------------------------------------------------------*/
+static void
+heap_sift_up(uint16_t i)
+{
+  coap_transaction_t *t = heap[i];
+
+  while(i > 0 && t->send_time < heap[(i - 1) / 2]->send_time) {
+    heap_set(i, heap[(i - 1) / 2]);
+    i = (i - 1) / 2;
+  }
+  heap_set(i, t);
+}
+/*---------------------------------------------------------------------------*/
+static void
+heap_sift_down(uint16_t i)
+{
+  coap_transaction_t *t = heap[i];
+  uint16_t child;
+
+  while((child = 2 * i + 1) < heap_size) {
+    if(child + 1 < heap_size
+       && heap[child + 1]->send_time < heap[child]->send_time) {
+      child++;
+    }
+    if(t->send_time <= heap[child]->send_time) {
+      break;
+    }
+    heap_set(i, heap[child]);
+    i = child;
+  }
+  heap_set(i, t);
+}
 /*---------------------------------------------------------------------------*/
+/* Set the timer to the earliest send time */
 static void
-coap_retransmit_transaction(coap_timer_t *nt)
+heap_update_timer(void)
 {
-  coap_transaction_t *t = coap_timer_get_user_data(nt);
-  if(t == NULL) {
-    LOG_DBG("No retransmission data in coap_timer!\n");
+  uint64_t now;
+
+  if(heap_size == 0) {
+    coap_timer_stop(&heap_timer);
     return;
   }
-  ++(t->retrans_counter);
-  LOG_DBG("Retransmitting %u (%u)\n", t->mid, t->retrans_counter);
-  coap_send_transaction(t);
+  now = coap_timer_uptime();
+  coap_timer_set(&heap_timer,
+                 heap[0]->send_time > now ? heap[0]->send_time - now : 0);
 }
 /*---------------------------------------------------------------------------*/
+static void
+heap_remove(coap_transaction_t *t)
+{
+  uint16_t i = t->heap_index;
+  coap_transaction_t *first = heap[0];
+  coap_transaction_t *last;
 
+  if(i == NOT_SCHEDULED) {
+    return;
+  }
+  t->heap_index = NOT_SCHEDULED;
+  if(i < --heap_size) {
+    /* move the last one to the hole and restore the order around it */
+    last = heap[heap_size];
+    heap_set(i, last);
+    heap_sift_down(i);
+    heap_sift_up(last->heap_index);
+  }
+  if(first == t) {
+    heap_update_timer();
+  }
+}
 /*---------------------------------------------------------------------------*/
-/*- Internal API ------------------------------------------------------------*/
+/* Send a transaction again after a delay in milliseconds */
+static void
+schedule(coap_transaction_t *t, uint32_t delay)
+{
+  heap_remove(t);
+  t->send_time = coap_timer_uptime() + delay;
+  heap_set(heap_size++, t);
+  heap_sift_up(heap_size - 1);
+  if(heap[0] == t) {
+    heap_update_timer();
+  }
+}
 /*---------------------------------------------------------------------------*/
-coap_transaction_t *
-coap_new_transaction(uint16_t mid, const coap_endpoint_t *endpoint)
+static void
+heap_timer_expired(coap_timer_t *timer)
 {
-  coap_transaction_t *t = memb_alloc(&transactions_memb);
+  coap_transaction_t *t;
+  uint64_t now = coap_timer_uptime();
 
-  if(t) {
-    t->mid = mid;
-    t->retrans_counter = 0;
+  while(heap_size > 0 && heap[0]->send_time <= now) {
+    t = heap[0];
+    heap_remove(t);
+    if(t->state == TRANSACTION_SENT) {
+      ++(t->retrans_counter);
+      LOG_DBG("Retransmitting %u (%u)\n", t->mid, t->retrans_counter);
+    }
+    send_transaction(t);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static int
+is_confirmable(const coap_transaction_t *t)
+{
+  return COAP_TYPE_CON ==
+    ((COAP_HEADER_TYPE_MASK & t->message[0]) >> COAP_HEADER_TYPE_POSITION);
+}
+/*---------------------------------------------------------------------------*/
+#if COAP_NSTART
+/* Number of outstanding confirmable messages to an endpoint */
+static int
+outstanding(const coap_endpoint_t *endpoint)
+{
+  coap_transaction_t *t;
+  int count = 0;
 
-    /* save client address */
-    coap_endpoint_copy(&t->endpoint, endpoint);
+  for(t = list_head(transactions_list); t != NULL; t = t->next) {
+    if(t->state == TRANSACTION_SENT && is_confirmable(t)
+       && coap_endpoint_cmp(&t->endpoint, endpoint)) {
+      count++;
+    }
+  }
+  return count;
+}
+#endif /* COAP_NSTART */
+/*---------------------------------------------------------------------------*/
+/*
+ * Schedule the oldest transaction that waits for an endpoint. It is not
+ * sent at once, as the caller may still be using the received message.
+ */
+static void
+release_queued(const coap_endpoint_t *endpoint, int timed_out)
+{
+  coap_transaction_t *t;
+  uint32_t delay = 0;
 
-    list_add(transactions_list, t); /* list itself makes sure same element is not added twice */
+  for(t = list_head(transactions_list); t != NULL; t = t->next) {
+    if(t->state == TRANSACTION_QUEUED && t->heap_index == NOT_SCHEDULED
+       && coap_endpoint_cmp(&t->endpoint, endpoint)) {
+#if COAP_PROBING_RATE
+      if(timed_out) {
+        delay = t->message_len * 1000UL / COAP_PROBING_RATE;
+        LOG_DBG("Probing endpoint with %u after %lu ms\n", t->mid,
+                (unsigned long)delay);
+      }
+#endif /* COAP_PROBING_RATE */
+      schedule(t, delay);
+      return;
+    }
   }
+}
+/*---------------------------------------------------------------------------*/
+static void
+clear_transaction(coap_transaction_t *t, int timed_out)
+{
+  coap_endpoint_t endpoint;
+  int release;
 
-  return t;
+  LOG_DBG("Freeing transaction %u: %p\n", t->mid, t);
+
+  release = t->state == TRANSACTION_SENT && is_confirmable(t);
+  coap_endpoint_copy(&endpoint, &t->endpoint);
+  heap_remove(t);
+  mid_index_remove(t);
+  list_remove(transactions_list, t);
+  memb_free(&transactions_memb, t);
+
+  if(release) {
+    release_queued(&endpoint, timed_out);
+  }
 }
 /*---------------------------------------------------------------------------*/
-void
-coap_send_transaction(coap_transaction_t *t)
+static void
+send_transaction(coap_transaction_t *t)
 {
+#if COAP_NSTART
+  if(t->state != TRANSACTION_SENT && is_confirmable(t)
+     && outstanding(&t->endpoint) >= COAP_NSTART) {
+    LOG_DBG("Queuing transaction %u, NSTART reached\n", t->mid);
+    t->state = TRANSACTION_QUEUED;
+    return;
+  }
+#endif /* COAP_NSTART */
+  t->state = TRANSACTION_SENT;
+
   LOG_DBG("Sending transaction %u\n", t->mid);
 
   coap_sendto(&t->endpoint, t->message, t->message_len);
 
-  if(COAP_TYPE_CON ==
-     ((COAP_HEADER_TYPE_MASK & t->message[0]) >> COAP_HEADER_TYPE_POSITION)) {
+  if(is_confirmable(t)) {
     if(t->retrans_counter < COAP_MAX_RETRANSMIT) {
       /* not timed out yet */
       LOG_DBG("Keeping transaction %u\n", t->mid);
 
       if(t->retrans_counter == 0) {
-        coap_timer_set_callback(&t->retrans_timer, coap_retransmit_transaction);
-        coap_timer_set_user_data(&t->retrans_timer, t);
         t->retrans_interval =
           COAP_RESPONSE_TIMEOUT_TICKS + (rand() %
                                          COAP_RESPONSE_TIMEOUT_BACKOFF_MASK);
@@ -121,7 +314,7 @@ coap_send_transaction(coap_transaction_t *t)
       }
 
       /* interval updated above */
-      coap_timer_set(&t->retrans_timer, t->retrans_interval);
+      schedule(t, t->retrans_interval);
     } else {
       /* timed out */
       LOG_DBG("Timeout\n");
@@ -131,26 +324,55 @@ coap_send_transaction(coap_transaction_t *t)
       /* handle observers */
       coap_remove_observer_by_client(&t->endpoint);
 
-      coap_clear_transaction(t);
+      clear_transaction(t, 1);
 
       if(callback) {
         callback(callback_data, NULL);
       }
     }
   } else {
-    coap_clear_transaction(t);
+    clear_transaction(t, 0);
   }
 }
 /*---------------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------------*/
+/*- Internal API ------------------------------------------------------------*/
+/*---------------------------------------------------------------------------*/
+coap_transaction_t *
+coap_new_transaction(uint16_t mid, const coap_endpoint_t *endpoint)
+{
+  coap_transaction_t *t = memb_alloc(&transactions_memb);
+
+  if(t) {
+    t->mid = mid;
+    t->retrans_counter = 0;
+    t->state = TRANSACTION_NEW;
+    t->heap_index = NOT_SCHEDULED;
+
+    /* save client address */
+    coap_endpoint_copy(&t->endpoint, endpoint);
+
+    list_add(transactions_list, t); /* list itself makes sure same element is not added twice */
+    mid_index_add(t);
+
+    coap_timer_set_callback(&heap_timer, heap_timer_expired);
+  }
+
+  return t;
+}
+/*---------------------------------------------------------------------------*/
+void
+coap_send_transaction(coap_transaction_t *t)
+{
+  send_transaction(t);
+}
+/*---------------------------------------------------------------------------*/
 void
 coap_clear_transaction(coap_transaction_t *t)
 {
   if(t) {
-    LOG_DBG("Freeing transaction %u: %p\n", t->mid, t);
-
-    coap_timer_stop(&t->retrans_timer);
-    list_remove(transactions_list, t);
-    memb_free(&transactions_memb, t);
+    clear_transaction(t, 0);
   }
 }
 /*---------------------------------------------------------------------------*/
@@ -159,7 +381,7 @@ coap_get_transaction_by_mid(uint16_t mid)
 {
   coap_transaction_t *t = NULL;
 
-  for(t = (coap_transaction_t *)list_head(transactions_list); t; t = t->next) {
+  for(t = mid_index[mid % COAP_TRANSACTION_HASH_SIZE]; t; t = t->mid_next) {
     if(t->mid == mid) {
       LOG_DBG("Found transaction for MID %u: %p\n", t->mid, t);
       return t;
@@ -168,4 +390,12 @@ coap_get_transaction_by_mid(uint16_t mid)
   return NULL;
 }
 /*---------------------------------------------------------------------------*/
+void
+coap_set_transaction_mid(coap_transaction_t *t, uint16_t mid)
+{
+  mid_index_remove(t);
+  t->mid = mid;
+  mid_index_add(t);
+}
+/*---------------------------------------------------------------------------*/
 /** @} */
@@ -58,11 +58,14 @@
 /* container for transactions with message buffer and retransmission info */
 typedef struct coap_transaction {
   struct coap_transaction *next;        /* for LIST */
+  struct coap_transaction *mid_next;    /* for the index by MID */
 
   uint16_t mid;
-  coap_timer_t retrans_timer;
+  uint64_t send_time;                   /* of the next transmission */
   uint32_t retrans_interval;
   uint8_t retrans_counter;
+  uint8_t state;
+  uint16_t heap_index;                  /* in the heap of send times */
 
   coap_endpoint_t endpoint;
 
@@ -78,6 +81,7 @@ coap_transaction_t *coap_new_transaction(uint16_t mid, const coap_endpoint_t *ep
 void coap_send_transaction(coap_transaction_t *t);
 void coap_clear_transaction(coap_transaction_t *t);
 coap_transaction_t *coap_get_transaction_by_mid(uint16_t mid);
+void coap_set_transaction_mid(coap_transaction_t *t, uint16_t mid);
 
 #endif /* COAP_TRANSACTIONS_H_ */
 /** @} */
@@ -79,6 +79,25 @@ int coap_sendto(const coap_endpoint_t *ep, const uint8_t *data, uint16_t len);
  */
 void coap_transport_init(void);
 
+#ifdef WITH_DTLS
+typedef struct coap_dtls_stats {
+  uint32_t handshakes;          /* completed handshakes */
+  uint32_t handshake_time;      /* total time of the handshakes in ms */
+  uint32_t last_handshake_time; /* in ms */
+  uint32_t handshake_frames;    /* datagrams sent and received in them */
+  uint32_t reused;              /* connects to an established session */
+  uint32_t evictions;           /* sessions closed to make room */
+  uint32_t handshake_timeouts;  /* handshakes restarted by a connect */
+} coap_dtls_stats_t;
+
+/**
+ * \brief      Get the statistics of the DTLS sessions.
+ *
+ * \return     A pointer to the statistics.
+ */
+const coap_dtls_stats_t *coap_dtls_get_stats(void);
+#endif /* WITH_DTLS */
+
 #endif /* COAP_TRANSPORT_H_ */
 /** @} */
 /** @} */
@@ -94,6 +94,21 @@ static dtls_context_t *dtls_context = NULL;
 
 static const coap_keystore_t *dtls_keystore = NULL;
 static struct uip_udp_conn *dtls_conn = NULL;
+
+/* The DTLS sessions, by last use */
+typedef struct {
+  coap_endpoint_t endpoint;
+  clock_time_t last_used;
+  clock_time_t handshake_start;
+  uint16_t handshake_frames;
+  uint8_t used;
+  uint8_t connected;
+} dtls_session_info_t;
+
+static dtls_session_info_t sessions[COAP_DTLS_MAX_PEERS];
+static coap_dtls_stats_t dtls_stats;
+/* Datagrams sent by the DTLS code while it handles an incoming one */
+static uint16_t frames_sent;
 #endif /* WITH_DTLS */
 
 PROCESS(coap_engine, "CoAP Engine");
@@ -260,6 +275,78 @@ coap_endpoint_is_secure(const coap_endpoint_t *ep)
   return ep->secure;
 }
 /*---------------------------------------------------------------------------*/
+#ifdef WITH_DTLS
+static dtls_session_info_t *
+find_session(const coap_endpoint_t *ep)
+{
+  int i;
+
+  for(i = 0; i < COAP_DTLS_MAX_PEERS; i++) {
+    if(sessions[i].used && coap_endpoint_cmp(&sessions[i].endpoint, ep)) {
+      return &sessions[i];
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+/* A free session, or the least recently used one after closing it */
+static dtls_session_info_t *
+new_session(const coap_endpoint_t *ep)
+{
+  dtls_session_info_t *s = NULL;
+  dtls_peer_t *peer;
+  int i;
+
+  for(i = 0; i < COAP_DTLS_MAX_PEERS; i++) {
+    if(!sessions[i].used) {
+      s = &sessions[i];
+      break;
+    }
+    if(s == NULL || sessions[i].last_used < s->last_used) {
+      s = &sessions[i];
+    }
+  }
+
+  if(s->used) {
+    LOG_INFO("DTLS evicting session with ");
+    LOG_INFO_COAP_EP(&s->endpoint);
+    LOG_INFO_("\n");
+    peer = dtls_get_peer(dtls_context, &s->endpoint);
+    if(peer != NULL) {
+      dtls_reset_peer(dtls_context, peer);
+    }
+    dtls_stats.evictions++;
+  }
+
+  memset(s, 0, sizeof(*s));
+  coap_endpoint_copy(&s->endpoint, ep);
+  s->used = 1;
+  s->last_used = clock_time();
+  s->handshake_start = s->last_used;
+  return s;
+}
+/*---------------------------------------------------------------------------*/
+/* Count a datagram of a session */
+static void
+session_frame(const coap_endpoint_t *ep)
+{
+  dtls_session_info_t *s = find_session(ep);
+
+  if(s != NULL) {
+    s->last_used = clock_time();
+    if(!s->connected) {
+      s->handshake_frames++;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+const coap_dtls_stats_t *
+coap_dtls_get_stats(void)
+{
+  return &dtls_stats;
+}
+#endif /* WITH_DTLS */
+/*---------------------------------------------------------------------------*/
 int
 coap_endpoint_is_connected(const coap_endpoint_t *ep)
 {
@@ -315,6 +402,37 @@ coap_endpoint_connect(coap_endpoint_t *ep)
 
   /* setup all address info here... should be done to connect */
   if(dtls_context) {
+    dtls_peer_t *peer = dtls_get_peer(dtls_context, ep);
+    dtls_session_info_t *s = find_session(ep);
+
+    if(peer != NULL && s != NULL) {
+      /* reuse the session, or wait for its handshake for a while */
+      if(dtls_peer_is_connected(peer)) {
+        LOG_DBG("DTLS reusing session\n");
+        dtls_stats.reused++;
+        s->last_used = clock_time();
+        return 1;
+      }
+      if(clock_time() - s->handshake_start
+         < COAP_DTLS_HANDSHAKE_TIMEOUT * CLOCK_SECOND) {
+        s->last_used = clock_time();
+        return 1;
+      }
+      LOG_WARN("DTLS handshake with ");
+      LOG_WARN_COAP_EP(ep);
+      LOG_WARN_(" timed out, restarting it\n");
+      dtls_reset_peer(dtls_context, peer);
+      dtls_stats.handshake_timeouts++;
+      /* the reset may have dropped the session through handle_event() */
+      s = find_session(ep);
+    }
+    if(s == NULL) {
+      s = new_session(ep);
+    } else {
+      s->handshake_start = clock_time();
+      s->handshake_frames = 0;
+      s->connected = 0;
+    }
     dtls_connect(dtls_context, ep);
     return 1;
   }
@@ -327,8 +445,14 @@ void
 coap_endpoint_disconnect(coap_endpoint_t *ep)
 {
 #ifdef WITH_DTLS
+  dtls_session_info_t *s;
+
   if(ep && ep->secure && dtls_context) {
     dtls_close(dtls_context, ep);
+    s = find_session(ep);
+    if(s != NULL) {
+      s->used = 0;
+    }
   }
 #endif /* WITH_DTLS */
 }
@@ -363,8 +487,26 @@ process_secure_data(void)
   LOG_INFO("  Length: %u\n", uip_datalen());
 
   if(dtls_context) {
-    dtls_handle_message(dtls_context, (coap_endpoint_t *)get_src_endpoint(1),
-                        uip_appdata, uip_datalen());
+    coap_endpoint_t *src = (coap_endpoint_t *)get_src_endpoint(1);
+    dtls_session_info_t *s;
+    int known = dtls_get_peer(dtls_context, src) != NULL;
+
+    session_frame(src);
+    frames_sent = 0;
+    dtls_handle_message(dtls_context, src, uip_appdata, uip_datalen());
+
+    /*
+     * The DTLS code answers a ClientHello without a valid cookie
+     * statelessly, and only makes a peer once the cookie is verified. A
+     * session is only made for (and may only evict another one for) such
+     * a peer, that has shown that it owns its address (RFC 6347 4.2.1).
+     */
+    if(!known && find_session(src) == NULL
+       && dtls_get_peer(dtls_context, src) != NULL) {
+      s = new_session(src);
+      /* the ClientHello, and the flight that answered it */
+      s->handshake_frames = 1 + frames_sent;
+    }
   }
 }
 #endif /* WITH_DTLS */
@@ -508,11 +650,46 @@ output_to_peer(struct dtls_context_t *ctx,
   LOG_DBG("output_to DTLS peer [");
   LOG_DBG_6ADDR(&session->ipaddr);
   LOG_DBG_("]:%u %ld bytes\n", uip_ntohs(session->port), (long)len);
+  session_frame(session);
+  frames_sent++;
   uip_udp_packet_sendto(udp_connection, data, len,
                         &session->ipaddr, session->port);
   return len;
 }
 
+/* Handshake completion and alerts from the DTLS code */
+static int
+handle_event(struct dtls_context_t *ctx, session_t *session,
+             dtls_alert_level_t level, unsigned short code)
+{
+  dtls_session_info_t *s = find_session(session);
+  uint32_t elapsed;
+
+  if(s == NULL) {
+    return 0;
+  }
+
+  if(level == 0 && code == DTLS_EVENT_CONNECTED) {
+    elapsed = (uint32_t)((clock_time() - s->handshake_start) * 1000UL
+                         / CLOCK_SECOND);
+    s->connected = 1;
+    dtls_stats.handshakes++;
+    dtls_stats.handshake_time += elapsed;
+    dtls_stats.last_handshake_time = elapsed;
+    dtls_stats.handshake_frames += s->handshake_frames;
+    LOG_INFO("DTLS handshake with ");
+    LOG_INFO_COAP_EP(session);
+    LOG_INFO_(" done in %lu ms, %u frames\n", (unsigned long)elapsed,
+              s->handshake_frames);
+  } else if(level == DTLS_ALERT_LEVEL_FATAL
+            || (level == DTLS_ALERT_LEVEL_WARNING
+                && code == DTLS_ALERT_CLOSE_NOTIFY)) {
+    /* the DTLS code drops the peer */
+    s->used = 0;
+  }
+  return 0;
+}
+
 /* This defines the key-store set API since we hookup DTLS here */
 void
 coap_set_keystore(const coap_keystore_t *keystore)
@@ -597,7 +774,7 @@ get_psk_info(struct dtls_context_t *ctx,
 static dtls_handler_t cb = {
   .write = output_to_peer,
   .read  = input_from_peer,
-  .event = NULL,
+  .event = handle_event,
 #ifdef DTLS_PSK
   .get_psk_info = get_psk_info,
 #endif /* DTLS_PSK */
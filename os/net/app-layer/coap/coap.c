@@ -239,6 +239,37 @@ coap_merge_multi_option(char **dst, size_t *dst_len, uint8_t *option,
   }
 }
 /*---------------------------------------------------------------------------*/
+#if COAP_MAX_INDEXED_OPTIONS
+/*
+ * Join the values of a repeated option, the first time its getter is
+ * called. The index is updated with the new location of the values.
+ */
+static void
+merge_indexed_option(coap_message_t *coap_pkt, unsigned int number,
+                     const char **dst, size_t *dst_len, char separator)
+{
+  coap_option_ref_t *ref;
+  char *merged = NULL;
+  size_t merged_len = 0;
+
+  if(*dst != NULL) {
+    /* already merged, or set by the application */
+    return;
+  }
+  for(ref = coap_pkt->option_index;
+      ref < coap_pkt->option_index + coap_pkt->option_count; ref++) {
+    if(ref->number == number) {
+      coap_merge_multi_option(&merged, &merged_len,
+                              coap_pkt->buffer + ref->offset, ref->len,
+                              separator);
+      ref->offset = (uint8_t *)merged + merged_len - ref->len - coap_pkt->buffer;
+    }
+  }
+  *dst = merged;
+  *dst_len = merged_len;
+}
+#endif /* COAP_MAX_INDEXED_OPTIONS */
+/*---------------------------------------------------------------------------*/
 static int
 coap_get_variable(const char *buffer, size_t length, const char *name,
                   const char **output)
@@ -415,7 +446,12 @@ coap_status_t
 coap_parse_message(coap_message_t *coap_pkt, uint8_t *data, uint16_t data_len)
 {
   /* initialize message */
+#if COAP_MAX_INDEXED_OPTIONS
+  /* entries of the index are written before being read */
+  memset(coap_pkt, 0, offsetof(coap_message_t, option_index));
+#else /* COAP_MAX_INDEXED_OPTIONS */
   memset(coap_pkt, 0, sizeof(coap_message_t));
+#endif /* COAP_MAX_INDEXED_OPTIONS */
 
   /* pointer to message bytes */
   coap_pkt->buffer = data;
@@ -517,6 +553,19 @@ coap_parse_message(coap_message_t *coap_pkt, uint8_t *data, uint16_t data_len)
     LOG_DBG("OPTION %u (delta %u, len %zu): ", option_number, option_delta,
             option_length);
 
+#if COAP_MAX_INDEXED_OPTIONS
+    if(coap_pkt->option_count == COAP_MAX_INDEXED_OPTIONS) {
+      LOG_WARN("BAD REQUEST: more than %u options\n", COAP_MAX_INDEXED_OPTIONS);
+      coap_error_message = "Too many options";
+      return BAD_REQUEST_4_00;
+    }
+    coap_pkt->option_index[coap_pkt->option_count].number = option_number;
+    coap_pkt->option_index[coap_pkt->option_count].offset =
+      current_option - data;
+    coap_pkt->option_index[coap_pkt->option_count].len = option_length;
+    coap_pkt->option_count++;
+#endif /* COAP_MAX_INDEXED_OPTIONS */
+
     coap_set_option(coap_pkt, option_number);
 
     switch(option_number) {
@@ -597,6 +646,10 @@ coap_parse_message(coap_message_t *coap_pkt, uint8_t *data, uint16_t data_len)
       LOG_DBG_("Uri-Port [%u]\n", coap_pkt->uri_port);
       break;
     case COAP_OPTION_URI_PATH:
+#if COAP_MAX_INDEXED_OPTIONS
+      /* joined on first use, see merge_indexed_option() */
+      LOG_DBG_("Uri-Path\n");
+#else /* COAP_MAX_INDEXED_OPTIONS */
       /* coap_merge_multi_option() operates in-place on the IPBUF, but final message field should be const string -> cast to string */
       coap_merge_multi_option((char **)&(coap_pkt->uri_path),
                               &(coap_pkt->uri_path_len), current_option,
@@ -604,8 +657,13 @@ coap_parse_message(coap_message_t *coap_pkt, uint8_t *data, uint16_t data_len)
       LOG_DBG_("Uri-Path [");
       LOG_DBG_COAP_STRING(coap_pkt->uri_path, coap_pkt->uri_path_len);
       LOG_DBG_("]\n");
+#endif /* COAP_MAX_INDEXED_OPTIONS */
       break;
     case COAP_OPTION_URI_QUERY:
+#if COAP_MAX_INDEXED_OPTIONS
+      /* joined on first use, see merge_indexed_option() */
+      LOG_DBG_("Uri-Query\n");
+#else /* COAP_MAX_INDEXED_OPTIONS */
       /* coap_merge_multi_option() operates in-place on the IPBUF, but final message field should be const string -> cast to string */
       coap_merge_multi_option((char **)&(coap_pkt->uri_query),
                               &(coap_pkt->uri_query_len), current_option,
@@ -613,9 +671,14 @@ coap_parse_message(coap_message_t *coap_pkt, uint8_t *data, uint16_t data_len)
       LOG_DBG_("Uri-Query[");
       LOG_DBG_COAP_STRING(coap_pkt->uri_query, coap_pkt->uri_query_len);
       LOG_DBG_("]\n");
+#endif /* COAP_MAX_INDEXED_OPTIONS */
       break;
 
     case COAP_OPTION_LOCATION_PATH:
+#if COAP_MAX_INDEXED_OPTIONS
+      /* joined on first use, see merge_indexed_option() */
+      LOG_DBG_("Location-Path\n");
+#else /* COAP_MAX_INDEXED_OPTIONS */
       /* coap_merge_multi_option() operates in-place on the IPBUF, but final message field should be const string -> cast to string */
       coap_merge_multi_option((char **)&(coap_pkt->location_path),
                               &(coap_pkt->location_path_len), current_option,
@@ -624,8 +687,13 @@ coap_parse_message(coap_message_t *coap_pkt, uint8_t *data, uint16_t data_len)
       LOG_DBG_("Location-Path [");
       LOG_DBG_COAP_STRING(coap_pkt->location_path, coap_pkt->location_path_len);
       LOG_DBG_("]\n");
+#endif /* COAP_MAX_INDEXED_OPTIONS */
       break;
     case COAP_OPTION_LOCATION_QUERY:
+#if COAP_MAX_INDEXED_OPTIONS
+      /* joined on first use, see merge_indexed_option() */
+      LOG_DBG_("Location-Query\n");
+#else /* COAP_MAX_INDEXED_OPTIONS */
       /* coap_merge_multi_option() operates in-place on the IPBUF, but final message field should be const string -> cast to string */
       coap_merge_multi_option((char **)&(coap_pkt->location_query),
                               &(coap_pkt->location_query_len), current_option,
@@ -633,6 +701,7 @@ coap_parse_message(coap_message_t *coap_pkt, uint8_t *data, uint16_t data_len)
       LOG_DBG_("Location-Query [");
       LOG_DBG_COAP_STRING(coap_pkt->location_query, coap_pkt->location_query_len);
       LOG_DBG_("]\n");
+#endif /* COAP_MAX_INDEXED_OPTIONS */
       break;
 
     case COAP_OPTION_OBSERVE:
@@ -694,9 +763,12 @@ int
 coap_get_query_variable(coap_message_t *coap_pkt,
                         const char *name, const char **output)
 {
-  if(coap_is_option(coap_pkt, COAP_OPTION_URI_QUERY)) {
-    return coap_get_variable(coap_pkt->uri_query, coap_pkt->uri_query_len,
-                             name, output);
+  const char *query;
+  int query_len;
+
+  query_len = coap_get_header_uri_query(coap_pkt, &query);
+  if(query_len > 0) {
+    return coap_get_variable(query, query_len, name, output);
   }
   return 0;
 }
@@ -881,6 +953,10 @@ coap_get_header_uri_path(coap_message_t *coap_pkt, const char **path)
   if(!coap_is_option(coap_pkt, COAP_OPTION_URI_PATH)) {
     return 0;
   }
+#if COAP_MAX_INDEXED_OPTIONS
+  merge_indexed_option(coap_pkt, COAP_OPTION_URI_PATH, &coap_pkt->uri_path,
+                       &coap_pkt->uri_path_len, '/');
+#endif /* COAP_MAX_INDEXED_OPTIONS */
   *path = coap_pkt->uri_path;
   return coap_pkt->uri_path_len;
 }
@@ -904,6 +980,10 @@ coap_get_header_uri_query(coap_message_t *coap_pkt, const char **query)
   if(!coap_is_option(coap_pkt, COAP_OPTION_URI_QUERY)) {
     return 0;
   }
+#if COAP_MAX_INDEXED_OPTIONS
+  merge_indexed_option(coap_pkt, COAP_OPTION_URI_QUERY, &coap_pkt->uri_query,
+                       &coap_pkt->uri_query_len, '&');
+#endif /* COAP_MAX_INDEXED_OPTIONS */
   *query = coap_pkt->uri_query;
   return coap_pkt->uri_query_len;
 }
@@ -927,6 +1007,10 @@ coap_get_header_location_path(coap_message_t *coap_pkt, const char **path)
   if(!coap_is_option(coap_pkt, COAP_OPTION_LOCATION_PATH)) {
     return 0;
   }
+#if COAP_MAX_INDEXED_OPTIONS
+  merge_indexed_option(coap_pkt, COAP_OPTION_LOCATION_PATH, &coap_pkt->location_path,
+                       &coap_pkt->location_path_len, '/');
+#endif /* COAP_MAX_INDEXED_OPTIONS */
   *path = coap_pkt->location_path;
   return coap_pkt->location_path_len;
 }
@@ -958,6 +1042,10 @@ coap_get_header_location_query(coap_message_t *coap_pkt, const char **query)
   if(!coap_is_option(coap_pkt, COAP_OPTION_LOCATION_QUERY)) {
     return 0;
   }
+#if COAP_MAX_INDEXED_OPTIONS
+  merge_indexed_option(coap_pkt, COAP_OPTION_LOCATION_QUERY, &coap_pkt->location_query,
+                       &coap_pkt->location_query_len, '&');
+#endif /* COAP_MAX_INDEXED_OPTIONS */
   *query = coap_pkt->location_query;
   return coap_pkt->location_query_len;
 }
@@ -1112,6 +1200,24 @@ coap_set_header_size1(coap_message_t *coap_pkt, uint32_t size)
   return 1;
 }
 /*---------------------------------------------------------------------------*/
+#if COAP_MAX_INDEXED_OPTIONS
+int
+coap_get_option_value(coap_message_t *coap_pkt, unsigned int number,
+                      unsigned int n, const uint8_t **value)
+{
+  const coap_option_ref_t *ref;
+
+  for(ref = coap_pkt->option_index;
+      ref < coap_pkt->option_index + coap_pkt->option_count; ref++) {
+    if(ref->number == number && n-- == 0) {
+      *value = coap_pkt->buffer + ref->offset;
+      return ref->len;
+    }
+  }
+  return -1;
+}
+#endif /* COAP_MAX_INDEXED_OPTIONS */
+/*---------------------------------------------------------------------------*/
 int
 coap_get_payload(coap_message_t *coap_pkt, const uint8_t **payload)
 {
@@ -73,6 +73,13 @@
 /* bitmap for set options */
 #define COAP_OPTION_MAP_SIZE  (sizeof(uint8_t) * 8)
 
+/* location of an option value in a parsed message */
+typedef struct {
+  uint16_t number;
+  uint16_t offset; /* from the start of the message */
+  uint16_t len;
+} coap_option_ref_t;
+
 /* parsed message struct */
 typedef struct {
   uint8_t *buffer; /* pointer to CoAP header / incoming message buffer / memory to serialize message */
@@ -126,6 +133,11 @@ typedef struct {
 
   uint16_t payload_len;
   uint8_t *payload;
+
+#if COAP_MAX_INDEXED_OPTIONS
+  uint8_t option_count;
+  coap_option_ref_t option_index[COAP_MAX_INDEXED_OPTIONS];
+#endif /* COAP_MAX_INDEXED_OPTIONS */
 } coap_message_t;
 
 static inline int
@@ -296,6 +308,12 @@ int coap_set_header_size2(coap_message_t *message, uint32_t size);
 int coap_get_header_size1(coap_message_t *message, uint32_t *size);
 int coap_set_header_size1(coap_message_t *message, uint32_t size);
 
+#if COAP_MAX_INDEXED_OPTIONS
+/* in-place value of the n-th option with this number, or -1 if absent. */
+int coap_get_option_value(coap_message_t *message, unsigned int number,
+                          unsigned int n, const uint8_t **value);
+#endif /* COAP_MAX_INDEXED_OPTIONS */
+
 int coap_get_payload(coap_message_t *message, const uint8_t **payload);
 int coap_set_payload(coap_message_t *message, const void *payload, size_t length);
 
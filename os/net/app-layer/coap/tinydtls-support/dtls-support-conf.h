@@ -45,9 +45,16 @@
 #define DTLS_LOG_CONF_PATH "coap-log.h"
 
 #include "coap-endpoint.h"
+#include "coap-conf.h"
 
 typedef coap_endpoint_t session_t;
 
+/* One peer more than the DTLS sessions of CoAP: a new peer can then pass
+   the cookie exchange before a session is evicted for it */
+#ifndef DTLS_PEER_MAX
+#define DTLS_PEER_MAX (COAP_DTLS_MAX_PEERS + 1)
+#endif /* DTLS_PEER_MAX */
+
 #include "sys/ctimer.h"
 #include <stdint.h>
 
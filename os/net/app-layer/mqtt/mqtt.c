@@ -58,6 +58,10 @@
 #include "lib/list.h"
 #include "sys/cc.h"
 
+#if MQTT_OUT_QUEUE_SIZE > 0 && MQTT_OUT_QUEUE_CFS_SIZE > 0
+#include "cfs/cfs.h"
+#endif
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -121,9 +125,17 @@ typedef enum {
 #define MQTT_STRING_LEN_SIZE 2
 #define MQTT_MID_SIZE 2
 #define MQTT_QOS_SIZE 1
+
+#define MQTT_FHDR_QOS(fhdr) (((fhdr) >> 1) & 0x03)
 /*---------------------------------------------------------------------------*/
 #define RESPONSE_WAIT_TIMEOUT (CLOCK_SECOND * 10)
 /*---------------------------------------------------------------------------*/
+/* Outbound queue slot states, QUEUED may carry the DUP flag */
+#define OUT_QUEUE_FREE   0
+#define OUT_QUEUE_QUEUED 1
+#define OUT_QUEUE_SENT   2
+#define OUT_QUEUE_DUP    0x80
+/*---------------------------------------------------------------------------*/
 #define INCREMENT_MID(conn)   (conn)->mid_counter += 2
 #define MQTT_STRING_LENGTH(s) (((s)->length) == 0 ? 0 : (MQTT_STRING_LEN_SIZE + (s)->length))
 /*---------------------------------------------------------------------------*/
@@ -169,6 +181,7 @@ static process_event_t mqtt_do_subscribe_event;
 static process_event_t mqtt_do_unsubscribe_event;
 static process_event_t mqtt_do_publish_event;
 static process_event_t mqtt_do_pingreq_event;
+static process_event_t mqtt_do_ack_event;
 static process_event_t mqtt_continue_send_event;
 static process_event_t mqtt_abort_now_event;
 process_event_t mqtt_update_event;
@@ -205,9 +218,360 @@ call_event(struct mqtt_connection *conn,
 }
 /*---------------------------------------------------------------------------*/
 static void
+queue_ack(struct mqtt_connection *conn, uint8_t type, uint16_t mid)
+{
+  uint8_t i;
+
+  if(conn->ack_count == MQTT_ACK_QUEUE_SIZE) {
+    /* The broker retransmits what it does not get acknowledged */
+    PRINTF("MQTT - Ack queue full, dropping %02X for %u\n", type, mid);
+    return;
+  }
+
+  i = (conn->ack_head + conn->ack_count) % MQTT_ACK_QUEUE_SIZE;
+  conn->ack_type[i] = type;
+  conn->ack_mid[i] = mid;
+  conn->ack_count++;
+
+  process_post(&mqtt_process, mqtt_do_ack_event, conn);
+}
+/*---------------------------------------------------------------------------*/
+static int
+in_qos2_find(struct mqtt_connection *conn, uint16_t mid)
+{
+  int i;
+
+  for(i = 0; i < conn->in_qos2_count; i++) {
+    if(conn->in_qos2_mid[i] == mid) {
+      return i;
+    }
+  }
+  return -1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+in_qos2_remove(struct mqtt_connection *conn, int i)
+{
+  conn->in_qos2_count--;
+  memmove(&conn->in_qos2_mid[i], &conn->in_qos2_mid[i + 1],
+          (conn->in_qos2_count - i) * sizeof(conn->in_qos2_mid[0]));
+}
+/*---------------------------------------------------------------------------*/
+static void
+in_qos2_add(struct mqtt_connection *conn, uint16_t mid)
+{
+  if(conn->in_qos2_count == MQTT_MAX_INFLIGHT) {
+    /* Forget the oldest, its PUBREL is long overdue */
+    in_qos2_remove(conn, 0);
+  }
+  conn->in_qos2_mid[conn->in_qos2_count++] = mid;
+}
+/*---------------------------------------------------------------------------*/
+#if MQTT_OUT_QUEUE_SIZE > 0
+#if MQTT_OUT_QUEUE_CFS_SIZE > 0
+static void
+cfs_file_name(struct mqtt_connection *conn, char *name, int len)
+{
+  snprintf(name, len, "%s%.*s", MQTT_OUT_QUEUE_CFS_FILE, 16,
+           conn->client_id.string);
+}
+/*---------------------------------------------------------------------------*/
+static int
+cfs_spill(struct mqtt_connection *conn, const struct mqtt_queued_msg *msg)
+{
+  char name[32];
+  int fd;
+  int ok;
+
+  /* The file only shrinks once it has been read back entirely */
+  if(conn->cfs_head + conn->cfs_count >= MQTT_OUT_QUEUE_CFS_SIZE) {
+    return 0;
+  }
+
+  cfs_file_name(conn, name, sizeof(name));
+  fd = cfs_open(name, CFS_WRITE | CFS_APPEND);
+  if(fd < 0) {
+    return 0;
+  }
+  ok = cfs_write(fd, msg, sizeof(*msg)) == sizeof(*msg);
+  cfs_close(fd);
+
+  if(ok) {
+    conn->cfs_count++;
+  }
+  return ok;
+}
+/*---------------------------------------------------------------------------*/
+static void
+cfs_refill(struct mqtt_connection *conn, int slot)
+{
+  char name[32];
+  int fd;
+
+  cfs_file_name(conn, name, sizeof(name));
+  fd = cfs_open(name, CFS_READ);
+  if(fd >= 0) {
+    if(cfs_seek(fd, conn->cfs_head * sizeof(struct mqtt_queued_msg),
+                CFS_SEEK_SET) >= 0 &&
+       cfs_read(fd, &conn->out_queue[slot], sizeof(struct mqtt_queued_msg)) ==
+       sizeof(struct mqtt_queued_msg)) {
+      conn->out_queue_state[slot] = OUT_QUEUE_QUEUED;
+    }
+    cfs_close(fd);
+  }
+
+  if(conn->out_queue_state[slot] == OUT_QUEUE_FREE) {
+    PRINTF("MQTT - Error reading %s, dropping %u messages\n", name,
+           conn->cfs_count);
+    conn->cfs_count = 0;
+  } else {
+    conn->cfs_head++;
+    conn->cfs_count--;
+  }
+
+  if(conn->cfs_count == 0) {
+    cfs_remove(name);
+    conn->cfs_head = 0;
+  }
+}
+#endif /* MQTT_OUT_QUEUE_CFS_SIZE > 0 */
+/*---------------------------------------------------------------------------*/
+static int
+out_queue_free_slot(struct mqtt_connection *conn)
+{
+  int i;
+
+  for(i = 0; i < MQTT_OUT_QUEUE_SIZE; i++) {
+    if(conn->out_queue_state[i] == OUT_QUEUE_FREE) {
+      return i;
+    }
+  }
+  return -1;
+}
+/*---------------------------------------------------------------------------*/
+/* The oldest message waiting to be sent, message IDs increase */
+static int
+out_queue_next(struct mqtt_connection *conn)
+{
+  int i;
+  int next = -1;
+
+  for(i = 0; i < MQTT_OUT_QUEUE_SIZE; i++) {
+    if((conn->out_queue_state[i] & OUT_QUEUE_QUEUED) &&
+       (next < 0 ||
+        (int16_t)(conn->out_queue[i].mid - conn->out_queue[next].mid) < 0)) {
+      next = i;
+    }
+  }
+  return next;
+}
+/*---------------------------------------------------------------------------*/
+static mqtt_status_t
+out_queue_add(struct mqtt_connection *conn, uint16_t mid, char *topic,
+              uint8_t *payload, uint32_t payload_size,
+              mqtt_qos_level_t qos_level, mqtt_retain_t retain)
+{
+  static struct mqtt_queued_msg spill;
+  struct mqtt_queued_msg *msg;
+  uint16_t topic_length;
+  int i = -1;
+
+  topic_length = strlen(topic);
+  if(topic_length + payload_size > MQTT_OUT_QUEUE_MSG_LEN) {
+    return MQTT_STATUS_INVALID_ARGS_ERROR;
+  }
+
+#if MQTT_OUT_QUEUE_CFS_SIZE > 0
+  /* Keep the order: once spilling, spill until the file is read back */
+  if(conn->cfs_count == 0)
+#endif /* MQTT_OUT_QUEUE_CFS_SIZE > 0 */
+  {
+    i = out_queue_free_slot(conn);
+  }
+  msg = i >= 0 ? &conn->out_queue[i] : &spill;
+
+  msg->mid = mid;
+  msg->qos = qos_level;
+  msg->retain = retain;
+  msg->topic_length = topic_length;
+  msg->payload_size = payload_size;
+  memcpy(msg->data, topic, topic_length);
+  memcpy(&msg->data[topic_length], payload, payload_size);
+
+  if(i >= 0) {
+    conn->out_queue_state[i] = OUT_QUEUE_QUEUED;
+    return MQTT_STATUS_OK;
+  }
+#if MQTT_OUT_QUEUE_CFS_SIZE > 0
+  if(cfs_spill(conn, msg)) {
+    return MQTT_STATUS_OK;
+  }
+#endif /* MQTT_OUT_QUEUE_CFS_SIZE > 0 */
+  return MQTT_STATUS_OUT_QUEUE_FULL;
+}
+/*---------------------------------------------------------------------------*/
+static void
+out_queue_release(struct mqtt_connection *conn, int slot)
+{
+  conn->out_queue_state[slot] = OUT_QUEUE_FREE;
+#if MQTT_OUT_QUEUE_CFS_SIZE > 0
+  if(conn->cfs_count > 0) {
+    cfs_refill(conn, slot);
+  }
+#endif /* MQTT_OUT_QUEUE_CFS_SIZE > 0 */
+}
+/*---------------------------------------------------------------------------*/
+/* Sets up the out packet with the next queued message, if it may be sent */
+static int
+load_next_publish(struct mqtt_connection *conn)
+{
+  struct mqtt_queued_msg *msg;
+  int i;
+
+  if(conn->out_queue_full || conn->inflight_count == MQTT_MAX_INFLIGHT) {
+    return 0;
+  }
+  i = out_queue_next(conn);
+  if(i < 0) {
+    return 0;
+  }
+
+  msg = &conn->out_queue[i];
+  conn->out_packet.mid = msg->mid;
+  conn->out_packet.retain = msg->retain;
+  conn->out_packet.topic = (char *)msg->data;
+  conn->out_packet.topic_length = msg->topic_length;
+  conn->out_packet.payload = &msg->data[msg->topic_length];
+  conn->out_packet.payload_size = msg->payload_size;
+  conn->out_packet.qos = msg->qos;
+  conn->out_packet.dup = (conn->out_queue_state[i] & OUT_QUEUE_DUP) != 0;
+  conn->out_packet.slot = i;
+
+  conn->out_queue_state[i] = OUT_QUEUE_SENT;
+  conn->out_queue_full = 1;
+  return 1;
+}
+#endif /* MQTT_OUT_QUEUE_SIZE > 0 */
+/*---------------------------------------------------------------------------*/
+static void
+resume_out_queue(struct mqtt_connection *conn)
+{
+#if MQTT_OUT_QUEUE_SIZE > 0
+  if(conn->state == MQTT_CONN_STATE_CONNECTED_TO_BROKER &&
+     conn->inflight_count < MQTT_MAX_INFLIGHT && out_queue_next(conn) >= 0) {
+    process_post(&mqtt_process, mqtt_do_publish_event, conn);
+  }
+#endif /* MQTT_OUT_QUEUE_SIZE > 0 */
+}
+/*---------------------------------------------------------------------------*/
+static struct mqtt_inflight *
+inflight_find(struct mqtt_connection *conn, uint16_t mid)
+{
+  int i;
+
+  for(i = 0; i < MQTT_MAX_INFLIGHT; i++) {
+    if(conn->inflight[i].qos != MQTT_QOS_LEVEL_0 &&
+       conn->inflight[i].mid == mid) {
+      return &conn->inflight[i];
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static void
+inflight_release(struct mqtt_connection *conn, struct mqtt_inflight *entry)
+{
+#if MQTT_OUT_QUEUE_SIZE > 0
+  if(entry->slot >= 0) {
+    out_queue_release(conn, entry->slot);
+  }
+#endif /* MQTT_OUT_QUEUE_SIZE > 0 */
+  entry->qos = MQTT_QOS_LEVEL_0;
+  conn->inflight_count--;
+  resume_out_queue(conn);
+}
+/*---------------------------------------------------------------------------*/
+static void
+inflight_timeout(void *ptr)
+{
+  struct mqtt_connection *conn = ptr;
+  struct mqtt_inflight *entry;
+  clock_time_t now;
+  uint8_t pending = 0;
+  uint8_t dropped;
+  uint16_t mid;
+
+  now = clock_time();
+  for(entry = conn->inflight;
+      entry < &conn->inflight[MQTT_MAX_INFLIGHT]; entry++) {
+    if(entry->qos == MQTT_QOS_LEVEL_0) {
+      continue;
+    }
+    if(now - entry->sent < RESPONSE_WAIT_TIMEOUT) {
+      pending = 1;
+    } else if(entry->qos_state == MQTT_QOS_STATE_GOT_PUBREC) {
+      DBG("MQTT - Timeout waiting for PUBCOMP %u\n", entry->mid);
+      queue_ack(conn, MQTT_FHDR_MSG_TYPE_PUBREL | MQTT_FHDR_QOS_LEVEL_1,
+                entry->mid);
+      entry->sent = now;
+      pending = 1;
+    } else {
+      DBG("MQTT - Timeout waiting for the ack of %u\n", entry->mid);
+      mid = entry->mid;
+      dropped = 1;
+#if MQTT_OUT_QUEUE_SIZE > 0
+      /* Send the copy again, otherwise give up on the message */
+      if(entry->slot >= 0) {
+        conn->out_queue_state[entry->slot] = OUT_QUEUE_QUEUED | OUT_QUEUE_DUP;
+        entry->slot = -1;
+        dropped = 0;
+      }
+#endif /* MQTT_OUT_QUEUE_SIZE > 0 */
+      inflight_release(conn, entry);
+      if(dropped) {
+        call_event(conn, MQTT_EVENT_PUBLISH_TIMEOUT_ERROR, &mid);
+      }
+    }
+  }
+
+  if(pending) {
+    ctimer_set(&conn->inflight_timer, RESPONSE_WAIT_TIMEOUT / 2,
+               inflight_timeout, conn);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+inflight_add(struct mqtt_connection *conn)
+{
+  struct mqtt_inflight *entry;
+
+  for(entry = conn->inflight;
+      entry < &conn->inflight[MQTT_MAX_INFLIGHT]; entry++) {
+    if(entry->qos == MQTT_QOS_LEVEL_0) {
+      break;
+    }
+  }
+  if(entry == &conn->inflight[MQTT_MAX_INFLIGHT]) {
+    /* Can not happen, the window was checked before publishing */
+    return;
+  }
+
+  entry->mid = conn->out_packet.mid;
+  entry->qos = conn->out_packet.qos;
+  entry->qos_state = MQTT_QOS_STATE_NO_ACK;
+  entry->slot = conn->out_packet.slot;
+  entry->sent = clock_time();
+  conn->inflight_count++;
+
+  if(ctimer_expired(&conn->inflight_timer)) {
+    ctimer_set(&conn->inflight_timer, RESPONSE_WAIT_TIMEOUT / 2,
+               inflight_timeout, conn);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
 reset_defaults(struct mqtt_connection *conn)
 {
-  conn->mid_counter = 1;
   PT_INIT(&conn->out_proto_thread);
   conn->waiting_for_pingresp = 0;
 
@@ -218,6 +582,23 @@ reset_defaults(struct mqtt_connection *conn)
 static void
 abort_connection(struct mqtt_connection *conn)
 {
+#if MQTT_OUT_QUEUE_SIZE > 0
+  int i;
+
+  /* Queued messages survive, the unacknowledged ones are sent again */
+  for(i = 0; i < MQTT_OUT_QUEUE_SIZE; i++) {
+    if(conn->out_queue_state[i] == OUT_QUEUE_SENT) {
+      conn->out_queue_state[i] = OUT_QUEUE_QUEUED |
+        (conn->out_queue[i].qos > MQTT_QOS_LEVEL_0 ? OUT_QUEUE_DUP : 0);
+    }
+  }
+#endif /* MQTT_OUT_QUEUE_SIZE > 0 */
+  memset(conn->inflight, 0, sizeof(conn->inflight));
+  conn->inflight_count = 0;
+  ctimer_stop(&conn->inflight_timer);
+  conn->in_qos2_count = 0;
+  conn->ack_count = 0;
+
   conn->out_buffer_ptr = conn->out_buffer;
   conn->out_queue_full = 0;
 
@@ -416,16 +797,16 @@ PT_THREAD(connect_pt(struct pt *pt, struct mqtt_connection *conn))
   PT_MQTT_WRITE_BYTE(conn, conn->connect_vhdr_flags);
   PT_MQTT_WRITE_BYTE(conn, (conn->keep_alive >> 8));
   PT_MQTT_WRITE_BYTE(conn, (conn->keep_alive & 0x00FF));
-  PT_MQTT_WRITE_BYTE(conn, conn->client_id.length << 8);
+  PT_MQTT_WRITE_BYTE(conn, conn->client_id.length >> 8);
   PT_MQTT_WRITE_BYTE(conn, conn->client_id.length & 0x00FF);
   PT_MQTT_WRITE_BYTES(conn, (uint8_t *)conn->client_id.string,
                       conn->client_id.length);
   if(conn->connect_vhdr_flags & MQTT_VHDR_WILL_FLAG) {
-    PT_MQTT_WRITE_BYTE(conn, conn->will.topic.length << 8);
+    PT_MQTT_WRITE_BYTE(conn, conn->will.topic.length >> 8);
     PT_MQTT_WRITE_BYTE(conn, conn->will.topic.length & 0x00FF);
     PT_MQTT_WRITE_BYTES(conn, (uint8_t *)conn->will.topic.string,
                         conn->will.topic.length);
-    PT_MQTT_WRITE_BYTE(conn, conn->will.message.length << 8);
+    PT_MQTT_WRITE_BYTE(conn, conn->will.message.length >> 8);
     PT_MQTT_WRITE_BYTE(conn, conn->will.message.length & 0x00FF);
     PT_MQTT_WRITE_BYTES(conn, (uint8_t *)conn->will.message.string,
                         conn->will.message.length);
@@ -436,14 +817,14 @@ PT_THREAD(connect_pt(struct pt *pt, struct mqtt_connection *conn))
         conn->will.message.length);
   }
   if(conn->connect_vhdr_flags & MQTT_VHDR_USERNAME_FLAG) {
-    PT_MQTT_WRITE_BYTE(conn, conn->credentials.username.length << 8);
+    PT_MQTT_WRITE_BYTE(conn, conn->credentials.username.length >> 8);
     PT_MQTT_WRITE_BYTE(conn, conn->credentials.username.length & 0x00FF);
     PT_MQTT_WRITE_BYTES(conn,
                         (uint8_t *)conn->credentials.username.string,
                         conn->credentials.username.length);
   }
   if(conn->connect_vhdr_flags & MQTT_VHDR_PASSWORD_FLAG) {
-    PT_MQTT_WRITE_BYTE(conn, conn->credentials.password.length << 8);
+    PT_MQTT_WRITE_BYTE(conn, conn->credentials.password.length >> 8);
     PT_MQTT_WRITE_BYTE(conn, conn->credentials.password.length & 0x00FF);
     PT_MQTT_WRITE_BYTES(conn,
                         (uint8_t *)conn->credentials.password.string,
@@ -534,7 +915,7 @@ PT_THREAD(subscribe_pt(struct pt *pt, struct mqtt_connection *conn))
                       conn->out_packet.remaining_length_enc,
                       conn->out_packet.remaining_length_enc_bytes);
   /* Write Variable Header */
-  PT_MQTT_WRITE_BYTE(conn, (conn->out_packet.mid << 8));
+  PT_MQTT_WRITE_BYTE(conn, (conn->out_packet.mid >> 8));
   PT_MQTT_WRITE_BYTE(conn, (conn->out_packet.mid & 0x00FF));
   /* Write Payload */
   PT_MQTT_WRITE_BYTE(conn, (conn->out_packet.topic_length >> 8));
@@ -548,17 +929,16 @@ PT_THREAD(subscribe_pt(struct pt *pt, struct mqtt_connection *conn))
   timer_set(&conn->t, RESPONSE_WAIT_TIMEOUT);
 
   /* Wait for SUBACK. */
-  reset_packet(&conn->in_packet);
   PT_WAIT_UNTIL(pt, conn->out_packet.qos_state == MQTT_QOS_STATE_GOT_ACK ||
                 timer_expired(&conn->t));
 
   if(timer_expired(&conn->t)) {
     DBG("Timeout waiting for SUBACK\n");
   }
-  reset_packet(&conn->in_packet);
 
   /* This is clear after the entire transaction is complete */
   conn->out_queue_full = 0;
+  resume_out_queue(conn);
 
   DBG("MQTT - Done in send_subscribe!\n");
 
@@ -596,7 +976,7 @@ PT_THREAD(unsubscribe_pt(struct pt *pt, struct mqtt_connection *conn))
   PT_MQTT_WRITE_BYTES(conn, (uint8_t *)conn->out_packet.remaining_length_enc,
                       conn->out_packet.remaining_length_enc_bytes);
   /* Write Variable Header */
-  PT_MQTT_WRITE_BYTE(conn, (conn->out_packet.mid << 8));
+  PT_MQTT_WRITE_BYTE(conn, (conn->out_packet.mid >> 8));
   PT_MQTT_WRITE_BYTE(conn, (conn->out_packet.mid & 0x00FF));
   /* Write Payload */
   PT_MQTT_WRITE_BYTE(conn, (conn->out_packet.topic_length >> 8));
@@ -609,7 +989,6 @@ PT_THREAD(unsubscribe_pt(struct pt *pt, struct mqtt_connection *conn))
   timer_set(&conn->t, RESPONSE_WAIT_TIMEOUT);
 
   /* Wait for UNSUBACK */
-  reset_packet(&conn->in_packet);
   PT_WAIT_UNTIL(pt, conn->out_packet.qos_state == MQTT_QOS_STATE_GOT_ACK ||
                 timer_expired(&conn->t));
 
@@ -617,10 +996,9 @@ PT_THREAD(unsubscribe_pt(struct pt *pt, struct mqtt_connection *conn))
     DBG("Timeout waiting for UNSUBACK\n");
   }
 
-  reset_packet(&conn->in_packet);
-
   /* This is clear after the entire transaction is complete */
   conn->out_queue_full = 0;
+  resume_out_queue(conn);
 
   DBG("MQTT - Done writing subscribe message to out buffer!\n");
 
@@ -644,6 +1022,9 @@ PT_THREAD(publish_pt(struct pt *pt, struct mqtt_connection *conn))
   if(conn->out_packet.retain == MQTT_RETAIN_ON) {
     conn->out_packet.fhdr |= MQTT_FHDR_RETAIN_FLAG;
   }
+  if(conn->out_packet.dup) {
+    conn->out_packet.fhdr |= MQTT_FHDR_DUP_FLAG;
+  }
   conn->out_packet.remaining_length = MQTT_STRING_LEN_SIZE +
     conn->out_packet.topic_length +
     conn->out_packet.payload_size;
@@ -669,7 +1050,7 @@ PT_THREAD(publish_pt(struct pt *pt, struct mqtt_connection *conn))
   PT_MQTT_WRITE_BYTES(conn, (uint8_t *)conn->out_packet.topic,
                       conn->out_packet.topic_length);
   if(conn->out_packet.qos > MQTT_QOS_LEVEL_0) {
-    PT_MQTT_WRITE_BYTE(conn, (conn->out_packet.mid << 8));
+    PT_MQTT_WRITE_BYTE(conn, (conn->out_packet.mid >> 8));
     PT_MQTT_WRITE_BYTE(conn, (conn->out_packet.mid & 0x00FF));
   }
   /* Write Payload */
@@ -678,37 +1059,24 @@ PT_THREAD(publish_pt(struct pt *pt, struct mqtt_connection *conn))
                       conn->out_packet.payload_size);
 
   send_out_buffer(conn);
-  timer_set(&conn->t, RESPONSE_WAIT_TIMEOUT);
 
   /*
-   * If QoS is zero then wait until the message has been sent, since there is
-   * no ACK to wait for.
-   *
-   * Also notify the app will not be notified via PUBACK or PUBCOMP
+   * A QoS 1 or 2 message stays in flight until acknowledged, without holding
+   * up the next one unless the window is full.
    */
-  if(conn->out_packet.qos == 0) {
-    process_post(conn->app_process, mqtt_update_event, NULL);
-  } else if(conn->out_packet.qos == 1) {
-    /* Wait for PUBACK */
-    reset_packet(&conn->in_packet);
-    PT_WAIT_UNTIL(pt, conn->out_packet.qos_state == MQTT_QOS_STATE_GOT_ACK ||
-                  timer_expired(&conn->t));
-    if(timer_expired(&conn->t)) {
-      DBG("Timeout waiting for PUBACK\n");
-    }
-    if(conn->in_packet.mid != conn->out_packet.mid) {
-      DBG("MQTT - Warning, got PUBACK with none matching MID. Currently there "
-          "is no support for several concurrent PUBLISH messages.\n");
+  if(conn->out_packet.qos == MQTT_QOS_LEVEL_0) {
+#if MQTT_OUT_QUEUE_SIZE > 0
+    if(conn->out_packet.slot >= 0) {
+      out_queue_release(conn, conn->out_packet.slot);
     }
-  } else if(conn->out_packet.qos == 2) {
-    DBG("MQTT - QoS not implemented yet.\n");
-    /* Should wait for PUBREC, send PUBREL and then wait for PUBCOMP */
+#endif /* MQTT_OUT_QUEUE_SIZE > 0 */
+  } else {
+    inflight_add(conn);
   }
 
-  reset_packet(&conn->in_packet);
-
-  /* This is clear after the entire transaction is complete */
+  /* This is clear once the message is written out, tell the app */
   conn->out_queue_full = 0;
+  process_post(conn->app_process, mqtt_update_event, NULL);
 
   DBG("MQTT - Publish Enqueued\n");
 
@@ -732,12 +1100,9 @@ PT_THREAD(pingreq_pt(struct pt *pt, struct mqtt_connection *conn))
   conn->waiting_for_pingresp = 1;
 
   /* Wait for PINGRESP or timeout */
-  reset_packet(&conn->in_packet);
   timer_set(&conn->t, RESPONSE_WAIT_TIMEOUT);
 
-  PT_WAIT_UNTIL(pt, conn->in_packet.packet_received || timer_expired(&conn->t));
-
-  reset_packet(&conn->in_packet);
+  PT_WAIT_UNTIL(pt, !conn->waiting_for_pingresp || timer_expired(&conn->t));
 
   conn->waiting_for_pingresp = 0;
 
@@ -767,12 +1132,40 @@ handle_connack(struct mqtt_connection *conn)
   /* Always reset packet before callback since it might be used directly */
   conn->state = MQTT_CONN_STATE_CONNECTED_TO_BROKER;
   call_event(conn, MQTT_EVENT_CONNECTED, NULL);
+
+  /* Send what was published while not connected */
+  resume_out_queue(conn);
 }
 /*---------------------------------------------------------------------------*/
 static void
 handle_pingresp(struct mqtt_connection *conn)
 {
   DBG("MQTT - Got RINGRESP\n");
+
+  conn->waiting_for_pingresp = 0;
+}
+/*---------------------------------------------------------------------------*/
+static
+PT_THREAD(ack_pt(struct pt *pt, struct mqtt_connection *conn))
+{
+  PT_BEGIN(pt);
+
+  while(conn->ack_count > 0) {
+    DBG("MQTT - Sending %02X for %u\n", conn->ack_type[conn->ack_head],
+        conn->ack_mid[conn->ack_head]);
+
+    PT_MQTT_WRITE_BYTE(conn, conn->ack_type[conn->ack_head]);
+    PT_MQTT_WRITE_BYTE(conn, MQTT_MID_SIZE);
+    PT_MQTT_WRITE_BYTE(conn, conn->ack_mid[conn->ack_head] >> 8);
+    PT_MQTT_WRITE_BYTE(conn, conn->ack_mid[conn->ack_head] & 0x00FF);
+
+    conn->ack_head = (conn->ack_head + 1) % MQTT_ACK_QUEUE_SIZE;
+    conn->ack_count--;
+  }
+
+  send_out_buffer(conn);
+
+  PT_END(pt);
 }
 /*---------------------------------------------------------------------------*/
 static void
@@ -824,28 +1217,113 @@ handle_unsuback(struct mqtt_connection *conn)
 static void
 handle_puback(struct mqtt_connection *conn)
 {
+  struct mqtt_inflight *entry;
+
   DBG("MQTT - Got PUBACK\n");
 
-  conn->out_packet.qos_state = MQTT_QOS_STATE_GOT_ACK;
   conn->in_packet.mid = (conn->in_packet.payload[0] << 8) |
     (conn->in_packet.payload[1]);
 
+  entry = inflight_find(conn, conn->in_packet.mid);
+  if(entry != NULL && entry->qos == MQTT_QOS_LEVEL_1) {
+    inflight_release(conn, entry);
+  } else {
+    DBG("MQTT - Warning, got PUBACK for unknown MID %u\n",
+        conn->in_packet.mid);
+  }
+
   call_event(conn, MQTT_EVENT_PUBACK, &conn->in_packet.mid);
 }
 /*---------------------------------------------------------------------------*/
 static void
+handle_pubrec(struct mqtt_connection *conn)
+{
+  struct mqtt_inflight *entry;
+
+  DBG("MQTT - Got PUBREC\n");
+
+  conn->in_packet.mid = (conn->in_packet.payload[0] << 8) |
+    (conn->in_packet.payload[1]);
+
+  entry = inflight_find(conn, conn->in_packet.mid);
+  if(entry != NULL && entry->qos == MQTT_QOS_LEVEL_2) {
+    entry->qos_state = MQTT_QOS_STATE_GOT_PUBREC;
+    entry->sent = clock_time();
+#if MQTT_OUT_QUEUE_SIZE > 0
+    /* The broker owns the message now, only the PUBREL may be resent */
+    if(entry->slot >= 0) {
+      out_queue_release(conn, entry->slot);
+      entry->slot = -1;
+    }
+#endif /* MQTT_OUT_QUEUE_SIZE > 0 */
+  }
+
+  queue_ack(conn, MQTT_FHDR_MSG_TYPE_PUBREL | MQTT_FHDR_QOS_LEVEL_1,
+            conn->in_packet.mid);
+}
+/*---------------------------------------------------------------------------*/
+static void
+handle_pubcomp(struct mqtt_connection *conn)
+{
+  struct mqtt_inflight *entry;
+
+  DBG("MQTT - Got PUBCOMP\n");
+
+  conn->in_packet.mid = (conn->in_packet.payload[0] << 8) |
+    (conn->in_packet.payload[1]);
+
+  entry = inflight_find(conn, conn->in_packet.mid);
+  if(entry != NULL && entry->qos == MQTT_QOS_LEVEL_2) {
+    inflight_release(conn, entry);
+  } else {
+    DBG("MQTT - Warning, got PUBCOMP for unknown MID %u\n",
+        conn->in_packet.mid);
+  }
+
+  call_event(conn, MQTT_EVENT_PUBCOMP, &conn->in_packet.mid);
+}
+/*---------------------------------------------------------------------------*/
+static void
+handle_pubrel(struct mqtt_connection *conn)
+{
+  int i;
+
+  DBG("MQTT - Got PUBREL\n");
+
+  conn->in_packet.mid = (conn->in_packet.payload[0] << 8) |
+    (conn->in_packet.payload[1]);
+
+  /* The message was delivered when its PUBLISH arrived */
+  i = in_qos2_find(conn, conn->in_packet.mid);
+  if(i >= 0) {
+    in_qos2_remove(conn, i);
+  }
+
+  queue_ack(conn, MQTT_FHDR_MSG_TYPE_PUBCOMP, conn->in_packet.mid);
+}
+/*---------------------------------------------------------------------------*/
+static void
 handle_publish(struct mqtt_connection *conn)
 {
   DBG("MQTT - Got PUBLISH, called once per manageable chunk of message.\n");
   DBG("MQTT - Handling publish on topic '%s'\n", conn->in_publish_msg.topic);
 
-  DBG("MQTT - This chunk is %i bytes\n", conn->in_packet.payload_pos);
+  DBG("MQTT - This chunk is %i bytes\n",
+      conn->in_publish_msg.payload_chunk_length);
 
-  if(((conn->in_packet.fhdr & 0x09) >> 1) > 0) {
-    PRINTF("MQTT - Error, got incoming PUBLISH with QoS > 0, not supported atm!\n");
+  /*
+   * The app is woken up once per message, a large payload in many chunks
+   * would otherwise fill the event queue.
+   */
+  if(!conn->in_packet.duplicate) {
+    if(conn->in_publish_msg.payload_left > 0) {
+      conn->event_callback(conn, MQTT_EVENT_PUBLISH, &conn->in_publish_msg);
+    } else {
+      call_event(conn, MQTT_EVENT_PUBLISH, &conn->in_publish_msg);
+    }
   }
-
-  call_event(conn, MQTT_EVENT_PUBLISH, &conn->in_publish_msg);
+  conn->in_publish_msg.payload_offset +=
+    conn->in_publish_msg.payload_chunk_length;
 
   if(conn->in_publish_msg.first_chunk == 1) {
     conn->in_publish_msg.first_chunk = 0;
@@ -856,6 +1334,14 @@ handle_publish(struct mqtt_connection *conn)
 
     /* Check for QoS and initiate the reply, do not rely on the data in the
      * in_packet being untouched. */
+    if(MQTT_FHDR_QOS(conn->in_packet.fhdr) == MQTT_QOS_LEVEL_1) {
+      queue_ack(conn, MQTT_FHDR_MSG_TYPE_PUBACK, conn->in_packet.mid);
+    } else if(MQTT_FHDR_QOS(conn->in_packet.fhdr) == MQTT_QOS_LEVEL_2) {
+      if(!conn->in_packet.duplicate) {
+        in_qos2_add(conn, conn->in_packet.mid);
+      }
+      queue_ack(conn, MQTT_FHDR_MSG_TYPE_PUBREC, conn->in_packet.mid);
+    }
 
     DBG("MQTT - (handle_publish) resetting packet.\n");
     reset_packet(&conn->in_packet);
@@ -871,69 +1357,98 @@ parse_publish_vhdr(struct mqtt_connection *conn,
   uint16_t copy_bytes;
 
   /* Read out topic length */
-  if(conn->in_packet.topic_len_received == 0) {
-    conn->in_packet.topic_len = (input_data_ptr[(*pos)++] << 8);
-    conn->in_packet.byte_counter++;
-    if(*pos >= input_data_len) {
-      return;
-    }
-    conn->in_packet.topic_len |= input_data_ptr[(*pos)++];
+  while(conn->in_packet.topic_len_received < 2 && *pos < input_data_len) {
+    conn->in_packet.topic_len = (conn->in_packet.topic_len << 8) |
+      input_data_ptr[(*pos)++];
     conn->in_packet.byte_counter++;
-    conn->in_packet.topic_len_received = 1;
-
-    DBG("MQTT - Read PUBLISH topic len %i\n", conn->in_packet.topic_len);
-    /* WARNING: Check here if TOPIC fits in payload area, otherwise error */
+    conn->in_packet.topic_len_received++;
+  }
+  if(conn->in_packet.topic_len_received < 2) {
+    return;
   }
 
   /* Read out topic */
-  if(conn->in_packet.topic_len_received == 1 &&
-     conn->in_packet.topic_received == 0) {
+  if(conn->in_packet.topic_received == 0) {
+    DBG("MQTT - Read PUBLISH topic len %i\n", conn->in_packet.topic_len);
+
     copy_bytes = MIN(conn->in_packet.topic_len - conn->in_packet.topic_pos,
                      input_data_len - *pos);
     DBG("MQTT - topic_pos: %i copy_bytes: %i", conn->in_packet.topic_pos,
         copy_bytes);
-    memcpy(&conn->in_publish_msg.topic[conn->in_packet.topic_pos],
-           &input_data_ptr[*pos],
-           copy_bytes);
+    /* What does not fit is skipped */
+    if(conn->in_packet.topic_pos < MQTT_MAX_TOPIC_LENGTH) {
+      memcpy(&conn->in_publish_msg.topic[conn->in_packet.topic_pos],
+             &input_data_ptr[*pos],
+             MIN(copy_bytes,
+                 MQTT_MAX_TOPIC_LENGTH - conn->in_packet.topic_pos));
+    }
     (*pos) += copy_bytes;
     conn->in_packet.byte_counter += copy_bytes;
     conn->in_packet.topic_pos += copy_bytes;
 
     if(conn->in_packet.topic_len - conn->in_packet.topic_pos == 0) {
-      DBG("MQTT - Got topic '%s'", conn->in_publish_msg.topic);
       conn->in_packet.topic_received = 1;
-      conn->in_publish_msg.topic[conn->in_packet.topic_pos] = '\0';
+      conn->in_publish_msg.topic[MIN(conn->in_packet.topic_pos,
+                                     MQTT_MAX_TOPIC_LENGTH)] = '\0';
+      DBG("MQTT - Got topic '%s'", conn->in_publish_msg.topic);
       conn->in_publish_msg.payload_length =
         conn->in_packet.remaining_length - conn->in_packet.topic_len - 2;
+      if(MQTT_FHDR_QOS(conn->in_packet.fhdr) > MQTT_QOS_LEVEL_0) {
+        conn->in_publish_msg.payload_length -= MQTT_MID_SIZE;
+      }
       conn->in_publish_msg.payload_left = conn->in_publish_msg.payload_length;
+      conn->in_publish_msg.payload_offset = 0;
+      conn->in_publish_msg.payload_chunk = conn->in_packet.payload;
+      conn->in_publish_msg.payload_chunk_length = 0;
     }
 
     /* Set this once per incomming publish message */
     conn->in_publish_msg.first_chunk = 1;
   }
+
+  if(conn->in_packet.topic_received == 0) {
+    return;
+  }
+
+  /* Read out the message ID of QoS 1 and 2 messages */
+  if(MQTT_FHDR_QOS(conn->in_packet.fhdr) > MQTT_QOS_LEVEL_0) {
+    while(conn->in_packet.mid_bytes < MQTT_MID_SIZE && *pos < input_data_len) {
+      conn->in_packet.mid = (conn->in_packet.mid << 8) |
+        input_data_ptr[(*pos)++];
+      conn->in_packet.byte_counter++;
+      conn->in_packet.mid_bytes++;
+    }
+    if(conn->in_packet.mid_bytes < MQTT_MID_SIZE) {
+      return;
+    }
+    conn->in_publish_msg.mid = conn->in_packet.mid;
+
+    /* A QoS 2 message is delivered once, until its PUBREL */
+    conn->in_packet.duplicate =
+      MQTT_FHDR_QOS(conn->in_packet.fhdr) == MQTT_QOS_LEVEL_2 &&
+      in_qos2_find(conn, conn->in_packet.mid) >= 0;
+  }
+  conn->in_packet.vhdr_received = 1;
 }
 /*---------------------------------------------------------------------------*/
-static int
-tcp_input(struct tcp_socket *s,
-          void *ptr,
-          const uint8_t *input_data_ptr,
-          int input_data_len)
+/*
+ * Reads at most one packet from the input and handles it once complete.
+ * Returns the number of bytes used.
+ */
+static uint32_t
+input_packet(struct mqtt_connection *conn,
+             const uint8_t *input_data_ptr,
+             int input_data_len)
 {
-  struct mqtt_connection *conn = ptr;
   uint32_t pos = 0;
   uint32_t copy_bytes = 0;
+  uint32_t packet_end;
   uint8_t byte;
 
-  if(input_data_len == 0) {
-    return 0;
-  }
-
   if(conn->in_packet.packet_received) {
     reset_packet(&conn->in_packet);
   }
 
-  DBG("tcp_input with %i bytes of data:\n", input_data_len);
-
   /* Read the fixed header field, if we do not have it */
   if(!conn->in_packet.fhdr) {
     conn->in_packet.fhdr = input_data_ptr[pos++];
@@ -942,7 +1457,7 @@ tcp_input(struct tcp_socket *s,
     DBG("MQTT - Read VHDR '%02X'\n", conn->in_packet.fhdr);
 
     if(pos >= input_data_len) {
-      return 0;
+      return pos;
     }
   }
 
@@ -950,7 +1465,7 @@ tcp_input(struct tcp_socket *s,
   if(!conn->in_packet.has_remaining_length) {
     do {
       if(pos >= input_data_len) {
-        return 0;
+        return pos;
       }
 
       byte = input_data_ptr[pos++];
@@ -961,7 +1476,7 @@ tcp_input(struct tcp_socket *s,
       if(conn->in_packet.byte_counter > 5) {
         call_event(conn, MQTT_EVENT_ERROR, NULL);
         DBG("Received more then 4 byte 'remaining lenght'.");
-        return 0;
+        return input_data_len;
       }
 
       conn->in_packet.remaining_length +=
@@ -973,6 +1488,9 @@ tcp_input(struct tcp_socket *s,
     conn->in_packet.has_remaining_length = 1;
   }
 
+  packet_end = MQTT_FHDR_SIZE + conn->in_packet.remaining_length_bytes +
+    conn->in_packet.remaining_length;
+
   /*
    * Check for unsupported payload length. Will read all incoming data from the
    * server in any case and then reset the packet.
@@ -984,12 +1502,14 @@ tcp_input(struct tcp_socket *s,
 
     PRINTF("MQTT - Error, unsupported payload size for non-PUBLISH message\n");
 
-    conn->in_packet.byte_counter += input_data_len;
-    if(conn->in_packet.byte_counter >=
-       (MQTT_FHDR_SIZE + conn->in_packet.remaining_length)) {
+    copy_bytes = MIN(input_data_len - pos,
+                     packet_end - conn->in_packet.byte_counter);
+    conn->in_packet.byte_counter += copy_bytes;
+    pos += copy_bytes;
+    if(conn->in_packet.byte_counter >= packet_end) {
       conn->in_packet.packet_received = 1;
     }
-    return 0;
+    return pos;
   }
 
   /*
@@ -998,17 +1518,43 @@ tcp_input(struct tcp_socket *s,
    * Note: There will always be at least one byte left to read when we enter
    *       this loop.
    */
-  while(conn->in_packet.byte_counter <
-        (MQTT_FHDR_SIZE + conn->in_packet.remaining_length)) {
+  while(conn->in_packet.byte_counter < packet_end) {
 
     if((conn->in_packet.fhdr & 0xF0) == MQTT_FHDR_MSG_TYPE_PUBLISH &&
-       conn->in_packet.topic_received == 0) {
+       conn->in_packet.vhdr_received == 0) {
       parse_publish_vhdr(conn, &pos, input_data_ptr, input_data_len);
     }
 
+#if MQTT_STREAM_PUBLISH
+    /* Pass the payload on as a slice of the input, without copying it */
+    if((conn->in_packet.fhdr & 0xF0) == MQTT_FHDR_MSG_TYPE_PUBLISH) {
+      copy_bytes = MIN(input_data_len - pos,
+                       packet_end - conn->in_packet.byte_counter);
+      if(conn->in_packet.vhdr_received && copy_bytes > 0) {
+        conn->in_publish_msg.payload_chunk = (uint8_t *)&input_data_ptr[pos];
+        conn->in_publish_msg.payload_chunk_length = copy_bytes;
+        conn->in_publish_msg.payload_left -= copy_bytes;
+        conn->in_packet.byte_counter += copy_bytes;
+        pos += copy_bytes;
+
+        /* The last slice is handled with the complete packet below */
+        if(conn->in_packet.byte_counter < packet_end) {
+          handle_publish(conn);
+        }
+      }
+
+      if(pos >= input_data_len &&
+         conn->in_packet.byte_counter < packet_end) {
+        return pos;
+      }
+      continue;
+    }
+#endif /* MQTT_STREAM_PUBLISH */
+
     /* Read in as much as we can into the packet payload */
     copy_bytes = MIN(input_data_len - pos,
                      MQTT_INPUT_BUFF_SIZE - conn->in_packet.payload_pos);
+    copy_bytes = MIN(copy_bytes, packet_end - conn->in_packet.byte_counter);
     DBG("- Copied %lu payload bytes\n", copy_bytes);
     memcpy(&conn->in_packet.payload[conn->in_packet.payload_pos],
            &input_data_ptr[pos],
@@ -1017,15 +1563,19 @@ tcp_input(struct tcp_socket *s,
     conn->in_packet.payload_pos += copy_bytes;
     pos += copy_bytes;
 
-    uint8_t i;
+    uint32_t i;
     DBG("MQTT - Copied bytes: \n");
     for(i = 0; i < copy_bytes; i++) {
       DBG("%02X ", conn->in_packet.payload[i]);
     }
     DBG("\n");
 
-    /* Full buffer, shall only happen to PUBLISH messages. */
-    if(MQTT_INPUT_BUFF_SIZE - conn->in_packet.payload_pos == 0) {
+    /*
+     * Full buffer, shall only happen to PUBLISH messages. The last chunk is
+     * handled with the complete packet below.
+     */
+    if(MQTT_INPUT_BUFF_SIZE - conn->in_packet.payload_pos == 0 &&
+       conn->in_packet.byte_counter < packet_end) {
       conn->in_publish_msg.payload_chunk = conn->in_packet.payload;
       conn->in_publish_msg.payload_chunk_length = MQTT_INPUT_BUFF_SIZE;
       conn->in_publish_msg.payload_left -= MQTT_INPUT_BUFF_SIZE;
@@ -1037,8 +1587,8 @@ tcp_input(struct tcp_socket *s,
     }
 
     if(pos >= input_data_len &&
-       (conn->in_packet.byte_counter < (MQTT_FHDR_SIZE + conn->in_packet.remaining_length))) {
-      return 0;
+       (conn->in_packet.byte_counter < packet_end)) {
+      return pos;
     }
   }
 
@@ -1047,8 +1597,7 @@ tcp_input(struct tcp_socket *s,
   /* Take care of input */
   DBG("MQTT - Finished reading packet!\n");
   /* What to return? */
-  DBG("MQTT - total data was %i bytes of data. \n",
-      (MQTT_FHDR_SIZE + conn->in_packet.remaining_length));
+  DBG("MQTT - total data was %lu bytes of data. \n", packet_end);
 
   /* Handle packet here. */
   switch(conn->in_packet.fhdr & 0xF0) {
@@ -1057,14 +1606,25 @@ tcp_input(struct tcp_socket *s,
     break;
   case MQTT_FHDR_MSG_TYPE_PUBLISH:
     /* This is the only or the last chunk of publish payload */
+#if !MQTT_STREAM_PUBLISH
     conn->in_publish_msg.payload_chunk = conn->in_packet.payload;
     conn->in_publish_msg.payload_chunk_length = conn->in_packet.payload_pos;
+#endif /* !MQTT_STREAM_PUBLISH */
     conn->in_publish_msg.payload_left = 0;
     handle_publish(conn);
     break;
   case MQTT_FHDR_MSG_TYPE_PUBACK:
     handle_puback(conn);
     break;
+  case MQTT_FHDR_MSG_TYPE_PUBREC:
+    handle_pubrec(conn);
+    break;
+  case MQTT_FHDR_MSG_TYPE_PUBREL:
+    handle_pubrel(conn);
+    break;
+  case MQTT_FHDR_MSG_TYPE_PUBCOMP:
+    handle_pubcomp(conn);
+    break;
   case MQTT_FHDR_MSG_TYPE_SUBACK:
     handle_suback(conn);
     break;
@@ -1075,15 +1635,6 @@ tcp_input(struct tcp_socket *s,
     handle_pingresp(conn);
     break;
 
-  /* QoS 2 not implemented yet */
-  case MQTT_FHDR_MSG_TYPE_PUBREC:
-  case MQTT_FHDR_MSG_TYPE_PUBREL:
-  case MQTT_FHDR_MSG_TYPE_PUBCOMP:
-    call_event(conn, MQTT_EVENT_NOT_IMPLEMENTED_ERROR, NULL);
-    PRINTF("MQTT - Got unhandled MQTT Message Type '%i'",
-           (conn->in_packet.fhdr & 0xF0));
-    break;
-
   default:
     /* All server-only message */
     PRINTF("MQTT - Got MQTT Message Type '%i'", (conn->in_packet.fhdr & 0xF0));
@@ -1092,6 +1643,25 @@ tcp_input(struct tcp_socket *s,
 
   conn->in_packet.packet_received = 1;
 
+  return pos;
+}
+/*---------------------------------------------------------------------------*/
+static int
+tcp_input(struct tcp_socket *s,
+          void *ptr,
+          const uint8_t *input_data_ptr,
+          int input_data_len)
+{
+  struct mqtt_connection *conn = ptr;
+  uint32_t pos = 0;
+
+  DBG("tcp_input with %i bytes of data:\n", input_data_len);
+
+  /* A segment may hold several packets, e.g. the PUBACKs of a window */
+  while(pos < input_data_len) {
+    pos += input_packet(conn, &input_data_ptr[pos], input_data_len - pos);
+  }
+
   return 0;
 }
 /*---------------------------------------------------------------------------*/
@@ -1137,6 +1707,12 @@ tcp_event(struct tcp_socket *s, void *ptr, tcp_socket_event_t event)
     if(conn->socket.output_data_len == 0) {
       conn->out_buffer_sent = 1;
       conn->out_buffer_ptr = conn->out_buffer;
+
+      /* Continue with what had to wait for the buffer */
+      if(conn->ack_count > 0) {
+        process_post(&mqtt_process, mqtt_do_ack_event, conn);
+      }
+      resume_out_queue(conn);
     }
 
     ctimer_restart(&conn->keep_alive_timer);
@@ -1247,7 +1823,13 @@ PROCESS_THREAD(mqtt_process, ev, data)
       DBG("MQTT - Got mqtt_do_publish_mqtt_event!\n");
 
       if(conn->out_buffer_sent == 1 &&
-         conn->state == MQTT_CONN_STATE_CONNECTED_TO_BROKER) {
+         conn->state == MQTT_CONN_STATE_CONNECTED_TO_BROKER &&
+#if MQTT_OUT_QUEUE_SIZE > 0
+         load_next_publish(conn)
+#else
+         conn->out_queue_full
+#endif /* MQTT_OUT_QUEUE_SIZE > 0 */
+         ) {
         PT_INIT(&conn->out_proto_thread);
         while(conn->state == MQTT_CONN_STATE_CONNECTED_TO_BROKER &&
               publish_pt(&conn->out_proto_thread, conn) < PT_EXITED) {
@@ -1255,6 +1837,20 @@ PROCESS_THREAD(mqtt_process, ev, data)
         }
       }
     }
+    if(ev == mqtt_do_ack_event) {
+      conn = data;
+      DBG("MQTT - Got mqtt_do_ack_event!\n");
+
+      if(conn->out_buffer_sent == 1 &&
+         conn->state == MQTT_CONN_STATE_CONNECTED_TO_BROKER &&
+         conn->ack_count > 0) {
+        PT_INIT(&conn->out_proto_thread);
+        while(conn->state == MQTT_CONN_STATE_CONNECTED_TO_BROKER &&
+              ack_pt(&conn->out_proto_thread, conn) < PT_EXITED) {
+          PT_MQTT_WAIT_SEND();
+        }
+      }
+    }
   }
   PROCESS_END();
 }
@@ -1273,6 +1869,7 @@ mqtt_init(void)
     mqtt_do_unsubscribe_event = process_alloc_event();
     mqtt_do_publish_event = process_alloc_event();
     mqtt_do_pingreq_event = process_alloc_event();
+    mqtt_do_ack_event = process_alloc_event();
     mqtt_update_event = process_alloc_event();
     mqtt_abort_now_event = process_alloc_event();
     mqtt_event_max = mqtt_abort_now_event;
@@ -1301,8 +1898,20 @@ mqtt_register(struct mqtt_connection *conn, struct process *app_process,
   conn->app_process = app_process;
   conn->auto_reconnect = 1;
   conn->max_segment_size = max_segment_size;
+  /* Not reset on reconnect, queued messages keep their IDs */
+  conn->mid_counter = 1;
   reset_defaults(conn);
 
+#if MQTT_OUT_QUEUE_SIZE > 0 && MQTT_OUT_QUEUE_CFS_SIZE > 0
+  {
+    char name[32];
+
+    /* Nothing refers to what an earlier run left behind */
+    cfs_file_name(conn, name, sizeof(name));
+    cfs_remove(name);
+  }
+#endif /* MQTT_OUT_QUEUE_SIZE > 0 && MQTT_OUT_QUEUE_CFS_SIZE > 0 */
+
   mqtt_init();
   list_add(mqtt_conn_list, conn);
 
@@ -1423,14 +2032,42 @@ mqtt_publish(struct mqtt_connection *conn, uint16_t *mid, char *topic,
              uint8_t *payload, uint32_t payload_size,
              mqtt_qos_level_t qos_level, mqtt_retain_t retain)
 {
+#if MQTT_OUT_QUEUE_SIZE > 0
+  mqtt_status_t status;
+
+  /* Messages published while not connected wait in the queue */
+  if(conn->app_process == NULL) {
+    return MQTT_STATUS_NOT_CONNECTED_ERROR;
+  }
+#else /* MQTT_OUT_QUEUE_SIZE > 0 */
   if(conn->state != MQTT_CONN_STATE_CONNECTED_TO_BROKER) {
     return MQTT_STATUS_NOT_CONNECTED_ERROR;
   }
+#endif /* MQTT_OUT_QUEUE_SIZE > 0 */
 
   DBG("MQTT - Call to mqtt_publish...\n");
 
-  /* Currently don't have a queue, so only one item at a time */
-  if(conn->out_queue_full) {
+#if MQTT_OUT_QUEUE_SIZE > 0
+  status = out_queue_add(conn, conn->mid_counter + 2, topic, payload,
+                         payload_size, qos_level, retain);
+  if(status != MQTT_STATUS_OK) {
+    DBG("MQTT - Not accepted!\n");
+    return status;
+  }
+  DBG("MQTT - Queued!\n");
+
+  INCREMENT_MID(conn);
+  if(mid != NULL) {
+    *mid = conn->mid_counter;
+  }
+
+  resume_out_queue(conn);
+  return MQTT_STATUS_OK;
+#else /* MQTT_OUT_QUEUE_SIZE > 0 */
+  /* Without a queue, only one item at a time is written out */
+  if(conn->out_queue_full ||
+     (qos_level > MQTT_QOS_LEVEL_0 &&
+      conn->inflight_count == MQTT_MAX_INFLIGHT)) {
     DBG("MQTT - Not accepted!\n");
     return MQTT_STATUS_OUT_QUEUE_FULL;
   }
@@ -1445,9 +2082,15 @@ mqtt_publish(struct mqtt_connection *conn, uint16_t *mid, char *topic,
   conn->out_packet.payload_size = payload_size;
   conn->out_packet.qos = qos_level;
   conn->out_packet.qos_state = MQTT_QOS_STATE_NO_ACK;
+  conn->out_packet.dup = 0;
+  conn->out_packet.slot = -1;
+  if(mid != NULL) {
+    *mid = conn->out_packet.mid;
+  }
 
   process_post(&mqtt_process, mqtt_do_publish_event, conn);
   return MQTT_STATUS_OK;
+#endif /* MQTT_OUT_QUEUE_SIZE > 0 */
 }
 /*----------------------------------------------------------------------------*/
 void
@@ -35,7 +35,8 @@
  * \defgroup mqtt-engine An implementation of MQTT v3.1
  * @{
  *
- * This application is an engine for MQTT v3.1. It supports QoS Levels 0 and 1.
+ * This application is an engine for MQTT v3.1. It supports QoS Levels 0, 1
+ * and 2.
  *
  * MQTT is a Client Server publish/subscribe messaging transport protocol.
  * It is light weight, open, simple, and designed so as to be easy to implement.
@@ -60,8 +61,7 @@
  *  can occur.
  *  -- "Exactly once" (2), where message are assured to arrive exactly once.
  *  This level could be used, for example, with billing systems where duplicate
- *  or lost messages could lead to incorrect charges being applied. This QoS
- *  level is currently not supported in this implementation.
+ *  or lost messages could lead to incorrect charges being applied.
  *
  * - A small transport overhead and protocol exchanges minimized to reduce
  *   network traffic.
@@ -107,7 +107,11 @@
 #define MQTT_TCP_INPUT_BUFF_SIZE 512
 #define MQTT_TCP_OUTPUT_BUFF_SIZE 512
 
+#ifdef MQTT_CONF_INPUT_BUFF_SIZE
+#define MQTT_INPUT_BUFF_SIZE MQTT_CONF_INPUT_BUFF_SIZE
+#else
 #define MQTT_INPUT_BUFF_SIZE 512
+#endif
 #define MQTT_MAX_TOPIC_LENGTH 64
 #define MQTT_MAX_TOPICS_PER_SUBSCRIBE 1
 
@@ -117,6 +121,77 @@
 #define MQTT_PROTOCOL_NAME "MQIsdp"
 #define MQTT_TOPIC_MAX_LENGTH 128
 /*---------------------------------------------------------------------------*/
+/*
+ * Number of QoS 1 and 2 PUBLISH messages that may be waiting for their PUBACK
+ * or PUBCOMP at the same time, and of received QoS 2 message IDs remembered
+ * until their PUBREL. With 1, each publish waits for the previous one to be
+ * acknowledged.
+ */
+#ifdef MQTT_CONF_MAX_INFLIGHT
+#define MQTT_MAX_INFLIGHT MQTT_CONF_MAX_INFLIGHT
+#else
+#define MQTT_MAX_INFLIGHT 1
+#endif
+
+/* Number of PUBACK, PUBREC, PUBREL and PUBCOMP waiting to be sent */
+#ifdef MQTT_CONF_ACK_QUEUE_SIZE
+#define MQTT_ACK_QUEUE_SIZE MQTT_CONF_ACK_QUEUE_SIZE
+#else
+#define MQTT_ACK_QUEUE_SIZE (MQTT_MAX_INFLIGHT + 2)
+#endif
+
+/*
+ * Number of messages mqtt_publish() can copy into the outbound queue. Queued
+ * messages are accepted while the in-flight window is full or the broker is
+ * unreachable, are sent in order once there is room, and are resent with the
+ * DUP flag if their acknowledgement does not arrive. With 0, mqtt_publish()
+ * sends the buffers of the caller, who must keep them until the PUBACK or
+ * PUBCOMP event.
+ */
+#ifdef MQTT_CONF_OUT_QUEUE_SIZE
+#define MQTT_OUT_QUEUE_SIZE MQTT_CONF_OUT_QUEUE_SIZE
+#else
+#define MQTT_OUT_QUEUE_SIZE 0
+#endif
+
+/* Maximum topic plus payload length of a queued message */
+#ifdef MQTT_CONF_OUT_QUEUE_MSG_LEN
+#define MQTT_OUT_QUEUE_MSG_LEN MQTT_CONF_OUT_QUEUE_MSG_LEN
+#else
+#define MQTT_OUT_QUEUE_MSG_LEN 128
+#endif
+
+/*
+ * Number of messages written to a CFS file when the outbound queue is full,
+ * so that bursts and long broker outages do not lose them. They are read back
+ * into the queue as it drains. With 0, a full queue rejects new messages.
+ */
+#ifdef MQTT_CONF_OUT_QUEUE_CFS_SIZE
+#define MQTT_OUT_QUEUE_CFS_SIZE MQTT_CONF_OUT_QUEUE_CFS_SIZE
+#else
+#define MQTT_OUT_QUEUE_CFS_SIZE 0
+#endif
+
+/* Prefix of the CFS file, followed by the client ID */
+#ifdef MQTT_CONF_OUT_QUEUE_CFS_FILE
+#define MQTT_OUT_QUEUE_CFS_FILE MQTT_CONF_OUT_QUEUE_CFS_FILE
+#else
+#define MQTT_OUT_QUEUE_CFS_FILE "mqtt-"
+#endif
+
+/*
+ * With 1, the payload of a received PUBLISH is not copied into the input
+ * buffer. Each MQTT_EVENT_PUBLISH points payload_chunk straight into the TCP
+ * input data, one slice per segment, so payloads of any length are passed on
+ * as they arrive and the input buffer only has to hold the other packets.
+ * With 0, the payload is delivered in chunks of MQTT_INPUT_BUFF_SIZE bytes.
+ */
+#ifdef MQTT_CONF_STREAM_PUBLISH
+#define MQTT_STREAM_PUBLISH MQTT_CONF_STREAM_PUBLISH
+#else
+#define MQTT_STREAM_PUBLISH 0
+#endif
+/*---------------------------------------------------------------------------*/
 /*
  * Debug configuration, this is similar but not exactly like the Debugging
  * System discussion at https://github.com/contiki-os/contiki/wiki.
@@ -150,6 +225,7 @@ typedef enum {
   MQTT_EVENT_UNSUBACK,
   MQTT_EVENT_PUBLISH,
   MQTT_EVENT_PUBACK,
+  MQTT_EVENT_PUBCOMP,
 
   /* Errors */
   MQTT_EVENT_ERROR = 0x80,
@@ -157,6 +233,8 @@ typedef enum {
   MQTT_EVENT_CONNECTION_REFUSED_ERROR,
   MQTT_EVENT_DNS_ERROR,
   MQTT_EVENT_NOT_IMPLEMENTED_ERROR,
+  /* A QoS 1 or 2 message was not acknowledged and is dropped, with its MID */
+  MQTT_EVENT_PUBLISH_TIMEOUT_ERROR,
   /* Add more */
 } mqtt_event_t;
 
@@ -182,7 +260,8 @@ typedef enum {
   MQTT_QOS_STATE_NO_ACK,
   MQTT_QOS_STATE_GOT_ACK,
 
-  /* Expand for QoS 2 */
+  /* QoS 2: PUBREL sent, waiting for PUBCOMP */
+  MQTT_QOS_STATE_GOT_PUBREC,
 } mqtt_qos_state_t;
 /*---------------------------------------------------------------------------*/
 /*
@@ -222,7 +301,13 @@ struct mqtt_suback_event {
   mqtt_qos_level_t qos_level;
 };
 
-/* This is the MQTT message that is exposed to the end user. */
+/*
+ * This is the MQTT message that is exposed to the end user. A PUBLISH is
+ * passed on in one or more chunks: payload_chunk is valid during the event
+ * only and holds the payload_chunk_length bytes at payload_offset, of a
+ * payload of payload_length bytes. payload_left is 0 for the last chunk.
+ * Topics longer than MQTT_MAX_TOPIC_LENGTH are truncated.
+ */
 struct mqtt_message {
   uint32_t mid;
   char topic[MQTT_MAX_TOPIC_LENGTH + 1]; /* +1 for string termination */
@@ -231,8 +316,9 @@ struct mqtt_message {
   uint16_t payload_chunk_length;
 
   uint8_t first_chunk;
-  uint16_t payload_length;
-  uint16_t payload_left;
+  uint32_t payload_length;
+  uint32_t payload_left;
+  uint32_t payload_offset;
 };
 
 /* This struct represents a packet received from the MQTT server. */
@@ -246,25 +332,30 @@ struct mqtt_in_packet {
   uint8_t packet_received;
 
   uint8_t fhdr;
-  uint16_t remaining_length;
+  uint32_t remaining_length;
   uint16_t mid;
 
   /* Helper variables needed to decode the remaining_length */
-  uint8_t remaining_multiplier;
+  uint32_t remaining_multiplier;
   uint8_t has_remaining_length;
   uint8_t remaining_length_bytes;
 
   /* Not the same as payload in the MQTT sense, it also contains the variable
    * header.
    */
-  uint8_t payload_pos;
+  uint16_t payload_pos;
   uint8_t payload[MQTT_INPUT_BUFF_SIZE];
 
   /* Message specific data */
   uint16_t topic_len;
   uint16_t topic_pos;
+  /* Bytes of the topic length read so far, it may span two segments */
   uint8_t topic_len_received;
   uint8_t topic_received;
+  uint8_t mid_bytes;
+  uint8_t vhdr_received;
+  /* A QoS 2 PUBLISH whose PUBREL has not arrived yet, not delivered again */
+  uint8_t duplicate;
 };
 
 /* This struct represents a packet sent to the MQTT server. */
@@ -281,7 +372,30 @@ struct mqtt_out_packet {
   mqtt_qos_level_t qos;
   mqtt_qos_state_t qos_state;
   mqtt_retain_t retain;
+  uint8_t dup;
+  int8_t slot; /* Outbound queue slot holding the message, or -1 */
+};
+
+/* A QoS 1 or 2 PUBLISH waiting for its PUBACK or PUBCOMP */
+struct mqtt_inflight {
+  uint16_t mid;
+  mqtt_qos_level_t qos; /* MQTT_QOS_LEVEL_0 for a free entry */
+  mqtt_qos_state_t qos_state;
+  int8_t slot; /* Outbound queue slot holding the message, or -1 */
+  clock_time_t sent;
 };
+
+#if MQTT_OUT_QUEUE_SIZE > 0
+/* A message copied into the outbound queue, also the CFS record format */
+struct mqtt_queued_msg {
+  uint16_t mid;
+  uint8_t qos;
+  uint8_t retain;
+  uint16_t topic_length;
+  uint16_t payload_size;
+  uint8_t data[MQTT_OUT_QUEUE_MSG_LEN];
+};
+#endif /* MQTT_OUT_QUEUE_SIZE > 0 */
 /*---------------------------------------------------------------------------*/
 /**
  * \brief           MQTT event callback function
@@ -347,6 +461,27 @@ struct mqtt_connection {
   uint32_t out_write_pos;
   uint16_t max_segment_size;
 
+  /* QoS 1 and 2 message flows */
+  struct mqtt_inflight inflight[MQTT_MAX_INFLIGHT];
+  uint8_t inflight_count;
+  struct ctimer inflight_timer;
+  uint16_t in_qos2_mid[MQTT_MAX_INFLIGHT];
+  uint8_t in_qos2_count;
+  uint8_t ack_type[MQTT_ACK_QUEUE_SIZE];
+  uint16_t ack_mid[MQTT_ACK_QUEUE_SIZE];
+  uint8_t ack_head;
+  uint8_t ack_count;
+
+#if MQTT_OUT_QUEUE_SIZE > 0
+  /* Outbound queue, see MQTT_OUT_QUEUE_SIZE */
+  struct mqtt_queued_msg out_queue[MQTT_OUT_QUEUE_SIZE];
+  uint8_t out_queue_state[MQTT_OUT_QUEUE_SIZE];
+#if MQTT_OUT_QUEUE_CFS_SIZE > 0
+  uint16_t cfs_head;
+  uint16_t cfs_count;
+#endif /* MQTT_OUT_QUEUE_CFS_SIZE > 0 */
+#endif /* MQTT_OUT_QUEUE_SIZE > 0 */
+
   /* Incoming data related */
   uint8_t in_buffer[MQTT_TCP_INPUT_BUFF_SIZE];
   struct mqtt_in_packet in_packet;
@@ -437,18 +572,26 @@ mqtt_status_t mqtt_unsubscribe(struct mqtt_connection *conn,
 /**
  * \brief Publish to a MQTT topic.
  * \param conn A pointer to the MQTT connection.
- * \param mid A pointer to message ID.
+ * \param mid A pointer to message ID, set to the ID of the message if not
+ *        NULL. It is passed to the MQTT_EVENT_PUBACK or MQTT_EVENT_PUBCOMP
+ *        event.
  * \param topic A pointer to the topic to subscribe to.
  * \param payload A pointer to the topic payload.
  * \param payload_size Payload size.
- * \param qos_level Quality Of Service level to use. Currently supports 0, 1.
+ * \param qos_level Quality Of Service level to use: 0, 1 or 2.
  * \param retain If the RETAIN flag is set to 1, in a PUBLISH Packet sent by a
  *        Client to a Server, the Server MUST store the Application Message
  *        and its QoS, so that it can be delivered to future subscribers whose
  *        subscriptions match its topic name
  * \return MQTT_STATUS_OK or some error status
  *
- * This function publishes to a topic on a MQTT broker.
+ * This function publishes to a topic on a MQTT broker. Up to
+ * MQTT_MAX_INFLIGHT messages of QoS 1 and 2 may wait for acknowledgement at
+ * the same time. With an outbound queue (MQTT_OUT_QUEUE_SIZE), the message is
+ * copied and MQTT_STATUS_OUT_QUEUE_FULL is returned only when the queue and
+ * its CFS spill file are full; messages published while not connected are
+ * sent once connected. A message that is not acknowledged in time is sent
+ * again from the queue, or else dropped with MQTT_EVENT_PUBLISH_TIMEOUT_ERROR.
  */
 mqtt_status_t mqtt_publish(struct mqtt_connection *conn,
                            uint16_t *mid,
@@ -497,7 +640,8 @@ void mqtt_set_last_will(struct mqtt_connection *conn,
   ((conn)->state == MQTT_CONN_STATE_CONNECTED_TO_BROKER ? 1 : 0)
 
 #define mqtt_ready(conn) \
-  (!(conn)->out_queue_full && mqtt_connected((conn)))
+  (!(conn)->out_queue_full && \
+   (conn)->inflight_count < MQTT_MAX_INFLIGHT && mqtt_connected((conn)))
 /*---------------------------------------------------------------------------*/
 #endif /* MQTT_H_ */
 /*---------------------------------------------------------------------------*/
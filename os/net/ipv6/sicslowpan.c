@@ -250,6 +250,11 @@ static uint16_t my_tag;
 /* Assuming that the worst growth for uncompression is 38 bytes */
 #define SICSLOWPAN_FIRST_FRAGMENT_SIZE (SICSLOWPAN_FRAGMENT_SIZE + 38)
 
+/* The largest packet that can be reassembled, and the number of
+   8-byte units (the unit of fragment offsets) that it spans */
+#define SICSLOWPAN_REASS_MAX_LEN (UIP_BUFSIZE - UIP_LLH_LEN)
+#define SICSLOWPAN_REASS_UNITS ((SICSLOWPAN_REASS_MAX_LEN + 7) / 8)
+
 /* all information needed for reassembly */
 struct sicslowpan_frag_info {
   /** When reassembling, the source address of the fragments being merged */
@@ -264,6 +269,10 @@ struct sicslowpan_frag_info {
   uint16_t reassembled_len;
   /** Reassembly %process %timer. */
   struct timer reass_timer;
+  /** Value of reass_clock when a fragment was last added, for LRU eviction */
+  uint16_t last_used;
+  /** One bit per 8-byte unit of the packet that has been received */
+  uint8_t received[(SICSLOWPAN_REASS_UNITS + 7) / 8];
 
   /** Fragment size of first fragment */
   uint16_t first_frag_len;
@@ -286,12 +295,28 @@ struct sicslowpan_frag_buf {
 
 static struct sicslowpan_frag_buf frag_buf[SICSLOWPAN_FRAGMENT_BUFFERS];
 
+/* Incremented whenever a fragment is added to a reassembly */
+static uint16_t reass_clock;
+
+/* Result of checking the range of a fragment against the received units */
+#define REASS_RANGE_NEW       0
+#define REASS_RANGE_DUPLICATE 1
+#define REASS_RANGE_OVERLAP   2
+
+#if SICSLOWPAN_REASS_STATS
+static struct sicslowpan_reass_stats reass_stats;
+#define REASS_STAT(code) (code)
+#else /* SICSLOWPAN_REASS_STATS */
+#define REASS_STAT(code)
+#endif /* SICSLOWPAN_REASS_STATS */
+
 /*---------------------------------------------------------------------------*/
 static int
 clear_fragments(uint8_t frag_info_index)
 {
   int i, clear_count;
   clear_count = 0;
+  REASS_STAT(reass_stats.contexts -= frag_info[frag_info_index].len > 0);
   frag_info[frag_info_index].len = 0;
   for(i = 0; i < SICSLOWPAN_FRAGMENT_BUFFERS; i++) {
     if(frag_buf[i].len > 0 && frag_buf[i].index == frag_info_index) {
@@ -300,6 +325,7 @@ clear_fragments(uint8_t frag_info_index)
       clear_count++;
     }
   }
+  REASS_STAT(reass_stats.buffers -= clear_count);
   return clear_count;
 }
 /*---------------------------------------------------------------------------*/
@@ -312,26 +338,115 @@ timeout_fragments(int not_context)
     if(frag_info[i].len > 0 && i != not_context &&
        timer_expired(&frag_info[i].reass_timer)) {
       /* This context can be freed */
+      LOG_INFO("reassembly timed out - tag: %d\n", frag_info[i].tag);
+      REASS_STAT(reass_stats.timeouts++);
       count += clear_fragments(i);
     }
   }
   return count;
 }
 /*---------------------------------------------------------------------------*/
+/* Abort the least recently used reassembly, except not_context, to
+   free its context and buffers. Returns the index of the context, or -1. */
 static int
-store_fragment(uint8_t index, uint8_t offset)
+evict_fragments(int not_context)
+{
+  int i;
+  int lru = -1;
+
+  for(i = 0; i < SICSLOWPAN_REASS_CONTEXTS; i++) {
+    if(frag_info[i].len > 0 && i != not_context &&
+       (lru < 0 || (uint16_t)(reass_clock - frag_info[i].last_used) >
+        (uint16_t)(reass_clock - frag_info[lru].last_used))) {
+      lru = i;
+    }
+  }
+  if(lru >= 0) {
+    LOG_WARN("evicting reassembly - tag: %d\n", frag_info[lru].tag);
+    REASS_STAT(reass_stats.evictions++);
+    clear_fragments(lru);
+  }
+  return lru;
+}
+/*---------------------------------------------------------------------------*/
+/* Check the byte range [offset, offset + len) of the packet against
+   the units received so far */
+static int
+check_range(const struct sicslowpan_frag_info *info,
+            uint16_t offset, uint16_t len)
+{
+  uint16_t unit;
+  uint16_t last = (offset + len + 7) >> 3;
+  uint16_t seen = 0;
+
+  for(unit = offset >> 3; unit < last; unit++) {
+    if(info->received[unit >> 3] & (1 << (unit & 7))) {
+      seen++;
+    }
+  }
+  if(seen == 0) {
+    return REASS_RANGE_NEW;
+  }
+  if(seen == last - (offset >> 3)) {
+    return REASS_RANGE_DUPLICATE;
+  }
+  return REASS_RANGE_OVERLAP;
+}
+/*---------------------------------------------------------------------------*/
+static void
+mark_range(struct sicslowpan_frag_info *info, uint16_t offset, uint16_t len)
+{
+  uint16_t unit;
+  uint16_t last = (offset + len + 7) >> 3;
+
+  for(unit = offset >> 3; unit < last; unit++) {
+    info->received[unit >> 3] |= 1 << (unit & 7);
+  }
+  info->reassembled_len += len;
+}
+/*---------------------------------------------------------------------------*/
+/* Check that a received fragment brings new data to its reassembly.
+   Returns 0 if the fragment is new, -1 if it must be dropped. */
+static int
+accept_range(int context, uint16_t offset, uint16_t len)
+{
+  switch(check_range(&frag_info[context], offset, len)) {
+  case REASS_RANGE_NEW:
+    return 0;
+  case REASS_RANGE_DUPLICATE:
+    LOG_INFO("duplicate fragment - tag: %d offset: %d\n",
+             frag_info[context].tag, offset >> 3);
+    REASS_STAT(reass_stats.duplicates++);
+    return -1;
+  default:
+    /* Fragments of different sizes: the packet cannot be rebuilt
+       reliably, as per RFC 4944 */
+    LOG_WARN("overlapping fragment - tag: %d offset: %d\n",
+             frag_info[context].tag, offset >> 3);
+    REASS_STAT(reass_stats.drops++);
+    clear_fragments(context);
+    return -1;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static int
+store_fragment(uint8_t index, uint8_t offset, uint8_t len)
 {
   int i;
   for(i = 0; i < SICSLOWPAN_FRAGMENT_BUFFERS; i++) {
     if(frag_buf[i].len == 0) {
       /* copy over the data from packetbuf into the fragment buffer and store offset and len */
       frag_buf[i].offset = offset; /* frag offset */
-      frag_buf[i].len = packetbuf_datalen() - packetbuf_hdr_len;
+      frag_buf[i].len = len;
       frag_buf[i].index = index;
-      memcpy(frag_buf[i].data, packetbuf_ptr + packetbuf_hdr_len,
-             packetbuf_datalen() - packetbuf_hdr_len);
+      memcpy(frag_buf[i].data, packetbuf_ptr + packetbuf_hdr_len, len);
 
       LOG_INFO("Fragsize: %d\n", frag_buf[i].len);
+#if SICSLOWPAN_REASS_STATS
+      if(++reass_stats.buffers > reass_stats.peak_buffers) {
+        reass_stats.peak_buffers = reass_stats.buffers;
+      }
+#endif /* SICSLOWPAN_REASS_STATS */
       /* return the length of the stored fragment */
       return frag_buf[i].len;
     }
@@ -340,76 +455,125 @@ store_fragment(uint8_t index, uint8_t offset)
   return -1;
 }
 /*---------------------------------------------------------------------------*/
-/* add a new fragment to the buffer */
+/* Find the reassembly of a fragment, or start a new one. Fragments can
+   arrive in any order, so any fragment can start a reassembly. */
 static int8_t
-add_fragment(uint16_t tag, uint16_t frag_size, uint8_t offset)
+get_context(uint16_t tag, uint16_t frag_size)
 {
   int i;
-  int len;
   int8_t found = -1;
 
-  if(offset == 0) {
-    /* This is a first fragment - check if we can add this */
-    for(i = 0; i < SICSLOWPAN_REASS_CONTEXTS; i++) {
-      /* clear all fragment info with expired timer to free all fragment buffers */
-      if(frag_info[i].len > 0 && timer_expired(&frag_info[i].reass_timer)) {
-        clear_fragments(i);
-      }
-
-      /* We use len as indication on used or not used */
-      if(found < 0 && frag_info[i].len == 0) {
-        /* We remember the first free fragment info but must continue
-           the loop to free any other expired fragment buffers. */
-        found = i;
+  for(i = 0; i < SICSLOWPAN_REASS_CONTEXTS; i++) {
+    if(frag_info[i].tag == tag && frag_info[i].len > 0 &&
+       linkaddr_cmp(&frag_info[i].sender, packetbuf_addr(PACKETBUF_ADDR_SENDER))) {
+      /* Tag and Sender match - this must be the correct info to store in */
+      if(frag_info[i].len == frag_size) {
+        return i;
       }
+      /* The sender has reused the tag for another packet */
+      LOG_WARN("fragment size mismatch - tag: %d\n", tag);
+      clear_fragments(i);
+      break;
     }
+  }
 
+  for(i = 0; i < SICSLOWPAN_REASS_CONTEXTS; i++) {
+    /* We use len as indication on used or not used */
+    if(frag_info[i].len == 0) {
+      found = i;
+      break;
+    }
+  }
+  if(found < 0) {
+    /* All contexts are in use: abort the least recently used reassembly */
+    found = evict_fragments(-1);
     if(found < 0) {
-      LOG_WARN("*** Failed to store new fragment session - tag: %d\n", tag);
       return -1;
     }
+  }
 
-    /* Found a free fragment info to store data in */
-    frag_info[found].len = frag_size;
-    frag_info[found].tag = tag;
-    linkaddr_copy(&frag_info[found].sender,
-                  packetbuf_addr(PACKETBUF_ADDR_SENDER));
-    timer_set(&frag_info[found].reass_timer, SICSLOWPAN_REASS_MAXAGE * CLOCK_SECOND / 16);
-    /* first fragment can not be stored immediately but is moved into
-       the buffer while uncompressing */
-    return found;
+  /* Found a free fragment info to store data in */
+  frag_info[found].len = frag_size;
+  frag_info[found].tag = tag;
+  frag_info[found].reassembled_len = 0;
+  frag_info[found].first_frag_len = 0;
+  memset(frag_info[found].received, 0, sizeof(frag_info[found].received));
+  linkaddr_copy(&frag_info[found].sender,
+                packetbuf_addr(PACKETBUF_ADDR_SENDER));
+  timer_set(&frag_info[found].reass_timer, SICSLOWPAN_REASS_MAXAGE * CLOCK_SECOND / 16);
+#if SICSLOWPAN_REASS_STATS
+  if(++reass_stats.contexts > reass_stats.peak_contexts) {
+    reass_stats.peak_contexts = reass_stats.contexts;
   }
+#endif /* SICSLOWPAN_REASS_STATS */
+  return found;
+}
+/*---------------------------------------------------------------------------*/
+/* add a new fragment to the buffer */
+static int8_t
+add_fragment(uint16_t tag, uint16_t frag_size, uint8_t offset)
+{
+  int len;
+  int8_t found;
 
-  /* This is a N-fragment - should find the info */
-  for(i = 0; i < SICSLOWPAN_REASS_CONTEXTS; i++) {
-    if(frag_info[i].tag == tag && frag_info[i].len > 0 &&
-       linkaddr_cmp(&frag_info[i].sender, packetbuf_addr(PACKETBUF_ADDR_SENDER))) {
-      /* Tag and Sender match - this must be the correct info to store in */
-      found = i;
-      break;
-    }
+  REASS_STAT(reass_stats.fragments++);
+
+  /* clear all fragment info with expired timer to free all fragment buffers */
+  timeout_fragments(-1);
+
+  if(frag_size == 0 || frag_size > SICSLOWPAN_REASS_MAX_LEN ||
+     (uint16_t)(offset << 3) >= frag_size) {
+    LOG_WARN("*** Invalid fragment - tag: %d size: %d offset: %d\n",
+             tag, frag_size, offset);
+    REASS_STAT(reass_stats.drops++);
+    return -1;
   }
 
+  found = get_context(tag, frag_size);
   if(found < 0) {
-    /* no entry found for storing the new fragment */
-    LOG_WARN("*** Failed to store N-fragment - could not find session - tag: %d offset: %d\n", tag, offset);
+    LOG_WARN("*** Failed to store new fragment session - tag: %d\n", tag);
+    REASS_STAT(reass_stats.drops++);
     return -1;
   }
+  frag_info[found].last_used = ++reass_clock;
 
-  /* i is the index of the reassembly context */
-  len = store_fragment(i, offset);
-  if(len < 0 && timeout_fragments(i) > 0) {
-    len = store_fragment(i, offset);
+  if(offset == 0) {
+    if(frag_info[found].first_frag_len > 0) {
+      LOG_INFO("duplicate first fragment - tag: %d\n", tag);
+      REASS_STAT(reass_stats.duplicates++);
+      return -1;
+    }
+    /* first fragment can not be stored immediately but is moved into
+       the buffer while uncompressing */
+    return found;
   }
-  if(len > 0) {
-    frag_info[i].reassembled_len += len;
-    return i;
-  } else {
-    /* should we also clear all fragments since we failed to store
-       this fragment? */
-    LOG_WARN("*** Failed to store fragment - packet reassembly will fail tag:%d l\n", frag_info[i].tag);
+
+  /* This is a N-fragment */
+  len = packetbuf_datalen() - packetbuf_hdr_len;
+  if(len <= 0 || len > SICSLOWPAN_FRAGMENT_SIZE) {
+    LOG_WARN("*** Invalid N-fragment length %d - tag: %d\n", len, tag);
+    REASS_STAT(reass_stats.drops++);
+    return -1;
+  }
+  /* We may shave off any extraneous bytes at the end of the packet */
+  if((offset << 3) + len > frag_size) {
+    len = frag_size - (offset << 3);
+  }
+  if(accept_range(found, offset << 3, len) < 0) {
     return -1;
   }
+
+  while(store_fragment(found, offset, len) < 0) {
+    /* Out of buffers: abort another reassembly to free its buffers */
+    if(evict_fragments(found) < 0) {
+      LOG_WARN("*** Failed to store fragment - tag: %d offset: %d\n",
+               tag, offset);
+      REASS_STAT(reass_stats.drops++);
+      return -1;
+    }
+  }
+  mark_range(&frag_info[found], offset << 3, len);
+  return found;
 }
 /*---------------------------------------------------------------------------*/
 /* Copy all the fragments that are associated with a specific context
@@ -429,9 +593,29 @@ copy_frags2uip(int context)
              (uint8_t *)frag_buf[i].data, frag_buf[i].len);
     }
   }
+  REASS_STAT(reass_stats.hits++);
   /* deallocate all the fragments for this context */
   clear_fragments(context);
 }
+/*---------------------------------------------------------------------------*/
+#if SICSLOWPAN_REASS_STATS
+const struct sicslowpan_reass_stats *
+sicslowpan_reass_stats(void)
+{
+  return &reass_stats;
+}
+/*---------------------------------------------------------------------------*/
+void
+sicslowpan_reass_stats_reset(void)
+{
+  uint8_t contexts = reass_stats.contexts;
+  uint8_t buffers = reass_stats.buffers;
+
+  memset(&reass_stats, 0, sizeof(reass_stats));
+  reass_stats.contexts = reass_stats.peak_contexts = contexts;
+  reass_stats.buffers = reass_stats.peak_buffers = buffers;
+}
+#endif /* SICSLOWPAN_REASS_STATS */
 #endif /* SICSLOWPAN_CONF_FRAG */
 
 /* -------------------------------------------------------------------------- */
@@ -1788,7 +1972,10 @@ input(void)
          we should not store more */
       buffer = NULL;
 
-      if(frag_info[frag_context].reassembled_len >= frag_size) {
+      /* Fragments may arrive in any order: the packet is complete
+         once all its bytes, including the first fragment, are in */
+      if(frag_info[frag_context].first_frag_len > 0 &&
+         frag_info[frag_context].reassembled_len >= frag_size) {
         last_fragment = 1;
       }
       is_fragment = 1;
@@ -1863,6 +2050,21 @@ input(void)
     }
   }
 
+#if SICSLOWPAN_CONF_FRAG
+  if(first_fragment) {
+    /* The first fragment is reassembled in its context buffer */
+    if(uncomp_hdr_len + packetbuf_payload_len > SICSLOWPAN_FIRST_FRAGMENT_SIZE) {
+      LOG_ERR("first fragment dropped, too large for its buffer (%u)\n",
+              uncomp_hdr_len + packetbuf_payload_len);
+      REASS_STAT(reass_stats.drops++);
+      return;
+    }
+    if(accept_range(frag_context, 0, uncomp_hdr_len + packetbuf_payload_len) < 0) {
+      return;
+    }
+  }
+#endif /* SICSLOWPAN_CONF_FRAG */
+
   /* copy the payload if buffer is non-null - which is only the case with first fragment
      or packets that are non fragmented */
   if(buffer != NULL) {
@@ -1875,8 +2077,12 @@ input(void)
   if(frag_size > 0) {
     /* Add the size of the header only for the first fragment. */
     if(first_fragment != 0) {
-      frag_info[frag_context].reassembled_len = uncomp_hdr_len + packetbuf_payload_len;
+      mark_range(&frag_info[frag_context], 0, uncomp_hdr_len + packetbuf_payload_len);
       frag_info[frag_context].first_frag_len = uncomp_hdr_len + packetbuf_payload_len;
+      /* The first fragment may be the last one to arrive */
+      if(frag_info[frag_context].reassembled_len >= frag_size) {
+        last_fragment = 1;
+      }
     }
     /* For the last fragment, we are OK if there is extrenous bytes at
        the end of the packet. */
@@ -336,6 +336,43 @@ struct sicslowpan_nh_compressor {
 
 int sicslowpan_get_last_rssi(void);
 
+#if SICSLOWPAN_CONF_FRAG && SICSLOWPAN_REASS_STATS
+/**
+ * \brief Statistics on the reassembly of fragmented packets
+ */
+struct sicslowpan_reass_stats {
+  /** Fragments received */
+  uint32_t fragments;
+  /** Packets completely reassembled */
+  uint32_t hits;
+  /** Fragments dropped because they had already been received */
+  uint32_t duplicates;
+  /** Fragments dropped because they were invalid, overlapped
+      fragments received earlier or could not be stored */
+  uint32_t drops;
+  /** Reassemblies that timed out */
+  uint32_t timeouts;
+  /** Reassemblies aborted to make room for another one */
+  uint32_t evictions;
+  /** Reassembly contexts in use, and the peak since the last reset */
+  uint8_t contexts;
+  uint8_t peak_contexts;
+  /** Fragment buffers in use, and the peak since the last reset */
+  uint8_t buffers;
+  uint8_t peak_buffers;
+};
+
+/**
+ * \brief Get the reassembly statistics
+ */
+const struct sicslowpan_reass_stats *sicslowpan_reass_stats(void);
+
+/**
+ * \brief Reset the reassembly counters, and the peaks to the current usage
+ */
+void sicslowpan_reass_stats_reset(void);
+#endif /* SICSLOWPAN_CONF_FRAG && SICSLOWPAN_REASS_STATS */
+
 extern const struct network_driver sicslowpan_driver;
 
 #endif /* SICSLOWPAN_H_ */
@@ -164,6 +164,8 @@ appcall(void *state)
 	  s->flags &= ~TCP_SOCKET_FLAGS_LISTENING;
           s->output_data_max_seg = uip_mss();
 	  tcp_markconn(uip_conn, s);
+	  /* So that tcp_socket_send() can poll the connection */
+	  s->c = uip_conn;
 	  call_event(s, TCP_SOCKET_CONNECTED);
 	  break;
 	}
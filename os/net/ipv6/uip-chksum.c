@@ -0,0 +1,253 @@
+/*
+ * Copyright (c) 2018, RISE SICS.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \addtogroup uip
+ * @{
+ */
+
+/**
+ * \file
+ *         Internet checksum backends and incremental checksum updates.
+ *
+ *         The word-at-a-time backends load words in the byte order of
+ *         the CPU. Their one's complement sum is then the byte-swapped
+ *         sum of the words in network byte order (RFC 1071), so the
+ *         byte order is fixed once, after folding the accumulator.
+ */
+
+#include "net/ipv6/uip.h"
+#include "net/ipv6/uip-chksum.h"
+
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif /* __SSE2__ */
+
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#endif /* __ARM_NEON */
+/*---------------------------------------------------------------------------*/
+static uint16_t
+add16(uint16_t sum, uint16_t t)
+{
+  sum += t;
+  if(sum < t) {
+    sum++;      /* carry */
+  }
+  return sum;
+}
+/*---------------------------------------------------------------------------*/
+/* Fold an accumulator of words in CPU byte order and add it to sum */
+static uint16_t
+fold(uint16_t sum, uint64_t acc)
+{
+  while(acc >> 16) {
+    acc = (acc & 0xffff) + (acc >> 16);
+  }
+  return add16(sum, uip_ntohs((uint16_t)acc));
+}
+/*---------------------------------------------------------------------------*/
+/* Add the words of the end of a buffer to an accumulator */
+static uint64_t
+add_tail(uint64_t acc, const uint8_t *data, uint16_t len)
+{
+  uint32_t w32;
+  uint16_t w16;
+
+  while(len >= 4) {
+    memcpy(&w32, data, 4);
+    acc += w32;
+    data += 4;
+    len -= 4;
+  }
+  if(len >= 2) {
+    memcpy(&w16, data, 2);
+    acc += w16;
+    data += 2;
+    len -= 2;
+  }
+  if(len > 0) {
+    /* The odd byte is the first byte of a zero-padded word */
+    w16 = 0;
+    memcpy(&w16, data, 1);
+    acc += w16;
+  }
+  return acc;
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+uip_chksum_bytes(uint16_t sum, const uint8_t *data, uint16_t len)
+{
+  const uint8_t *dataptr;
+  const uint8_t *last_byte;
+
+  dataptr = data;
+  last_byte = data + len - 1;
+
+  while(dataptr < last_byte) {   /* At least two more bytes */
+    sum = add16(sum, (dataptr[0] << 8) + dataptr[1]);
+    dataptr += 2;
+  }
+
+  if(dataptr == last_byte) {
+    sum = add16(sum, (dataptr[0] << 8) + 0);
+  }
+
+  /* Return sum in host byte order. */
+  return sum;
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+uip_chksum_acc32(uint16_t sum, const uint8_t *data, uint16_t len)
+{
+  /* At most 32768 words of 16 bits: the accumulator cannot overflow */
+  uint32_t acc = 0;
+  uint16_t w[4];
+
+  while(len >= 8) {
+    memcpy(w, data, 8);
+    acc += w[0];
+    acc += w[1];
+    acc += w[2];
+    acc += w[3];
+    data += 8;
+    len -= 8;
+  }
+  while(len >= 2) {
+    memcpy(w, data, 2);
+    acc += w[0];
+    data += 2;
+    len -= 2;
+  }
+  if(len > 0) {
+    w[0] = 0;
+    memcpy(w, data, 1);
+    acc += w[0];
+  }
+  return fold(sum, acc);
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+uip_chksum_acc64(uint16_t sum, const uint8_t *data, uint16_t len)
+{
+  /* At most 16384 words of 32 bits: the accumulator cannot overflow */
+  uint64_t acc = 0;
+  uint32_t w[4];
+
+  while(len >= 16) {
+    memcpy(w, data, 16);
+    acc += w[0];
+    acc += w[1];
+    acc += w[2];
+    acc += w[3];
+    data += 16;
+    len -= 16;
+  }
+  return fold(sum, add_tail(acc, data, len));
+}
+/*---------------------------------------------------------------------------*/
+#ifdef __SSE2__
+uint16_t
+uip_chksum_sse2(uint16_t sum, const uint8_t *data, uint16_t len)
+{
+  /* Every 32-bit lane of each accumulator gets two 16-bit words per
+     32 bytes: at most 8192 words in total, so the lanes cannot overflow */
+  const __m128i mask = _mm_set1_epi32(0xffff);
+  __m128i acc = _mm_setzero_si128();
+  __m128i acc2 = _mm_setzero_si128();
+  __m128i v, v2;
+  uint32_t lanes[4];
+
+  /* Add the low and the high words of the 32-bit lanes to independent
+     accumulators */
+  while(len >= 32) {
+    v = _mm_loadu_si128((const __m128i *)data);
+    v2 = _mm_loadu_si128((const __m128i *)(data + 16));
+    acc = _mm_add_epi32(acc, _mm_and_si128(v, mask));
+    acc2 = _mm_add_epi32(acc2, _mm_srli_epi32(v, 16));
+    acc = _mm_add_epi32(acc, _mm_and_si128(v2, mask));
+    acc2 = _mm_add_epi32(acc2, _mm_srli_epi32(v2, 16));
+    data += 32;
+    len -= 32;
+  }
+  acc = _mm_add_epi32(acc, acc2);
+  _mm_storeu_si128((__m128i *)lanes, acc);
+  return fold(sum, add_tail((uint64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3],
+                            data, len));
+}
+#endif /* __SSE2__ */
+/*---------------------------------------------------------------------------*/
+#ifdef __ARM_NEON
+uint16_t
+uip_chksum_neon(uint16_t sum, const uint8_t *data, uint16_t len)
+{
+  /* Every 32-bit lane gets two 16-bit words per 16 bytes: at most
+     8192 words, so the lanes cannot overflow */
+  uint32x4_t acc = vdupq_n_u32(0);
+  uint32_t lanes[4];
+
+  while(len >= 16) {
+    acc = vpadalq_u16(acc, vreinterpretq_u16_u8(vld1q_u8(data)));
+    data += 16;
+    len -= 16;
+  }
+  vst1q_u32(lanes, acc);
+  return fold(sum, add_tail((uint64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3],
+                            data, len));
+}
+#endif /* __ARM_NEON */
+/*---------------------------------------------------------------------------*/
+uint16_t
+uip_chksum_update(uint16_t chksum, const void *old_data,
+                  const void *new_data, uint16_t len)
+{
+  uint16_t sum;
+
+  /* RFC 1624, eqn. 3: HC' = ~(~HC + ~m + m') */
+  sum = ~uip_ntohs(chksum);
+  sum = add16(sum, ~uip_chksum_add(0, old_data, len));
+  sum = uip_chksum_add(sum, new_data, len);
+  return uip_htons(~sum);
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+uip_chksum_update16(uint16_t chksum, uint16_t old_word, uint16_t new_word)
+{
+  uint16_t sum;
+
+  sum = ~uip_ntohs(chksum);
+  sum = add16(sum, ~uip_ntohs(old_word));
+  sum = add16(sum, uip_ntohs(new_word));
+  return uip_htons(~sum);
+}
+/*---------------------------------------------------------------------------*/
+/** @} */
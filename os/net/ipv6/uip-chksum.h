@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2018, RISE SICS.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * \addtogroup uip
+ * @{
+ */
+
+/**
+ * \file
+ *         Internet checksum backends and incremental checksum updates.
+ *
+ *         A backend adds the 16-bit words of a buffer to a one's
+ *         complement sum. The sum is in host byte order, the words are
+ *         in network byte order, and an odd trailing byte is padded
+ *         with zero. uIP computes all its checksums with the backend
+ *         selected by UIP_CONF_CHKSUM_BACKEND.
+ */
+
+#ifndef UIP_CHKSUM_H_
+#define UIP_CHKSUM_H_
+
+#include "contiki.h"
+
+/** \brief Reference implementation, adding one byte at a time */
+uint16_t uip_chksum_bytes(uint16_t sum, const uint8_t *data, uint16_t len);
+
+/** \brief Adds 16-bit words to a 32-bit accumulator, for 16 and 32-bit CPUs */
+uint16_t uip_chksum_acc32(uint16_t sum, const uint8_t *data, uint16_t len);
+
+/** \brief Adds 32-bit words to a 64-bit accumulator, for 64-bit CPUs */
+uint16_t uip_chksum_acc64(uint16_t sum, const uint8_t *data, uint16_t len);
+
+#ifdef __SSE2__
+/** \brief Adds 128-bit vectors of words with SSE2 */
+uint16_t uip_chksum_sse2(uint16_t sum, const uint8_t *data, uint16_t len);
+#endif /* __SSE2__ */
+
+#ifdef __ARM_NEON
+/** \brief Adds 128-bit vectors of words with NEON */
+uint16_t uip_chksum_neon(uint16_t sum, const uint8_t *data, uint16_t len);
+#endif /* __ARM_NEON */
+
+/**
+ * The checksum backend of uIP. The default is the reference
+ * implementation; platforms and projects opt in to a faster backend,
+ * e.g. uip_chksum_acc32 on 32-bit CPUs, with UIP_CONF_CHKSUM_BACKEND.
+ */
+#ifdef UIP_CONF_CHKSUM_BACKEND
+#define UIP_CHKSUM_BACKEND UIP_CONF_CHKSUM_BACKEND
+#else
+#define UIP_CHKSUM_BACKEND uip_chksum_bytes
+#endif /* UIP_CONF_CHKSUM_BACKEND */
+
+/**
+ * \brief          Add a buffer to a one's complement sum with the uIP backend
+ * \param sum      The sum so far, in host byte order
+ * \param data     The buffer
+ * \param len      The length of the buffer
+ * \return         The new sum, in host byte order
+ */
+#define uip_chksum_add(sum, data, len) \
+  UIP_CHKSUM_BACKEND((sum), (const uint8_t *)(data), (len))
+
+/**
+ * \brief          Update a checksum after a part of the data it covers changed
+ * \param chksum   The checksum field, as stored in the packet
+ * \param old_data The part of the data before the change
+ * \param new_data The part of the data after the change
+ * \param len      The length of the part
+ * \return         The new checksum field, to store in the packet
+ *
+ *                 This implements RFC 1624, instead of computing the
+ *                 checksum from scratch. The part must start at an even
+ *                 offset from the start of the checksummed data. As the
+ *                 checksum of UDP cannot be zero, a zero result must be
+ *                 stored as 0xffff for UDP.
+ */
+uint16_t uip_chksum_update(uint16_t chksum, const void *old_data,
+                           const void *new_data, uint16_t len);
+
+/**
+ * \brief          Update a checksum after a 16-bit word of its data changed
+ * \param chksum   The checksum field, as stored in the packet
+ * \param old_word The word before the change, as stored in the packet
+ * \param new_word The word after the change, as stored in the packet
+ * \return         The new checksum field, to store in the packet
+ */
+uint16_t uip_chksum_update16(uint16_t chksum, uint16_t old_word,
+                             uint16_t new_word);
+
+#endif /* UIP_CHKSUM_H_ */
+/** @} */
@@ -91,6 +91,24 @@ MEMB(routememb, uip_ds6_route_t, UIP_DS6_ROUTE_NB);
 static int num_routes = 0;
 static void rm_routelist_callback(nbr_table_item_t *ptr);
 
+#if UIP_DS6_ROUTE_WITH_TRIE
+/* A node of the route trie. Nodes without a route are branching points
+   and always have two children. */
+struct route_trie_node {
+  struct route_trie_node *child[2];
+  uip_ds6_route_t *route;
+  uip_ipaddr_t prefix;
+  uint8_t length;
+};
+
+/* A path-compressed trie has at most 2N-1 nodes for N routes */
+MEMB(routetriememb, struct route_trie_node, 2 * UIP_DS6_ROUTE_NB);
+static struct route_trie_node *trie_root;
+/* Number of routes in routelist that are not indexed because a more
+   recent route with the same prefix took their node */
+static int trie_shadowed;
+#endif /* UIP_DS6_ROUTE_WITH_TRIE */
+
 #endif /* (UIP_MAX_ROUTES != 0) */
 
 /* Default routes are held on the defaultrouterlist and their
@@ -168,12 +186,190 @@ uip_ds6_notification_rm(struct uip_ds6_notification *n)
 }
 #endif
 /*---------------------------------------------------------------------------*/
+#if (UIP_MAX_ROUTES != 0) && UIP_DS6_ROUTE_WITH_TRIE
+static int
+addr_bit(const uip_ipaddr_t *addr, unsigned pos)
+{
+  return (addr->u8[pos >> 3] >> (7 - (pos & 7))) & 1;
+}
+/*---------------------------------------------------------------------------*/
+/* Returns the length of the common prefix of a and b, knowing that
+   they match up to bit 'from' and comparing no further than bit 'to' */
+static unsigned
+common_prefix_len(const uip_ipaddr_t *a, const uip_ipaddr_t *b,
+                  unsigned from, unsigned to)
+{
+  unsigned i = from;
+
+  while(i < to) {
+    if((i & 7) == 0 && i + 8 <= to && a->u8[i >> 3] == b->u8[i >> 3]) {
+      i += 8;
+    } else if(addr_bit(a, i) != addr_bit(b, i)) {
+      return i;
+    } else {
+      i++;
+    }
+  }
+  return to;
+}
+/*---------------------------------------------------------------------------*/
+static struct route_trie_node *
+trie_node_new(const uip_ipaddr_t *prefix, uint8_t length,
+              uip_ds6_route_t *route)
+{
+  struct route_trie_node *n = memb_alloc(&routetriememb);
+  if(n != NULL) {
+    n->child[0] = n->child[1] = NULL;
+    n->route = route;
+    uip_ipaddr_copy(&n->prefix, prefix);
+    n->length = length;
+  }
+  return n;
+}
+/*---------------------------------------------------------------------------*/
+static uip_ds6_route_t *
+trie_lookup(const uip_ipaddr_t *addr)
+{
+  struct route_trie_node *n = trie_root;
+  uip_ds6_route_t *found_route = NULL;
+  unsigned matched = 0;
+
+  while(n != NULL &&
+        common_prefix_len(addr, &n->prefix, matched, n->length) == n->length) {
+    if(n->route != NULL) {
+      found_route = n->route;
+    }
+    if(n->length == 128) {
+      break;
+    }
+    matched = n->length;
+    n = n->child[addr_bit(addr, n->length)];
+  }
+  return found_route;
+}
+/*---------------------------------------------------------------------------*/
+static int
+trie_insert(uip_ds6_route_t *r)
+{
+  struct route_trie_node **link = &trie_root;
+  struct route_trie_node *n;
+  struct route_trie_node *leaf;
+  struct route_trie_node *split;
+  unsigned matched = 0;
+  unsigned common;
+
+  while((n = *link) != NULL) {
+    common = common_prefix_len(&r->ipaddr, &n->prefix, matched,
+                               MIN(r->length, n->length));
+    if(common == n->length) {
+      if(n->length == r->length) {
+        /* Same prefix: the new route takes over the node */
+        if(n->route != NULL) {
+          trie_shadowed++;
+        }
+        n->route = r;
+        return 1;
+      }
+      /* n covers the new prefix, go further down */
+      matched = n->length;
+      link = &n->child[addr_bit(&r->ipaddr, n->length)];
+      continue;
+    }
+
+    leaf = trie_node_new(&r->ipaddr, r->length, r);
+    if(leaf == NULL) {
+      return 0;
+    }
+    if(common == r->length) {
+      /* The new prefix covers n: insert it above n */
+      leaf->child[addr_bit(&n->prefix, common)] = n;
+      *link = leaf;
+    } else {
+      /* The prefixes diverge: branch where they differ */
+      split = trie_node_new(&r->ipaddr, common, NULL);
+      if(split == NULL) {
+        memb_free(&routetriememb, leaf);
+        return 0;
+      }
+      split->child[addr_bit(&r->ipaddr, common)] = leaf;
+      split->child[addr_bit(&n->prefix, common)] = n;
+      *link = split;
+    }
+    return 1;
+  }
+
+  *link = trie_node_new(&r->ipaddr, r->length, r);
+  return *link != NULL;
+}
+/*---------------------------------------------------------------------------*/
+/* Unlink and free a node that no longer carries a route, unless it is
+   still needed as a branching point */
+static void
+trie_prune(struct route_trie_node **link)
+{
+  struct route_trie_node *n = *link;
+
+  if(n == NULL || n->route != NULL ||
+     (n->child[0] != NULL && n->child[1] != NULL)) {
+    return;
+  }
+  *link = n->child[0] != NULL ? n->child[0] : n->child[1];
+  memb_free(&routetriememb, n);
+}
+/*---------------------------------------------------------------------------*/
+static void
+trie_remove(uip_ds6_route_t *r)
+{
+  struct route_trie_node **link = &trie_root;
+  struct route_trie_node **parent_link = NULL;
+  struct route_trie_node *n;
+  uip_ds6_route_t *other;
+
+  while((n = *link) != NULL && n->length < r->length) {
+    parent_link = link;
+    link = &n->child[addr_bit(&r->ipaddr, n->length)];
+  }
+
+  if(n == NULL || n->route != r) {
+    /* Not indexed: the route was shadowed by a more recent one */
+    if(trie_shadowed > 0) {
+      trie_shadowed--;
+    }
+    return;
+  }
+
+  if(trie_shadowed > 0) {
+    /* Hand the node over to a shadowed route with the same prefix */
+    for(other = list_head(routelist); other != NULL;
+        other = list_item_next(other)) {
+      if(other != r && other->length == r->length &&
+         uip_ipaddr_prefixcmp(&other->ipaddr, &r->ipaddr, r->length)) {
+        n->route = other;
+        trie_shadowed--;
+        return;
+      }
+    }
+  }
+
+  n->route = NULL;
+  trie_prune(link);
+  if(parent_link != NULL) {
+    trie_prune(parent_link);
+  }
+}
+#endif /* (UIP_MAX_ROUTES != 0) && UIP_DS6_ROUTE_WITH_TRIE */
+/*---------------------------------------------------------------------------*/
 void
 uip_ds6_route_init(void)
 {
 #if (UIP_MAX_ROUTES != 0)
   memb_init(&routememb);
   list_init(routelist);
+#if UIP_DS6_ROUTE_WITH_TRIE
+  memb_init(&routetriememb);
+  trie_root = NULL;
+  trie_shadowed = 0;
+#endif /* UIP_DS6_ROUTE_WITH_TRIE */
   nbr_table_register(nbr_routes,
                      (nbr_table_callback *)rm_routelist_callback);
 #endif /* (UIP_MAX_ROUTES != 0) */
@@ -266,9 +462,11 @@ uip_ds6_route_t *
 uip_ds6_route_lookup(uip_ipaddr_t *addr)
 {
 #if (UIP_MAX_ROUTES != 0)
-  uip_ds6_route_t *r;
   uip_ds6_route_t *found_route;
+#if !UIP_DS6_ROUTE_WITH_TRIE
+  uip_ds6_route_t *r;
   uint8_t longestmatch;
+#endif /* !UIP_DS6_ROUTE_WITH_TRIE */
 
   LOG_INFO("Looking up route for ");
   LOG_INFO_6ADDR(addr);
@@ -278,6 +476,9 @@ uip_ds6_route_lookup(uip_ipaddr_t *addr)
     return NULL;
   }
 
+#if UIP_DS6_ROUTE_WITH_TRIE
+  found_route = trie_lookup(addr);
+#else /* UIP_DS6_ROUTE_WITH_TRIE */
   found_route = NULL;
   longestmatch = 0;
   for(r = uip_ds6_route_head();
@@ -293,6 +494,7 @@ uip_ds6_route_lookup(uip_ipaddr_t *addr)
       }
     }
   }
+#endif /* UIP_DS6_ROUTE_WITH_TRIE */
 
   if(found_route != NULL) {
     LOG_INFO("Found route: ");
@@ -304,6 +506,9 @@ uip_ds6_route_lookup(uip_ipaddr_t *addr)
     LOG_WARN("No route found\n");
   }
 
+#if !UIP_DS6_ROUTE_WITH_TRIE || UIP_DS6_ROUTE_REMOVE_LEAST_RECENTLY_USED
+  /* The trie makes the list order irrelevant to lookups, only keep it
+     when it is needed for eviction, as list_remove() is O(n) */
   if(found_route != NULL && found_route != list_head(routelist)) {
     /* If we found a route, we put it at the start of the routeslist
        list. The list is ordered by how recently we looked them up:
@@ -313,6 +518,7 @@ uip_ds6_route_lookup(uip_ipaddr_t *addr)
     list_remove(routelist, found_route);
     list_push(routelist, found_route);
   }
+#endif /* !UIP_DS6_ROUTE_WITH_TRIE || UIP_DS6_ROUTE_REMOVE_LEAST_RECENTLY_USED */
 
   return found_route;
 #else /* (UIP_MAX_ROUTES != 0) */
@@ -456,6 +662,13 @@ uip_ds6_route_add(uip_ipaddr_t *ipaddr, uint8_t length,
   uip_ipaddr_copy(&(r->ipaddr), ipaddr);
   r->length = length;
 
+#if UIP_DS6_ROUTE_WITH_TRIE
+  if(!trie_insert(r)) {
+    /* Cannot happen as the trie pool is sized for the route table */
+    LOG_ERR("Add: could not index route\n");
+  }
+#endif /* UIP_DS6_ROUTE_WITH_TRIE */
+
 #ifdef UIP_DS6_ROUTE_STATE_TYPE
   memset(&r->state, 0, sizeof(UIP_DS6_ROUTE_STATE_TYPE));
 #endif
@@ -500,6 +713,9 @@ uip_ds6_route_rm(uip_ds6_route_t *route)
 
     /* Remove the route from the route list */
     list_remove(routelist, route);
+#if UIP_DS6_ROUTE_WITH_TRIE
+    trie_remove(route);
+#endif /* UIP_DS6_ROUTE_WITH_TRIE */
 
     /* Find the corresponding neighbor_route and remove it. */
     for(neighbor_route = list_head(route->neighbor_routes->route_list);
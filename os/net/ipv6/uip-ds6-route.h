@@ -104,6 +104,15 @@ void uip_ds6_notification_rm(struct uip_ds6_notification *n);
 /*--------------------------------------------------*/
 #endif
 
+/* Index the routing table with a path-compressed binary trie, making
+   uip_ds6_route_lookup() independent of the number of routes. Costs
+   up to two trie nodes per route. */
+#ifdef UIP_DS6_ROUTE_CONF_WITH_TRIE
+#define UIP_DS6_ROUTE_WITH_TRIE UIP_DS6_ROUTE_CONF_WITH_TRIE
+#else /* UIP_DS6_ROUTE_CONF_WITH_TRIE */
+#define UIP_DS6_ROUTE_WITH_TRIE 0
+#endif /* UIP_DS6_ROUTE_CONF_WITH_TRIE */
+
 /* Routing table */
 #ifdef UIP_MAX_ROUTES
 #define UIP_DS6_ROUTE_NB UIP_MAX_ROUTES
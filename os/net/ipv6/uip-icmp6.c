@@ -45,6 +45,7 @@
 #include <string.h>
 #include "net/ipv6/uip-ds6.h"
 #include "net/ipv6/uip-icmp6.h"
+#include "net/ipv6/uip-chksum.h"
 #include "contiki-default-conf.h"
 #include "net/routing/routing.h"
 
@@ -111,6 +112,9 @@ uip_icmp6_register_input_handler(uip_icmp6_input_handler_t *handler)
 static void
 echo_request_input(void)
 {
+  uint16_t chksum;
+  uint16_t type_code;
+
   /*
    * we send an echo reply. It is trivial if there was no extension
    * headers in the request otherwise we need to remove the extension
@@ -122,13 +126,27 @@ echo_request_input(void)
   LOG_INFO_6ADDR(&UIP_IP_BUF->destipaddr);
   LOG_INFO_("\n");
 
+  /*
+   * The reply has the payload and the upper-layer length of the request,
+   * so its checksum is updated incrementally (RFC 1624) rather than
+   * recomputed over the whole payload. A request with a bad checksum, if
+   * not dropped by UIP_CONF_IPV6_CHECKS, gets a reply with a bad checksum
+   */
+  chksum = UIP_ICMP_BUF->icmpchksum;
+  type_code = UIP_HTONS((UIP_ICMP_BUF->type << 8) | UIP_ICMP_BUF->icode);
+
   /* IP header */
   UIP_IP_BUF->ttl = uip_ds6_if.cur_hop_limit;
 
   if(uip_is_addr_mcast(&UIP_IP_BUF->destipaddr)){
+    /* The multicast group in the pseudo-header is replaced by a source */
+    uip_ipaddr_copy(&tmp_ipaddr, &UIP_IP_BUF->destipaddr);
     uip_ipaddr_copy(&UIP_IP_BUF->destipaddr, &UIP_IP_BUF->srcipaddr);
     uip_ds6_select_src(&UIP_IP_BUF->srcipaddr, &UIP_IP_BUF->destipaddr);
+    chksum = uip_chksum_update(chksum, &tmp_ipaddr, &UIP_IP_BUF->srcipaddr,
+                               sizeof(uip_ipaddr_t));
   } else {
+    /* Swapping the addresses does not change the checksum */
     uip_ipaddr_copy(&tmp_ipaddr, &UIP_IP_BUF->srcipaddr);
     uip_ipaddr_copy(&UIP_IP_BUF->srcipaddr, &UIP_IP_BUF->destipaddr);
     uip_ipaddr_copy(&UIP_IP_BUF->destipaddr, &tmp_ipaddr);
@@ -158,8 +176,8 @@ echo_request_input(void)
   /* Note: now UIP_ICMP_BUF points to the beginning of the echo reply */
   UIP_ICMP_BUF->type = ICMP6_ECHO_REPLY;
   UIP_ICMP_BUF->icode = 0;
-  UIP_ICMP_BUF->icmpchksum = 0;
-  UIP_ICMP_BUF->icmpchksum = ~uip_icmp6chksum();
+  UIP_ICMP_BUF->icmpchksum = uip_chksum_update16(chksum, type_code,
+                                                 UIP_HTONS(ICMP6_ECHO_REPLY << 8));
 
   LOG_INFO("Sending Echo Reply to ");
   LOG_INFO_6ADDR(&UIP_IP_BUF->destipaddr);
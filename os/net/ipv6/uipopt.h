@@ -585,6 +585,16 @@ void uip_log(char *msg);
 #define SICSLOWPAN_CONF_FRAG  1
 #endif
 
+/**
+ * Do we keep statistics on 6lowpan packet reassembly, available
+ * through sicslowpan_reass_stats()
+ */
+#ifdef SICSLOWPAN_CONF_REASS_STATS
+#define SICSLOWPAN_REASS_STATS SICSLOWPAN_CONF_REASS_STATS
+#else
+#define SICSLOWPAN_REASS_STATS 0
+#endif /* SICSLOWPAN_CONF_REASS_STATS */
+
 /** @} */
 
 /*------------------------------------------------------------------------------*/
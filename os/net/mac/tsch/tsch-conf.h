@@ -341,6 +341,15 @@
 #define TSCH_SCHEDULE_MAX_LINKS 32
 #endif
 
+/* Keep the links of each slotframe in an array sorted by timeslot, so that
+ * the next active link is found by binary search instead of by iterating
+ * over all links. Costs one pointer per link. */
+#ifdef TSCH_SCHEDULE_CONF_WITH_TIMELINE
+#define TSCH_SCHEDULE_WITH_TIMELINE TSCH_SCHEDULE_CONF_WITH_TIMELINE
+#else
+#define TSCH_SCHEDULE_WITH_TIMELINE 0
+#endif
+
 /* To include Sixtop Implementation */
 #ifdef TSCH_CONF_WITH_SIXTOP
 #define TSCH_WITH_SIXTOP TSCH_CONF_WITH_SIXTOP
@@ -67,6 +67,76 @@ MEMB(slotframe_memb, struct tsch_slotframe, TSCH_SCHEDULE_MAX_SLOTFRAMES);
 /* List of slotframes (each slotframe holds its own list of links) */
 LIST(slotframe_list);
 
+#if TSCH_SCHEDULE_WITH_TIMELINE
+/* All links, grouped by slotframe in the order of slotframe_list, and
+ * sorted by timeslot within each slotframe. Updated on every link
+ * addition and removal, read by the slot operation */
+static struct tsch_link *timeline[TSCH_SCHEDULE_MAX_LINKS];
+static uint16_t timeline_len;
+
+/*---------------------------------------------------------------------------*/
+/* Returns the position within the slotframe segment of the first link with
+ * a timeslot greater than the given timeslot (segment length if none) */
+static uint16_t
+timeline_search(const struct tsch_slotframe *sf, uint16_t timeslot)
+{
+  struct tsch_link **segment = &timeline[sf->timeline_start];
+  uint16_t low = 0;
+  uint16_t high = sf->timeline_len;
+  uint16_t mid;
+
+  while(low < high) {
+    mid = (low + high) / 2;
+    if(segment[mid]->timeslot <= timeslot) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+/*---------------------------------------------------------------------------*/
+/* Shifts the segments of all slotframes after sf by one position */
+static void
+timeline_shift_after(struct tsch_slotframe *sf, int delta)
+{
+  struct tsch_slotframe *next = list_item_next(sf);
+  while(next != NULL) {
+    next->timeline_start += delta;
+    next = list_item_next(next);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Adds a link to the timeline. Called with the lock held */
+static void
+timeline_add(struct tsch_slotframe *sf, struct tsch_link *l)
+{
+  uint16_t pos = sf->timeline_start + timeline_search(sf, l->timeslot);
+  memmove(&timeline[pos + 1], &timeline[pos],
+          (timeline_len - pos) * sizeof(timeline[0]));
+  timeline[pos] = l;
+  timeline_len++;
+  sf->timeline_len++;
+  timeline_shift_after(sf, 1);
+}
+/*---------------------------------------------------------------------------*/
+/* Removes a link from the timeline. Called with the lock held */
+static void
+timeline_remove(struct tsch_slotframe *sf, struct tsch_link *l)
+{
+  uint16_t pos = timeline_search(sf, l->timeslot);
+  if(pos == 0 || timeline[sf->timeline_start + pos - 1] != l) {
+    return;
+  }
+  pos += sf->timeline_start - 1;
+  memmove(&timeline[pos], &timeline[pos + 1],
+          (timeline_len - pos - 1) * sizeof(timeline[0]));
+  timeline_len--;
+  sf->timeline_len--;
+  timeline_shift_after(sf, -1);
+}
+#endif /* TSCH_SCHEDULE_WITH_TIMELINE */
+
 /* Adds and returns a slotframe (NULL if failure) */
 struct tsch_slotframe *
 tsch_schedule_add_slotframe(uint16_t handle, uint16_t size)
@@ -87,6 +157,11 @@ tsch_schedule_add_slotframe(uint16_t handle, uint16_t size)
       sf->handle = handle;
       TSCH_ASN_DIVISOR_INIT(sf->size, size);
       LIST_STRUCT_INIT(sf, links_list);
+#if TSCH_SCHEDULE_WITH_TIMELINE
+      /* The slotframe goes last, its segment starts at the end */
+      sf->timeline_start = timeline_len;
+      sf->timeline_len = 0;
+#endif /* TSCH_SCHEDULE_WITH_TIMELINE */
       /* Add the slotframe to the global list */
       list_add(slotframe_list, sf);
     }
@@ -217,6 +292,9 @@ tsch_schedule_add_link(struct tsch_slotframe *slotframe,
           address = &linkaddr_null;
         }
         linkaddr_copy(&l->addr, address);
+#if TSCH_SCHEDULE_WITH_TIMELINE
+        timeline_add(slotframe, l);
+#endif /* TSCH_SCHEDULE_WITH_TIMELINE */
 
         LOG_INFO("add_link %u %u %u %u %u ",
                slotframe->handle, link_options, link_type, timeslot, channel_offset);
@@ -266,6 +344,9 @@ tsch_schedule_remove_link(struct tsch_slotframe *slotframe, struct tsch_link *l)
       LOG_INFO_("\n");
 
       list_remove(slotframe->links_list, l);
+#if TSCH_SCHEDULE_WITH_TIMELINE
+      timeline_remove(slotframe, l);
+#endif /* TSCH_SCHEDULE_WITH_TIMELINE */
       memb_free(&link_memb, l);
 
       /* Release the lock before we update the neighbor (will take the lock) */
@@ -304,6 +385,13 @@ tsch_schedule_get_link_by_timeslot(struct tsch_slotframe *slotframe, uint16_t ti
 {
   if(!tsch_is_locked()) {
     if(slotframe != NULL) {
+#if TSCH_SCHEDULE_WITH_TIMELINE
+      uint16_t pos = timeline_search(slotframe, timeslot);
+      if(pos > 0 && timeline[slotframe->timeline_start + pos - 1]->timeslot == timeslot) {
+        return timeline[slotframe->timeline_start + pos - 1];
+      }
+      return NULL;
+#else /* TSCH_SCHEDULE_WITH_TIMELINE */
       struct tsch_link *l = list_head(slotframe->links_list);
       /* Loop over all items. Assume there is max one link per timeslot */
       while(l != NULL) {
@@ -313,11 +401,58 @@ tsch_schedule_get_link_by_timeslot(struct tsch_slotframe *slotframe, uint16_t ti
         l = list_item_next(l);
       }
       return l;
+#endif /* TSCH_SCHEDULE_WITH_TIMELINE */
     }
   }
   return NULL;
 }
 /*---------------------------------------------------------------------------*/
+/* Considers link l, occurring time_to_timeslot slots from now, as the next
+ * active link, updating the current best and backup links */
+static void
+select_link(struct tsch_link *l, uint16_t time_to_timeslot,
+            struct tsch_link **curr_best, uint16_t *time_to_curr_best,
+            struct tsch_link **curr_backup)
+{
+  if(*curr_best == NULL || time_to_timeslot < *time_to_curr_best) {
+    *time_to_curr_best = time_to_timeslot;
+    *curr_best = l;
+    *curr_backup = NULL;
+  } else if(time_to_timeslot == *time_to_curr_best) {
+    struct tsch_link *new_best = NULL;
+    /* Two links are overlapping, we need to select one of them.
+     * By standard: prioritize Tx links first, second by lowest handle */
+    if(((*curr_best)->link_options & LINK_OPTION_TX) == (l->link_options & LINK_OPTION_TX)) {
+      /* Both or neither links have Tx, select the one with lowest handle */
+      if(l->slotframe_handle < (*curr_best)->slotframe_handle) {
+        new_best = l;
+      }
+    } else {
+      /* Select the link that has the Tx option */
+      if(l->link_options & LINK_OPTION_TX) {
+        new_best = l;
+      }
+    }
+
+    /* Maintain backup_link */
+    if(*curr_backup == NULL) {
+      /* Check if 'l' best can be used as backup */
+      if(new_best != l && (l->link_options & LINK_OPTION_RX)) { /* Does 'l' have Rx flag? */
+        *curr_backup = l;
+      }
+      /* Check if curr_best can be used as backup */
+      if(new_best != *curr_best && ((*curr_best)->link_options & LINK_OPTION_RX)) { /* Does curr_best have Rx flag? */
+        *curr_backup = *curr_best;
+      }
+    }
+
+    /* Maintain curr_best */
+    if(new_best != NULL) {
+      *curr_best = new_best;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
 /* Returns the next active link after a given ASN, and a backup link (for the same ASN, with Rx flag) */
 struct tsch_link *
 tsch_schedule_get_next_active_link(struct tsch_asn_t *asn, uint16_t *time_offset,
@@ -335,52 +470,30 @@ tsch_schedule_get_next_active_link(struct tsch_asn_t *asn, uint16_t *time_offset
     while(sf != NULL) {
       /* Get timeslot from ASN, given the slotframe length */
       uint16_t timeslot = TSCH_ASN_MOD(*asn, sf->size);
+#if TSCH_SCHEDULE_WITH_TIMELINE
+      /* There is at most one link per timeslot: only the first link after
+       * the current timeslot (wrapping around) can be the earliest one */
+      if(sf->timeline_len > 0) {
+        uint16_t pos = timeline_search(sf, timeslot);
+        struct tsch_link *l = timeline[sf->timeline_start +
+                                       (pos < sf->timeline_len ? pos : 0)];
+        uint16_t time_to_timeslot =
+          l->timeslot > timeslot ?
+          l->timeslot - timeslot :
+          sf->size.val + l->timeslot - timeslot;
+        select_link(l, time_to_timeslot, &curr_best, &time_to_curr_best, &curr_backup);
+      }
+#else /* TSCH_SCHEDULE_WITH_TIMELINE */
       struct tsch_link *l = list_head(sf->links_list);
       while(l != NULL) {
         uint16_t time_to_timeslot =
           l->timeslot > timeslot ?
           l->timeslot - timeslot :
           sf->size.val + l->timeslot - timeslot;
-        if(curr_best == NULL || time_to_timeslot < time_to_curr_best) {
-          time_to_curr_best = time_to_timeslot;
-          curr_best = l;
-          curr_backup = NULL;
-        } else if(time_to_timeslot == time_to_curr_best) {
-          struct tsch_link *new_best = NULL;
-          /* Two links are overlapping, we need to select one of them.
-           * By standard: prioritize Tx links first, second by lowest handle */
-          if((curr_best->link_options & LINK_OPTION_TX) == (l->link_options & LINK_OPTION_TX)) {
-            /* Both or neither links have Tx, select the one with lowest handle */
-            if(l->slotframe_handle < curr_best->slotframe_handle) {
-              new_best = l;
-            }
-          } else {
-            /* Select the link that has the Tx option */
-            if(l->link_options & LINK_OPTION_TX) {
-              new_best = l;
-            }
-          }
-
-          /* Maintain backup_link */
-          if(curr_backup == NULL) {
-            /* Check if 'l' best can be used as backup */
-            if(new_best != l && (l->link_options & LINK_OPTION_RX)) { /* Does 'l' have Rx flag? */
-              curr_backup = l;
-            }
-            /* Check if curr_best can be used as backup */
-            if(new_best != curr_best && (curr_best->link_options & LINK_OPTION_RX)) { /* Does curr_best have Rx flag? */
-              curr_backup = curr_best;
-            }
-          }
-
-          /* Maintain curr_best */
-          if(new_best != NULL) {
-            curr_best = new_best;
-          }
-        }
-
+        select_link(l, time_to_timeslot, &curr_best, &time_to_curr_best, &curr_backup);
         l = list_item_next(l);
       }
+#endif /* TSCH_SCHEDULE_WITH_TIMELINE */
       sf = list_item_next(sf);
     }
     if(time_offset != NULL) {
@@ -401,6 +514,9 @@ tsch_schedule_init(void)
     memb_init(&link_memb);
     memb_init(&slotframe_memb);
     list_init(slotframe_list);
+#if TSCH_SCHEDULE_WITH_TIMELINE
+    timeline_len = 0;
+#endif /* TSCH_SCHEDULE_WITH_TIMELINE */
     tsch_release_lock();
     return 1;
   } else {
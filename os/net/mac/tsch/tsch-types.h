@@ -47,6 +47,7 @@
 
 /********** Includes **********/
 
+#include "net/mac/tsch/tsch-conf.h"
 #include "net/mac/tsch/tsch-asn.h"
 #include "lib/list.h"
 #include "lib/ringbufindex.h"
@@ -94,6 +95,11 @@ struct tsch_slotframe {
   struct tsch_asn_divisor_t size;
   /* List of links belonging to this slotframe */
   LIST_STRUCT(links_list);
+#if TSCH_SCHEDULE_WITH_TIMELINE
+  /* Segment of the schedule timeline holding the links of this slotframe */
+  uint16_t timeline_start;
+  uint16_t timeline_len;
+#endif /* TSCH_SCHEDULE_WITH_TIMELINE */
 };
 
 /* TSCH packet information */
@@ -83,6 +83,19 @@ static unsigned num_tables;
 MEMB(neighbor_addr_mem, nbr_table_key_t, NBR_TABLE_MAX_NEIGHBORS);
 LIST(nbr_table_keys);
 
+#if NBR_TABLE_WITH_LLADDR_HASH
+#if NBR_TABLE_LLADDR_HASH_SIZE & (NBR_TABLE_LLADDR_HASH_SIZE - 1)
+#error NBR_TABLE_LLADDR_HASH_SIZE must be a power of two
+#endif
+#if NBR_TABLE_LLADDR_HASH_SIZE <= NBR_TABLE_MAX_NEIGHBORS
+#error NBR_TABLE_LLADDR_HASH_SIZE must be larger than NBR_TABLE_MAX_NEIGHBORS
+#endif
+#define LLADDR_HASH_MASK (NBR_TABLE_LLADDR_HASH_SIZE - 1)
+/* Hash index over the keys in nbr_table_keys, using linear probing.
+ * Each slot holds the neighbor index + 1, 0 denotes an empty slot */
+static uint16_t lladdr_hash[NBR_TABLE_LLADDR_HASH_SIZE];
+#endif /* NBR_TABLE_WITH_LLADDR_HASH */
+
 /*---------------------------------------------------------------------------*/
 /* Get a key from a neighbor index */
 static nbr_table_key_t *
@@ -126,16 +139,91 @@ key_from_item(nbr_table_t *table, const nbr_table_item_t *item)
   return key_from_index(index_from_item(table, item));
 }
 /*---------------------------------------------------------------------------*/
+#if NBR_TABLE_WITH_LLADDR_HASH
+/* Get the home slot of a link-layer address (FNV-1a) */
+static unsigned
+hash_slot(const linkaddr_t *lladdr)
+{
+  uint32_t hash = 2166136261UL;
+  int i;
+  for(i = 0; i < LINKADDR_SIZE; i++) {
+    hash ^= lladdr->u8[i];
+    hash *= 16777619UL;
+  }
+  return (unsigned)(hash ^ (hash >> 16)) & LLADDR_HASH_MASK;
+}
+/*---------------------------------------------------------------------------*/
+/* Add a key to the hash index. Its link-layer address must be set */
+static void
+hash_insert(nbr_table_key_t *key)
+{
+  unsigned slot = hash_slot(&key->lladdr);
+  /* The index is larger than the table, there is always a free slot */
+  while(lladdr_hash[slot] != 0) {
+    slot = (slot + 1) & LLADDR_HASH_MASK;
+  }
+  lladdr_hash[slot] = index_from_key(key) + 1;
+}
+/*---------------------------------------------------------------------------*/
+/* Remove a key from the hash index, using backward-shift deletion so that
+ * no tombstones are needed */
+static void
+hash_remove(nbr_table_key_t *key)
+{
+  uint16_t value = index_from_key(key) + 1;
+  unsigned slot = hash_slot(&key->lladdr);
+  unsigned next;
+  unsigned home;
+
+  while(lladdr_hash[slot] != value) {
+    if(lladdr_hash[slot] == 0) {
+      /* Not in the index */
+      return;
+    }
+    slot = (slot + 1) & LLADDR_HASH_MASK;
+  }
+  lladdr_hash[slot] = 0;
+
+  /* Move back entries of the probe chain that followed the removed one */
+  next = slot;
+  while(1) {
+    next = (next + 1) & LLADDR_HASH_MASK;
+    if(lladdr_hash[next] == 0) {
+      break;
+    }
+    home = hash_slot(&key_from_index(lladdr_hash[next] - 1)->lladdr);
+    if(((next - home) & LLADDR_HASH_MASK) >= ((next - slot) & LLADDR_HASH_MASK)) {
+      lladdr_hash[slot] = lladdr_hash[next];
+      lladdr_hash[next] = 0;
+      slot = next;
+    }
+  }
+}
+#endif /* NBR_TABLE_WITH_LLADDR_HASH */
+/*---------------------------------------------------------------------------*/
 /* Get the index of a neighbor from its link-layer address */
 static int
 index_from_lladdr(const linkaddr_t *lladdr)
 {
   nbr_table_key_t *key;
+#if NBR_TABLE_WITH_LLADDR_HASH
+  unsigned slot;
+#endif /* NBR_TABLE_WITH_LLADDR_HASH */
   /* Allow lladdr-free insertion, useful e.g. for IPv6 ND.
    * Only one such entry is possible at a time, indexed by linkaddr_null. */
   if(lladdr == NULL) {
     lladdr = &linkaddr_null;
   }
+#if NBR_TABLE_WITH_LLADDR_HASH
+  slot = hash_slot(lladdr);
+  while(lladdr_hash[slot] != 0) {
+    key = key_from_index(lladdr_hash[slot] - 1);
+    if(linkaddr_cmp(lladdr, &key->lladdr)) {
+      return lladdr_hash[slot] - 1;
+    }
+    slot = (slot + 1) & LLADDR_HASH_MASK;
+  }
+#else /* NBR_TABLE_WITH_LLADDR_HASH */
   key = list_head(nbr_table_keys);
   while(key != NULL) {
     if(lladdr && linkaddr_cmp(lladdr, &key->lladdr)) {
@@ -143,6 +231,7 @@ index_from_lladdr(const linkaddr_t *lladdr)
     }
     key = list_item_next(key);
   }
+#endif /* NBR_TABLE_WITH_LLADDR_HASH */
   return -1;
 }
 /*---------------------------------------------------------------------------*/
@@ -195,6 +284,9 @@ remove_key(nbr_table_key_t *least_used_key)
   used_map[index_from_key(least_used_key)] = 0;
   /* Remove neighbor from list */
   list_remove(nbr_table_keys, least_used_key);
+#if NBR_TABLE_WITH_LLADDR_HASH
+  hash_remove(least_used_key);
+#endif /* NBR_TABLE_WITH_LLADDR_HASH */
 }
 /*---------------------------------------------------------------------------*/
 static nbr_table_key_t *
@@ -377,6 +469,9 @@ nbr_table_add_lladdr(nbr_table_t *table, const linkaddr_t *lladdr, nbr_table_rea
 
     /* Set link-layer address */
     linkaddr_copy(&key->lladdr, lladdr);
+#if NBR_TABLE_WITH_LLADDR_HASH
+    hash_insert(key);
+#endif /* NBR_TABLE_WITH_LLADDR_HASH */
   }
 
   /* Get item in the current table */
@@ -46,6 +46,37 @@
 #define NBR_TABLE_MAX_NEIGHBORS 8
 #endif /* NBR_TABLE_CONF_MAX_NEIGHBORS */
 
+/* Maintain an open-addressed hash index over the link-layer addresses of
+ * the neighbors, so that lookups do not have to walk the list of keys.
+ * Worth enabling on nodes with large neighbor tables, e.g. border routers */
+#ifdef NBR_TABLE_CONF_WITH_LLADDR_HASH
+#define NBR_TABLE_WITH_LLADDR_HASH NBR_TABLE_CONF_WITH_LLADDR_HASH
+#else /* NBR_TABLE_CONF_WITH_LLADDR_HASH */
+#define NBR_TABLE_WITH_LLADDR_HASH 0
+#endif /* NBR_TABLE_CONF_WITH_LLADDR_HASH */
+
+/* Number of slots in the hash index. Must be a power of two, and should
+ * be at least twice NBR_TABLE_MAX_NEIGHBORS to keep probe chains short */
+#ifdef NBR_TABLE_CONF_LLADDR_HASH_SIZE
+#define NBR_TABLE_LLADDR_HASH_SIZE NBR_TABLE_CONF_LLADDR_HASH_SIZE
+#elif NBR_TABLE_MAX_NEIGHBORS <= 8
+#define NBR_TABLE_LLADDR_HASH_SIZE 16
+#elif NBR_TABLE_MAX_NEIGHBORS <= 16
+#define NBR_TABLE_LLADDR_HASH_SIZE 32
+#elif NBR_TABLE_MAX_NEIGHBORS <= 32
+#define NBR_TABLE_LLADDR_HASH_SIZE 64
+#elif NBR_TABLE_MAX_NEIGHBORS <= 64
+#define NBR_TABLE_LLADDR_HASH_SIZE 128
+#elif NBR_TABLE_MAX_NEIGHBORS <= 128
+#define NBR_TABLE_LLADDR_HASH_SIZE 256
+#elif NBR_TABLE_MAX_NEIGHBORS <= 256
+#define NBR_TABLE_LLADDR_HASH_SIZE 512
+#elif NBR_TABLE_MAX_NEIGHBORS <= 512
+#define NBR_TABLE_LLADDR_HASH_SIZE 1024
+#else
+#define NBR_TABLE_LLADDR_HASH_SIZE 2048
+#endif /* NBR_TABLE_CONF_LLADDR_HASH_SIZE */
+
 /* An item in a neighbor table */
 typedef void nbr_table_item_t;
 
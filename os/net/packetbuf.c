@@ -48,19 +48,38 @@
 #include "net/packetbuf.h"
 #include "sys/cc.h"
 
+#if PACKETBUF_WITH_DESCRIPTORS
+#include "net/queuebuf.h"
+
+/* One descriptor per queuebuf, plus the one of the packetbuf, ensures
+   that a fresh descriptor is always available to the packetbuf. */
+#define DESC_NUM (QUEUEBUF_NUM + 1)
+
+static struct packetbuf_desc descs[DESC_NUM] = { { .refs = 1 } };
+/* The descriptor that the packetbuf refers to */
+static struct packetbuf_desc *current = &descs[0];
+
+static struct packetbuf_attr *packetbuf_attrs = descs[0].attrs;
+static struct packetbuf_addr *packetbuf_addrs = descs[0].addrs;
+#else /* PACKETBUF_WITH_DESCRIPTORS */
 struct packetbuf_attr packetbuf_attrs[PACKETBUF_NUM_ATTRS];
 struct packetbuf_addr packetbuf_addrs[PACKETBUF_NUM_ADDRS];
+#endif /* PACKETBUF_WITH_DESCRIPTORS */
 
 
 static uint16_t buflen, bufptr;
 static uint8_t hdrlen;
 
+#if PACKETBUF_WITH_DESCRIPTORS
+static uint8_t *packetbuf = descs[0].data;
+#else /* PACKETBUF_WITH_DESCRIPTORS */
 /* The declarations below ensure that the packet buffer is aligned on
    an even 32-bit boundary. On some platforms (most notably the
    msp430 or OpenRISC), having a potentially misaligned packet buffer may lead to
    problems when accessing words. */
 static uint32_t packetbuf_aligned[(PACKETBUF_SIZE + 3) / 4];
 static uint8_t *packetbuf = (uint8_t *)packetbuf_aligned;
+#endif /* PACKETBUF_WITH_DESCRIPTORS */
 
 #define DEBUG 0
 #if DEBUG
@@ -70,10 +89,130 @@ static uint8_t *packetbuf = (uint8_t *)packetbuf_aligned;
 #define PRINTF(...)
 #endif
 
+/*---------------------------------------------------------------------------*/
+#if PACKETBUF_WITH_DESCRIPTORS
+static struct packetbuf_desc *
+desc_alloc(void)
+{
+  int i;
+
+  for(i = 0; i < DESC_NUM; i++) {
+    if(descs[i].refs == 0) {
+      descs[i].refs = 1;
+      return &descs[i];
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static void
+use_desc(struct packetbuf_desc *desc)
+{
+  current = desc;
+  packetbuf = desc->data;
+  packetbuf_attrs = desc->attrs;
+  packetbuf_addrs = desc->addrs;
+}
+/*---------------------------------------------------------------------------*/
+/* Called before the packetbuf is modified: if its descriptor is shared,
+   continue with a private copy of it. Returns 0 if no descriptor is
+   free for the copy, in which case the packetbuf must not be modified. */
+static int
+unshare(void)
+{
+  struct packetbuf_desc *desc;
+
+  if(current->refs <= 1) {
+    return 1;
+  }
+  desc = desc_alloc();
+  if(desc == NULL) {
+    return 0;
+  }
+  desc->len = packetbuf_copyto(desc->data);
+  memcpy(desc->attrs, packetbuf_attrs, sizeof(desc->attrs));
+  memcpy(desc->addrs, packetbuf_addrs, sizeof(desc->addrs));
+  current->refs--;
+  use_desc(desc);
+  /* packetbuf_copyto() has removed the reduced header */
+  bufptr = 0;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+struct packetbuf_desc *
+packetbuf_desc_share(void)
+{
+  if(current->refs > 1) {
+    if(bufptr == 0 && hdrlen + buflen == current->len) {
+      /* The packetbuf has not been modified since it was shared */
+      current->refs++;
+      return current;
+    }
+    if(!unshare()) {
+      return NULL;
+    }
+  }
+
+  if(bufptr != 0) {
+    /* Lay out the header and data as packetbuf_copyto() does */
+    memmove(packetbuf + hdrlen, packetbuf + bufptr + hdrlen, buflen);
+    bufptr = 0;
+  }
+  current->len = hdrlen + buflen;
+  current->refs++;
+  return current;
+}
+/*---------------------------------------------------------------------------*/
+void
+packetbuf_desc_attach(struct packetbuf_desc *desc)
+{
+  desc->refs++;
+  packetbuf_desc_release(current);
+  use_desc(desc);
+  hdrlen = bufptr = 0;
+  buflen = desc->len;
+}
+/*---------------------------------------------------------------------------*/
+struct packetbuf_desc *
+packetbuf_desc_unshare(struct packetbuf_desc *desc)
+{
+  struct packetbuf_desc *copy;
+
+  if(desc->refs <= 1) {
+    return desc;
+  }
+  copy = desc_alloc();
+  if(copy != NULL) {
+    memcpy(copy->data, desc->data, desc->len);
+    copy->len = desc->len;
+    memcpy(copy->attrs, desc->attrs, sizeof(copy->attrs));
+    memcpy(copy->addrs, desc->addrs, sizeof(copy->addrs));
+    desc->refs--;
+  }
+  return copy;
+}
+/*---------------------------------------------------------------------------*/
+void
+packetbuf_desc_release(struct packetbuf_desc *desc)
+{
+  if(desc->refs > 0) {
+    desc->refs--;
+  }
+}
+#endif /* PACKETBUF_WITH_DESCRIPTORS */
 /*---------------------------------------------------------------------------*/
 void
 packetbuf_clear(void)
 {
+#if PACKETBUF_WITH_DESCRIPTORS
+  struct packetbuf_desc *desc;
+
+  if(current->refs > 1 && (desc = desc_alloc()) != NULL) {
+    /* Leave the shared descriptor to its other users, no need to copy */
+    current->refs--;
+    use_desc(desc);
+  }
+#endif /* PACKETBUF_WITH_DESCRIPTORS */
   buflen = bufptr = 0;
   hdrlen = 0;
 
@@ -86,6 +225,11 @@ packetbuf_copyfrom(const void *from, uint16_t len)
   uint16_t l;
 
   packetbuf_clear();
+#if PACKETBUF_WITH_DESCRIPTORS
+  if(current->refs > 1) {
+    return 0;
+  }
+#endif /* PACKETBUF_WITH_DESCRIPTORS */
   l = MIN(PACKETBUF_SIZE, len);
   memcpy(packetbuf, from, l);
   buflen = l;
@@ -112,6 +256,12 @@ packetbuf_hdralloc(int size)
     return 0;
   }
 
+#if PACKETBUF_WITH_DESCRIPTORS
+  if(!unshare()) {
+    return 0;
+  }
+#endif /* PACKETBUF_WITH_DESCRIPTORS */
+
   /* shift data to the right */
   for(i = packetbuf_totlen() - 1; i >= 0; i--) {
     packetbuf[i + size] = packetbuf[i];
@@ -179,7 +329,13 @@ void
 packetbuf_attr_clear(void)
 {
   int i;
-  memset(packetbuf_attrs, 0, sizeof(packetbuf_attrs));
+#if PACKETBUF_WITH_DESCRIPTORS
+  if(!unshare()) {
+    return;
+  }
+#endif /* PACKETBUF_WITH_DESCRIPTORS */
+  memset(packetbuf_attrs, 0,
+         PACKETBUF_NUM_ATTRS * sizeof(struct packetbuf_attr));
   for(i = 0; i < PACKETBUF_NUM_ADDRS; ++i) {
     linkaddr_copy(&packetbuf_addrs[i].addr, &linkaddr_null);
   }
@@ -189,21 +345,39 @@ void
 packetbuf_attr_copyto(struct packetbuf_attr *attrs,
                       struct packetbuf_addr *addrs)
 {
-  memcpy(attrs, packetbuf_attrs, sizeof(packetbuf_attrs));
-  memcpy(addrs, packetbuf_addrs, sizeof(packetbuf_addrs));
+  memcpy(attrs, packetbuf_attrs,
+         PACKETBUF_NUM_ATTRS * sizeof(struct packetbuf_attr));
+  memcpy(addrs, packetbuf_addrs,
+         PACKETBUF_NUM_ADDRS * sizeof(struct packetbuf_addr));
 }
 /*---------------------------------------------------------------------------*/
 void
 packetbuf_attr_copyfrom(struct packetbuf_attr *attrs,
                         struct packetbuf_addr *addrs)
 {
-  memcpy(packetbuf_attrs, attrs, sizeof(packetbuf_attrs));
-  memcpy(packetbuf_addrs, addrs, sizeof(packetbuf_addrs));
+#if PACKETBUF_WITH_DESCRIPTORS
+  if(!unshare()) {
+    return;
+  }
+#endif /* PACKETBUF_WITH_DESCRIPTORS */
+  memcpy(packetbuf_attrs, attrs,
+         PACKETBUF_NUM_ATTRS * sizeof(struct packetbuf_attr));
+  memcpy(packetbuf_addrs, addrs,
+         PACKETBUF_NUM_ADDRS * sizeof(struct packetbuf_addr));
 }
 /*---------------------------------------------------------------------------*/
 int
 packetbuf_set_attr(uint8_t type, const packetbuf_attr_t val)
 {
+#if PACKETBUF_WITH_DESCRIPTORS
+  if(packetbuf_attrs[type].val == val) {
+    /* Avoid copying a shared descriptor */
+    return 1;
+  }
+  if(!unshare()) {
+    return 0;
+  }
+#endif /* PACKETBUF_WITH_DESCRIPTORS */
   packetbuf_attrs[type].val = val;
   return 1;
 }
@@ -217,6 +391,14 @@ packetbuf_attr(uint8_t type)
 int
 packetbuf_set_addr(uint8_t type, const linkaddr_t *addr)
 {
+#if PACKETBUF_WITH_DESCRIPTORS
+  if(linkaddr_cmp(&packetbuf_addrs[type - PACKETBUF_ADDR_FIRST].addr, addr)) {
+    return 1;
+  }
+  if(!unshare()) {
+    return 0;
+  }
+#endif /* PACKETBUF_WITH_DESCRIPTORS */
   linkaddr_copy(&packetbuf_addrs[type - PACKETBUF_ADDR_FIRST].addr, addr);
   return 1;
 }
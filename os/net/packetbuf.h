@@ -283,6 +283,79 @@ struct packetbuf_attrlist {
   uint8_t len;
 };
 
+/**
+ * \brief      Share packetbuf contents through reference-counted
+ *             descriptors instead of copying them.
+ *
+ *             With this option, the packet data and attributes live in
+ *             a descriptor. The queuebuf module takes a reference to
+ *             the descriptor of the packetbuf instead of copying it,
+ *             and queuebuf_to_packetbuf() makes the packetbuf refer to
+ *             the descriptor of the queuebuf. The packetbuf copies the
+ *             descriptor only when it is modified through the
+ *             packetbuf functions while shared, and switches to a
+ *             fresh descriptor when it is cleared.
+ *
+ *             Writing through packetbuf_dataptr() or packetbuf_hdrptr()
+ *             without calling one of the modifying functions first
+ *             also changes the shared copies, and so does writing
+ *             through queuebuf_dataptr(). Not compatible with
+ *             queuebuf swapping.
+ */
+#ifdef PACKETBUF_CONF_WITH_DESCRIPTORS
+#define PACKETBUF_WITH_DESCRIPTORS PACKETBUF_CONF_WITH_DESCRIPTORS
+#else
+#define PACKETBUF_WITH_DESCRIPTORS 0
+#endif /* PACKETBUF_CONF_WITH_DESCRIPTORS */
+
+#if PACKETBUF_WITH_DESCRIPTORS
+/**
+ * \brief      A packet shared between the packetbuf and queuebufs
+ */
+struct packetbuf_desc {
+  union {
+    uint8_t data[PACKETBUF_SIZE];
+    /* Keep the data aligned on an even 32-bit boundary */
+    uint32_t aligned[(PACKETBUF_SIZE + 3) / 4];
+  };
+  uint16_t len;
+  uint8_t refs;
+  struct packetbuf_attr attrs[PACKETBUF_NUM_ATTRS];
+  struct packetbuf_addr addrs[PACKETBUF_NUM_ADDRS];
+};
+
+/**
+ * \brief      Take a reference to the contents of the packetbuf
+ * \return     The descriptor, with the header and data of the packetbuf
+ *             in its data field, or NULL if none is available
+ */
+struct packetbuf_desc *packetbuf_desc_share(void);
+
+/**
+ * \brief      Make the packetbuf refer to a descriptor
+ * \param desc The descriptor, whose data becomes the packetbuf data
+ *
+ *             This is equivalent to copying the data and attributes
+ *             of the descriptor into the packetbuf.
+ */
+void packetbuf_desc_attach(struct packetbuf_desc *desc);
+
+/**
+ * \brief      Get a descriptor that can be modified
+ * \param desc A descriptor that the caller holds a reference to
+ * \return     desc if the caller holds the only reference, otherwise
+ *             a private copy that replaces the reference of the caller,
+ *             or NULL if none is available
+ */
+struct packetbuf_desc *packetbuf_desc_unshare(struct packetbuf_desc *desc);
+
+/**
+ * \brief      Drop a reference to a descriptor
+ * \param desc The descriptor
+ */
+void packetbuf_desc_release(struct packetbuf_desc *desc);
+#endif /* PACKETBUF_WITH_DESCRIPTORS */
+
 #endif /* PACKETBUF_H_ */
 /** @} */
 /** @} */
@@ -51,6 +51,16 @@
 
 #include <string.h> /* for memcpy() */
 
+#if PACKETBUF_WITH_DESCRIPTORS
+#if WITH_SWAP
+#error "Packetbuf descriptors cannot be used with queuebuf swapping"
+#endif /* WITH_SWAP */
+/* The queuebuf holds a reference to a packetbuf descriptor */
+typedef struct packetbuf_desc queuebuf_data_t;
+#else /* PACKETBUF_WITH_DESCRIPTORS */
+typedef struct queuebuf_data queuebuf_data_t;
+#endif /* PACKETBUF_WITH_DESCRIPTORS */
+
 /* Structure pointing to a buffer either stored
    in RAM or swapped in CFS */
 struct queuebuf {
@@ -64,7 +74,7 @@ struct queuebuf {
   enum {IN_RAM, IN_CFS} location;
   union {
 #endif
-    struct queuebuf_data *ram_ptr;
+    queuebuf_data_t *ram_ptr;
 #if WITH_SWAP
     int swap_id;
   };
@@ -80,7 +90,9 @@ struct queuebuf_data {
 };
 
 MEMB(bufmem, struct queuebuf, QUEUEBUF_NUM);
+#if !PACKETBUF_WITH_DESCRIPTORS
 MEMB(buframmem, struct queuebuf_data, QUEUEBUFRAM_NUM);
+#endif /* !PACKETBUF_WITH_DESCRIPTORS */
 
 #if WITH_SWAP
 
@@ -270,7 +282,7 @@ queuebuf_load_to_ram(struct queuebuf *b)
 }
 #else /* WITH_SWAP */
 /*---------------------------------------------------------------------------*/
-static struct queuebuf_data *
+static queuebuf_data_t *
 queuebuf_load_to_ram(struct queuebuf *b)
 {
   return b->ram_ptr;
@@ -287,7 +299,9 @@ queuebuf_init(void)
     qbuf_renew_file(i);
   }
 #endif
+#if !PACKETBUF_WITH_DESCRIPTORS
   memb_init(&buframmem);
+#endif /* !PACKETBUF_WITH_DESCRIPTORS */
   memb_init(&bufmem);
 #if QUEUEBUF_STATS
   queuebuf_max_len = 0;
@@ -310,7 +324,9 @@ queuebuf_new_from_packetbuf(void)
 {
   struct queuebuf *buf;
 
+#if !PACKETBUF_WITH_DESCRIPTORS
   struct queuebuf_data *buframptr;
+#endif /* !PACKETBUF_WITH_DESCRIPTORS */
   buf = memb_alloc(&bufmem);
   if(buf != NULL) {
 #if QUEUEBUF_DEBUG
@@ -319,6 +335,15 @@ queuebuf_new_from_packetbuf(void)
     buf->line = line;
     buf->time = clock_time();
 #endif /* QUEUEBUF_DEBUG */
+#if PACKETBUF_WITH_DESCRIPTORS
+    /* Take a reference to the packetbuf contents instead of copying them */
+    buf->ram_ptr = packetbuf_desc_share();
+    if(buf->ram_ptr == NULL) {
+      PRINTF("queuebuf_new_from_packetbuf: could not share packetbuf\n");
+      memb_free(&bufmem, buf);
+      return NULL;
+    }
+#else /* PACKETBUF_WITH_DESCRIPTORS */
     buf->ram_ptr = memb_alloc(&buframmem);
 #if WITH_SWAP
     /* If the allocation failed, store the qbuf in swap files */
@@ -352,6 +377,7 @@ queuebuf_new_from_packetbuf(void)
       }
     }
 #endif
+#endif /* PACKETBUF_WITH_DESCRIPTORS */
 
 #if QUEUEBUF_STATS
     ++queuebuf_len;
@@ -370,7 +396,16 @@ queuebuf_new_from_packetbuf(void)
 void
 queuebuf_update_attr_from_packetbuf(struct queuebuf *buf)
 {
+#if PACKETBUF_WITH_DESCRIPTORS
+  queuebuf_data_t *buframptr = packetbuf_desc_unshare(buf->ram_ptr);
+  if(buframptr == NULL) {
+    PRINTF("queuebuf_update_attr_from_packetbuf: could not unshare\n");
+    return;
+  }
+  buf->ram_ptr = buframptr;
+#else /* PACKETBUF_WITH_DESCRIPTORS */
   struct queuebuf_data *buframptr = queuebuf_load_to_ram(buf);
+#endif /* PACKETBUF_WITH_DESCRIPTORS */
   packetbuf_attr_copyto(buframptr->attrs, buframptr->addrs);
 #if WITH_SWAP
   if(buf->location == IN_CFS) {
@@ -382,6 +417,16 @@ queuebuf_update_attr_from_packetbuf(struct queuebuf *buf)
 void
 queuebuf_update_from_packetbuf(struct queuebuf *buf)
 {
+#if PACKETBUF_WITH_DESCRIPTORS
+  queuebuf_data_t *desc = packetbuf_desc_share();
+  if(desc == NULL) {
+    PRINTF("queuebuf_update_from_packetbuf: could not share packetbuf\n");
+    return;
+  }
+  packetbuf_desc_release(buf->ram_ptr);
+  buf->ram_ptr = desc;
+}
+#else /* PACKETBUF_WITH_DESCRIPTORS */
   struct queuebuf_data *buframptr = queuebuf_load_to_ram(buf);
   packetbuf_attr_copyto(buframptr->attrs, buframptr->addrs);
   buframptr->len = packetbuf_copyto(buframptr->data);
@@ -391,6 +436,7 @@ queuebuf_update_from_packetbuf(struct queuebuf *buf)
   }
 #endif
 }
+#endif /* PACKETBUF_WITH_DESCRIPTORS */
 /*---------------------------------------------------------------------------*/
 void
 queuebuf_free(struct queuebuf *buf)
@@ -402,6 +448,8 @@ queuebuf_free(struct queuebuf *buf)
     } else {
       queuebuf_remove_from_file(buf->swap_id);
     }
+#elif PACKETBUF_WITH_DESCRIPTORS
+    packetbuf_desc_release(buf->ram_ptr);
 #else
     memb_free(&buframmem, buf->ram_ptr);
 #endif
@@ -420,9 +468,13 @@ void
 queuebuf_to_packetbuf(struct queuebuf *b)
 {
   if(memb_inmemb(&bufmem, b)) {
+#if PACKETBUF_WITH_DESCRIPTORS
+    packetbuf_desc_attach(b->ram_ptr);
+#else /* PACKETBUF_WITH_DESCRIPTORS */
     struct queuebuf_data *buframptr = queuebuf_load_to_ram(b);
     packetbuf_copyfrom(buframptr->data, buframptr->len);
     packetbuf_attr_copyfrom(buframptr->attrs, buframptr->addrs);
+#endif /* PACKETBUF_WITH_DESCRIPTORS */
   }
 }
 /*---------------------------------------------------------------------------*/
@@ -430,7 +482,7 @@ void *
 queuebuf_dataptr(struct queuebuf *b)
 {
   if(memb_inmemb(&bufmem, b)) {
-    struct queuebuf_data *buframptr = queuebuf_load_to_ram(b);
+    queuebuf_data_t *buframptr = queuebuf_load_to_ram(b);
     return buframptr->data;
   }
   return NULL;
@@ -439,21 +491,21 @@ queuebuf_dataptr(struct queuebuf *b)
 int
 queuebuf_datalen(struct queuebuf *b)
 {
-  struct queuebuf_data *buframptr = queuebuf_load_to_ram(b);
+  queuebuf_data_t *buframptr = queuebuf_load_to_ram(b);
   return buframptr->len;
 }
 /*---------------------------------------------------------------------------*/
 linkaddr_t *
 queuebuf_addr(struct queuebuf *b, uint8_t type)
 {
-  struct queuebuf_data *buframptr = queuebuf_load_to_ram(b);
+  queuebuf_data_t *buframptr = queuebuf_load_to_ram(b);
   return &buframptr->addrs[type - PACKETBUF_ADDR_FIRST].addr;
 }
 /*---------------------------------------------------------------------------*/
 packetbuf_attr_t
 queuebuf_attr(struct queuebuf *b, uint8_t type)
 {
-  struct queuebuf_data *buframptr = queuebuf_load_to_ram(b);
+  queuebuf_data_t *buframptr = queuebuf_load_to_ram(b);
   return buframptr->attrs[type].val;
 }
 /*---------------------------------------------------------------------------*/
@@ -61,6 +61,7 @@
 #include "ip64/ip64-slip-interface.h"
 #include "ip64/ip64-dns64.h"
 #include "net/ipv6/uip-ds6.h"
+#include "net/ipv6/uip-chksum.h"
 #include "ip64/ip64-ipv4-dhcp.h"
 #include "contiki-net.h"
 
@@ -271,32 +272,9 @@ ip64_set_ipv6_address(const uip_ip6addr_t *addr)
 static uint16_t
 chksum(uint16_t sum, const uint8_t *data, uint16_t len)
 {
-  uint16_t t;
-  const uint8_t *dataptr;
-  const uint8_t *last_byte;
-
-  dataptr = data;
-  last_byte = data + len - 1;
-
-  while(dataptr < last_byte) {	/* At least two more bytes */
-    t = (dataptr[0] << 8) + dataptr[1];
-    sum += t;
-    if(sum < t) {
-      sum++;		/* carry */
-    }
-    dataptr += 2;
-  }
-
-  if(dataptr == last_byte) {
-    t = (dataptr[0] << 8) + 0;
-    sum += t;
-    if(sum < t) {
-      sum++;		/* carry */
-    }
-  }
-
-  /* Return sum in host byte order. */
-  return sum;
+  /* Translated packets are checksummed from scratch, as DNS64 may have
+     rewritten the payload: use the fastest backend of uIP. */
+  return uip_chksum_add(sum, data, len);
 }
 /*---------------------------------------------------------------------------*/
 static uint16_t
@@ -0,0 +1,541 @@
+/*
+ * Copyright (c) 2018, RISE SICS.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \addtogroup lwm2m
+ * @{
+ */
+
+/**
+ * \file
+ *         Implementation of the Contiki OMA LWM2M CBOR reader / writer
+ *         (application/cbor), for single resource values. The encoding
+ *         functions are shared with the SenML CBOR writer.
+ */
+
+#include "lwm2m-object.h"
+#include "lwm2m-cbor.h"
+#include <string.h>
+
+/* Log configuration */
+#include "coap-log.h"
+#define LOG_MODULE "lwm2m-cbor"
+#define LOG_LEVEL  LOG_LEVEL_NONE
+
+/* Nesting of arrays and maps skipped by lwm2m_cbor_item_size() */
+#define MAX_DEPTH 4
+/*---------------------------------------------------------------------------*/
+size_t
+lwm2m_cbor_write_head(uint8_t *buffer, size_t len, uint8_t major,
+                      uint32_t value)
+{
+  size_t size;
+
+  if(value < 24) {
+    size = 1;
+  } else if(value <= 0xff) {
+    size = 2;
+  } else if(value <= 0xffff) {
+    size = 3;
+  } else {
+    size = 5;
+  }
+  if(size > len) {
+    return 0;
+  }
+
+  switch(size) {
+  case 1:
+    buffer[0] = major | value;
+    break;
+  case 2:
+    buffer[0] = major | 24;
+    buffer[1] = value;
+    break;
+  case 3:
+    buffer[0] = major | 25;
+    buffer[1] = value >> 8;
+    buffer[2] = value;
+    break;
+  default:
+    buffer[0] = major | 26;
+    buffer[1] = value >> 24;
+    buffer[2] = value >> 16;
+    buffer[3] = value >> 8;
+    buffer[4] = value;
+    break;
+  }
+  return size;
+}
+/*---------------------------------------------------------------------------*/
+size_t
+lwm2m_cbor_write_int(uint8_t *buffer, size_t len, int32_t value)
+{
+  if(value < 0) {
+    /* -1 - n is encoded as n */
+    return lwm2m_cbor_write_head(buffer, len, LWM2M_CBOR_NINT,
+                                 (uint32_t)(-(value + 1)));
+  }
+  return lwm2m_cbor_write_head(buffer, len, LWM2M_CBOR_UINT, value);
+}
+/*---------------------------------------------------------------------------*/
+size_t
+lwm2m_cbor_write_text(uint8_t *buffer, size_t len,
+                      const char *text, size_t textlen)
+{
+  size_t size;
+
+  size = lwm2m_cbor_write_head(buffer, len, LWM2M_CBOR_TEXT, textlen);
+  if(size == 0 || size + textlen > len) {
+    return 0;
+  }
+  memcpy(&buffer[size], text, textlen);
+  return size + textlen;
+}
+/*---------------------------------------------------------------------------*/
+size_t
+lwm2m_cbor_write_float32fix(uint8_t *buffer, size_t len,
+                            int32_t value, int bits)
+{
+  uint32_t v;
+  uint32_t mantissa;
+  uint32_t f;
+  int msb;
+  int e;
+
+  v = value < 0 ? -(uint32_t)value : (uint32_t)value;
+  if(v == 0) {
+    f = 0;
+    e = 0;
+  } else {
+    /* 1.mantissa * 2^e, with 23 bits of mantissa */
+    for(msb = 31; (v & (1UL << msb)) == 0; msb--);
+    e = msb - bits;
+    mantissa = msb > 23 ? v >> (msb - 23) : v << (23 - msb);
+    mantissa &= 0x7fffff;
+    f = ((uint32_t)(e + 127) << 23) | mantissa;
+  }
+  if(value < 0) {
+    f |= 0x80000000UL;
+  }
+
+  /* Half precision, if nothing is lost */
+  if(v == 0 || (e >= -14 && e <= 15 && (f & 0x1fff) == 0)) {
+    if(len < 3) {
+      return 0;
+    }
+    buffer[0] = LWM2M_CBOR_FLOAT16;
+    buffer[1] = (f >> 24 & 0x80) | (v == 0 ? 0 : (e + 15) << 2) |
+      (f >> 21 & 0x03);
+    buffer[2] = f >> 13;
+    return 3;
+  }
+
+  if(len < 5) {
+    return 0;
+  }
+  buffer[0] = LWM2M_CBOR_FLOAT32;
+  buffer[1] = f >> 24;
+  buffer[2] = f >> 16;
+  buffer[3] = f >> 8;
+  buffer[4] = f;
+  return 5;
+}
+/*---------------------------------------------------------------------------*/
+size_t
+lwm2m_cbor_read_head(const uint8_t *buffer, size_t len,
+                     uint8_t *major, uint32_t *value)
+{
+  uint8_t info;
+
+  if(len < 1) {
+    return 0;
+  }
+  *major = buffer[0] & 0xe0;
+  info = buffer[0] & 0x1f;
+
+  if(info < 24 || info == LWM2M_CBOR_INDEFINITE) {
+    *value = info < 24 ? info : 0;
+    return 1;
+  }
+  switch(info) {
+  case 24:
+    if(len < 2) {
+      return 0;
+    }
+    *value = buffer[1];
+    return 2;
+  case 25:
+    if(len < 3) {
+      return 0;
+    }
+    *value = ((uint32_t)buffer[1] << 8) | buffer[2];
+    return 3;
+  case 26:
+    if(len < 5) {
+      return 0;
+    }
+    *value = ((uint32_t)buffer[1] << 24) | ((uint32_t)buffer[2] << 16) |
+      ((uint32_t)buffer[3] << 8) | buffer[4];
+    return 5;
+  case 27:
+    if(len < 9 || buffer[1] || buffer[2] || buffer[3] || buffer[4]) {
+      return 0;
+    }
+    *value = ((uint32_t)buffer[5] << 24) | ((uint32_t)buffer[6] << 16) |
+      ((uint32_t)buffer[7] << 8) | buffer[8];
+    return 9;
+  default:
+    /* Reserved */
+    return 0;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+item_size(const uint8_t *buffer, size_t len, int depth)
+{
+  uint8_t major;
+  uint32_t value;
+  uint32_t count;
+  size_t pos;
+  size_t size;
+  int indefinite;
+
+  if(len < 1 || depth > MAX_DEPTH) {
+    return 0;
+  }
+
+  /* Floating point values do not need to fit in 32 bits */
+  if(buffer[0] == LWM2M_CBOR_FLOAT64) {
+    return len < 9 ? 0 : 9;
+  }
+
+  indefinite = (buffer[0] & 0x1f) == LWM2M_CBOR_INDEFINITE;
+  pos = lwm2m_cbor_read_head(buffer, len, &major, &value);
+  if(pos == 0) {
+    return 0;
+  }
+
+  switch(major) {
+  case LWM2M_CBOR_UINT:
+  case LWM2M_CBOR_NINT:
+  case LWM2M_CBOR_SIMPLE:
+    return indefinite ? 0 : pos;
+  case LWM2M_CBOR_BYTES:
+  case LWM2M_CBOR_TEXT:
+    if(!indefinite) {
+      return value > len - pos ? 0 : pos + value;
+    }
+    /* Definite length chunks up to a break */
+    while(pos < len && buffer[pos] != LWM2M_CBOR_BREAK) {
+      if((buffer[pos] & 0xe0) != major ||
+         (size = item_size(&buffer[pos], len - pos, depth + 1)) == 0) {
+        return 0;
+      }
+      pos += size;
+    }
+    return pos < len ? pos + 1 : 0;
+  case LWM2M_CBOR_TAG:
+    size = item_size(&buffer[pos], len - pos, depth + 1);
+    return size == 0 ? 0 : pos + size;
+  default:
+    /* Arrays and maps */
+    count = major == LWM2M_CBOR_MAP ? value * 2 : value;
+    while(pos < len && (indefinite ? buffer[pos] != LWM2M_CBOR_BREAK :
+                        count > 0)) {
+      size = item_size(&buffer[pos], len - pos, depth + 1);
+      if(size == 0) {
+        return 0;
+      }
+      pos += size;
+      count--;
+    }
+    if(indefinite) {
+      return pos < len ? pos + 1 : 0;
+    }
+    return count == 0 ? pos : 0;
+  }
+}
+/*---------------------------------------------------------------------------*/
+size_t
+lwm2m_cbor_item_size(const uint8_t *buffer, size_t len)
+{
+  return item_size(buffer, len, 0);
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Converts 1.mantissa * 2^e, or 0.mantissa * 2^e for subnormal numbers, to
+ * fixpoint with the given number of fraction bits.
+ */
+static int
+float_to_fix(int sign, int e, uint32_t mantissa, int mantissa_bits,
+             int normal, int32_t *value, int bits)
+{
+  int shift;
+
+  if(normal) {
+    mantissa |= 1UL << mantissa_bits;
+  }
+  shift = e - mantissa_bits + bits;
+  if(shift >= 0) {
+    if(mantissa_bits + 1 + shift > 31) {
+      /* Out of range */
+      return 0;
+    }
+    mantissa <<= shift;
+  } else {
+    mantissa = -shift >= 32 ? 0 : mantissa >> -shift;
+  }
+  *value = sign ? -(int32_t)mantissa : (int32_t)mantissa;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+read_float32fix(lwm2m_context_t *ctx, const uint8_t *inbuf, size_t len,
+                int32_t *value, int bits)
+{
+  uint8_t major;
+  uint32_t v;
+  uint32_t mantissa;
+  size_t size;
+  int e;
+  int ok;
+
+  if(len < 1) {
+    return 0;
+  }
+
+  switch(inbuf[0]) {
+  case LWM2M_CBOR_FLOAT16:
+    if(len < 3) {
+      return 0;
+    }
+    e = (inbuf[1] >> 2) & 0x1f;
+    mantissa = ((uint32_t)(inbuf[1] & 0x03) << 8) | inbuf[2];
+    ok = e != 0x1f &&
+      float_to_fix(inbuf[1] & 0x80, e == 0 ? -14 : e - 15, mantissa, 10,
+                   e != 0, value, bits);
+    size = 3;
+    break;
+  case LWM2M_CBOR_FLOAT32:
+    if(len < 5) {
+      return 0;
+    }
+    e = ((inbuf[1] & 0x7f) << 1) | (inbuf[2] >> 7);
+    mantissa = ((uint32_t)(inbuf[2] & 0x7f) << 16) |
+      ((uint32_t)inbuf[3] << 8) | inbuf[4];
+    ok = e != 0xff &&
+      float_to_fix(inbuf[1] & 0x80, e == 0 ? -126 : e - 127, mantissa, 23,
+                   e != 0, value, bits);
+    size = 5;
+    break;
+  case LWM2M_CBOR_FLOAT64:
+    if(len < 9) {
+      return 0;
+    }
+    /* Only the top 23 of the 52 bits of mantissa are used */
+    e = ((inbuf[1] & 0x7f) << 4) | (inbuf[2] >> 4);
+    mantissa = ((uint32_t)(inbuf[2] & 0x0f) << 19) |
+      ((uint32_t)inbuf[3] << 11) | ((uint32_t)inbuf[4] << 3) |
+      (inbuf[5] >> 5);
+    ok = e != 0x7ff &&
+      float_to_fix(inbuf[1] & 0x80, e == 0 ? -1022 : e - 1023, mantissa, 23,
+                   e != 0, value, bits);
+    size = 9;
+    break;
+  default:
+    /* Integers are accepted too */
+    size = lwm2m_cbor_read_head(inbuf, len, &major, &v);
+    if(size == 0 || (major != LWM2M_CBOR_UINT && major != LWM2M_CBOR_NINT) ||
+       v >= (1UL << (31 - bits))) {
+      return 0;
+    }
+    *value = (int32_t)(v << bits);
+    if(major == LWM2M_CBOR_NINT) {
+      *value = -*value - (1L << bits);
+    }
+    ok = 1;
+    break;
+  }
+
+  if(!ok) {
+    return 0;
+  }
+  ctx->last_value_len = size;
+  return size;
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+read_int(lwm2m_context_t *ctx, const uint8_t *inbuf, size_t len,
+         int32_t *value)
+{
+  uint8_t major;
+  uint32_t v;
+  size_t size;
+
+  size = lwm2m_cbor_read_head(inbuf, len, &major, &v);
+  if(size == 0 || (inbuf[0] & 0x1f) == LWM2M_CBOR_INDEFINITE ||
+     (major != LWM2M_CBOR_UINT && major != LWM2M_CBOR_NINT) ||
+     v > INT32_MAX) {
+    return 0;
+  }
+  *value = major == LWM2M_CBOR_NINT ? -(int32_t)v - 1 : (int32_t)v;
+  ctx->last_value_len = size;
+  return size;
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+read_string(lwm2m_context_t *ctx, const uint8_t *inbuf, size_t len,
+            uint8_t *value, size_t stringlen)
+{
+  uint8_t major;
+  uint32_t v;
+  size_t size;
+
+  size = lwm2m_cbor_read_head(inbuf, len, &major, &v);
+  if(size == 0 || (inbuf[0] & 0x1f) == LWM2M_CBOR_INDEFINITE ||
+     (major != LWM2M_CBOR_TEXT && major != LWM2M_CBOR_BYTES) ||
+     v > len - size) {
+    return 0;
+  }
+  if(stringlen <= v) {
+    /* The outbuffer can not contain the full string including ending zero */
+    return 0;
+  }
+  memcpy(value, &inbuf[size], v);
+  value[v] = '\0';
+  ctx->last_value_len = v;
+  return size + v;
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+read_boolean(lwm2m_context_t *ctx, const uint8_t *inbuf, size_t len,
+             int *value)
+{
+  int32_t i;
+
+  if(len >= 1 &&
+     (inbuf[0] == LWM2M_CBOR_FALSE || inbuf[0] == LWM2M_CBOR_TRUE)) {
+    *value = inbuf[0] == LWM2M_CBOR_TRUE;
+    ctx->last_value_len = 1;
+    return 1;
+  }
+  if(read_int(ctx, inbuf, len, &i) == 0) {
+    return 0;
+  }
+  *value = i != 0;
+  return ctx->last_value_len;
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+init_write(lwm2m_context_t *ctx)
+{
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+end_write(lwm2m_context_t *ctx)
+{
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+enter_sub(lwm2m_context_t *ctx)
+{
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+exit_sub(lwm2m_context_t *ctx)
+{
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+write_int(lwm2m_context_t *ctx, uint8_t *outbuf, size_t outlen,
+          int32_t value)
+{
+  return lwm2m_cbor_write_int(outbuf, outlen, value);
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+write_string(lwm2m_context_t *ctx, uint8_t *outbuf, size_t outlen,
+             const char *value, size_t stringlen)
+{
+  return lwm2m_cbor_write_text(outbuf, outlen, value, stringlen);
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+write_float32fix(lwm2m_context_t *ctx, uint8_t *outbuf, size_t outlen,
+                 int32_t value, int bits)
+{
+  return lwm2m_cbor_write_float32fix(outbuf, outlen, value, bits);
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+write_boolean(lwm2m_context_t *ctx, uint8_t *outbuf, size_t outlen,
+              int value)
+{
+  if(outlen < 1) {
+    return 0;
+  }
+  outbuf[0] = value ? LWM2M_CBOR_TRUE : LWM2M_CBOR_FALSE;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+write_opaque_header(lwm2m_context_t *ctx, size_t payloadsize)
+{
+  /* The opaque data follows as a byte string */
+  return lwm2m_cbor_write_head(&ctx->outbuf->buffer[ctx->outbuf->len],
+                               ctx->outbuf->size - ctx->outbuf->len,
+                               LWM2M_CBOR_BYTES, payloadsize);
+}
+/*---------------------------------------------------------------------------*/
+const lwm2m_reader_t lwm2m_cbor_reader = {
+  read_int,
+  read_string,
+  read_float32fix,
+  read_boolean
+};
+/*---------------------------------------------------------------------------*/
+const lwm2m_writer_t lwm2m_cbor_writer = {
+  init_write,
+  end_write,
+  enter_sub,
+  exit_sub,
+  write_int,
+  write_string,
+  write_float32fix,
+  write_boolean,
+  write_opaque_header
+};
+/*---------------------------------------------------------------------------*/
+/** @} */
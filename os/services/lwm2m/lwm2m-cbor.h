@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2018, RISE SICS.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \addtogroup lwm2m
+ * @{
+ */
+
+/**
+ * \file
+ *         Header file for the Contiki OMA LWM2M CBOR reader / writer
+ */
+
+#ifndef LWM2M_CBOR_H_
+#define LWM2M_CBOR_H_
+
+#include "lwm2m-object.h"
+
+/* CBOR major types, in the top three bits of the initial byte */
+#define LWM2M_CBOR_UINT        0x00
+#define LWM2M_CBOR_NINT        0x20
+#define LWM2M_CBOR_BYTES       0x40
+#define LWM2M_CBOR_TEXT        0x60
+#define LWM2M_CBOR_ARRAY       0x80
+#define LWM2M_CBOR_MAP         0xa0
+#define LWM2M_CBOR_TAG         0xc0
+#define LWM2M_CBOR_SIMPLE      0xe0
+
+#define LWM2M_CBOR_FALSE       0xf4
+#define LWM2M_CBOR_TRUE        0xf5
+#define LWM2M_CBOR_FLOAT16     0xf9
+#define LWM2M_CBOR_FLOAT32     0xfa
+#define LWM2M_CBOR_FLOAT64     0xfb
+#define LWM2M_CBOR_BREAK       0xff
+/* Additional information of an indefinite length item */
+#define LWM2M_CBOR_INDEFINITE  0x1f
+
+extern const lwm2m_reader_t lwm2m_cbor_reader;
+extern const lwm2m_writer_t lwm2m_cbor_writer;
+
+/*
+ * The functions below encode one data item into buffer and return its size,
+ * or 0 if it does not fit.
+ */
+size_t lwm2m_cbor_write_head(uint8_t *buffer, size_t len, uint8_t major,
+                             uint32_t value);
+size_t lwm2m_cbor_write_int(uint8_t *buffer, size_t len, int32_t value);
+size_t lwm2m_cbor_write_text(uint8_t *buffer, size_t len,
+                             const char *text, size_t textlen);
+/* As the shortest of half and single precision that holds the value */
+size_t lwm2m_cbor_write_float32fix(uint8_t *buffer, size_t len,
+                                   int32_t value, int bits);
+
+/*
+ * Decodes the initial byte and argument of the data item at buffer. Returns
+ * the size of the head, or 0 if it is truncated or malformed. The argument
+ * of 8 byte heads must fit in 32 bits.
+ */
+size_t lwm2m_cbor_read_head(const uint8_t *buffer, size_t len,
+                            uint8_t *major, uint32_t *value);
+
+/* Returns the size of the complete data item at buffer, or 0 */
+size_t lwm2m_cbor_item_size(const uint8_t *buffer, size_t len);
+
+#endif /* LWM2M_CBOR_H_ */
+/** @} */
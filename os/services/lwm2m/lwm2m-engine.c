@@ -46,6 +46,8 @@
 #include "lwm2m-device.h"
 #include "lwm2m-plain-text.h"
 #include "lwm2m-json.h"
+#include "lwm2m-cbor.h"
+#include "lwm2m-senml-cbor.h"
 #include "coap-constants.h"
 #include "coap-engine.h"
 #include "lwm2m-tlv.h"
@@ -84,6 +86,41 @@
 #include "lwm2m-rd-client.h"
 #endif
 
+/*
+ * Number of object instances and generic objects that can be looked up by
+ * binary search. When more are registered, lookups walk the sorted lists.
+ */
+#ifdef LWM2M_ENGINE_CONF_INSTANCE_INDEX_SIZE
+#define INSTANCE_INDEX_SIZE LWM2M_ENGINE_CONF_INSTANCE_INDEX_SIZE
+#else
+#define INSTANCE_INDEX_SIZE 32
+#endif /* LWM2M_ENGINE_CONF_INSTANCE_INDEX_SIZE */
+
+#ifdef LWM2M_ENGINE_CONF_OBJECT_INDEX_SIZE
+#define OBJECT_INDEX_SIZE LWM2M_ENGINE_CONF_OBJECT_INDEX_SIZE
+#else
+#define OBJECT_INDEX_SIZE 16
+#endif /* LWM2M_ENGINE_CONF_OBJECT_INDEX_SIZE */
+
+/*
+ * Batching window for notifications, in milliseconds. Resource changes
+ * within the window are notified together when it ends, once to the
+ * observers of each changed resource, instance and object. 0 notifies the
+ * observers of the resource at once.
+ */
+#ifdef LWM2M_ENGINE_CONF_NOTIFY_WINDOW
+#define NOTIFY_WINDOW LWM2M_ENGINE_CONF_NOTIFY_WINDOW
+#else
+#define NOTIFY_WINDOW 0
+#endif /* LWM2M_ENGINE_CONF_NOTIFY_WINDOW */
+
+/* Number of changed resources kept during the window */
+#ifdef LWM2M_ENGINE_CONF_MAX_PENDING_NOTIFICATIONS
+#define MAX_PENDING_NOTIFICATIONS LWM2M_ENGINE_CONF_MAX_PENDING_NOTIFICATIONS
+#else
+#define MAX_PENDING_NOTIFICATIONS 16
+#endif /* LWM2M_ENGINE_CONF_MAX_PENDING_NOTIFICATIONS */
+
 /* MACRO for getting out resource ID from resource array ID + flags */
 #define RSC_ID(x)       ((uint16_t)(x & 0xffff))
 #define RSC_READABLE(x) ((x & LWM2M_RESOURCE_READ) > 0)
@@ -131,20 +168,148 @@ static struct {
 
 
 COAP_HANDLER(lwm2m_handler, lwm2m_handler_callback);
+
+/*
+ * The object instances are kept sorted by object id and instance id, and
+ * the generic objects by object id. The index arrays mirror the lists as
+ * long as they fit.
+ */
 LIST(object_list);
 LIST(generic_object_list);
 
+static lwm2m_object_instance_t *instance_index[INSTANCE_INDEX_SIZE];
+static uint16_t instance_count;
+static lwm2m_object_t *object_index[OBJECT_INDEX_SIZE];
+static uint16_t object_count;
+
+#define INSTANCE_KEY(oid, iid) (((uint32_t)(oid) << 16) | (iid))
 /*---------------------------------------------------------------------------*/
+/*
+ * Returns the first object instance with an id not less than
+ * object_id/instance_id, and sets prev to the one before it.
+ */
+static lwm2m_object_instance_t *
+find_instance(uint16_t object_id, uint16_t instance_id,
+              lwm2m_object_instance_t **prev, int *pos)
+{
+  lwm2m_object_instance_t *instance;
+  uint32_t key = INSTANCE_KEY(object_id, instance_id);
+  int low, high, mid;
+
+  if(instance_count <= INSTANCE_INDEX_SIZE) {
+    low = 0;
+    high = instance_count;
+    while(low < high) {
+      mid = (low + high) / 2;
+      instance = instance_index[mid];
+      if(INSTANCE_KEY(instance->object_id, instance->instance_id) < key) {
+        low = mid + 1;
+      } else {
+        high = mid;
+      }
+    }
+    if(prev) {
+      *prev = low > 0 ? instance_index[low - 1] : NULL;
+    }
+    if(pos) {
+      *pos = low;
+    }
+    return low < instance_count ? instance_index[low] : NULL;
+  }
+
+  if(prev) {
+    *prev = NULL;
+  }
+  for(instance = list_head(object_list);
+      instance != NULL;
+      instance = instance->next) {
+    if(INSTANCE_KEY(instance->object_id, instance->instance_id) >= key) {
+      break;
+    }
+    if(prev) {
+      *prev = instance;
+    }
+  }
+  return instance;
+}
+/*---------------------------------------------------------------------------*/
+static void
+rebuild_instance_index(void)
+{
+  lwm2m_object_instance_t *instance;
+  int i;
+
+  for(i = 0, instance = list_head(object_list);
+      i < INSTANCE_INDEX_SIZE && instance != NULL;
+      i++, instance = instance->next) {
+    instance_index[i] = instance;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Returns the first generic object with an id not less than object_id */
 static lwm2m_object_t *
-get_object(uint16_t object_id)
+find_object(uint16_t object_id, lwm2m_object_t **prev, int *pos)
 {
   lwm2m_object_t *object;
+  int low, high, mid;
+
+  if(object_count <= OBJECT_INDEX_SIZE) {
+    low = 0;
+    high = object_count;
+    while(low < high) {
+      mid = (low + high) / 2;
+      if(object_index[mid]->impl->object_id < object_id) {
+        low = mid + 1;
+      } else {
+        high = mid;
+      }
+    }
+    if(prev) {
+      *prev = low > 0 ? object_index[low - 1] : NULL;
+    }
+    if(pos) {
+      *pos = low;
+    }
+    return low < object_count ? object_index[low] : NULL;
+  }
+
+  if(prev) {
+    *prev = NULL;
+  }
   for(object = list_head(generic_object_list);
       object != NULL;
       object = object->next) {
-    if(object->impl && object->impl->object_id == object_id) {
-      return object;
+    if(object->impl->object_id >= object_id) {
+      break;
     }
+    if(prev) {
+      *prev = object;
+    }
+  }
+  return object;
+}
+/*---------------------------------------------------------------------------*/
+static void
+rebuild_object_index(void)
+{
+  lwm2m_object_t *object;
+  int i;
+
+  for(i = 0, object = list_head(generic_object_list);
+      i < OBJECT_INDEX_SIZE && object != NULL;
+      i++, object = object->next) {
+    object_index[i] = object;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static lwm2m_object_t *
+get_object(uint16_t object_id)
+{
+  lwm2m_object_t *object;
+
+  object = find_object(object_id, NULL, NULL);
+  if(object != NULL && object->impl->object_id == object_id) {
+    return object;
   }
   return NULL;
 }
@@ -153,15 +318,9 @@ static int
 has_non_generic_object(uint16_t object_id)
 {
   lwm2m_object_instance_t *instance;
-  for(instance = list_head(object_list);
-      instance != NULL;
-      instance = instance->next) {
-    if(instance->object_id == object_id) {
-      return 1;
-    }
-  }
 
-  return 0;
+  instance = find_instance(object_id, 0, NULL, NULL);
+  return instance != NULL && instance->object_id == object_id;
 }
 /*---------------------------------------------------------------------------*/
 static lwm2m_object_instance_t *
@@ -174,15 +333,16 @@ get_instance(uint16_t object_id, uint16_t instance_id, lwm2m_object_t **o)
     *o = NULL;
   }
 
-  for(instance = list_head(object_list);
-      instance != NULL;
-      instance = instance->next) {
-    if(instance->object_id == object_id) {
-      if(instance->instance_id == instance_id ||
-         instance_id == LWM2M_OBJECT_INSTANCE_NONE) {
-        return instance;
-      }
-    }
+  if(instance_id == LWM2M_OBJECT_INSTANCE_NONE) {
+    /* The first instance of the object */
+    instance = find_instance(object_id, 0, NULL, NULL);
+  } else {
+    instance = find_instance(object_id, instance_id, NULL, NULL);
+  }
+  if(instance != NULL && instance->object_id == object_id &&
+     (instance->instance_id == instance_id ||
+      instance_id == LWM2M_OBJECT_INSTANCE_NONE)) {
+    return instance;
   }
 
   object = get_object(object_id);
@@ -272,7 +432,7 @@ get_method_as_string(coap_resource_flags_t method)
 static const char *
 get_status_as_string(lwm2m_status_t status)
 {
-  static char buffer[8];
+  static char buffer[14];
   switch(status) {
   case LWM2M_STATUS_OK:
     return "OK";
@@ -382,6 +542,7 @@ int
 lwm2m_engine_set_rd_data(lwm2m_buffer_t *outbuf, int block)
 {
   /* remember things here - need to lock lwm2m buffer also!!! */
+  static lwm2m_object_instance_t *simple;
   static lwm2m_object_t *object;
   static lwm2m_object_instance_t *instance;
   int len;
@@ -399,20 +560,17 @@ lwm2m_engine_set_rd_data(lwm2m_buffer_t *outbuf, int block)
 
   if(block == 0) {
     LOG_DBG("Starting RD generation\n");
-    /* start with simple object instances */
-    instance = list_head(object_list);
-    object = NULL;
-
-    if(instance == NULL) {
-      /* No simple object instances available */
-      object = list_head(generic_object_list);
-      if(object == NULL) {
-        /* No objects of any kind available */
-        return 0;
-      }
-      if(object->impl != NULL) {
-        instance = object->impl->get_first(NULL);
-      }
+    /*
+     * Both lists are sorted - merge the simple object instances and the
+     * generic objects into one list ordered by object id.
+     */
+    simple = list_head(object_list);
+    object = list_head(generic_object_list);
+    instance = object != NULL ? object->impl->get_first(NULL) : NULL;
+
+    if(simple == NULL && object == NULL) {
+      /* No objects of any kind available */
+      return 0;
     }
 
     lwm2m_buf_lock[0] = 1; /* lock "flag" */
@@ -426,51 +584,41 @@ lwm2m_engine_set_rd_data(lwm2m_buffer_t *outbuf, int block)
   lwm2m_buf_lock_timeout = coap_timer_uptime() + 1000;
 
   LOG_DBG("Generating RD list:");
-  while(instance != NULL || object != NULL) {
+  while(simple != NULL || object != NULL) {
     int pos = lwm2m_buf.len;
-    if(instance != NULL) {
+    const char *sep = (pos > 0 || block > 0) ? "," : "";
+    if(simple != NULL &&
+       (object == NULL || simple->object_id < object->impl->object_id)) {
+      len = snprintf((char *) &lwm2m_buf.buffer[pos],
+                     lwm2m_buf.size - pos, "%s</%d/%d>", sep,
+                     simple->object_id, simple->instance_id);
+      LOG_DBG_("%s</%d/%d>", sep, simple->object_id, simple->instance_id);
+      simple = simple->next;
+    } else if(instance != NULL) {
       len = snprintf((char *) &lwm2m_buf.buffer[pos],
-                     lwm2m_buf.size - pos, (pos > 0 || block > 0) ? ",</%d/%d>" : "</%d/%d>",
+                     lwm2m_buf.size - pos, "%s</%d/%d>", sep,
                      instance->object_id, instance->instance_id);
-      LOG_DBG_((pos > 0 || block > 0) ? ",</%d/%d>" : "</%d/%d>",
-               instance->object_id, instance->instance_id);
-    } else if(object->impl != NULL) {
+      LOG_DBG_("%s</%d/%d>", sep, instance->object_id, instance->instance_id);
+      instance = object->impl->get_next(instance, NULL);
+      if(instance == NULL) {
+        /* Instances for this object are done - go to next */
+        object = object->next;
+        instance = object != NULL ? object->impl->get_first(NULL) : NULL;
+      }
+    } else {
+      /* A generic object without instances */
       len = snprintf((char *) &lwm2m_buf.buffer[pos],
-                     lwm2m_buf.size - pos,
-                     (pos > 0 || block > 0) ? ",</%d>" : "</%d>",
+                     lwm2m_buf.size - pos, "%s</%d>", sep,
                      object->impl->object_id);
-      LOG_DBG_((pos > 0 || block > 0) ? ",</%d>" : "</%d>",
-               object->impl->object_id);
-    } else {
-      len = 0;
+      LOG_DBG_("%s</%d>", sep, object->impl->object_id);
+      object = object->next;
+      instance = object != NULL ? object->impl->get_first(NULL) : NULL;
     }
     lwm2m_buf.len += len;
-    if(instance != NULL) {
-      instance = next_object_instance(NULL, object, instance);
-    }
 
-    if(instance == NULL) {
-      if(object == NULL) {
-        /*
-         * No object and no instance - we are done with simple object instances.
-         */
-        object = list_head(generic_object_list);
-      } else {
-        /*
-         * Object exists but not an instance - instances for this object are
-         * done - go to next.
-         */
-        object = object->next;
-      }
-
-      if(object != NULL && object->impl != NULL) {
-        instance = object->impl->get_first(NULL);
-      }
-
-      if(instance == NULL && object == NULL && lwm2m_buf.len <= maxsize) {
-        /* Data generation is done. No more messages are needed after this. */
-        break;
-      }
+    if(simple == NULL && object == NULL && lwm2m_buf.len <= maxsize) {
+      /* Data generation is done. No more messages are needed after this. */
+      break;
     }
 
     if(lwm2m_buf.len >= maxsize) {
@@ -495,6 +643,8 @@ lwm2m_engine_init(void)
 {
   list_init(object_list);
   list_init(generic_object_list);
+  instance_count = 0;
+  object_count = 0;
 
 #ifdef LWM2M_ENGINE_CLIENT_ENDPOINT_NAME
   const char *endpoint = LWM2M_ENGINE_CLIENT_ENDPOINT_NAME;
@@ -578,6 +728,12 @@ lwm2m_engine_select_writer(lwm2m_context_t *context, unsigned int accept)
     case APPLICATION_JSON:
       context->writer = &lwm2m_json_writer;
       break;
+    case LWM2M_CBOR:
+      context->writer = &lwm2m_cbor_writer;
+      break;
+    case LWM2M_SENML_CBOR:
+      context->writer = &lwm2m_senml_cbor_writer;
+      break;
     default:
       LOG_WARN("Unknown Accept type %u, using LWM2M plain text\n", accept);
       context->writer = &lwm2m_plain_text_writer;
@@ -611,6 +767,11 @@ lwm2m_engine_select_reader(lwm2m_context_t *context, unsigned int content_format
     case TEXT_PLAIN:
       context->reader = &lwm2m_plain_text_reader;
       break;
+    case LWM2M_CBOR:
+    case LWM2M_SENML_CBOR:
+      /* SenML CBOR values are single CBOR data items */
+      context->reader = &lwm2m_cbor_reader;
+      break;
     default:
       LOG_WARN("Unknown content type %u, using LWM2M plain text\n",
                content_format);
@@ -645,6 +806,7 @@ perform_multi_resource_read_op(lwm2m_object_t *object,
   if(ctx->level < 3 &&
      (ctx->content_type == LWM2M_TEXT_PLAIN ||
       ctx->content_type == TEXT_PLAIN ||
+      ctx->content_type == LWM2M_CBOR ||
       ctx->content_type == LWM2M_OLD_OPAQUE)) {
     return LWM2M_STATUS_OPERATION_NOT_ALLOWED;
   }
@@ -1169,8 +1331,73 @@ perform_multi_resource_write_op(lwm2m_object_t *object,
       }
       tlvpos += len;
     }
+  } else if(format == LWM2M_SENML_CBOR) {
+    struct senml_cbor_record record;
+    char path[32];
+    int path_len;
+    lwm2m_status_t status;
+
+    memset(&record, 0, sizeof(record));
+    while(lwm2m_senml_cbor_next_record(ctx, &record)) {
+      if(record.value == NULL) {
+        continue;
+      }
+      /* The full path is the base name followed by the name */
+      path_len = record.base_name_len + record.name_len;
+      if(path_len < 1 || path_len > sizeof(path)) {
+        return LWM2M_STATUS_ERROR;
+      }
+      if(record.base_name_len > 0) {
+        memcpy(path, record.base_name, record.base_name_len);
+      }
+      if(record.name_len > 0) {
+        memcpy(&path[record.base_name_len], record.name, record.name_len);
+      }
+      LOG_DBG("SenML CBOR: '");
+      LOG_DBG_COAP_STRING(path, path_len);
+      LOG_DBG_("' %u bytes\n", record.value_len);
+
+      /* Skip the leading slash */
+      if(path[0] == '/') {
+        i = parse_path(&path[1], path_len - 1, &oid, &iid, &rid);
+      } else {
+        i = parse_path(path, path_len, &oid, &iid, &rid);
+      }
+      if(i != 3 || oid != ctx->object_id ||
+         (olv > 1 && iid != ctx->object_instance_id) ||
+         (olv > 2 && rid != ctx->resource_id)) {
+        return LWM2M_STATUS_ERROR;
+      }
+      if(olv == 1) {
+        ctx->object_instance_id = iid;
+        instance = get_or_create_instance(ctx, object, &created);
+      }
+      if(instance == NULL || instance->callback == NULL) {
+        return LWM2M_STATUS_ERROR;
+      }
+      ctx->level = 3;
+      ctx->resource_id = rid;
+
+      /* allow write if just created - otherwise not */
+      if(!check_write(ctx, instance, ctx->resource_id)) {
+        return LWM2M_STATUS_OPERATION_NOT_ALLOWED;
+      }
+      inpos = ctx->inbuf->pos;
+      ctx->inbuf->buffer = (uint8_t *)record.value;
+      ctx->inbuf->pos = 0;
+      ctx->inbuf->size = record.value_len;
+      status = instance->callback(instance, ctx);
+      ctx->inbuf->buffer = inbuf;
+      ctx->inbuf->pos = inpos;
+      ctx->inbuf->size = insize;
+      ctx->level = olv;
+      if(status != LWM2M_STATUS_OK) {
+        return status;
+      }
+    }
   } else if(format == LWM2M_TEXT_PLAIN ||
             format == TEXT_PLAIN ||
+            format == LWM2M_CBOR ||
             format == LWM2M_OLD_OPAQUE) {
     return call_instance(instance, ctx);
 
@@ -1199,9 +1426,8 @@ int
 lwm2m_engine_add_object(lwm2m_object_instance_t *object)
 {
   lwm2m_object_instance_t *instance;
-  uint16_t min_id = 0xffff;
-  uint16_t max_id = 0;
-  int found = 0;
+  lwm2m_object_instance_t *prev;
+  int pos;
 
   if(object == NULL || object->callback == NULL) {
     /* Insufficient object configuration */
@@ -1214,38 +1440,39 @@ lwm2m_engine_add_object(lwm2m_object_instance_t *object)
     return 0;
   }
 
-  for(instance = list_head(object_list);
-      instance != NULL;
-      instance = instance->next) {
-    if(object->object_id == instance->object_id) {
-      if(object->instance_id == instance->instance_id) {
-        LOG_DBG("object with id %u/%u already registered\n",
-               instance->object_id, instance->instance_id);
-        return 0;
-      }
-
-      found++;
-      if(instance->instance_id > max_id) {
-        max_id = instance->instance_id;
-      }
-      if(instance->instance_id < min_id) {
-        min_id = instance->instance_id;
-      }
-    }
-  }
-
   if(object->instance_id == LWM2M_OBJECT_INSTANCE_NONE) {
     /* No instance id has been assigned yet */
-    if(found == 0) {
+    instance = find_instance(object->object_id, 0, NULL, NULL);
+    if(instance == NULL || instance->object_id != object->object_id) {
       /* First object with this id */
       object->instance_id = 0;
-    } else if(min_id > 0) {
-      object->instance_id = min_id - 1;
+    } else if(instance->instance_id > 0) {
+      object->instance_id = instance->instance_id - 1;
     } else {
-      object->instance_id = max_id + 1;
+      /* One more than the highest instance id */
+      find_instance(object->object_id, LWM2M_OBJECT_INSTANCE_NONE,
+                    &prev, NULL);
+      object->instance_id = prev->instance_id + 1;
     }
   }
-  list_add(object_list, object);
+
+  instance = find_instance(object->object_id, object->instance_id,
+                           &prev, &pos);
+  if(instance != NULL && instance->object_id == object->object_id &&
+     instance->instance_id == object->instance_id) {
+    LOG_DBG("object with id %u/%u already registered\n",
+            instance->object_id, instance->instance_id);
+    return 0;
+  }
+
+  list_insert(object_list, prev, object);
+  if(instance_count < INSTANCE_INDEX_SIZE) {
+    memmove(&instance_index[pos + 1], &instance_index[pos],
+            (instance_count - pos) * sizeof(instance_index[0]));
+    instance_index[pos] = object;
+  }
+  instance_count++;
+
 #if USE_RD_CLIENT
   lwm2m_rd_client_set_update_rd();
 #endif
@@ -1255,7 +1482,27 @@ lwm2m_engine_add_object(lwm2m_object_instance_t *object)
 void
 lwm2m_engine_remove_object(lwm2m_object_instance_t *object)
 {
+  lwm2m_object_instance_t *instance;
+  int pos;
+
+  instance = find_instance(object->object_id, object->instance_id,
+                           NULL, &pos);
+  if(instance != object) {
+    /* Not registered */
+    return;
+  }
+
   list_remove(object_list, object);
+  if(instance_count <= INSTANCE_INDEX_SIZE) {
+    memmove(&instance_index[pos], &instance_index[pos + 1],
+            (instance_count - pos - 1) * sizeof(instance_index[0]));
+  }
+  instance_count--;
+  if(instance_count == INSTANCE_INDEX_SIZE) {
+    /* All instances fit the index again */
+    rebuild_instance_index();
+  }
+
 #if USE_RD_CLIENT
   lwm2m_rd_client_set_update_rd();
 #endif
@@ -1264,6 +1511,9 @@ lwm2m_engine_remove_object(lwm2m_object_instance_t *object)
 int
 lwm2m_engine_add_generic_object(lwm2m_object_t *object)
 {
+  lwm2m_object_t *prev;
+  int pos;
+
   if(object == NULL || object->impl == NULL
      || object->impl->get_first == NULL
      || object->impl->get_next == NULL
@@ -1283,7 +1533,15 @@ lwm2m_engine_add_generic_object(lwm2m_object_t *object)
              object->impl->object_id);
     return 0;
   }
-  list_add(generic_object_list, object);
+
+  find_object(object->impl->object_id, &prev, &pos);
+  list_insert(generic_object_list, prev, object);
+  if(object_count < OBJECT_INDEX_SIZE) {
+    memmove(&object_index[pos + 1], &object_index[pos],
+            (object_count - pos) * sizeof(object_index[0]));
+    object_index[pos] = object;
+  }
+  object_count++;
 
 #if USE_RD_CLIENT
   lwm2m_rd_client_set_update_rd();
@@ -1295,7 +1553,24 @@ lwm2m_engine_add_generic_object(lwm2m_object_t *object)
 void
 lwm2m_engine_remove_generic_object(lwm2m_object_t *object)
 {
+  int pos;
+
+  if(object == NULL || object->impl == NULL ||
+     find_object(object->impl->object_id, NULL, &pos) != object) {
+    /* Not registered */
+    return;
+  }
+
   list_remove(generic_object_list, object);
+  if(object_count <= OBJECT_INDEX_SIZE) {
+    memmove(&object_index[pos], &object_index[pos + 1],
+            (object_count - pos - 1) * sizeof(object_index[0]));
+  }
+  object_count--;
+  if(object_count == OBJECT_INDEX_SIZE) {
+    /* All objects fit the index again */
+    rebuild_object_index();
+  }
 #if USE_RD_CLIENT
   lwm2m_rd_client_set_update_rd();
 #endif
@@ -1316,11 +1591,12 @@ next_object_instance(const lwm2m_context_t *context, lwm2m_object_t *object,
   }
 
   if(object == NULL) {
-    for(last = last->next; last != NULL; last = last->next) {
-      /* if no context is given - this will just give the next object */
-      if(context == NULL || last->object_id == context->object_id) {
-        return last;
-      }
+    /* The instances are sorted - the next one is in the list if any */
+    last = last->next;
+    /* if no context is given - this will just give the next object */
+    if(last != NULL &&
+       (context == NULL || last->object_id == context->object_id)) {
+      return last;
     }
     return NULL;
   }
@@ -1629,14 +1905,195 @@ lwm2m_handler_callback(coap_message_t *request, coap_message_t *response,
   return COAP_HANDLER_STATUS_PROCESSED;
 }
 /*---------------------------------------------------------------------------*/
+int
+lwm2m_engine_read_composite(const lwm2m_resource_path_t *paths, int count,
+                            lwm2m_buffer_t *outbuf)
+{
+  lwm2m_context_t ctx;
+  lwm2m_object_instance_t *instance = NULL;
+  lwm2m_object_instance_t *last = NULL;
+  lwm2m_status_t status;
+  uint16_t len;
+  uint8_t flags;
+  int i, j;
+
+  if(outbuf->size < 2) {
+    return 0;
+  }
+
+  memset(&ctx, 0, sizeof(ctx));
+  ctx.outbuf = outbuf;
+  ctx.operation = LWM2M_OP_READ;
+  ctx.level = 3;
+  lwm2m_engine_select_writer(&ctx, LWM2M_SENML_CBOR);
+
+  outbuf->len = 0;
+  /* Keep room for the end of the pack */
+  outbuf->size--;
+  outbuf->len += ctx.writer->init_write(&ctx);
+
+  for(i = 0; i < count; i++) {
+    if(last == NULL || last->object_id != paths[i].object_id ||
+       last->instance_id != paths[i].instance_id) {
+      instance = get_instance(paths[i].object_id, paths[i].instance_id, NULL);
+      if(instance == NULL || instance->callback == NULL) {
+        last = NULL;
+        continue;
+      }
+      last = instance;
+      /* Give the base name of the instance with the next record */
+      ctx.writer_flags &= ~WRITER_OUTPUT_VALUE;
+    }
+    for(j = 0; j < instance->resource_count; j++) {
+      if(RSC_ID(instance->resource_ids[j]) == paths[i].resource_id) {
+        break;
+      }
+    }
+    if(j == instance->resource_count ||
+       !RSC_READABLE(instance->resource_ids[j])) {
+      continue;
+    }
+
+    ctx.object_id = paths[i].object_id;
+    ctx.object_instance_id = paths[i].instance_id;
+    ctx.resource_id = paths[i].resource_id;
+    len = outbuf->len;
+    flags = ctx.writer_flags;
+    status = instance->callback(instance, &ctx);
+    if(current_opaque_callback != NULL) {
+      /* Opaque streams are not part of composite reads */
+      current_opaque_callback = NULL;
+      outbuf->len = len;
+    } else if(status != LWM2M_STATUS_OK) {
+      LOG_DBG("Composite read of %u/%u/%u failed: %s\n", paths[i].object_id,
+              paths[i].instance_id, paths[i].resource_id,
+              get_status_as_string(status));
+      outbuf->len = len;
+      ctx.writer_flags = flags;
+    } else if(outbuf->len == len) {
+      /* Full */
+      break;
+    }
+  }
+
+  outbuf->size++;
+  outbuf->len += ctx.writer->end_write(&ctx);
+  return i;
+}
+/*---------------------------------------------------------------------------*/
+int
+lwm2m_engine_add_path(lwm2m_resource_path_t *paths, int count, int max,
+                      uint16_t object_id, uint16_t instance_id,
+                      uint16_t resource_id)
+{
+  uint32_t key = INSTANCE_KEY(object_id, instance_id);
+  uint32_t k;
+  int i;
+
+  for(i = 0; i < count; i++) {
+    k = INSTANCE_KEY(paths[i].object_id, paths[i].instance_id);
+    if(k > key || (k == key && paths[i].resource_id >= resource_id)) {
+      break;
+    }
+  }
+  if(i < count && paths[i].object_id == object_id &&
+     paths[i].instance_id == instance_id &&
+     paths[i].resource_id == resource_id) {
+    /* Already there */
+    return count;
+  }
+  if(count >= max) {
+    return -1;
+  }
+
+  memmove(&paths[i + 1], &paths[i], (count - i) * sizeof(paths[0]));
+  paths[i].object_id = object_id;
+  paths[i].instance_id = instance_id;
+  paths[i].resource_id = resource_id;
+  return count + 1;
+}
+/*---------------------------------------------------------------------------*/
+#if NOTIFY_WINDOW
+static lwm2m_resource_path_t pending[MAX_PENDING_NOTIFICATIONS];
+static uint8_t pending_count;
+static coap_timer_t notify_timer;
+/* Not the timer state, an expired timer may still be waiting to run */
+static uint8_t notify_window_open;
+
+static void
+flush_notifications(void)
+{
+  static lwm2m_resource_path_t changed[MAX_PENDING_NOTIFICATIONS];
+  char path[20]; /* 60000/60000/60000 */
+  int count;
+  int i;
+
+  /* Notifications may change resources again */
+  count = pending_count;
+  memcpy(changed, pending, count * sizeof(changed[0]));
+  pending_count = 0;
+
+  for(i = 0; i < count; i++) {
+    if(i == 0 || changed[i].object_id != changed[i - 1].object_id) {
+      snprintf(path, sizeof(path), "%u", changed[i].object_id);
+      coap_notify_observers_url(path);
+    }
+    if(i == 0 || changed[i].object_id != changed[i - 1].object_id ||
+       changed[i].instance_id != changed[i - 1].instance_id) {
+      snprintf(path, sizeof(path), "%u/%u",
+               changed[i].object_id, changed[i].instance_id);
+      coap_notify_observers_url(path);
+    }
+    snprintf(path, sizeof(path), "%u/%u/%u", changed[i].object_id,
+             changed[i].instance_id, changed[i].resource_id);
+    coap_notify_observers_sub(NULL, path);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+notify_window_ended(coap_timer_t *timer)
+{
+  notify_window_open = 0;
+  flush_notifications();
+}
+#endif /* NOTIFY_WINDOW */
+/*---------------------------------------------------------------------------*/
 void lwm2m_notify_object_observers(lwm2m_object_instance_t *obj,
                                    uint16_t resource)
 {
+#if NOTIFY_WINDOW
+  int count;
+
+  if(obj == NULL) {
+    return;
+  }
+
+  count = lwm2m_engine_add_path(pending, pending_count,
+                                MAX_PENDING_NOTIFICATIONS, obj->object_id,
+                                obj->instance_id, resource);
+  if(count < 0) {
+    /* Notify what has changed so far */
+    coap_timer_stop(&notify_timer);
+    notify_window_open = 0;
+    flush_notifications();
+    count = lwm2m_engine_add_path(pending, pending_count,
+                                  MAX_PENDING_NOTIFICATIONS, obj->object_id,
+                                  obj->instance_id, resource);
+  }
+  pending_count = count;
+
+  if(!notify_window_open) {
+    coap_timer_set_callback(&notify_timer, notify_window_ended);
+    coap_timer_set(&notify_timer, NOTIFY_WINDOW);
+    notify_window_open = 1;
+  }
+#else /* NOTIFY_WINDOW */
   char path[20]; /* 60000/60000/60000 */
   if(obj != NULL) {
     snprintf(path, 20, "%d/%d/%d", obj->object_id, obj->instance_id, resource);
     coap_notify_observers_sub(NULL, path);
   }
+#endif /* NOTIFY_WINDOW */
 }
 /*---------------------------------------------------------------------------*/
 /** @} */
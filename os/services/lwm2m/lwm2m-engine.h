@@ -56,7 +56,9 @@ typedef enum {
   LWM2M_JSON       = 11543,
   LWM2M_OLD_TLV    = 1542,
   LWM2M_OLD_JSON   = 1543,
-  LWM2M_OLD_OPAQUE  = 1544
+  LWM2M_OLD_OPAQUE  = 1544,
+  LWM2M_CBOR       = 60,
+  LWM2M_SENML_CBOR = 112
 } lwm2m_content_format_t;
 
 void lwm2m_engine_init(void);
@@ -112,6 +114,28 @@ void lwm2m_engine_remove_generic_object(lwm2m_object_t *object);
 void lwm2m_notify_object_observers(lwm2m_object_instance_t *obj,
                                    uint16_t resource);
 
+typedef struct {
+  uint16_t object_id;
+  uint16_t instance_id;
+  uint16_t resource_id;
+} lwm2m_resource_path_t;
+
+/*
+ * Reads the resources, sorted by path, as one SenML CBOR pack into outbuf
+ * and returns the number of paths that fit. Paths to missing or
+ * unreadable resources, and those whose read fails, are skipped.
+ */
+int lwm2m_engine_read_composite(const lwm2m_resource_path_t *paths,
+                                int count, lwm2m_buffer_t *outbuf);
+
+/*
+ * Adds a path to an array of count sorted paths, unless it is there
+ * already. Returns the new count, or -1 if the array of max paths is full.
+ */
+int lwm2m_engine_add_path(lwm2m_resource_path_t *paths, int count, int max,
+                          uint16_t object_id, uint16_t instance_id,
+                          uint16_t resource_id);
+
 void lwm2m_engine_set_opaque_callback(lwm2m_context_t *ctx, lwm2m_write_opaque_callback cb);
 
 
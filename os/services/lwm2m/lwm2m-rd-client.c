@@ -78,6 +78,26 @@
 
 #define STATE_MACHINE_UPDATE_INTERVAL 500
 
+/*
+ * Block size of an object list that does not fit in one request. A block
+ * must fit the payload of a CoAP message: coap_set_payload() cuts it to
+ * COAP_MAX_CHUNK_SIZE, while Block1 announces the full block size, so the
+ * server would miss the end of every block.
+ */
+#define RD_BLOCK_SIZE COAP_MAX_BLOCK_SIZE
+
+/*
+ * Size of the cache of the serialized object list. The list is generated
+ * again only after the objects have changed, and an Update leaves it out
+ * when it is the same as the one last sent. A larger list is generated for
+ * every request, as without the cache (size 0, the default).
+ */
+#ifdef LWM2M_RD_CLIENT_CONF_PAYLOAD_CACHE_SIZE
+#define RD_PAYLOAD_CACHE_SIZE LWM2M_RD_CLIENT_CONF_PAYLOAD_CACHE_SIZE
+#else
+#define RD_PAYLOAD_CACHE_SIZE 0
+#endif /* LWM2M_RD_CLIENT_CONF_PAYLOAD_CACHE_SIZE */
+
 static struct lwm2m_session_info session_info;
 static coap_request_state_t rd_request_state;
 
@@ -103,16 +123,27 @@ static coap_message_t request[1];      /* This way the message can be treated as
 
 #define FLAG_RD_DATA_DIRTY            0x01
 #define FLAG_RD_DATA_UPDATE_TRIGGERED 0x02
+#define FLAG_RD_PAYLOAD_DIRTY         0x04
 #define FLAG_RD_DATA_UPDATE_ON_DIRTY  0x10
 
 static uint8_t rd_state = 0;
-static uint8_t rd_flags = FLAG_RD_DATA_UPDATE_ON_DIRTY;
+static uint8_t rd_flags = FLAG_RD_DATA_UPDATE_ON_DIRTY | FLAG_RD_PAYLOAD_DIRTY;
 static uint64_t wait_until_network_check = 0;
 static uint64_t last_update;
 static uint64_t last_rd_progress = 0;
 
 static char query_data[64]; /* allocate some data for queries and updates */
-static uint8_t rd_data[128]; /* allocate some data for the RD */
+static uint8_t rd_data[RD_BLOCK_SIZE]; /* allocate some data for the RD */
+
+#if RD_PAYLOAD_CACHE_SIZE
+static uint8_t rd_payload[RD_PAYLOAD_CACHE_SIZE];
+static uint16_t rd_payload_len;
+static uint8_t rd_payload_cached; /* the whole object list is in rd_payload */
+static uint8_t rd_payload_sent;   /* and it is the one last sent */
+#endif /* RD_PAYLOAD_CACHE_SIZE */
+
+static lwm2m_rd_client_stats_t stats;
+static uint64_t request_start;
 
 static uint32_t rd_block1;
 static uint8_t rd_more;
@@ -124,11 +155,118 @@ static coap_timer_t block1_timer;
 static void check_periodic_observations();
 static void update_callback(coap_request_state_t *state);
 
+static void
+send_request(coap_endpoint_t *endpoint,
+             void (*callback)(coap_request_state_t *state))
+{
+  stats.packets++;
+  stats.payload_bytes += request->payload_len;
+  coap_send_request(&rd_request_state, endpoint, request, callback);
+}
+/*---------------------------------------------------------------------------*/
+#if RD_PAYLOAD_CACHE_SIZE
+static void
+update_rd_payload(void)
+{
+  lwm2m_buffer_t outbuf;
+  int block = 0;
+  int more;
+  int len = 0;
+  uint8_t changed;
+
+  if((rd_flags & FLAG_RD_PAYLOAD_DIRTY) == 0) {
+    return;
+  }
+
+  /*
+   * Each block is generated in rd_data and compared with the list in the
+   * cache before it is copied there, so that the list last sent is known
+   * to be the same without a copy of it.
+   */
+  changed = !rd_payload_cached;
+  rd_payload_cached = 1;
+  outbuf.buffer = rd_data;
+  outbuf.size = RD_BLOCK_SIZE;
+  do {
+    outbuf.len = 0;
+    more = lwm2m_engine_set_rd_data(&outbuf, block++);
+    if(rd_payload_cached && len + outbuf.len <= sizeof(rd_payload)) {
+      if(len + outbuf.len > rd_payload_len ||
+         memcmp(&rd_payload[len], rd_data, outbuf.len) != 0) {
+        changed = 1;
+        memcpy(&rd_payload[len], rd_data, outbuf.len);
+      }
+    } else {
+      /* Too large - let the engine finish the list anyway */
+      rd_payload_cached = 0;
+    }
+    len += outbuf.len;
+  } while(more);
+
+  if(len == 0) {
+    /* No objects, or the engine is busy - try again with the next request */
+    rd_payload_cached = 0;
+    rd_payload_sent = 0;
+    return;
+  }
+  rd_flags &= ~FLAG_RD_PAYLOAD_DIRTY;
+  if(len != rd_payload_len) {
+    changed = 1;
+  }
+  if(changed || !rd_payload_cached) {
+    rd_payload_sent = 0;
+  }
+  if(rd_payload_cached) {
+    rd_payload_len = len;
+    LOG_DBG("Cached object list of %u bytes\n", rd_payload_len);
+  } else {
+    /* Generated block by block for every request until the objects change */
+    rd_payload_len = 0;
+    LOG_DBG("Object list too large for the cache\n");
+  }
+}
+/*---------------------------------------------------------------------------*/
+static int
+rd_payload_is_sent(void)
+{
+  update_rd_payload();
+  return rd_payload_cached && rd_payload_sent;
+}
+/*---------------------------------------------------------------------------*/
+static void
+set_rd_block(coap_message_t *request, uint32_t block)
+{
+  uint32_t offset = block * RD_BLOCK_SIZE;
+
+  if(block == 0 && rd_payload_len <= COAP_MAX_CHUNK_SIZE) {
+    /* All in one request */
+    rd_more = 0;
+    coap_set_payload(request, rd_payload, rd_payload_len);
+    return;
+  }
+  rd_more = offset + RD_BLOCK_SIZE < rd_payload_len;
+  coap_set_payload(request, &rd_payload[offset],
+                   rd_more ? RD_BLOCK_SIZE : rd_payload_len - offset);
+  if(block > 0 || rd_more) {
+    coap_set_header_block1(request, block, rd_more, RD_BLOCK_SIZE);
+  }
+}
+#endif /* RD_PAYLOAD_CACHE_SIZE */
+/*---------------------------------------------------------------------------*/
 static int
 set_rd_data(coap_message_t *request)
 {
   lwm2m_buffer_t outbuf;
 
+#if RD_PAYLOAD_CACHE_SIZE
+  update_rd_payload();
+  rd_payload_sent = rd_payload_cached;
+  if(rd_payload_cached) {
+    set_rd_block(request, 0);
+    return request->payload_len;
+  }
+#endif /* RD_PAYLOAD_CACHE_SIZE */
+
   /* setup the output buffer */
   outbuf.buffer = rd_data;
   outbuf.size = sizeof(rd_data);
@@ -157,8 +295,15 @@ prepare_update(coap_message_t *request, int triggered) {
 
   if((triggered || rd_flags & FLAG_RD_DATA_UPDATE_ON_DIRTY) && (rd_flags & FLAG_RD_DATA_DIRTY)) {
     rd_flags &= ~FLAG_RD_DATA_DIRTY;
+#if RD_PAYLOAD_CACHE_SIZE
+    if(rd_payload_is_sent()) {
+      LOG_DBG("Object list unchanged - not included in the update\n");
+      return;
+    }
+#endif /* RD_PAYLOAD_CACHE_SIZE */
     set_rd_data(request);
     rd_callback = update_callback;
+    stats.update_lists++;
   }
 }
 /*---------------------------------------------------------------------------*/
@@ -182,6 +327,12 @@ lwm2m_rd_client_is_registered(void)
   return rd_state == REGISTRATION_DONE || rd_state == UPDATE_SENT;
 }
 /*---------------------------------------------------------------------------*/
+const coap_endpoint_t *
+lwm2m_rd_client_get_server_endpoint(void)
+{
+  return lwm2m_rd_client_is_registered() ? &session_info.server_ep : NULL;
+}
+/*---------------------------------------------------------------------------*/
 void
 lwm2m_rd_client_use_bootstrap_server(int use)
 {
@@ -236,7 +387,7 @@ lwm2m_rd_client_set_lifetime(uint16_t lifetime)
 void
 lwm2m_rd_client_set_update_rd(void)
 {
-  rd_flags |= FLAG_RD_DATA_DIRTY;
+  rd_flags |= FLAG_RD_DATA_DIRTY | FLAG_RD_PAYLOAD_DIRTY;
 }
 /*---------------------------------------------------------------------------*/
 void
@@ -384,6 +535,16 @@ produce_more_rd(void)
 
   rd_block1++;
 
+#if RD_PAYLOAD_CACHE_SIZE
+  if(rd_payload_cached) {
+    set_rd_block(request, rd_block1);
+    LOG_DBG("Setting cached block1 in request - block: %d more: %d\n",
+            (int)rd_block1, (int)rd_more);
+    send_request(&session_info.server_ep, rd_callback);
+    return;
+  }
+#endif /* RD_PAYLOAD_CACHE_SIZE */
+
   /* this will also set the request payload */
   rd_more = lwm2m_engine_set_rd_data(&outbuf, rd_block1);
   coap_set_payload(request, rd_data, outbuf.len);
@@ -392,7 +553,7 @@ produce_more_rd(void)
           (int)rd_block1, (int)rd_more);
   coap_set_header_block1(request, rd_block1, rd_more, sizeof(rd_data));
 
-  coap_send_request(&rd_request_state, &session_info.server_ep, request, rd_callback);
+  send_request(&session_info.server_ep, rd_callback);
 }
 /*---------------------------------------------------------------------------*/
 static void
@@ -407,6 +568,9 @@ block1_rd_callback(coap_timer_t *timer)
 static void
 registration_callback(coap_request_state_t *state)
 {
+  const char *location = NULL;
+  int location_len;
+
   LOG_DBG("Registration callback. Response: %d, ", state->response != NULL);
   if(state->response) {
     /* check state and possibly set registration to done */
@@ -418,22 +582,22 @@ registration_callback(coap_request_state_t *state)
       coap_timer_set(&block1_timer, 1); /* delay 1 ms */
       LOG_DBG_("Continue\n");
     } else if(CREATED_2_01 == state->response->code) {
-      if(state->response->location_path_len < LWM2M_RD_CLIENT_ASSIGNED_ENDPOINT_MAX_LEN) {
-        memcpy(session_info.assigned_ep, state->response->location_path,
-               state->response->location_path_len);
-        session_info.assigned_ep[state->response->location_path_len] = 0;
+      location_len = coap_get_header_location_path(state->response, &location);
+      if(location_len < LWM2M_RD_CLIENT_ASSIGNED_ENDPOINT_MAX_LEN) {
+        memcpy(session_info.assigned_ep, location, location_len);
+        session_info.assigned_ep[location_len] = 0;
         /* if we decide to not pass the lt-argument on registration, we should force an initial "update" to register lifetime with server */
         rd_state = REGISTRATION_DONE;
         /* remember the last reg time */
         last_update = coap_timer_uptime();
+        stats.registration_time = last_update - request_start;
         LOG_DBG_("Done (assigned EP='%s')!\n", session_info.assigned_ep);
         perform_session_callback(LWM2M_RD_CLIENT_REGISTERED);
         return;
       }
 
       LOG_DBG_("failed to handle assigned EP: '");
-      LOG_DBG_COAP_STRING(state->response->location_path,
-                          state->response->location_path_len);
+      LOG_DBG_COAP_STRING(location, location_len);
       LOG_DBG_("'. Re-init network.\n");
     } else {
       /* Possible error response codes are 4.00 Bad request & 4.03 Forbidden */
@@ -468,6 +632,7 @@ update_callback(coap_request_state_t *state)
       LOG_DBG_("Done!\n");
       /* remember the last reg time */
       last_update = coap_timer_uptime();
+      stats.update_time = last_update - request_start;
       rd_state = REGISTRATION_DONE;
       rd_flags &= ~FLAG_RD_DATA_UPDATE_TRIGGERED;
     } else {
@@ -557,8 +722,7 @@ periodic_process(coap_timer_t *timer)
         LOG_INFO_COAP_EP(&session_info.bs_server_ep);
         LOG_INFO_("] as '%s'\n", query_data);
 
-        coap_send_request(&rd_request_state, &session_info.bs_server_ep,
-                          request, bootstrap_callback);
+        send_request(&session_info.bs_server_ep, bootstrap_callback);
 
         rd_state = BOOTSTRAP_SENT;
       }
@@ -656,9 +820,10 @@ periodic_process(coap_timer_t *timer)
       }
       LOG_INFO_("' More:%d\n", rd_more);
 
-      coap_send_request(&rd_request_state, &session_info.server_ep,
-                        request, registration_callback);
+      send_request(&session_info.server_ep, registration_callback);
       last_rd_progress = coap_timer_uptime();
+      request_start = last_rd_progress;
+      stats.registrations++;
       rd_state = REGISTRATION_SENT;
     }
     break;
@@ -679,9 +844,10 @@ periodic_process(coap_timer_t *timer)
        ((uint32_t)session_info.lifetime * 500) <= now - last_update) {
       /* triggered or time to send an update to the server, at half-time! sec vs ms */
       prepare_update(request, rd_flags & FLAG_RD_DATA_UPDATE_TRIGGERED);
-      coap_send_request(&rd_request_state, &session_info.server_ep, request,
-                        update_callback);
+      send_request(&session_info.server_ep, update_callback);
       last_rd_progress = coap_timer_uptime();
+      request_start = last_rd_progress;
+      stats.updates++;
       rd_state = UPDATE_SENT;
     }
     break;
@@ -697,8 +863,7 @@ periodic_process(coap_timer_t *timer)
     LOG_INFO("DEREGISTER %s\n", session_info.assigned_ep);
     coap_init_message(request, COAP_TYPE_CON, COAP_DELETE, 0);
     coap_set_header_uri_path(request, session_info.assigned_ep);
-    coap_send_request(&rd_request_state, &session_info.server_ep, request,
-                      deregister_callback);
+    send_request(&session_info.server_ep, deregister_callback);
     rd_state = DEREGISTER_SENT;
     break;
   case DEREGISTER_SENT:
@@ -729,6 +894,12 @@ lwm2m_rd_client_init(const char *ep)
   coap_timer_set(&rd_timer, STATE_MACHINE_UPDATE_INTERVAL);
 }
 /*---------------------------------------------------------------------------*/
+const lwm2m_rd_client_stats_t *
+lwm2m_rd_client_get_stats(void)
+{
+  return &stats;
+}
+/*---------------------------------------------------------------------------*/
 static void
 check_periodic_observations(void)
 {
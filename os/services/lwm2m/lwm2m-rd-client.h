@@ -57,6 +57,8 @@ struct lwm2m_session_info;
 typedef void (*session_callback_t)(struct lwm2m_session_info *session, int status);
 
 int  lwm2m_rd_client_is_registered(void);
+/* The registration server, or NULL when not registered */
+const coap_endpoint_t *lwm2m_rd_client_get_server_endpoint(void);
 void lwm2m_rd_client_use_bootstrap_server(int use);
 void lwm2m_rd_client_use_registration_server(int use);
 void lwm2m_rd_client_register_with_server(const coap_endpoint_t *server);
@@ -75,6 +77,21 @@ void lwm2m_rd_client_init(const char *ep);
 
 void lwm2m_rd_client_set_session_callback(session_callback_t cb);
 
+typedef struct {
+  /* Register and Update requests, and the Updates with the object list */
+  uint32_t registrations;
+  uint32_t updates;
+  uint32_t update_lists;
+  /* All requests, blocks included, and their payload */
+  uint32_t packets;
+  uint32_t payload_bytes;
+  /* Milliseconds from the first request until the last response */
+  uint32_t registration_time;
+  uint32_t update_time;
+} lwm2m_rd_client_stats_t;
+
+const lwm2m_rd_client_stats_t *lwm2m_rd_client_get_stats(void);
+
 #ifndef LWM2M_RD_CLIENT_ASSIGNED_ENDPOINT_MAX_LEN
 #define LWM2M_RD_CLIENT_ASSIGNED_ENDPOINT_MAX_LEN    15
 #endif /* LWM2M_RD_CLIENT_ASSIGNED_ENDPOINT_MAX_LEN */
@@ -0,0 +1,249 @@
+/*
+ * Copyright (c) 2018, RISE SICS.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \addtogroup lwm2m
+ * @{
+ */
+
+/**
+ * \file
+ *         Implementation of the LWM2M Send operation
+ */
+
+#include "lwm2m-send.h"
+#include "lwm2m-rd-client.h"
+#include "coap-engine.h"
+#include "coap-callback-api.h"
+#include <string.h>
+
+/* Log configuration */
+#include "coap-log.h"
+#define LOG_MODULE "lwm2m-send"
+#define LOG_LEVEL  LOG_LEVEL_LWM2M
+
+static lwm2m_resource_path_t pending[LWM2M_SEND_MAX_RESOURCES];
+static uint8_t pending_count;
+/* The resources of the Send in progress, sent again if it times out */
+static lwm2m_resource_path_t in_flight[LWM2M_SEND_MAX_RESOURCES];
+static uint8_t in_flight_count;
+
+static coap_timer_t send_timer;
+/* The timer expires before its callback has run, so track the window */
+static uint8_t window_open;
+static coap_request_state_t send_request_state;
+static coap_message_t request[1];
+static coap_endpoint_t server_ep;
+static uint8_t payload[COAP_MAX_CHUNK_SIZE];
+
+static lwm2m_send_stats_t stats;
+
+static void send_pending(void);
+/*---------------------------------------------------------------------------*/
+static void
+window_ended(coap_timer_t *timer)
+{
+  window_open = 0;
+  send_pending();
+}
+/*---------------------------------------------------------------------------*/
+static void
+start_window(void)
+{
+  coap_timer_set_callback(&send_timer, window_ended);
+  coap_timer_set(&send_timer, LWM2M_SEND_WINDOW);
+  window_open = 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+end_window(void)
+{
+  coap_timer_stop(&send_timer);
+  window_open = 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+add_pending(uint16_t object_id, uint16_t instance_id, uint16_t resource_id)
+{
+  int count;
+
+  count = lwm2m_engine_add_path(pending, pending_count,
+                                LWM2M_SEND_MAX_RESOURCES,
+                                object_id, instance_id, resource_id);
+  if(count < 0) {
+    return 0;
+  }
+  pending_count = count;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/* Send the current values of the resources in flight again */
+static void
+retry_in_flight(void)
+{
+  int i;
+
+  for(i = 0; i < in_flight_count; i++) {
+    add_pending(in_flight[i].object_id, in_flight[i].instance_id,
+                in_flight[i].resource_id);
+  }
+  in_flight_count = 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+send_callback(coap_request_state_t *state)
+{
+  if(state->response == NULL) {
+    if(in_flight_count == 0) {
+      /* The end of a request that already had its response */
+      return;
+    }
+    LOG_WARN("Send timed out\n");
+    stats.failures++;
+    retry_in_flight();
+  } else if(state->response->code >= BAD_REQUEST_4_00) {
+    LOG_WARN("Send rejected with %u\n", state->response->code);
+    stats.failures++;
+  }
+  in_flight_count = 0;
+
+  if(pending_count > 0 && !window_open) {
+    /* The window has ended while the Send was in progress */
+    send_pending();
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+send_pending(void)
+{
+  const coap_endpoint_t *server;
+  lwm2m_buffer_t outbuf;
+  int count;
+
+  if(pending_count == 0 || in_flight_count > 0) {
+    /* Nothing to send, or sent when the Send in progress is done */
+    return;
+  }
+
+  server = lwm2m_rd_client_get_server_endpoint();
+  if(server == NULL) {
+    LOG_DBG("Not registered - trying again after the window\n");
+    start_window();
+    return;
+  }
+  coap_endpoint_copy(&server_ep, server);
+
+  outbuf.buffer = payload;
+  outbuf.size = sizeof(payload);
+  outbuf.len = 0;
+  count = lwm2m_engine_read_composite(pending, pending_count, &outbuf);
+  if(count == 0) {
+    LOG_WARN("%u/%u/%u does not fit a Send\n", pending[0].object_id,
+             pending[0].instance_id, pending[0].resource_id);
+    count = 1;
+  }
+
+  /* Those that did not fit are sent with the next Send */
+  memcpy(in_flight, pending, count * sizeof(pending[0]));
+  in_flight_count = count;
+  pending_count -= count;
+  memmove(pending, &pending[count], pending_count * sizeof(pending[0]));
+
+  if(outbuf.len <= 2) {
+    /* None of the resources could be read */
+    in_flight_count = 0;
+    if(pending_count > 0) {
+      send_pending();
+    }
+    return;
+  }
+
+  coap_init_message(request, COAP_TYPE_CON, COAP_POST, coap_get_mid());
+  coap_set_header_uri_path(request, "dp");
+  coap_set_header_content_format(request, LWM2M_SENML_CBOR);
+  coap_set_payload(request, payload, outbuf.len);
+  LOG_DBG("Sending %d resources in %u bytes\n", count, outbuf.len);
+
+  coap_send_request(&send_request_state, &server_ep, request, send_callback);
+  if(send_request_state.transaction == NULL) {
+    /* No callback will come - try again after the window */
+    LOG_WARN("No transaction for a Send\n");
+    stats.failures++;
+    retry_in_flight();
+    if(!window_open) {
+      start_window();
+    }
+    return;
+  }
+  stats.sends++;
+  stats.resources += count;
+}
+/*---------------------------------------------------------------------------*/
+int
+lwm2m_send_resource(const lwm2m_object_instance_t *instance,
+                    uint16_t resource_id)
+{
+  if(instance == NULL) {
+    return 0;
+  }
+  if(!add_pending(instance->object_id, instance->instance_id, resource_id)) {
+    if(in_flight_count > 0) {
+      return 0;
+    }
+    /* Send what has changed so far */
+    end_window();
+    send_pending();
+    if(!add_pending(instance->object_id, instance->instance_id,
+                    resource_id)) {
+      return 0;
+    }
+  }
+  stats.changes++;
+
+  if(!window_open) {
+    start_window();
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+void
+lwm2m_send_flush(void)
+{
+  end_window();
+  send_pending();
+}
+/*---------------------------------------------------------------------------*/
+const lwm2m_send_stats_t *
+lwm2m_send_get_stats(void)
+{
+  return &stats;
+}
+/*---------------------------------------------------------------------------*/
+/** @} */
@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2018, RISE SICS.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \addtogroup lwm2m
+ * @{
+ */
+
+/**
+ * \file
+ *         Header file for the LWM2M Send operation: changed resources are
+ *         collected during a window and sent to the registration server in
+ *         one SenML CBOR pack.
+ */
+
+#ifndef LWM2M_SEND_H_
+#define LWM2M_SEND_H_
+
+#include "lwm2m-engine.h"
+
+/* Time from the first change until the Send, in milliseconds */
+#ifdef LWM2M_SEND_CONF_WINDOW
+#define LWM2M_SEND_WINDOW LWM2M_SEND_CONF_WINDOW
+#else
+#define LWM2M_SEND_WINDOW 1000
+#endif /* LWM2M_SEND_CONF_WINDOW */
+
+/* Number of changed resources kept until they are sent */
+#ifdef LWM2M_SEND_CONF_MAX_RESOURCES
+#define LWM2M_SEND_MAX_RESOURCES LWM2M_SEND_CONF_MAX_RESOURCES
+#else
+#define LWM2M_SEND_MAX_RESOURCES 16
+#endif /* LWM2M_SEND_CONF_MAX_RESOURCES */
+
+typedef struct {
+  /* Calls of lwm2m_send_resource() */
+  uint32_t changes;
+  /* Send requests and the resource values in them */
+  uint32_t sends;
+  uint32_t resources;
+  /* Send requests that were not acknowledged, rejected or not sent */
+  uint32_t failures;
+} lwm2m_send_stats_t;
+
+/*
+ * Sends the value of a resource to the server at the end of the window.
+ * Several changes of a resource within a window are sent once, with the
+ * value at the end of the window. Returns 0 if the resource could not be
+ * added since LWM2M_SEND_MAX_RESOURCES are waiting for a Send in progress.
+ */
+int lwm2m_send_resource(const lwm2m_object_instance_t *instance,
+                        uint16_t resource_id);
+
+/* Sends the changed resources now instead of at the end of the window */
+void lwm2m_send_flush(void);
+
+const lwm2m_send_stats_t *lwm2m_send_get_stats(void);
+
+#endif /* LWM2M_SEND_H_ */
+/** @} */
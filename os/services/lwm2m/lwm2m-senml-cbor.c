@@ -0,0 +1,369 @@
+/*
+ * Copyright (c) 2018, RISE SICS.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \addtogroup lwm2m
+ * @{
+ */
+
+/**
+ * \file
+ *         Implementation of the Contiki OMA LWM2M SenML CBOR reader / writer
+ *         (application/senml+cbor, RFC 8428)
+ */
+
+#include "lwm2m-object.h"
+#include "lwm2m-senml-cbor.h"
+#include "lwm2m-cbor.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Log configuration */
+#include "coap-log.h"
+#define LOG_MODULE "lwm2m-senml-cbor"
+#define LOG_LEVEL  LOG_LEVEL_NONE
+
+/* [{-2:"/3303/0/",0:"5700",2:22.5},{0:"5701",3:"Cel"}] */
+
+/* SenML labels used by LWM2M */
+#define SENML_BASE_NAME  -2
+#define SENML_NAME        0
+#define SENML_VALUE       2
+#define SENML_STRING      3
+#define SENML_BOOLEAN     4
+#define SENML_DATA        8
+/*---------------------------------------------------------------------------*/
+static int
+read_text(const uint8_t *buffer, size_t len, const uint8_t **text,
+          uint8_t *text_len)
+{
+  uint8_t major;
+  uint32_t value;
+  size_t size;
+
+  size = lwm2m_cbor_read_head(buffer, len, &major, &value);
+  if(size == 0 || major != LWM2M_CBOR_TEXT ||
+     (buffer[0] & 0x1f) == LWM2M_CBOR_INDEFINITE ||
+     value > 0xff || value > len - size) {
+    return 0;
+  }
+  *text = &buffer[size];
+  *text_len = value;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+int
+lwm2m_senml_cbor_next_record(lwm2m_context_t *ctx,
+                             struct senml_cbor_record *record)
+{
+  const uint8_t *buffer = ctx->inbuf->buffer;
+  size_t len = ctx->inbuf->size;
+  size_t pos = ctx->inbuf->pos;
+  uint8_t major;
+  uint32_t value;
+  uint32_t pairs;
+  int32_t label;
+  size_t size;
+  int indefinite;
+
+  if(pos == 0) {
+    /* The records are in an array */
+    size = lwm2m_cbor_read_head(buffer, len, &major, &value);
+    if(size == 0 || major != LWM2M_CBOR_ARRAY || value >= 0xffff) {
+      return 0;
+    }
+    record->records_left =
+      (buffer[0] & 0x1f) == LWM2M_CBOR_INDEFINITE ? 0xffff : value;
+    pos = size;
+  }
+  if(record->records_left == 0 || pos >= len ||
+     buffer[pos] == LWM2M_CBOR_BREAK) {
+    return 0;
+  }
+
+  record->name = NULL;
+  record->name_len = 0;
+  record->value = NULL;
+  record->value_len = 0;
+
+  /* Each record is a map of labels to values */
+  size = lwm2m_cbor_read_head(&buffer[pos], len - pos, &major, &pairs);
+  if(size == 0 || major != LWM2M_CBOR_MAP) {
+    return 0;
+  }
+  indefinite = (buffer[pos] & 0x1f) == LWM2M_CBOR_INDEFINITE;
+  pos += size;
+
+  while(pos < len && (indefinite ? buffer[pos] != LWM2M_CBOR_BREAK :
+                      pairs > 0)) {
+    /* Labels other than integers are not used by LWM2M, skip them */
+    size = lwm2m_cbor_read_head(&buffer[pos], len - pos, &major, &value);
+    if(size > 0 && major == LWM2M_CBOR_UINT && value <= INT32_MAX) {
+      label = value;
+    } else if(size > 0 && major == LWM2M_CBOR_NINT && value < INT32_MAX) {
+      label = -(int32_t)value - 1;
+    } else {
+      label = INT32_MAX;
+      size = lwm2m_cbor_item_size(&buffer[pos], len - pos);
+    }
+    if(size == 0) {
+      return 0;
+    }
+    pos += size;
+
+    size = lwm2m_cbor_item_size(&buffer[pos], len - pos);
+    if(size == 0) {
+      return 0;
+    }
+    switch(label) {
+    case SENML_BASE_NAME:
+      if(!read_text(&buffer[pos], size, &record->base_name,
+                    &record->base_name_len)) {
+        return 0;
+      }
+      break;
+    case SENML_NAME:
+      if(!read_text(&buffer[pos], size, &record->name, &record->name_len)) {
+        return 0;
+      }
+      break;
+    case SENML_VALUE:
+    case SENML_STRING:
+    case SENML_BOOLEAN:
+    case SENML_DATA:
+      record->value = &buffer[pos];
+      record->value_len = size;
+      break;
+    default:
+      LOG_DBG("Skipping label %d\n", (int)label);
+      break;
+    }
+    pos += size;
+    pairs--;
+  }
+
+  if(indefinite) {
+    if(pos >= len) {
+      return 0;
+    }
+    /* The break */
+    pos++;
+  } else if(pairs > 0) {
+    return 0;
+  }
+
+  if(record->records_left != 0xffff) {
+    record->records_left--;
+  }
+  ctx->inbuf->pos = pos;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+init_write(lwm2m_context_t *ctx)
+{
+  /* The number of records is not known yet */
+  if(ctx->outbuf->len >= ctx->outbuf->size) {
+    return 0;
+  }
+  ctx->outbuf->buffer[ctx->outbuf->len] =
+    LWM2M_CBOR_ARRAY | LWM2M_CBOR_INDEFINITE;
+  ctx->writer_flags = 0; /* set flags to zero */
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+end_write(lwm2m_context_t *ctx)
+{
+  if(ctx->outbuf->len >= ctx->outbuf->size) {
+    return 0;
+  }
+  ctx->outbuf->buffer[ctx->outbuf->len] = LWM2M_CBOR_BREAK;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+enter_sub(lwm2m_context_t *ctx)
+{
+  LOG_DBG("Enter sub-resource rsc=%d\n", ctx->resource_id);
+  ctx->writer_flags |= WRITER_RESOURCE_INSTANCE;
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+exit_sub(lwm2m_context_t *ctx)
+{
+  LOG_DBG("Exit sub-resource rsc=%d\n", ctx->resource_id);
+  ctx->writer_flags &= ~WRITER_RESOURCE_INSTANCE;
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Writes the start of a record up to the label of its value. The base name
+ * is only given with the first record.
+ */
+static size_t
+write_record(lwm2m_context_t *ctx, uint8_t *outbuf, size_t outlen,
+             int label)
+{
+  char name[24]; /* /60000/60000/ */
+  int first = (ctx->writer_flags & WRITER_OUTPUT_VALUE) == 0;
+  size_t len;
+  size_t size;
+  int n;
+
+  len = lwm2m_cbor_write_head(outbuf, outlen, LWM2M_CBOR_MAP, first ? 3 : 2);
+  if(len == 0) {
+    return 0;
+  }
+
+  if(first) {
+    n = snprintf(name, sizeof(name), "/%u/%u/",
+                 ctx->object_id, ctx->object_instance_id);
+    size = lwm2m_cbor_write_int(&outbuf[len], outlen - len, SENML_BASE_NAME);
+    if(size == 0) {
+      return 0;
+    }
+    len += size;
+    size = lwm2m_cbor_write_text(&outbuf[len], outlen - len, name, n);
+    if(size == 0) {
+      return 0;
+    }
+    len += size;
+  }
+
+  if(ctx->writer_flags & WRITER_RESOURCE_INSTANCE) {
+    n = snprintf(name, sizeof(name), "%u/%u",
+                 ctx->resource_id, ctx->resource_instance_id);
+  } else {
+    n = snprintf(name, sizeof(name), "%u", ctx->resource_id);
+  }
+  size = lwm2m_cbor_write_int(&outbuf[len], outlen - len, SENML_NAME);
+  if(size == 0) {
+    return 0;
+  }
+  len += size;
+  size = lwm2m_cbor_write_text(&outbuf[len], outlen - len, name, n);
+  if(size == 0) {
+    return 0;
+  }
+  len += size;
+
+  size = lwm2m_cbor_write_int(&outbuf[len], outlen - len, label);
+  if(size == 0) {
+    return 0;
+  }
+  return len + size;
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+write_int(lwm2m_context_t *ctx, uint8_t *outbuf, size_t outlen,
+          int32_t value)
+{
+  size_t len;
+  size_t size;
+
+  len = write_record(ctx, outbuf, outlen, SENML_VALUE);
+  if(len == 0) {
+    return 0;
+  }
+  size = lwm2m_cbor_write_int(&outbuf[len], outlen - len, value);
+  if(size == 0) {
+    return 0;
+  }
+  ctx->writer_flags |= WRITER_OUTPUT_VALUE;
+  return len + size;
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+write_string(lwm2m_context_t *ctx, uint8_t *outbuf, size_t outlen,
+             const char *value, size_t stringlen)
+{
+  size_t len;
+  size_t size;
+
+  len = write_record(ctx, outbuf, outlen, SENML_STRING);
+  if(len == 0) {
+    return 0;
+  }
+  size = lwm2m_cbor_write_text(&outbuf[len], outlen - len, value, stringlen);
+  if(size == 0) {
+    return 0;
+  }
+  ctx->writer_flags |= WRITER_OUTPUT_VALUE;
+  return len + size;
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+write_float32fix(lwm2m_context_t *ctx, uint8_t *outbuf, size_t outlen,
+                 int32_t value, int bits)
+{
+  size_t len;
+  size_t size;
+
+  len = write_record(ctx, outbuf, outlen, SENML_VALUE);
+  if(len == 0) {
+    return 0;
+  }
+  size = lwm2m_cbor_write_float32fix(&outbuf[len], outlen - len, value, bits);
+  if(size == 0) {
+    return 0;
+  }
+  ctx->writer_flags |= WRITER_OUTPUT_VALUE;
+  return len + size;
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+write_boolean(lwm2m_context_t *ctx, uint8_t *outbuf, size_t outlen,
+              int value)
+{
+  size_t len;
+
+  len = write_record(ctx, outbuf, outlen, SENML_BOOLEAN);
+  if(len == 0 || len >= outlen) {
+    return 0;
+  }
+  outbuf[len] = value ? LWM2M_CBOR_TRUE : LWM2M_CBOR_FALSE;
+  ctx->writer_flags |= WRITER_OUTPUT_VALUE;
+  return len + 1;
+}
+/*---------------------------------------------------------------------------*/
+const lwm2m_writer_t lwm2m_senml_cbor_writer = {
+  init_write,
+  end_write,
+  enter_sub,
+  exit_sub,
+  write_int,
+  write_string,
+  write_float32fix,
+  write_boolean
+};
+/*---------------------------------------------------------------------------*/
+/** @} */
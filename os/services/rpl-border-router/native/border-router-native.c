@@ -91,8 +91,19 @@ border_router_set_mac(const uint8_t *data)
 void
 border_router_print_stat()
 {
+#ifndef __CYGWIN__
+  const struct tun_batch_stats *stats = tun_stats();
+#endif /* __CYGWIN__ */
+
   printf("bytes received over SLIP: %ld\n", slip_received);
   printf("bytes sent over SLIP: %ld\n", slip_sent);
+#ifndef __CYGWIN__
+  printf("packets received over TUN: %lu in %lu wakeups (max %lu)\n",
+         stats->packets_in, stats->wakeups, stats->max_batch);
+  printf("packets sent over TUN: %lu, %lu flushes (max queued %lu), "
+         "%lu dropped\n", stats->packets_out, stats->flushes,
+         stats->max_queued, stats->drops);
+#endif /* __CYGWIN__ */
 }
 /*---------------------------------------------------------------------------*/
 PROCESS_THREAD(border_router_process, ev, data)
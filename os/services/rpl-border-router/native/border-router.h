@@ -39,6 +39,7 @@
 
 #include "contiki.h"
 #include "net/ipv6/uip.h"
+#include "tun-batch.h"
 #include <stdio.h>
 
 int border_router_cmd_handler(const uint8_t *data, int len);
@@ -51,6 +52,7 @@ void border_router_set_sensors(const char *data, int len);
 void border_router_print_stat(void);
 
 void tun_init(void);
+const struct tun_batch_stats *tun_stats(void);
 
 int slip_init(void);
 int slip_set_fd(int maxfd, fd_set *rset, fd_set *wset);
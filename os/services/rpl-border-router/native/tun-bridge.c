@@ -63,6 +63,7 @@
 #include "net/packetbuf.h"
 #include "cmd.h"
 #include "border-router.h"
+#include "tun-batch.h"
 
 extern const char *slip_config_ipaddr;
 extern char slip_config_tundev[32];
@@ -70,6 +71,7 @@ extern uint16_t slip_config_basedelay;
 
 #ifndef __CYGWIN__
 static int tunfd;
+static struct tun_batch tun_batch;
 
 static int set_fd(fd_set *rset, fd_set *wset);
 static void handle_fd(fd_set *rset, fd_set *wset);
@@ -210,6 +212,7 @@ tun_init()
     err(1, "main: open");
   }
 
+  tun_batch_init(&tun_batch, tunfd, tcpip_input);
   select_set_callback(tunfd, &tun_select_callback);
 
   fprintf(stderr, "opened %s device ``/dev/%s''\n",
@@ -226,21 +229,13 @@ static int
 tun_output(uint8_t *data, int len)
 {
   /* fprintf(stderr, "*** Writing to tun...%d\n", len); */
-  if(write(tunfd, data, len) != len) {
-    err(1, "serial_to_tun: write");
-    return -1;
-  }
-  return 0;
+  return tun_batch_write(&tun_batch, data, len);
 }
 /*---------------------------------------------------------------------------*/
-int
-tun_input(unsigned char *data, int maxlen)
+const struct tun_batch_stats *
+tun_stats(void)
 {
-  int size;
-  if((size = read(tunfd, data, maxlen)) == -1) {
-    err(1, "tun_input: read");
-  }
-  return size;
+  return &tun_batch.stats;
 }
 /*---------------------------------------------------------------------------*/
 static void
@@ -267,8 +262,7 @@ const struct uip_fallback_interface rpl_interface = {
 static int
 set_fd(fd_set *rset, fd_set *wset)
 {
-  FD_SET(tunfd, rset);
-  return 1;
+  return tun_batch_set_fd(&tun_batch, rset, wset);
 }
 /*---------------------------------------------------------------------------*/
 
@@ -292,14 +286,9 @@ handle_fd(fd_set *rset, fd_set *wset)
   }
 
   if(delaymsec == 0) {
-    int size;
-
-    if(FD_ISSET(tunfd, rset)) {
-      size = tun_input(&uip_buf[UIP_LLH_LEN], sizeof(uip_buf));
-      /* printf("TUN data incoming read:%d\n", size); */
-      uip_len = size;
-      tcpip_input();
-
+    /* With a delay between packets, read one packet per wakeup */
+    if(tun_batch_handle_fd(&tun_batch, rset, wset,
+                           slip_config_basedelay ? 1 : TUN_BATCH_SIZE) > 0) {
       if(slip_config_basedelay) {
         struct timeval tv;
         gettimeofday(&tv, NULL);
@@ -308,6 +297,8 @@ handle_fd(fd_set *rset, fd_set *wset)
         delaystartmsec = tv.tv_usec / 1000;
       }
     }
+  } else if(FD_ISSET(tunfd, wset)) {
+    tun_batch_flush(&tun_batch);
   }
 }
 #endif /*  __CYGWIN_ */
@@ -56,6 +56,7 @@
 #endif /* MAC_CONF_WITH_TSCH */
 #include "net/routing/routing.h"
 #include "net/mac/llsec802154.h"
+#include "lib/memb.h"
 
 /* For RPL-specific commands */
 #if ROUTING_CONF_RPL_LITE
@@ -647,6 +648,38 @@ PT_THREAD(cmd_reboot(struct pt *pt, shell_output_func output, char *args))
   watchdog_reboot();
   PT_END(pt);
 }
+#if MEMB_WITH_STATS
+/*---------------------------------------------------------------------------*/
+static
+PT_THREAD(cmd_memb(struct pt *pt, shell_output_func output, char *args))
+{
+  struct memb *m;
+  char *next_args;
+
+  PT_BEGIN(pt);
+
+  SHELL_ARGS_INIT(args, next_args);
+
+  /* Get and parse argument: reset (optional) */
+  SHELL_ARGS_NEXT(args, next_args);
+  if(args != NULL && strcmp(args, "reset")) {
+    SHELL_OUTPUT(output, "Invalid argument: %s\n", args);
+    PT_EXIT(pt);
+  }
+
+  SHELL_OUTPUT(output, "Memory blocks:\n");
+  for(m = memb_stats_list(); m != NULL; m = m->next) {
+    SHELL_OUTPUT(output, "-- %s: %u blocks of %u bytes, %u used, max %u, %lu failed\n",
+                 m->name, m->num, m->size, m->nused, m->max_used,
+                 (unsigned long)m->failures);
+    if(args != NULL) {
+      memb_stats_reset(m);
+    }
+  }
+
+  PT_END(pt);
+}
+#endif /* MEMB_WITH_STATS */
 #if MAC_CONF_WITH_TSCH
 /*---------------------------------------------------------------------------*/
 static
@@ -739,6 +772,9 @@ struct shell_command_t shell_commands[] = {
   { "rpl-status",           cmd_rpl_status,           "'> rpl-status': Shows a summary of the current RPL state" },
 #endif /* ROUTING_CONF_RPL_LITE */
   { "routes",               cmd_routes,               "'> routes': Shows the route entries" },
+#if MEMB_WITH_STATS
+  { "memb",                 cmd_memb,                 "'> memb [reset]': Shows the usage of memory blocks, optionally resetting the maximum and failure counts" },
+#endif /* MEMB_WITH_STATS */
 #if MAC_CONF_WITH_TSCH
   { "tsch-set-coordinator", cmd_tsch_set_coordinator, "'> tsch-set-coordinator 0/1 [0/1]': Sets node as coordinator (1) or not (0). Second, optional parameter: enable (1) or disable (0) security." },
   { "tsch-schedule",        cmd_tsch_schedule,        "'> tsch-schedule': Shows the current TSCH schedule" },
@@ -52,29 +52,125 @@
 static struct etimer *timerlist;
 static clock_time_t next_expiration;
 
+#if ETIMER_WITH_HEAP
+/* Pending timers ordered by expiration time, heap[0] expires first */
+static struct etimer *heap[ETIMER_HEAP_SIZE];
+static uint16_t heap_len;
+#endif /* ETIMER_WITH_HEAP */
+
 PROCESS(etimer_process, "Event timer");
 /*---------------------------------------------------------------------------*/
+#if ETIMER_WITH_HEAP
+#define EXPIRATION(t) ((t)->timer.start + (t)->timer.interval)
+/* Half the range of clock_time_t, i.e., its sign bit */
+#define CLOCK_TIME_HALF (((clock_time_t)~(clock_time_t)0 >> 1) + 1)
+/*---------------------------------------------------------------------------*/
+/* Returns non-zero if a expires before b. Wraps are handled as long as
+   the two expiration times are less than half the clock range apart */
+static int
+expires_before(struct etimer *a, struct etimer *b)
+{
+  clock_time_t diff = EXPIRATION(a) - EXPIRATION(b);
+  return diff >= CLOCK_TIME_HALF;
+}
+/*---------------------------------------------------------------------------*/
+static int
+in_heap(struct etimer *et)
+{
+  return et->heap_index < heap_len && heap[et->heap_index] == et;
+}
+/*---------------------------------------------------------------------------*/
+static void
+heap_place(struct etimer *et, uint16_t i)
+{
+  heap[i] = et;
+  et->heap_index = i;
+}
+/*---------------------------------------------------------------------------*/
+static void
+heap_sift_up(uint16_t i)
+{
+  struct etimer *et = heap[i];
+  uint16_t parent;
+
+  while(i > 0) {
+    parent = (i - 1) / 2;
+    if(!expires_before(et, heap[parent])) {
+      break;
+    }
+    heap_place(heap[parent], i);
+    i = parent;
+  }
+  heap_place(et, i);
+}
+/*---------------------------------------------------------------------------*/
+static void
+heap_sift_down(uint16_t i)
+{
+  struct etimer *et = heap[i];
+  uint16_t child;
+
+  while((child = 2 * i + 1) < heap_len) {
+    if(child + 1 < heap_len && expires_before(heap[child + 1], heap[child])) {
+      child++;
+    }
+    if(!expires_before(heap[child], et)) {
+      break;
+    }
+    heap_place(heap[child], i);
+    i = child;
+  }
+  heap_place(et, i);
+}
+/*---------------------------------------------------------------------------*/
+/* Restores the heap order after the expiration time of heap[i] changed */
+static void
+heap_update(uint16_t i)
+{
+  if(i > 0 && expires_before(heap[i], heap[(i - 1) / 2])) {
+    heap_sift_up(i);
+  } else {
+    heap_sift_down(i);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+heap_remove(uint16_t i)
+{
+  heap_len--;
+  if(i < heap_len) {
+    heap_place(heap[heap_len], i);
+    heap_update(i);
+  }
+  heap[heap_len] = NULL;
+}
+#endif /* ETIMER_WITH_HEAP */
+/*---------------------------------------------------------------------------*/
 static void
 update_time(void)
 {
   clock_time_t tdist;
   clock_time_t now;
   struct etimer *t;
+  int pending;
 
-  if (timerlist == NULL) {
-    next_expiration = 0;
-  } else {
-    now = clock_time();
-    t = timerlist;
-    /* Must calculate distance to next time into account due to wraps */
-    tdist = t->timer.start + t->timer.interval - now;
-    for(t = t->next; t != NULL; t = t->next) {
-      if(t->timer.start + t->timer.interval - now < tdist) {
-	tdist = t->timer.start + t->timer.interval - now;
-      }
+  now = clock_time();
+  tdist = 0;
+  pending = 0;
+#if ETIMER_WITH_HEAP
+  if(heap_len > 0) {
+    tdist = EXPIRATION(heap[0]) - now;
+    pending = 1;
+  }
+#endif /* ETIMER_WITH_HEAP */
+  /* Must calculate distance to next time into account due to wraps */
+  for(t = timerlist; t != NULL; t = t->next) {
+    if(!pending || t->timer.start + t->timer.interval - now < tdist) {
+      tdist = t->timer.start + t->timer.interval - now;
+      pending = 1;
     }
-    next_expiration = now + tdist;
   }
+  next_expiration = pending ? now + tdist : 0;
 }
 /*---------------------------------------------------------------------------*/
 PROCESS_THREAD(etimer_process, ev, data)
@@ -91,6 +187,25 @@ PROCESS_THREAD(etimer_process, ev, data)
     if(ev == PROCESS_EVENT_EXITED) {
       struct process *p = data;
 
+#if ETIMER_WITH_HEAP
+      {
+        /* Drop the timers of the process and rebuild the heap */
+        uint16_t i, j;
+        for(i = 0, j = 0; i < heap_len; i++) {
+          if(heap[i]->p != p) {
+            heap_place(heap[i], j++);
+          }
+        }
+        for(i = j; i < heap_len; i++) {
+          heap[i] = NULL;
+        }
+        heap_len = j;
+        for(i = heap_len / 2; i > 0; i--) {
+          heap_sift_down(i - 1);
+        }
+      }
+#endif /* ETIMER_WITH_HEAP */
+
       while(timerlist != NULL && timerlist->p == p) {
 	timerlist = timerlist->next;
       }
@@ -109,6 +224,21 @@ PROCESS_THREAD(etimer_process, ev, data)
       continue;
     }
 
+#if ETIMER_WITH_HEAP
+    while(heap_len > 0 && timer_expired(&heap[0]->timer)) {
+      t = heap[0];
+      if(process_post(t->p, PROCESS_EVENT_TIMER, t) == PROCESS_ERR_OK) {
+        /* Signal that the etimer has expired, see below */
+        t->p = PROCESS_NONE;
+        heap_remove(0);
+      } else {
+        etimer_request_poll();
+        break;
+      }
+    }
+    update_time();
+#endif /* ETIMER_WITH_HEAP */
+
   again:
     
     u = NULL;
@@ -155,6 +285,15 @@ add_timer(struct etimer *timer)
   etimer_request_poll();
 
   if(timer->p != PROCESS_NONE) {
+#if ETIMER_WITH_HEAP
+    if(in_heap(timer)) {
+      /* Timer already in the heap, its expiration time has changed */
+      timer->p = PROCESS_CURRENT();
+      heap_update(timer->heap_index);
+      update_time();
+      return;
+    }
+#endif /* ETIMER_WITH_HEAP */
     for(t = timerlist; t != NULL; t = t->next) {
       if(t == timer) {
 	/* Timer already on list, bail out. */
@@ -167,6 +306,14 @@ add_timer(struct etimer *timer)
 
   /* Timer not on list. */
   timer->p = PROCESS_CURRENT();
+#if ETIMER_WITH_HEAP
+  if(heap_len < ETIMER_HEAP_SIZE) {
+    heap[heap_len] = timer;
+    heap_sift_up(heap_len++);
+    update_time();
+    return;
+  }
+#endif /* ETIMER_WITH_HEAP */
   timer->next = timerlist;
   timerlist = timer;
 
@@ -206,6 +353,11 @@ void
 etimer_adjust(struct etimer *et, int timediff)
 {
   et->timer.start += timediff;
+#if ETIMER_WITH_HEAP
+  if(in_heap(et)) {
+    heap_update(et->heap_index);
+  }
+#endif /* ETIMER_WITH_HEAP */
   update_time();
 }
 /*---------------------------------------------------------------------------*/
@@ -230,6 +382,11 @@ etimer_start_time(struct etimer *et)
 int
 etimer_pending(void)
 {
+#if ETIMER_WITH_HEAP
+  if(heap_len > 0) {
+    return 1;
+  }
+#endif /* ETIMER_WITH_HEAP */
   return timerlist != NULL;
 }
 /*---------------------------------------------------------------------------*/
@@ -244,6 +401,12 @@ etimer_stop(struct etimer *et)
 {
   struct etimer *t;
 
+#if ETIMER_WITH_HEAP
+  if(in_heap(et)) {
+    heap_remove(et->heap_index);
+    update_time();
+  } else
+#endif /* ETIMER_WITH_HEAP */
   /* First check if et is the first event timer on the list. */
   if(et == timerlist) {
     timerlist = timerlist->next;
@@ -64,6 +64,30 @@
 
 #include "contiki.h"
 
+/**
+ * \brief      Keep pending event timers in a binary min-heap.
+ *
+ *             By default, pending event timers are kept on an unsorted
+ *             list that is scanned every time a timer is set, stopped
+ *             or expires. With the heap, these operations cost
+ *             O(log n). Up to ETIMER_CONF_HEAP_SIZE timers are kept in
+ *             the heap, any further ones go to the list as before.
+ *             The heap orders timers by the difference of their
+ *             expiration times, so pending timers must expire within
+ *             half the range of clock_time_t of each other.
+ */
+#ifdef ETIMER_CONF_WITH_HEAP
+#define ETIMER_WITH_HEAP ETIMER_CONF_WITH_HEAP
+#else /* ETIMER_CONF_WITH_HEAP */
+#define ETIMER_WITH_HEAP 0
+#endif /* ETIMER_CONF_WITH_HEAP */
+
+#ifdef ETIMER_CONF_HEAP_SIZE
+#define ETIMER_HEAP_SIZE ETIMER_CONF_HEAP_SIZE
+#else /* ETIMER_CONF_HEAP_SIZE */
+#define ETIMER_HEAP_SIZE 64
+#endif /* ETIMER_CONF_HEAP_SIZE */
+
 /**
  * A timer.
  *
@@ -76,6 +100,9 @@ struct etimer {
   struct timer timer;
   struct etimer *next;
   struct process *p;
+#if ETIMER_WITH_HEAP
+  uint16_t heap_index;
+#endif /* ETIMER_WITH_HEAP */
 };
 
 /**
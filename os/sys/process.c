@@ -63,13 +63,35 @@ struct event_data {
   process_event_t ev;
   process_data_t data;
   struct process *p;
+#if PROCESS_CONF_NUM_PRIORITIES > 1
+  process_num_events_t next;
+#endif /* PROCESS_CONF_NUM_PRIORITIES > 1 */
 };
 
-static process_num_events_t nevents, fevent;
+static process_num_events_t nevents;
 static struct event_data events[PROCESS_CONF_NUMEVENTS];
 
+#if PROCESS_CONF_NUM_PRIORITIES > 1
+#if PROCESS_CONF_NUMEVENTS > 255
+#error PROCESS_CONF_NUMEVENTS must be at most 255 with event priorities
+#endif
+/*
+ * With priorities, the entries of the events array are linked by
+ * index into one FIFO per priority level, plus a list of free entries.
+ */
+#define EVENT_NONE PROCESS_CONF_NUMEVENTS
+static process_num_events_t queue_head[PROCESS_CONF_NUM_PRIORITIES];
+static process_num_events_t queue_tail[PROCESS_CONF_NUM_PRIORITIES];
+static process_num_events_t free_events;
+#else /* PROCESS_CONF_NUM_PRIORITIES > 1 */
+static process_num_events_t fevent;
+#endif /* PROCESS_CONF_NUM_PRIORITIES > 1 */
+
 #if PROCESS_CONF_STATS
 process_num_events_t process_maxevents;
+static uint32_t posted_events;
+static uint32_t coalesced_events;
+static uint32_t dropped_events;
 #endif
 
 static volatile unsigned char poll_requested;
@@ -88,6 +110,117 @@ static void call_process(struct process *p, process_event_t ev, process_data_t d
 #define PRINTF(...)
 #endif
 
+/*---------------------------------------------------------------------------*/
+static void
+queue_init(void)
+{
+#if PROCESS_CONF_NUM_PRIORITIES > 1
+  process_num_events_t i;
+
+  for(i = 0; i < PROCESS_CONF_NUM_PRIORITIES; i++) {
+    queue_head[i] = queue_tail[i] = EVENT_NONE;
+  }
+  for(i = 0; i < PROCESS_CONF_NUMEVENTS; i++) {
+    events[i].next = i + 1;
+  }
+  free_events = 0;
+#else /* PROCESS_CONF_NUM_PRIORITIES > 1 */
+  fevent = 0;
+#endif /* PROCESS_CONF_NUM_PRIORITIES > 1 */
+  nevents = 0;
+}
+/*---------------------------------------------------------------------------*/
+#if PROCESS_CONF_COALESCE_EVENTS
+/* Returns non-zero if an identical event is waiting at this priority */
+static int
+queue_contains(struct process *p, process_event_t ev, process_data_t data,
+               uint8_t prio)
+{
+  struct event_data *e;
+  process_num_events_t i;
+
+#if PROCESS_CONF_NUM_PRIORITIES > 1
+  for(i = queue_head[prio]; i != EVENT_NONE; i = e->next) {
+    e = &events[i];
+    if(e->p == p && e->ev == ev && e->data == data) {
+      return 1;
+    }
+  }
+#else /* PROCESS_CONF_NUM_PRIORITIES > 1 */
+  for(i = 0; i < nevents; i++) {
+    e = &events[(fevent + i) % PROCESS_CONF_NUMEVENTS];
+    if(e->p == p && e->ev == ev && e->data == data) {
+      return 1;
+    }
+  }
+#endif /* PROCESS_CONF_NUM_PRIORITIES > 1 */
+  return 0;
+}
+#endif /* PROCESS_CONF_COALESCE_EVENTS */
+/*---------------------------------------------------------------------------*/
+/* Appends an event to the queue of its priority. There must be room */
+static void
+queue_put(struct process *p, process_event_t ev, process_data_t data,
+          uint8_t prio)
+{
+  process_num_events_t snum;
+
+#if PROCESS_CONF_NUM_PRIORITIES > 1
+  snum = free_events;
+  free_events = events[snum].next;
+  events[snum].next = EVENT_NONE;
+  if(queue_tail[prio] == EVENT_NONE) {
+    queue_head[prio] = snum;
+  } else {
+    events[queue_tail[prio]].next = snum;
+  }
+  queue_tail[prio] = snum;
+#else /* PROCESS_CONF_NUM_PRIORITIES > 1 */
+  snum = (process_num_events_t)(fevent + nevents) % PROCESS_CONF_NUMEVENTS;
+#endif /* PROCESS_CONF_NUM_PRIORITIES > 1 */
+  events[snum].ev = ev;
+  events[snum].data = data;
+  events[snum].p = p;
+  ++nevents;
+}
+/*---------------------------------------------------------------------------*/
+/* Removes the first event of the highest non-empty priority level.
+   Returns 0 if the queue is empty. */
+static int
+queue_get(struct event_data *e)
+{
+#if PROCESS_CONF_NUM_PRIORITIES > 1
+  process_num_events_t snum;
+  uint8_t prio;
+
+  for(prio = 0; prio < PROCESS_CONF_NUM_PRIORITIES; prio++) {
+    snum = queue_head[prio];
+    if(snum != EVENT_NONE) {
+      *e = events[snum];
+      queue_head[prio] = events[snum].next;
+      if(queue_head[prio] == EVENT_NONE) {
+        queue_tail[prio] = EVENT_NONE;
+      }
+      events[snum].next = free_events;
+      free_events = snum;
+      --nevents;
+      return 1;
+    }
+  }
+  return 0;
+#else /* PROCESS_CONF_NUM_PRIORITIES > 1 */
+  if(nevents == 0) {
+    return 0;
+  }
+  *e = events[fevent];
+
+  /* Since we have seen the new event, we move pointer upwards
+     and decrease the number of events. */
+  fevent = (fevent + 1) % PROCESS_CONF_NUMEVENTS;
+  --nevents;
+  return 1;
+#endif /* PROCESS_CONF_NUM_PRIORITIES > 1 */
+}
 /*---------------------------------------------------------------------------*/
 process_event_t
 process_alloc_event(void)
@@ -209,9 +342,9 @@ process_init(void)
 {
   lastevent = PROCESS_EVENT_MAX;
 
-  nevents = fevent = 0;
+  queue_init();
 #if PROCESS_CONF_STATS
-  process_maxevents = 0;
+  process_stats_reset();
 #endif /* PROCESS_CONF_STATS */
 
   process_current = process_list = NULL;
@@ -249,6 +382,7 @@ do_event(void)
   process_data_t data;
   struct process *receiver;
   struct process *p;
+  struct event_data e;
 
   /*
    * If there are any events in the queue, take the first one and walk
@@ -258,18 +392,12 @@ do_event(void)
    * call the poll handlers inbetween.
    */
 
-  if(nevents > 0) {
+  if(queue_get(&e)) {
 
     /* There are events that we should deliver. */
-    ev = events[fevent].ev;
-
-    data = events[fevent].data;
-    receiver = events[fevent].p;
-
-    /* Since we have seen the new event, we move pointer upwards
-       and decrease the number of events. */
-    fevent = (fevent + 1) % PROCESS_CONF_NUMEVENTS;
-    --nevents;
+    ev = e.ev;
+    data = e.data;
+    receiver = e.p;
 
     /* If this is a broadcast event, we deliver it to all events, in
        order of their priority. */
@@ -321,8 +449,13 @@ process_nevents(void)
 int
 process_post(struct process *p, process_event_t ev, process_data_t data)
 {
-  process_num_events_t snum;
-
+  return process_post_prio(p, ev, data, PROCESS_EVENT_PRIORITY(p, ev));
+}
+/*---------------------------------------------------------------------------*/
+int
+process_post_prio(struct process *p, process_event_t ev, process_data_t data,
+                  uint8_t prio)
+{
   if(PROCESS_CURRENT() == NULL) {
     PRINTF("process_post: NULL process posts event %d to process '%s', nevents %d\n",
 	   ev,PROCESS_NAME_STRING(p), nevents);
@@ -332,6 +465,24 @@ process_post(struct process *p, process_event_t ev, process_data_t data)
 	   p == PROCESS_BROADCAST? "<broadcast>": PROCESS_NAME_STRING(p), nevents);
   }
 
+  if(prio >= PROCESS_CONF_NUM_PRIORITIES) {
+    prio = PROCESS_PRIO_LOW;
+  }
+
+#if PROCESS_CONF_STATS
+  posted_events++;
+#endif /* PROCESS_CONF_STATS */
+
+#if PROCESS_CONF_COALESCE_EVENTS
+  if(queue_contains(p, ev, data, prio)) {
+    /* The receiver will see this very event anyway */
+#if PROCESS_CONF_STATS
+    coalesced_events++;
+#endif /* PROCESS_CONF_STATS */
+    return PROCESS_ERR_OK;
+  }
+#endif /* PROCESS_CONF_COALESCE_EVENTS */
+
   if(nevents == PROCESS_CONF_NUMEVENTS) {
 #if DEBUG
     if(p == PROCESS_BROADCAST) {
@@ -340,14 +491,13 @@ process_post(struct process *p, process_event_t ev, process_data_t data)
       printf("soft panic: event queue is full when event %d was posted to %s from %s\n", ev, PROCESS_NAME_STRING(p), PROCESS_NAME_STRING(process_current));
     }
 #endif /* DEBUG */
+#if PROCESS_CONF_STATS
+    dropped_events++;
+#endif /* PROCESS_CONF_STATS */
     return PROCESS_ERR_FULL;
   }
 
-  snum = (process_num_events_t)(fevent + nevents) % PROCESS_CONF_NUMEVENTS;
-  events[snum].ev = ev;
-  events[snum].data = data;
-  events[snum].p = p;
-  ++nevents;
+  queue_put(p, ev, data, prio);
 
 #if PROCESS_CONF_STATS
   if(nevents > process_maxevents) {
@@ -385,4 +535,25 @@ process_is_running(struct process *p)
   return p->state != PROCESS_STATE_NONE;
 }
 /*---------------------------------------------------------------------------*/
+#if PROCESS_CONF_STATS
+void
+process_stats_get(struct process_stats *stats)
+{
+  stats->nevents = nevents;
+  stats->maxevents = process_maxevents;
+  stats->posted = posted_events;
+  stats->coalesced = coalesced_events;
+  stats->dropped = dropped_events;
+}
+/*---------------------------------------------------------------------------*/
+void
+process_stats_reset(void)
+{
+  process_maxevents = nevents;
+  posted_events = 0;
+  coalesced_events = 0;
+  dropped_events = 0;
+}
+#endif /* PROCESS_CONF_STATS */
+/*---------------------------------------------------------------------------*/
 /** @} */
@@ -88,6 +88,54 @@ typedef unsigned char process_num_events_t;
 #define PROCESS_CONF_NUMEVENTS 32
 #endif /* PROCESS_CONF_NUMEVENTS */
 
+/**
+ * \name Event priorities
+ * @{
+ */
+
+/**
+ * \brief      Number of event priority levels.
+ *
+ *             With more than one level, the event queue holds one FIFO
+ *             per level, all sharing the PROCESS_CONF_NUMEVENTS entries,
+ *             and events of a higher priority level are always
+ *             delivered first. Level 0 is the highest priority.
+ */
+#ifndef PROCESS_CONF_NUM_PRIORITIES
+#define PROCESS_CONF_NUM_PRIORITIES 1
+#endif /* PROCESS_CONF_NUM_PRIORITIES */
+
+#define PROCESS_PRIO_HIGH   0
+#define PROCESS_PRIO_NORMAL (PROCESS_CONF_NUM_PRIORITIES > 1 ? 1 : 0)
+#define PROCESS_PRIO_LOW    (PROCESS_CONF_NUM_PRIORITIES - 1)
+
+/**
+ * \brief      Priority of an event posted with process_post().
+ *
+ *             By default, timer events (and with them ctimer callbacks)
+ *             are delivered ahead of all other events.
+ */
+#ifdef PROCESS_CONF_EVENT_PRIORITY
+#define PROCESS_EVENT_PRIORITY(p, ev) PROCESS_CONF_EVENT_PRIORITY(p, ev)
+#else /* PROCESS_CONF_EVENT_PRIORITY */
+#define PROCESS_EVENT_PRIORITY(p, ev) \
+  ((ev) == PROCESS_EVENT_TIMER ? PROCESS_PRIO_HIGH : PROCESS_PRIO_NORMAL)
+#endif /* PROCESS_CONF_EVENT_PRIORITY */
+
+/**
+ * \brief      Coalesce duplicate events.
+ *
+ *             When enabled, posting an event that is identical (same
+ *             process, event and data) to an event already waiting in
+ *             the queue at the same priority succeeds without queuing
+ *             a second copy. This costs a scan of the queue on every
+ *             post.
+ */
+#ifndef PROCESS_CONF_COALESCE_EVENTS
+#define PROCESS_CONF_COALESCE_EVENTS 0
+#endif /* PROCESS_CONF_COALESCE_EVENTS */
+/* @} */
+
 #define PROCESS_EVENT_NONE            0x80
 #define PROCESS_EVENT_INIT            0x81
 #define PROCESS_EVENT_POLL            0x82
@@ -364,6 +412,32 @@ void process_start(struct process *p, process_data_t data);
  */
 int process_post(struct process *p, process_event_t ev, process_data_t data);
 
+/**
+ * Post an asynchronous event with a given priority.
+ *
+ * This function works as process_post(), but puts the event on the
+ * queue of the given priority level instead of the level returned by
+ * PROCESS_EVENT_PRIORITY(). Without priority levels, this is the same
+ * as process_post().
+ *
+ * \param p The process to which the event should be posted, or
+ * PROCESS_BROADCAST if the event should be posted to all processes.
+ *
+ * \param ev The event to be posted.
+ *
+ * \param data The auxiliary data to be sent with the event
+ *
+ * \param prio The priority level, from PROCESS_PRIO_HIGH to
+ * PROCESS_PRIO_LOW.
+ *
+ * \retval PROCESS_ERR_OK The event could be posted.
+ *
+ * \retval PROCESS_ERR_FULL The event queue was full and the event could
+ * not be posted.
+ */
+int process_post_prio(struct process *p, process_event_t ev,
+                      process_data_t data, uint8_t prio);
+
 /**
  * Post a synchronous event to a process.
  *
@@ -519,6 +593,37 @@ int process_is_running(struct process *p);
  */
 int process_nevents(void);
 
+#if PROCESS_CONF_STATS
+/**
+ * Event queue statistics, collected when PROCESS_CONF_STATS is set.
+ */
+struct process_stats {
+  /** Number of events currently in the queue */
+  process_num_events_t nevents;
+  /** Highest number of events that were in the queue at once */
+  process_num_events_t maxevents;
+  /** Number of events posted */
+  uint32_t posted;
+  /** Number of events that were coalesced with a queued one */
+  uint32_t coalesced;
+  /** Number of events dropped because the queue was full */
+  uint32_t dropped;
+};
+
+/**
+ * Get the event queue statistics.
+ *
+ * \param stats Filled in with the current statistics.
+ */
+void process_stats_get(struct process_stats *stats);
+
+/**
+ * Reset the event queue statistics. The high-water mark restarts
+ * from the current queue depth.
+ */
+void process_stats_reset(void);
+#endif /* PROCESS_CONF_STATS */
+
 /** @} */
 
 extern struct process *process_list;
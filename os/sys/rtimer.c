@@ -54,6 +54,11 @@
 #define PRINTF(...)
 #endif
 
+#if RTIMER_MULTIPLE
+#include "sys/critical.h"
+#endif /* RTIMER_MULTIPLE */
+
+/* With RTIMER_MULTIPLE, the head of the queue of pending tasks */
 static struct rtimer *next_rtimer;
 
 /*---------------------------------------------------------------------------*/
@@ -63,6 +68,112 @@ rtimer_init(void)
   rtimer_arch_init();
 }
 /*---------------------------------------------------------------------------*/
+#if RTIMER_MULTIPLE
+/* Removes a task from the queue, returns non-zero if it was queued.
+   Must be called with interrupts disabled. */
+static int
+queue_remove(struct rtimer *rtimer)
+{
+  struct rtimer **p;
+
+  for(p = &next_rtimer; *p != NULL; p = &(*p)->next) {
+    if(*p == rtimer) {
+      *p = rtimer->next;
+      rtimer->next = NULL;
+      return 1;
+    }
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+/* Inserts a task after all tasks due no later than it.
+   Must be called with interrupts disabled. */
+static void
+queue_insert(struct rtimer *rtimer)
+{
+  struct rtimer **p;
+
+  for(p = &next_rtimer; *p != NULL; p = &(*p)->next) {
+    if(RTIMER_CLOCK_LT(rtimer->time, (*p)->time)) {
+      break;
+    }
+  }
+  rtimer->next = *p;
+  *p = rtimer;
+}
+/*---------------------------------------------------------------------------*/
+int
+rtimer_set(struct rtimer *rtimer, rtimer_clock_t time,
+	   rtimer_clock_t duration,
+	   rtimer_callback_t func, void *ptr)
+{
+  int_master_status_t status;
+  struct rtimer *head;
+  rtimer_clock_t head_time;
+
+  PRINTF("rtimer_set time %d\n", time);
+
+  status = critical_enter();
+  head = next_rtimer;
+  head_time = head != NULL ? head->time : 0;
+  queue_remove(rtimer);
+  rtimer->func = func;
+  rtimer->ptr = ptr;
+  rtimer->time = time;
+  queue_insert(rtimer);
+  /* The head may also be the same task set again to another time */
+  if(next_rtimer != head || next_rtimer->time != head_time) {
+    rtimer_arch_schedule(next_rtimer->time);
+  }
+  critical_exit(status);
+
+  return RTIMER_OK;
+}
+/*---------------------------------------------------------------------------*/
+int
+rtimer_cancel(struct rtimer *rtimer)
+{
+  int_master_status_t status;
+  struct rtimer *head;
+  int removed;
+
+  status = critical_enter();
+  head = next_rtimer;
+  removed = queue_remove(rtimer);
+  if(next_rtimer != head && next_rtimer != NULL) {
+    rtimer_arch_schedule(next_rtimer->time);
+  }
+  /* When the queue becomes empty, the hardware timer is left running and
+     rtimer_run_next() will find nothing to do */
+  critical_exit(status);
+
+  return removed;
+}
+/*---------------------------------------------------------------------------*/
+void
+rtimer_run_next(void)
+{
+  int_master_status_t status;
+  struct rtimer *t;
+
+  status = critical_enter();
+  /* Run all tasks that are due, in order. The hardware timer may fire
+     late, and tasks may share the same time */
+  while(next_rtimer != NULL &&
+        !RTIMER_CLOCK_LT(RTIMER_NOW(), next_rtimer->time)) {
+    t = next_rtimer;
+    next_rtimer = t->next;
+    t->next = NULL;
+    t->func(t, t->ptr);
+  }
+  if(next_rtimer != NULL) {
+    rtimer_arch_schedule(next_rtimer->time);
+  }
+  critical_exit(status);
+}
+/*---------------------------------------------------------------------------*/
+#else /* RTIMER_MULTIPLE */
+/*---------------------------------------------------------------------------*/
 int
 rtimer_set(struct rtimer *rtimer, rtimer_clock_t time,
 	   rtimer_clock_t duration,
@@ -104,5 +215,19 @@ rtimer_run_next(void)
   return;
 }
 /*---------------------------------------------------------------------------*/
+int
+rtimer_cancel(struct rtimer *rtimer)
+{
+  if(next_rtimer != rtimer) {
+    return 0;
+  }
+  /* The hardware timer is left running, rtimer_run_next() will find
+     nothing to do */
+  next_rtimer = NULL;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+#endif /* RTIMER_MULTIPLE */
+/*---------------------------------------------------------------------------*/
 
 /** @}*/
@@ -64,6 +64,24 @@ typedef unsigned short rtimer_clock_t;
 
 #include "rtimer-arch.h"
 
+/**
+ * \brief      Allow several real-time tasks to be pending at once.
+ *
+ *             By default, only one real-time task can be pending and
+ *             scheduling a task replaces any task already pending.
+ *             With this option, pending tasks are kept in a queue
+ *             sorted by time, and the hardware timer is always set for
+ *             the head of the queue. Tasks scheduled for the same time
+ *             run in the order they were scheduled. The queue is
+ *             protected by disabling the master interrupt, which
+ *             requires the platform to provide int-master.
+ */
+#ifdef RTIMER_CONF_MULTIPLE
+#define RTIMER_MULTIPLE RTIMER_CONF_MULTIPLE
+#else /* RTIMER_CONF_MULTIPLE */
+#define RTIMER_MULTIPLE 0
+#endif /* RTIMER_CONF_MULTIPLE */
+
 /**
  * \brief      Initialize the real-time scheduler.
  *
@@ -87,6 +105,9 @@ struct rtimer {
   rtimer_clock_t time;
   rtimer_callback_t func;
   void *ptr;
+#if RTIMER_MULTIPLE
+  struct rtimer *next;
+#endif /* RTIMER_MULTIPLE */
 };
 
 enum {
@@ -107,12 +128,21 @@ enum {
  *             (false) if the task could not be scheduled.
  *
  *             This function schedules a real-time task at a specified
- *             time in the future.
+ *             time in the future. With RTIMER_CONF_MULTIPLE, a task
+ *             that is already pending is moved to the new time.
  *
  */
 int rtimer_set(struct rtimer *task, rtimer_clock_t time,
 	       rtimer_clock_t duration, rtimer_callback_t func, void *ptr);
 
+/**
+ * \brief      Cancel a pending real-time task.
+ * \param task The task
+ * \return     Non-zero (true) if the task was pending and has been
+ *             cancelled, zero (false) otherwise.
+ */
+int rtimer_cancel(struct rtimer *task);
+
 /**
  * \brief      Execute the next real-time task and schedule the next task, if any
  *
@@ -0,0 +1,304 @@
+/*
+ * Copyright (c) 2018, RISE SICS.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * \file
+ *         Compares the Internet checksum backends with the reference
+ *         implementation on random buffers, checks incremental checksum
+ *         updates, and checks the checksum of echo replies.
+ */
+
+#include "contiki.h"
+#include "net/ipv6/uip.h"
+#include "net/ipv6/uip-chksum.h"
+#include "net/ipv6/uip-ds6.h"
+#include "net/ipv6/uip-icmp6.h"
+#include "lib/random.h"
+#include "services/unit-test/unit-test.h"
+
+#include <stdio.h>
+#include <string.h>
+/*---------------------------------------------------------------------------*/
+PROCESS(chksum_test_process, "Checksum test");
+AUTOSTART_PROCESSES(&chksum_test_process);
+/*---------------------------------------------------------------------------*/
+#define NUM_ROUNDS      2000
+#define MAX_LEN         1500
+/* Offset of the checksum field in the test buffers */
+#define CHKSUM_OFFSET   2
+
+#define UIP_IP_BUF      ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
+#define UIP_ICMP_BUF    ((struct uip_icmp_hdr *)&uip_buf[uip_l2_l3_hdr_len])
+/*---------------------------------------------------------------------------*/
+typedef uint16_t (*backend_t)(uint16_t sum, const uint8_t *data, uint16_t len);
+
+static const backend_t backends[] = {
+  uip_chksum_acc32,
+  uip_chksum_acc64,
+#ifdef __SSE2__
+  uip_chksum_sse2,
+#endif /* __SSE2__ */
+#ifdef __ARM_NEON
+  uip_chksum_neon,
+#endif /* __ARM_NEON */
+  UIP_CHKSUM_BACKEND,
+};
+
+#define NUM_BACKENDS    (sizeof(backends) / sizeof(backends[0]))
+
+/* Room for unaligned buffers */
+static uint8_t buf[MAX_LEN + 8];
+static uint8_t old_data[MAX_LEN];
+/*---------------------------------------------------------------------------*/
+void
+print_test_report(const unit_test_t *utp)
+{
+  printf("=check-me= ");
+  if(utp->result == unit_test_failure) {
+    printf("FAILED   - %s: exit at L%u\n", utp->descr, utp->exit_line);
+  } else {
+    printf("SUCCEEDED - %s\n", utp->descr);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+fill_random(uint8_t *data, uint16_t len)
+{
+  while(len-- > 0) {
+    *data++ = random_rand();
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Store the checksum of data in its checksum field */
+static void
+set_chksum(uint8_t *data, uint16_t len)
+{
+  uint16_t chksum;
+
+  memset(data + CHKSUM_OFFSET, 0, 2);
+  chksum = uip_htons(~uip_chksum_bytes(0, data, len));
+  memcpy(data + CHKSUM_OFFSET, &chksum, 2);
+}
+/*---------------------------------------------------------------------------*/
+static int
+chksum_valid(const uint8_t *data, uint16_t len)
+{
+  return uip_chksum_bytes(0, data, len) == 0xffff;
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(test_backends, "Backends match the reference");
+UNIT_TEST(test_backends)
+{
+  int round;
+  unsigned i;
+  uint16_t len;
+  uint16_t offset;
+  uint16_t sum;
+  uint16_t expected;
+
+  UNIT_TEST_BEGIN();
+
+  for(round = 0; round < NUM_ROUNDS; round++) {
+    /* Short buffers exercise the tails of the backends */
+    len = random_rand() % (round % 2 ? 64 : MAX_LEN + 1);
+    offset = random_rand() % 8;
+    sum = random_rand();
+    /* Buffers of ones make the accumulators carry the most */
+    if(round % 16 == 0) {
+      memset(buf + offset, 0xff, len);
+    } else {
+      fill_random(buf + offset, len);
+    }
+    expected = uip_chksum_bytes(sum, buf + offset, len);
+    for(i = 0; i < NUM_BACKENDS; i++) {
+      UNIT_TEST_ASSERT(backends[i](sum, buf + offset, len) == expected);
+    }
+  }
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(test_update, "Incremental updates");
+UNIT_TEST(test_update)
+{
+  int round;
+  uint16_t len;
+  uint16_t offset;
+  uint16_t part_len;
+  uint16_t chksum;
+
+  UNIT_TEST_BEGIN();
+
+  for(round = 0; round < NUM_ROUNDS; round++) {
+    len = 8 + random_rand() % (MAX_LEN - 7);
+    fill_random(buf, len);
+    set_chksum(buf, len);
+    UNIT_TEST_ASSERT(chksum_valid(buf, len));
+
+    /* Change a part after the checksum field, at an even offset */
+    offset = 4 + 2 * (random_rand() % ((len - 4) / 2));
+    part_len = 1 + random_rand() % (len - offset);
+    memcpy(old_data, buf + offset, part_len);
+    if(round % 4 == 0) {
+      /* Unchanged data must keep the checksum valid */
+    } else if(round % 4 == 1) {
+      memset(buf + offset, 0, part_len);
+    } else {
+      fill_random(buf + offset, part_len);
+    }
+    memcpy(&chksum, buf + CHKSUM_OFFSET, 2);
+    chksum = uip_chksum_update(chksum, old_data, buf + offset, part_len);
+    memcpy(buf + CHKSUM_OFFSET, &chksum, 2);
+    UNIT_TEST_ASSERT(chksum_valid(buf, len));
+  }
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(test_update16, "Incremental updates of words");
+UNIT_TEST(test_update16)
+{
+  int round;
+  uint16_t len;
+  uint16_t offset;
+  uint16_t old_word;
+  uint16_t new_word;
+  uint16_t chksum;
+
+  UNIT_TEST_BEGIN();
+
+  for(round = 0; round < NUM_ROUNDS; round++) {
+    len = 8 + 2 * (random_rand() % 64);
+    fill_random(buf, len);
+    set_chksum(buf, len);
+
+    offset = 4 + 2 * (random_rand() % ((len - 4) / 2));
+    memcpy(&old_word, buf + offset, 2);
+    new_word = round % 8 == 0 ? 0 : random_rand();
+    memcpy(buf + offset, &new_word, 2);
+    memcpy(&chksum, buf + CHKSUM_OFFSET, 2);
+    chksum = uip_chksum_update16(chksum, old_word, new_word);
+    memcpy(buf + CHKSUM_OFFSET, &chksum, 2);
+    UNIT_TEST_ASSERT(chksum_valid(buf, len));
+  }
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+/* Process an echo request to dest in uip_buf, with an optional
+   hop-by-hop header. Returns 1 if a valid echo reply is sent. */
+static int
+echo(const uip_ipaddr_t *dest, int hbh, uint16_t payload_len)
+{
+  uint8_t *ptr;
+  uip_ipaddr_t src;
+  uint16_t ext_len;
+
+  uip_ip6addr(&src, 0xfe80, 0, 0, 0, 0x0212, 0x7401, 0x0001, 0x0101);
+  ext_len = hbh ? 8 : 0;
+
+  memset(UIP_IP_BUF, 0, UIP_IPH_LEN);
+  UIP_IP_BUF->vtc = 0x60;
+  UIP_IP_BUF->proto = hbh ? UIP_PROTO_HBHO : UIP_PROTO_ICMP6;
+  UIP_IP_BUF->ttl = 64;
+  uip_ipaddr_copy(&UIP_IP_BUF->srcipaddr, &src);
+  uip_ipaddr_copy(&UIP_IP_BUF->destipaddr, dest);
+  uip_len = UIP_IPH_LEN + ext_len + UIP_ICMPH_LEN + payload_len;
+  UIP_IP_BUF->len[0] = (uip_len - UIP_IPH_LEN) >> 8;
+  UIP_IP_BUF->len[1] = (uip_len - UIP_IPH_LEN) & 0xff;
+
+  ptr = &uip_buf[UIP_LLH_LEN + UIP_IPH_LEN];
+  if(hbh) {
+    /* Next header, length, and a PadN option of 4 bytes */
+    memset(ptr, 0, 8);
+    ptr[0] = UIP_PROTO_ICMP6;
+    ptr[2] = 1;
+    ptr[3] = 4;
+    ptr += 8;
+  }
+  memset(ptr, 0, UIP_ICMPH_LEN);
+  ptr[0] = ICMP6_ECHO_REQUEST;
+  fill_random(ptr + UIP_ICMPH_LEN, payload_len);
+
+  /* uip_icmp6chksum() covers the ICMP message after the extension headers */
+  uip_ext_len = ext_len;
+  UIP_ICMP_BUF->icmpchksum = ~uip_icmp6chksum();
+  uip_ext_len = 0;
+
+  uip_input();
+
+  return uip_len == UIP_IPH_LEN + UIP_ICMPH_LEN + payload_len &&
+         UIP_IP_BUF->proto == UIP_PROTO_ICMP6 &&
+         UIP_ICMP_BUF->type == ICMP6_ECHO_REPLY &&
+         uip_ipaddr_cmp(&UIP_IP_BUF->destipaddr, &src) &&
+         uip_icmp6chksum() == 0xffff;
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(test_echo, "Echo replies");
+UNIT_TEST(test_echo)
+{
+  uip_ds6_addr_t *lladdr;
+  uip_ipaddr_t mcast;
+  int round;
+
+  UNIT_TEST_BEGIN();
+
+  lladdr = uip_ds6_get_link_local(-1);
+  UNIT_TEST_ASSERT(lladdr != NULL);
+  uip_create_linklocal_allnodes_mcast(&mcast);
+
+  for(round = 0; round < 100; round++) {
+    UNIT_TEST_ASSERT(echo(&lladdr->ipaddr, round % 2, random_rand() % 1024));
+    UNIT_TEST_ASSERT(echo(&mcast, round % 2, random_rand() % 1024));
+  }
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(chksum_test_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+  printf("Run unit-test\n");
+  printf("---\n");
+
+  random_init(0xc5c5);
+
+  UNIT_TEST_RUN(test_backends);
+  UNIT_TEST_RUN(test_update);
+  UNIT_TEST_RUN(test_update16);
+  UNIT_TEST_RUN(test_echo);
+
+  printf("=check-me= DONE\n");
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
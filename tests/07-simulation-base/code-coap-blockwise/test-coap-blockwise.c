@@ -0,0 +1,404 @@
+/*
+ * Copyright (c) 2018, RISE SICS.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Checks streaming block-wise transfers between the CoAP client and
+ *         a server resource of the same node: a Block2 download keeps
+ *         COAP_BLOCKWISE_WINDOW requests in flight, takes the block size
+ *         of the server, and gets its responses out of order; a Block1
+ *         upload sends one block per round-trip.
+ */
+
+#include "contiki.h"
+#include "coap-engine.h"
+#include "coap-block1.h"
+#include "coap-blockwise.h"
+#include "net/ipv6/uip.h"
+#include "net/netstack.h"
+#include "services/unit-test/unit-test.h"
+
+#include <stdio.h>
+#include <string.h>
+/*---------------------------------------------------------------------------*/
+/* Not a multiple of the block size, which the server makes smaller */
+#define BODY_LEN        700
+#define REQUEST_SIZE    128
+#define BLOCK_SIZE      COAP_MAX_BLOCK_SIZE
+#define BLOCKS          ((BODY_LEN + BLOCK_SIZE - 1) / BLOCK_SIZE)
+#define QUEUE_LEN       16
+/*---------------------------------------------------------------------------*/
+PROCESS(coap_blockwise_test_process, "CoAP block-wise test");
+PROCESS(link_process, "Link");
+AUTOSTART_PROCESSES(&link_process, &coap_blockwise_test_process);
+/*---------------------------------------------------------------------------*/
+static void res_get_handler(coap_message_t *request, coap_message_t *response,
+                            uint8_t *buffer, uint16_t preferred_size,
+                            int32_t *offset);
+static void res_put_handler(coap_message_t *request, coap_message_t *response,
+                            uint8_t *buffer, uint16_t preferred_size,
+                            int32_t *offset);
+
+RESOURCE(res_file, "", res_get_handler, NULL, res_put_handler, NULL);
+
+/* Messages on the link */
+static struct {
+  uint16_t len;
+  uint8_t data[COAP_MAX_PACKET_SIZE];
+} queue[QUEUE_LEN];
+static int queue_count;
+
+/* Requests sent and responses received by the client */
+static unsigned requests;
+static unsigned responses;
+static unsigned max_outstanding;
+static unsigned requests_before_first_response;
+
+/* Blocks of the download, in the order in which they arrived */
+static uint8_t block_count[BLOCKS];
+static unsigned block_errors;
+static unsigned out_of_order;
+static uint32_t last_offset;
+
+static uint32_t uploaded;
+static unsigned upload_errors;
+
+static coap_blockwise_transfer_t transfer;
+static coap_blockwise_status_t result;
+static int done;
+
+static coap_blockwise_status_t download_result;
+static coap_blockwise_stats_t download_stats;
+static uint16_t download_size;
+static coap_blockwise_status_t upload_result;
+static coap_blockwise_stats_t upload_stats;
+/*---------------------------------------------------------------------------*/
+void
+print_test_report(const unit_test_t *utp)
+{
+  printf("=check-me= ");
+  if(utp->result == unit_test_failure) {
+    printf("FAILED   - %s: exit at L%u\n", utp->descr, utp->exit_line);
+  } else {
+    printf("SUCCEEDED - %s\n", utp->descr);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t
+body(uint32_t offset)
+{
+  return (offset * 31 + (offset >> 8)) & 0xff;
+}
+/*---------------------------------------------------------------------------*/
+static int
+check_body(uint32_t offset, const uint8_t *data, uint16_t len)
+{
+  uint16_t i;
+
+  for(i = 0; i < len; i++) {
+    if(data[i] != body(offset + i)) {
+      return 0;
+    }
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/* Blockwise-aware resource, without Size2 */
+static void
+res_get_handler(coap_message_t *request, coap_message_t *response,
+                uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
+{
+  uint16_t len;
+  uint16_t i;
+
+  if(*offset >= BODY_LEN) {
+    coap_set_status_code(response, BAD_OPTION_4_02);
+    coap_set_payload(response, "BlockOutOfScope", 15);
+    return;
+  }
+  len = MIN(preferred_size, BODY_LEN - *offset);
+  for(i = 0; i < len; i++) {
+    buffer[i] = body(*offset + i);
+  }
+  coap_set_payload(response, buffer, len);
+  *offset += len;
+  if(*offset >= BODY_LEN) {
+    *offset = -1;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+res_put_handler(coap_message_t *request, coap_message_t *response,
+                uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
+{
+  const uint8_t *payload;
+  int len = coap_get_payload(request, &payload);
+  int more;
+
+  more = coap_block1_handler(request, response, NULL, NULL, BODY_LEN);
+  if(more < 0) {
+    return;
+  }
+  if(request->block1_offset != uploaded
+     || !check_body(request->block1_offset, payload, len)) {
+    upload_errors++;
+  }
+  uploaded += len;
+  if(more == 0) {
+    coap_set_status_code(response, CHANGED_2_04);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+init(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+static void
+input(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t
+output(const linkaddr_t *localdest)
+{
+  uint8_t *data = &uip_buf[UIP_LLH_LEN + UIP_IPUDPH_LEN];
+
+  if(uip_len == 0 || queue_count == QUEUE_LEN) {
+    return 0;
+  }
+  if((data[1] >> 5) == 0) {
+    /* a request of the client */
+    requests++;
+    if(requests - responses > max_outstanding) {
+      max_outstanding = requests - responses;
+    }
+  }
+  queue[queue_count].len = uip_len - UIP_IPUDPH_LEN;
+  memcpy(queue[queue_count].data, data, queue[queue_count].len);
+  queue_count++;
+  process_poll(&link_process);
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+const struct network_driver test_net_driver = {
+  "test",
+  init,
+  input,
+  output
+};
+/*---------------------------------------------------------------------------*/
+static void
+deliver(int i)
+{
+  static coap_endpoint_t src;
+  static uint8_t buf[COAP_MAX_PACKET_SIZE];
+  uint16_t len = queue[i].len;
+
+  memset(&src, 0, sizeof(src));
+  uip_create_linklocal_allnodes_mcast(&src.ipaddr);
+  src.port = UIP_HTONS(COAP_DEFAULT_PORT);
+
+  memcpy(buf, queue[i].data, len);
+  if((buf[1] >> 5) != 0) {
+    if(responses++ == 0) {
+      requests_before_first_response = requests;
+    }
+  }
+  coap_receive(&src, buf, len);
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Deliver the messages on the link in rounds: the requests in the order
+ * in which they were sent, then the responses in the reverse order.
+ */
+PROCESS_THREAD(link_process, ev, data)
+{
+  static int count;
+  static int i;
+
+  PROCESS_BEGIN();
+
+  while(1) {
+    PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL);
+    while(queue_count > 0) {
+      count = queue_count;
+      for(i = 0; i < count; i++) {
+        if((queue[i].data[1] >> 5) == 0) {
+          deliver(i);
+        }
+      }
+      for(i = count - 1; i >= 0; i--) {
+        if((queue[i].data[1] >> 5) != 0) {
+          deliver(i);
+        }
+      }
+      /* keep what was sent meanwhile */
+      memmove(&queue[0], &queue[count], (queue_count - count) * sizeof(queue[0]));
+      queue_count -= count;
+    }
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+static int
+block_callback(coap_blockwise_transfer_t *transfer, uint32_t offset,
+               const uint8_t *data, uint16_t len)
+{
+  uint32_t num = offset / BLOCK_SIZE;
+
+  if(offset % BLOCK_SIZE != 0 || num >= BLOCKS
+     || len != MIN(BLOCK_SIZE, BODY_LEN - offset)
+     || !check_body(offset, data, len)) {
+    block_errors++;
+    return 0;
+  }
+  if(offset < last_offset) {
+    out_of_order++;
+  }
+  last_offset = offset;
+  block_count[num]++;
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+read_callback(coap_blockwise_transfer_t *transfer, uint32_t offset,
+              uint8_t *data, uint16_t len)
+{
+  uint16_t i;
+
+  for(i = 0; i < len; i++) {
+    data[i] = body(offset + i);
+  }
+  return len;
+}
+/*---------------------------------------------------------------------------*/
+static void
+done_callback(coap_blockwise_transfer_t *transfer,
+              coap_blockwise_status_t status)
+{
+  result = status;
+  done = 1;
+  process_poll(&coap_blockwise_test_process);
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(test_download, "Block2 download");
+UNIT_TEST(test_download)
+{
+  unsigned i;
+
+  UNIT_TEST_BEGIN();
+
+  UNIT_TEST_ASSERT(download_result == COAP_BLOCKWISE_DONE);
+  UNIT_TEST_ASSERT(download_size == BLOCK_SIZE);
+  UNIT_TEST_ASSERT(download_stats.bytes == BODY_LEN);
+  UNIT_TEST_ASSERT(download_stats.blocks == BLOCKS);
+
+  /* every block once, with its content, some out of order */
+  UNIT_TEST_ASSERT(block_errors == 0);
+  for(i = 0; i < BLOCKS; i++) {
+    UNIT_TEST_ASSERT(block_count[i] == 1);
+  }
+  UNIT_TEST_ASSERT(out_of_order > 0);
+
+  /* block 0 alone, then a full window */
+  UNIT_TEST_ASSERT(requests_before_first_response == 1);
+  UNIT_TEST_ASSERT(max_outstanding == COAP_BLOCKWISE_WINDOW);
+
+  /* beyond the end, at most the rest of a window */
+  UNIT_TEST_ASSERT(download_stats.requests >= BLOCKS);
+  UNIT_TEST_ASSERT(download_stats.requests < BLOCKS + COAP_BLOCKWISE_WINDOW);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(test_upload, "Block1 upload");
+UNIT_TEST(test_upload)
+{
+  UNIT_TEST_BEGIN();
+
+  UNIT_TEST_ASSERT(upload_result == COAP_BLOCKWISE_DONE);
+  UNIT_TEST_ASSERT(upload_errors == 0);
+  UNIT_TEST_ASSERT(uploaded == BODY_LEN);
+  UNIT_TEST_ASSERT(upload_stats.bytes == BODY_LEN);
+  UNIT_TEST_ASSERT(upload_stats.requests == upload_stats.blocks);
+  UNIT_TEST_ASSERT(max_outstanding == 1);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(coap_blockwise_test_process, ev, data)
+{
+  static coap_message_t request[1];
+  static coap_endpoint_t server;
+  static struct etimer et;
+
+  PROCESS_BEGIN();
+
+  printf("Run unit-test\n");
+  printf("---\n");
+
+  coap_engine_init();
+  coap_activate_resource(&res_file, "file");
+  memset(&server, 0, sizeof(server));
+  uip_create_linklocal_allnodes_mcast(&server.ipaddr);
+  server.port = UIP_HTONS(COAP_DEFAULT_PORT);
+  etimer_set(&et, CLOCK_SECOND * 2);
+
+  coap_init_message(request, COAP_TYPE_CON, COAP_GET, 0);
+  coap_set_header_uri_path(request, "file");
+  done = 0;
+  if(coap_blockwise_get(&transfer, &server, request, REQUEST_SIZE,
+                        block_callback, done_callback)) {
+    PROCESS_WAIT_EVENT_UNTIL(done || etimer_expired(&et));
+  }
+  download_result = done ? result : COAP_BLOCKWISE_TIMEOUT;
+  download_stats = transfer.stats;
+  download_size = transfer.size;
+  UNIT_TEST_RUN(test_download);
+
+  requests = responses = max_outstanding = 0;
+  coap_init_message(request, COAP_TYPE_CON, COAP_PUT, 0);
+  coap_set_header_uri_path(request, "file");
+  done = 0;
+  if(coap_blockwise_put(&transfer, &server, request, BODY_LEN, BLOCK_SIZE,
+                        read_callback, done_callback)) {
+    PROCESS_WAIT_EVENT_UNTIL(done || etimer_expired(&et));
+  }
+  upload_result = done ? result : COAP_BLOCKWISE_TIMEOUT;
+  upload_stats = transfer.stats;
+  UNIT_TEST_RUN(test_upload);
+
+  printf("=check-me= DONE\n");
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
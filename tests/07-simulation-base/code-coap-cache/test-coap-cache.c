@@ -0,0 +1,345 @@
+/*
+ * Copyright (c) 2018, RISE SICS.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * \file
+ *         Checks the CoAP response cache: a cached response is served
+ *         without calling the handler and validated with 2.03, POST, PUT,
+ *         DELETE and notifications drop it so that the new state is served,
+ *         Max-Age counts down, and an expired response is fetched again.
+ */
+
+#include "contiki.h"
+#include "coap-engine.h"
+#include "coap-observe.h"
+#include "coap-cache.h"
+#include "net/ipv6/uip.h"
+#include "net/netstack.h"
+#include "services/unit-test/unit-test.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+/*---------------------------------------------------------------------------*/
+#define PORT    20001
+#define MAX_AGE 2
+/*---------------------------------------------------------------------------*/
+PROCESS(coap_cache_test_process, "CoAP cache test");
+AUTOSTART_PROCESSES(&coap_cache_test_process);
+/*---------------------------------------------------------------------------*/
+static void res_get_handler(coap_message_t *request, coap_message_t *response,
+                            uint8_t *buffer, uint16_t preferred_size,
+                            int32_t *offset);
+static void res_set_handler(coap_message_t *request, coap_message_t *response,
+                            uint8_t *buffer, uint16_t preferred_size,
+                            int32_t *offset);
+
+RESOURCE(res_data, "title=\"Data\"", res_get_handler, res_set_handler,
+         res_set_handler, res_set_handler);
+
+static unsigned value;
+static unsigned get_calls;
+static uint16_t mid;
+
+/* The last response that reached the network driver */
+typedef struct {
+  unsigned packets;
+  coap_status_t code;
+  uint8_t has_max_age;
+  uint32_t max_age;
+  uint8_t etag_len;
+  uint8_t etag[COAP_ETAG_LEN];
+  uint16_t payload_len;
+  unsigned value;
+  unsigned get_calls;
+} response_t;
+
+static response_t sent;
+
+/* What the test process saw at each step */
+static response_t miss, hit, valid;
+static response_t put, after_put, valid_after_put;
+static response_t after_post, after_delete, after_notify;
+static response_t counting_down, expired;
+static coap_cache_stats_t stats;
+/*---------------------------------------------------------------------------*/
+void
+print_test_report(const unit_test_t *utp)
+{
+  printf("=check-me= ");
+  if(utp->result == unit_test_failure) {
+    printf("FAILED   - %s: exit at L%u\n", utp->descr, utp->exit_line);
+  } else {
+    printf("SUCCEEDED - %s\n", utp->descr);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+res_get_handler(coap_message_t *request, coap_message_t *response,
+                uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
+{
+  get_calls++;
+  coap_set_header_content_format(response, TEXT_PLAIN);
+  coap_set_header_max_age(response, MAX_AGE);
+  coap_set_payload(response, buffer,
+                   snprintf((char *)buffer, preferred_size, "%u", value));
+}
+/*---------------------------------------------------------------------------*/
+/* POST and PUT set the value from the payload, DELETE resets it */
+static void
+res_set_handler(coap_message_t *request, coap_message_t *response,
+                uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
+{
+  const uint8_t *payload;
+  char text[8];
+  int len;
+
+  len = coap_get_payload(request, &payload);
+  if(len >= sizeof(text)) {
+    coap_set_status_code(response, BAD_REQUEST_4_00);
+    return;
+  }
+  memcpy(text, payload, len);
+  text[len] = '\0';
+  value = strtoul(text, NULL, 10);
+  coap_set_status_code(response,
+                       request->code == COAP_DELETE ? DELETED_2_02 : CHANGED_2_04);
+}
+/*---------------------------------------------------------------------------*/
+static void
+init(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+static void
+input(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t
+output(const linkaddr_t *localdest)
+{
+  static coap_message_t message[1];
+  char payload[8];
+
+  if(uip_len > 0
+     && coap_parse_message(message, &uip_buf[UIP_LLH_LEN + UIP_IPUDPH_LEN],
+                           uip_len - UIP_IPUDPH_LEN) == NO_ERROR
+     && message->payload_len < sizeof(payload)
+     && message->etag_len <= COAP_ETAG_LEN) {
+    memcpy(payload, message->payload, message->payload_len);
+    payload[message->payload_len] = '\0';
+    sent.packets++;
+    sent.code = message->code;
+    sent.has_max_age = coap_is_option(message, COAP_OPTION_MAX_AGE);
+    sent.max_age = message->max_age;
+    sent.etag_len = message->etag_len;
+    memcpy(sent.etag, message->etag, message->etag_len);
+    sent.payload_len = message->payload_len;
+    sent.value = strtoul(payload, NULL, 10);
+    sent.get_calls = get_calls;
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+const struct network_driver test_net_driver = {
+  "test",
+  init,
+  input,
+  output
+};
+/*---------------------------------------------------------------------------*/
+/* Send a request to the resource, as a client on PORT of all-nodes would,
+   and return the response */
+static response_t
+request(coap_method_t method, const char *payload, const response_t *etag)
+{
+  coap_message_t message[1];
+  coap_endpoint_t endpoint;
+  uint8_t buffer[64];
+
+  memset(&endpoint, 0, sizeof(endpoint));
+  uip_create_linklocal_allnodes_mcast(&endpoint.ipaddr);
+  endpoint.port = UIP_HTONS(PORT);
+
+  coap_init_message(message, COAP_TYPE_CON, method, ++mid);
+  coap_set_header_uri_path(message, res_data.url);
+  if(etag != NULL) {
+    coap_set_header_etag(message, etag->etag, etag->etag_len);
+  }
+  if(payload != NULL) {
+    coap_set_payload(message, payload, strlen(payload));
+  }
+  memset(&sent, 0, sizeof(sent));
+  coap_receive(&endpoint, buffer, coap_serialize_message(message, buffer));
+  return sent;
+}
+/*---------------------------------------------------------------------------*/
+static int
+same_etag(const response_t *a, const response_t *b)
+{
+  return a->etag_len == b->etag_len
+    && memcmp(a->etag, b->etag, a->etag_len) == 0;
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(test_hit, "Serve and validate a cached response");
+UNIT_TEST(test_hit)
+{
+  UNIT_TEST_BEGIN();
+
+  /* the first GET is passed to the handler and gets an ETag */
+  UNIT_TEST_ASSERT(miss.packets == 1);
+  UNIT_TEST_ASSERT(miss.code == CONTENT_2_05);
+  UNIT_TEST_ASSERT(miss.get_calls == 1);
+  UNIT_TEST_ASSERT(miss.value == 1);
+  UNIT_TEST_ASSERT(miss.has_max_age && miss.max_age == MAX_AGE);
+  UNIT_TEST_ASSERT(miss.etag_len > 0);
+
+  /* the second one is served from the cache */
+  UNIT_TEST_ASSERT(hit.packets == 1);
+  UNIT_TEST_ASSERT(hit.code == CONTENT_2_05);
+  UNIT_TEST_ASSERT(hit.get_calls == 1);
+  UNIT_TEST_ASSERT(hit.value == 1);
+  UNIT_TEST_ASSERT(hit.has_max_age && hit.max_age > 0);
+  UNIT_TEST_ASSERT(same_etag(&hit, &miss));
+
+  /* a GET with the ETag is answered with 2.03 Valid and no payload */
+  UNIT_TEST_ASSERT(valid.packets == 1);
+  UNIT_TEST_ASSERT(valid.code == VALID_2_03);
+  UNIT_TEST_ASSERT(valid.get_calls == 1);
+  UNIT_TEST_ASSERT(valid.payload_len == 0);
+  UNIT_TEST_ASSERT(same_etag(&valid, &miss));
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(test_invalidate, "Invalidate on changes");
+UNIT_TEST(test_invalidate)
+{
+  UNIT_TEST_BEGIN();
+
+  /* after a PUT, the new state is fetched from the handler */
+  UNIT_TEST_ASSERT(put.code == CHANGED_2_04);
+  UNIT_TEST_ASSERT(after_put.code == CONTENT_2_05);
+  UNIT_TEST_ASSERT(after_put.get_calls == 2);
+  UNIT_TEST_ASSERT(after_put.value == 5);
+  UNIT_TEST_ASSERT(!same_etag(&after_put, &miss));
+
+  /* the ETag of the stale response no longer validates */
+  UNIT_TEST_ASSERT(valid_after_put.code == CONTENT_2_05);
+  UNIT_TEST_ASSERT(valid_after_put.get_calls == 2);
+  UNIT_TEST_ASSERT(valid_after_put.value == 5);
+
+  UNIT_TEST_ASSERT(after_post.get_calls == 3);
+  UNIT_TEST_ASSERT(after_post.value == 6);
+  UNIT_TEST_ASSERT(after_delete.get_calls == 4);
+  UNIT_TEST_ASSERT(after_delete.value == 0);
+  UNIT_TEST_ASSERT(after_notify.get_calls == 5);
+  UNIT_TEST_ASSERT(after_notify.value == 7);
+
+  UNIT_TEST_ASSERT(stats.invalidations == 4);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(test_max_age, "Count down and expire Max-Age");
+UNIT_TEST(test_max_age)
+{
+  UNIT_TEST_BEGIN();
+
+  /* still fresh, for the time that is left */
+  UNIT_TEST_ASSERT(counting_down.code == CONTENT_2_05);
+  UNIT_TEST_ASSERT(counting_down.get_calls == after_notify.get_calls);
+  UNIT_TEST_ASSERT(counting_down.value == 7);
+  UNIT_TEST_ASSERT(counting_down.has_max_age);
+  UNIT_TEST_ASSERT(counting_down.max_age == MAX_AGE - 1);
+
+  /* stale, so fetched again */
+  UNIT_TEST_ASSERT(expired.code == CONTENT_2_05);
+  UNIT_TEST_ASSERT(expired.get_calls == counting_down.get_calls + 1);
+  UNIT_TEST_ASSERT(expired.value == 8);
+  UNIT_TEST_ASSERT(expired.max_age == MAX_AGE);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(coap_cache_test_process, ev, data)
+{
+  static struct etimer et;
+
+  PROCESS_BEGIN();
+
+  printf("Run unit-test\n");
+  printf("---\n");
+
+  coap_engine_init();
+  coap_activate_resource(&res_data, "test/data");
+
+  value = 1;
+  miss = request(COAP_GET, NULL, NULL);
+  hit = request(COAP_GET, NULL, NULL);
+  valid = request(COAP_GET, NULL, &miss);
+
+  put = request(COAP_PUT, "5", NULL);
+  after_put = request(COAP_GET, NULL, NULL);
+  valid_after_put = request(COAP_GET, NULL, &miss);
+
+  request(COAP_POST, "6", NULL);
+  after_post = request(COAP_GET, NULL, NULL);
+  request(COAP_DELETE, "0", NULL);
+  after_delete = request(COAP_GET, NULL, NULL);
+
+  /* the resource changes on its own and notifies its observers */
+  value = 7;
+  coap_notify_observers(&res_data);
+  after_notify = request(COAP_GET, NULL, NULL);
+  stats = *coap_cache_get_stats();
+
+  /* Max-Age is rounded up to the next second */
+  etimer_set(&et, CLOCK_SECOND * 6 / 5);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+  counting_down = request(COAP_GET, NULL, NULL);
+
+  /* a change without notification is seen once Max-Age has passed */
+  value = 8;
+  etimer_set(&et, CLOCK_SECOND * 6 / 5);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+  expired = request(COAP_GET, NULL, NULL);
+
+  UNIT_TEST_RUN(test_hit);
+  UNIT_TEST_RUN(test_invalidate);
+  UNIT_TEST_RUN(test_max_age);
+
+  printf("=check-me= DONE\n");
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,192 @@
+/*
+ * Copyright (c) 2018, RISE SICS.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * \file
+ *         Checks the option index of the CoAP parser and the prefix tree
+ *         of resource paths used to dispatch requests.
+ */
+
+#include "contiki.h"
+#include "coap-engine.h"
+#include "services/unit-test/unit-test.h"
+
+#include <stdio.h>
+#include <string.h>
+/*---------------------------------------------------------------------------*/
+PROCESS(coap_dispatch_test_process, "CoAP dispatch test");
+AUTOSTART_PROCESSES(&coap_dispatch_test_process);
+/*---------------------------------------------------------------------------*/
+static coap_message_t message[1];
+static uint8_t buffer[COAP_MAX_HEADER_SIZE];
+
+RESOURCE(res_root, "", NULL, NULL, NULL, NULL);
+PARENT_RESOURCE(res_a, "", NULL, NULL, NULL, NULL);
+RESOURCE(res_a_b, "", NULL, NULL, NULL, NULL);
+RESOURCE(res_a_b_c, "", NULL, NULL, NULL, NULL);
+RESOURCE(res_x_y, "", NULL, NULL, NULL, NULL);
+RESOURCE(res_long, "", NULL, NULL, NULL, NULL);
+/*---------------------------------------------------------------------------*/
+void
+print_test_report(const unit_test_t *utp)
+{
+  printf("=check-me= ");
+  if(utp->result == unit_test_failure) {
+    printf("FAILED   - %s: exit at L%u\n", utp->descr, utp->exit_line);
+  } else {
+    printf("SUCCEEDED - %s\n", utp->descr);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Serialize a GET request and parse it back in place */
+static coap_status_t
+parse_request(const char *path, const char *query)
+{
+  size_t len;
+
+  coap_init_message(message, COAP_TYPE_CON, COAP_GET, 0x1234);
+  coap_set_header_uri_path(message, path);
+  if(query != NULL) {
+    coap_set_header_uri_query(message, query);
+  }
+  len = coap_serialize_message(message, buffer);
+  return coap_parse_message(message, buffer, len);
+}
+/*---------------------------------------------------------------------------*/
+static int
+value_is(int len, const uint8_t *value, const char *expected)
+{
+  return len == strlen(expected) && memcmp(value, expected, len) == 0;
+}
+/*---------------------------------------------------------------------------*/
+static const char *
+dispatch(const char *path)
+{
+  coap_resource_t *resource;
+
+  if(parse_request(path, NULL) != NO_ERROR) {
+    return "(error)";
+  }
+  resource = coap_find_resource(message);
+  return resource == NULL ? "(none)" : resource->url;
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(test_option_index, "Option index");
+UNIT_TEST(test_option_index)
+{
+  const uint8_t *value;
+  const char *str;
+  int len;
+
+  UNIT_TEST_BEGIN();
+
+  UNIT_TEST_ASSERT(parse_request("a/bb/ccc", "x=1&y=22") == NO_ERROR);
+
+  /* the values are read in place, before and after joining them */
+  len = coap_get_option_value(message, COAP_OPTION_URI_PATH, 1, &value);
+  UNIT_TEST_ASSERT(value_is(len, value, "bb"));
+  len = coap_get_header_uri_path(message, &str);
+  UNIT_TEST_ASSERT(value_is(len, (const uint8_t *)str, "a/bb/ccc"));
+  len = coap_get_option_value(message, COAP_OPTION_URI_PATH, 0, &value);
+  UNIT_TEST_ASSERT(value_is(len, value, "a"));
+  len = coap_get_option_value(message, COAP_OPTION_URI_PATH, 2, &value);
+  UNIT_TEST_ASSERT(value_is(len, value, "ccc"));
+  len = coap_get_option_value(message, COAP_OPTION_URI_PATH, 3, &value);
+  UNIT_TEST_ASSERT(len == -1);
+
+  len = coap_get_query_variable(message, "y", &str);
+  UNIT_TEST_ASSERT(value_is(len, (const uint8_t *)str, "22"));
+  len = coap_get_option_value(message, COAP_OPTION_URI_QUERY, 0, &value);
+  UNIT_TEST_ASSERT(value_is(len, value, "x=1"));
+
+  /* one option more than the index holds */
+  UNIT_TEST_ASSERT(parse_request("1/2/3/4/5/6/7", "q") == NO_ERROR);
+  UNIT_TEST_ASSERT(parse_request("1/2/3/4/5/6/7/8", "q") == BAD_REQUEST_4_00);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(test_dispatch, "Dispatch tree");
+UNIT_TEST(test_dispatch)
+{
+  const char *path;
+
+  UNIT_TEST_BEGIN();
+
+  coap_activate_resource(&res_a, "a");
+  coap_activate_resource(&res_a_b, "a/b");
+  coap_activate_resource(&res_a_b_c, "a/b/c");
+  coap_activate_resource(&res_x_y, "x/y");
+  coap_activate_resource(&res_root, "");
+
+  UNIT_TEST_ASSERT(!strcmp(dispatch("a/b"), "a/b"));
+  UNIT_TEST_ASSERT(!strcmp(dispatch("a/b/c"), "a/b/c"));
+  UNIT_TEST_ASSERT(!strcmp(dispatch("a/b/d"), "a"));
+  UNIT_TEST_ASSERT(!strcmp(dispatch("a/zz/c"), "a"));
+  UNIT_TEST_ASSERT(!strcmp(dispatch("a"), "a"));
+  UNIT_TEST_ASSERT(!strcmp(dispatch("ab"), "(none)"));
+  UNIT_TEST_ASSERT(!strcmp(dispatch("x"), "(none)"));
+  UNIT_TEST_ASSERT(!strcmp(dispatch("x/y/z"), "(none)"));
+  UNIT_TEST_ASSERT(!strcmp(dispatch(""), ""));
+
+  /* joined paths are split again */
+  UNIT_TEST_ASSERT(parse_request("a/b/c", NULL) == NO_ERROR);
+  UNIT_TEST_ASSERT(coap_get_header_uri_path(message, &path) == 5);
+  UNIT_TEST_ASSERT(coap_find_resource(message) == &res_a_b_c);
+
+  /* more segments than nodes in the tree */
+  coap_activate_resource(&res_long, "long/path/to/res");
+  UNIT_TEST_ASSERT(!strcmp(dispatch("long/path/to/res"), "long/path/to/res"));
+  UNIT_TEST_ASSERT(!strcmp(dispatch("a/b/c"), "a/b/c"));
+
+  /* moved to another path */
+  coap_activate_resource(&res_x_y, "z");
+  UNIT_TEST_ASSERT(!strcmp(dispatch("x/y"), "(none)"));
+  UNIT_TEST_ASSERT(!strcmp(dispatch("z"), "z"));
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(coap_dispatch_test_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+  printf("Run unit-test\n");
+  printf("---\n");
+
+  UNIT_TEST_RUN(test_option_index);
+  UNIT_TEST_RUN(test_dispatch);
+
+  printf("=check-me= DONE\n");
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,461 @@
+/*
+ * Copyright (c) 2018, RISE SICS.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Checks the DTLS sessions of CoAP between two native nodes, a
+ *         server and a client, that exchange their packets over a UDP
+ *         socket on loopback. The client makes a handshake, reuses the
+ *         session for a second connect, and restarts a handshake with a
+ *         peer that does not answer once COAP_DTLS_HANDSHAKE_TIMEOUT has
+ *         passed. ClientHellos with a forged cookie, from more ports than
+ *         the server has sessions, must leave the session in place. Run
+ *         with "server" or "client" as argument.
+ */
+
+#include "contiki.h"
+#include "coap-engine.h"
+#include "coap-callback-api.h"
+#include "coap-transport.h"
+#include "net/ipv6/uip.h"
+#include "net/ipv6/uip-ds6.h"
+#include "net/ipv6/uip-ds6-nbr.h"
+#include "net/ipv6/uip-udp-packet.h"
+#include "net/netstack.h"
+#include "services/unit-test/unit-test.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+/*---------------------------------------------------------------------------*/
+/* Ports of the nodes on loopback */
+#define SERVER_LINK_PORT 60101
+#define CLIENT_LINK_PORT 60102
+
+#define SERVER_URI       "coaps://[fe80::1]"
+#define CLIENT_URI       "coaps://[fe80::2]"
+/* Not on the link: its handshake stalls */
+#define STALLED_URI      "coaps://[fe80::9]"
+
+/* Local ports of the ClientHellos with a forged cookie */
+#define FORGED_PORT      61000
+#define FORGED_HELLOS    COAP_DTLS_MAX_PEERS
+
+#define TIMEOUT          (CLOCK_SECOND * 10)
+#define CHECK_INTERVAL   (CLOCK_SECOND / 10)
+
+#define UIP_IP_BUF       ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
+/*---------------------------------------------------------------------------*/
+extern int contiki_argc;
+extern char **contiki_argv;
+
+PROCESS(coap_dtls_test_process, "CoAP DTLS test");
+AUTOSTART_PROCESSES(&coap_dtls_test_process);
+/*---------------------------------------------------------------------------*/
+static void res_get_handler(coap_message_t *request, coap_message_t *response,
+                            uint8_t *buffer, uint16_t preferred_size,
+                            int32_t *offset);
+
+RESOURCE(res_hello, "", res_get_handler, NULL, NULL, NULL);
+
+static int is_server;
+static int link_fd = -1;
+
+static coap_endpoint_t server_ep;
+static coap_endpoint_t client_ep;
+static coap_endpoint_t stalled_ep;
+
+/* What the nodes saw at each step */
+static int requests_served;
+static int connected;
+static int response_ok;
+static int forged_response_ok;
+static int stalled_connected;
+static int still_connected;
+static coap_dtls_stats_t handshake_stats;
+static coap_dtls_stats_t reuse_stats;
+static coap_dtls_stats_t forged_stats;
+static coap_dtls_stats_t stalled_stats;
+static coap_dtls_stats_t restart_stats;
+/*---------------------------------------------------------------------------*/
+void
+print_test_report(const unit_test_t *utp)
+{
+  printf("=check-me= ");
+  if(utp->result == unit_test_failure) {
+    printf("FAILED   - %s: exit at L%u\n", utp->descr, utp->exit_line);
+  } else {
+    printf("SUCCEEDED - %s\n", utp->descr);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+res_get_handler(coap_message_t *request, coap_message_t *response,
+                uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
+{
+  requests_served++;
+  coap_set_payload(response, "hello", 5);
+  process_poll(&coap_dtls_test_process);
+}
+/*---------------------------------------------------------------------------*/
+/* The link: a UDP socket on loopback to the other node */
+static int
+set_fd(fd_set *rset, fd_set *wset)
+{
+  FD_SET(link_fd, rset);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+handle_fd(fd_set *rset, fd_set *wset)
+{
+  ssize_t len;
+
+  if(!FD_ISSET(link_fd, rset)) {
+    return;
+  }
+  len = recv(link_fd, &uip_buf[UIP_LLH_LEN], UIP_BUFSIZE - UIP_LLH_LEN, 0);
+  if(len > 0) {
+    uip_len = len;
+    tcpip_input();
+  }
+}
+/*---------------------------------------------------------------------------*/
+static const struct select_callback link_callback = {
+  set_fd, handle_fd
+};
+/*---------------------------------------------------------------------------*/
+static void
+init(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+static void
+input(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t
+output(const linkaddr_t *localdest)
+{
+  struct sockaddr_in to;
+
+  if(uip_len == 0 || link_fd < 0
+     || uip_ipaddr_cmp(&UIP_IP_BUF->destipaddr, &stalled_ep.ipaddr)) {
+    return 0;
+  }
+  memset(&to, 0, sizeof(to));
+  to.sin_family = AF_INET;
+  to.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  to.sin_port = htons(is_server ? CLIENT_LINK_PORT : SERVER_LINK_PORT);
+  sendto(link_fd, &uip_buf[UIP_LLH_LEN], uip_len, 0,
+         (struct sockaddr *)&to, sizeof(to));
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+const struct network_driver test_net_driver = {
+  "test",
+  init,
+  input,
+  output
+};
+/*---------------------------------------------------------------------------*/
+/* Open the link, take the address of the role and add the neighbours */
+static int
+link_init(void)
+{
+  static const uip_lladdr_t lladdr = { { 0x02 } };
+  struct sockaddr_in addr;
+
+  coap_endpoint_parse(SERVER_URI, strlen(SERVER_URI), &server_ep);
+  coap_endpoint_parse(CLIENT_URI, strlen(CLIENT_URI), &client_ep);
+  coap_endpoint_parse(STALLED_URI, strlen(STALLED_URI), &stalled_ep);
+
+  link_fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if(link_fd < 0) {
+    return 0;
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(is_server ? SERVER_LINK_PORT : CLIENT_LINK_PORT);
+  if(bind(link_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    close(link_fd);
+    link_fd = -1;
+    return 0;
+  }
+  select_set_callback(link_fd, &link_callback);
+
+  uip_ds6_addr_add(is_server ? &server_ep.ipaddr : &client_ep.ipaddr, 0,
+                   ADDR_MANUAL);
+  uip_ds6_nbr_add(is_server ? &client_ep.ipaddr : &server_ep.ipaddr,
+                  &lladdr, 0, NBR_REACHABLE, NBR_TABLE_REASON_UNDEFINED, NULL);
+  if(!is_server) {
+    uip_ds6_nbr_add(&stalled_ep.ipaddr, &lladdr, 0, NBR_REACHABLE,
+                    NBR_TABLE_REASON_UNDEFINED, NULL);
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+response_callback(coap_request_state_t *state)
+{
+  const uint8_t *payload;
+
+  if(state->response != NULL
+     && state->response->code == CONTENT_2_05
+     && coap_get_payload(state->response, &payload) == 5
+     && memcmp(payload, "hello", 5) == 0) {
+    response_ok = 1;
+  }
+  process_poll(&coap_dtls_test_process);
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Send a ClientHello with a cookie that the server did not make, from
+ * each of FORGED_HELLOS ports, as an attacker that spoofs the address of
+ * the client would. Each one would take or evict a session if sessions
+ * were made before the cookie is verified.
+ */
+static void
+send_forged_hellos(void)
+{
+  static const uint8_t hello[] = {
+    /* record: handshake, DTLS 1.2, epoch 0, sequence number 0, length */
+    22, 0xfe, 0xfd, 0, 0, 0, 0, 0, 0, 0, 0, 0, 70,
+    /* ClientHello, length, message sequence 0, one fragment */
+    1, 0, 0, 58, 0, 0, 0, 0, 0, 0, 0, 58,
+    /* DTLS 1.2, random */
+    0xfe, 0xfd,
+    1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16,
+    17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32,
+    /* no session ID, a forged cookie of 16 bytes */
+    0,
+    16, 0xde, 0xad, 0xbe, 0xef, 0xde, 0xad, 0xbe, 0xef,
+    0xde, 0xad, 0xbe, 0xef, 0xde, 0xad, 0xbe, 0xef,
+    /* TLS_PSK_WITH_AES_128_CCM_8, no compression */
+    0, 2, 0xc0, 0xa8,
+    1, 0
+  };
+  struct uip_udp_conn *conn;
+  int i;
+
+  for(i = 0; i < FORGED_HELLOS; i++) {
+    conn = udp_new(NULL, 0, NULL);
+    if(conn == NULL) {
+      return;
+    }
+    udp_bind(conn, UIP_HTONS(FORGED_PORT + i));
+    uip_udp_packet_sendto(conn, hello, sizeof(hello),
+                          &server_ep.ipaddr, server_ep.port);
+    uip_udp_remove(conn);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+forged_response_callback(coap_request_state_t *state)
+{
+  const uint8_t *payload;
+
+  if(state->response != NULL
+     && state->response->code == CONTENT_2_05
+     && coap_get_payload(state->response, &payload) == 5
+     && memcmp(payload, "hello", 5) == 0) {
+    forged_response_ok = 1;
+  }
+  process_poll(&coap_dtls_test_process);
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(test_handshake, "Handshake");
+UNIT_TEST(test_handshake)
+{
+  UNIT_TEST_BEGIN();
+
+  UNIT_TEST_ASSERT(connected);
+  UNIT_TEST_ASSERT(handshake_stats.handshakes == 1);
+  UNIT_TEST_ASSERT(handshake_stats.handshake_frames > 0);
+  UNIT_TEST_ASSERT(handshake_stats.handshake_time
+                   == handshake_stats.last_handshake_time);
+  UNIT_TEST_ASSERT(response_ok);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(test_reuse, "Session reuse");
+UNIT_TEST(test_reuse)
+{
+  UNIT_TEST_BEGIN();
+
+  UNIT_TEST_ASSERT(reuse_stats.reused == handshake_stats.reused + 1);
+  UNIT_TEST_ASSERT(reuse_stats.handshakes == 1);
+  UNIT_TEST_ASSERT(reuse_stats.evictions == 0);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(test_forged, "Forged cookies leave the session");
+UNIT_TEST(test_forged)
+{
+  UNIT_TEST_BEGIN();
+
+  /* a request in the session of the first handshake is still answered */
+  UNIT_TEST_ASSERT(forged_response_ok);
+  UNIT_TEST_ASSERT(forged_stats.handshakes == 1);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(test_restart, "Stalled handshake restarted");
+UNIT_TEST(test_restart)
+{
+  UNIT_TEST_BEGIN();
+
+  /* waited for within the timeout */
+  UNIT_TEST_ASSERT(!stalled_connected);
+  UNIT_TEST_ASSERT(stalled_stats.handshake_timeouts == 0);
+
+  /* restarted after it, without touching the other session */
+  UNIT_TEST_ASSERT(restart_stats.handshake_timeouts == 1);
+  UNIT_TEST_ASSERT(restart_stats.evictions == 0);
+  UNIT_TEST_ASSERT(restart_stats.handshakes == 1);
+  UNIT_TEST_ASSERT(still_connected);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(test_server, "Server session");
+UNIT_TEST(test_server)
+{
+  UNIT_TEST_BEGIN();
+
+  /* the second request comes after the forged ClientHellos */
+  UNIT_TEST_ASSERT(requests_served == 2);
+  UNIT_TEST_ASSERT(handshake_stats.handshakes == 1);
+  UNIT_TEST_ASSERT(handshake_stats.handshake_frames > 0);
+  UNIT_TEST_ASSERT(handshake_stats.evictions == 0);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(coap_dtls_test_process, ev, data)
+{
+  static struct etimer et;
+  static coap_request_state_t state;
+  static coap_message_t request[1];
+  static int i;
+
+  PROCESS_BEGIN();
+
+  is_server = contiki_argc > 1 && strcmp(contiki_argv[1], "server") == 0;
+  printf("Run unit-test\n");
+  printf("---\n");
+
+  if(!link_init()) {
+    printf("=check-me= FAILED   - cannot open the link\n");
+    PROCESS_EXIT();
+  }
+  coap_engine_init();
+  coap_activate_resource(&res_hello, "hello");
+
+  if(is_server) {
+    /* until the client has made its requests */
+    etimer_set(&et, TIMEOUT * 2);
+    PROCESS_WAIT_EVENT_UNTIL(requests_served >= 2 || etimer_expired(&et));
+    etimer_set(&et, CLOCK_SECOND);
+    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+    handshake_stats = *coap_dtls_get_stats();
+
+    UNIT_TEST_RUN(test_server);
+    printf("=check-me= DONE\n");
+    PROCESS_EXIT();
+  }
+
+  /* let the server start, and the DTLS context be made */
+  etimer_set(&et, CLOCK_SECOND);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+
+  /* a full handshake, then a request in the session */
+  coap_endpoint_connect(&server_ep);
+  for(i = 0; i < TIMEOUT / CHECK_INTERVAL
+        && !coap_endpoint_is_connected(&server_ep); i++) {
+    etimer_set(&et, CHECK_INTERVAL);
+    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+  }
+  connected = coap_endpoint_is_connected(&server_ep);
+  handshake_stats = *coap_dtls_get_stats();
+
+  coap_init_message(request, COAP_TYPE_CON, COAP_GET, 0);
+  coap_set_header_uri_path(request, "hello");
+  coap_send_request(&state, &server_ep, request, response_callback);
+  etimer_set(&et, TIMEOUT);
+  PROCESS_WAIT_EVENT_UNTIL(response_ok || etimer_expired(&et));
+
+  /* connected already */
+  coap_endpoint_connect(&server_ep);
+  reuse_stats = *coap_dtls_get_stats();
+
+  /* forged cookies, then a request in the same session */
+  send_forged_hellos();
+  etimer_set(&et, CLOCK_SECOND / 2);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+  coap_init_message(request, COAP_TYPE_CON, COAP_GET, 0);
+  coap_set_header_uri_path(request, "hello");
+  coap_send_request(&state, &server_ep, request, forged_response_callback);
+  etimer_set(&et, TIMEOUT);
+  PROCESS_WAIT_EVENT_UNTIL(forged_response_ok || etimer_expired(&et));
+  forged_stats = *coap_dtls_get_stats();
+
+  /* a handshake without answer */
+  coap_endpoint_connect(&stalled_ep);
+  etimer_set(&et, CLOCK_SECOND);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+  coap_endpoint_connect(&stalled_ep);
+  stalled_connected = coap_endpoint_is_connected(&stalled_ep);
+  stalled_stats = *coap_dtls_get_stats();
+
+  etimer_set(&et, CLOCK_SECOND * (COAP_DTLS_HANDSHAKE_TIMEOUT + 1));
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+  coap_endpoint_connect(&stalled_ep);
+  restart_stats = *coap_dtls_get_stats();
+  still_connected = coap_endpoint_is_connected(&server_ep);
+
+  UNIT_TEST_RUN(test_handshake);
+  UNIT_TEST_RUN(test_reuse);
+  UNIT_TEST_RUN(test_forged);
+  UNIT_TEST_RUN(test_restart);
+
+  printf("=check-me= DONE\n");
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,319 @@
+/*
+ * Copyright (c) 2018, RISE SICS.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Checks the notifications of observed CoAP resources: a new state
+ *         replaces an unacknowledged confirmable notification and keeps its
+ *         retransmission state, and notifications closer together than
+ *         COAP_OBSERVE_MIN_INTERVAL are deferred and sent once.
+ */
+
+#include "contiki.h"
+#include "coap-engine.h"
+#include "coap-observe.h"
+#include "coap-transactions.h"
+#include "net/ipv6/uip.h"
+#include "net/netstack.h"
+#include "services/unit-test/unit-test.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+/*---------------------------------------------------------------------------*/
+#define REPLACE_PORT 20001
+#define DEFER_PORT   20002
+
+#define UIP_UDP_BUF  ((struct uip_udp_hdr *)&uip_buf[UIP_LLH_LEN + UIP_IPH_LEN])
+/*---------------------------------------------------------------------------*/
+PROCESS(coap_observe_test_process, "CoAP observe test");
+AUTOSTART_PROCESSES(&coap_observe_test_process);
+/*---------------------------------------------------------------------------*/
+static void res_get_handler(coap_message_t *request, coap_message_t *response,
+                            uint8_t *buffer, uint16_t preferred_size,
+                            int32_t *offset);
+
+EVENT_RESOURCE(res_replace, "obs", res_get_handler, NULL, NULL, NULL, NULL);
+EVENT_RESOURCE(res_defer, "obs", res_get_handler, NULL, NULL, NULL, NULL);
+
+static unsigned value;
+
+/* The last notification that reached the network driver */
+typedef struct {
+  unsigned packets;
+  uint16_t port;
+  uint16_t mid;
+  coap_message_type_t type;
+  unsigned value;
+} notification_t;
+
+static notification_t sent;
+
+/* What the test process saw at each step */
+static notification_t first, replaced, retransmitted;
+static notification_t immediate, deferring, deferred, later;
+static coap_transaction_t *first_transaction;
+static coap_transaction_t *replaced_transaction;
+static coap_transaction_t *retransmitted_transaction;
+static uint64_t first_send_time;
+static uint64_t replaced_send_time;
+static uint16_t replaced_mid;
+static uint8_t replaced_retransmissions;
+static int first_mid_found;
+static int acknowledged;
+/*---------------------------------------------------------------------------*/
+void
+print_test_report(const unit_test_t *utp)
+{
+  printf("=check-me= ");
+  if(utp->result == unit_test_failure) {
+    printf("FAILED   - %s: exit at L%u\n", utp->descr, utp->exit_line);
+  } else {
+    printf("SUCCEEDED - %s\n", utp->descr);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+res_get_handler(coap_message_t *request, coap_message_t *response,
+                uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
+{
+  coap_set_payload(response, buffer,
+                   snprintf((char *)buffer, preferred_size, "%u", value));
+}
+/*---------------------------------------------------------------------------*/
+static void
+init(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+static void
+input(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t
+output(const linkaddr_t *localdest)
+{
+  static coap_message_t message[1];
+  char payload[8];
+
+  if(uip_len > 0
+     && coap_parse_message(message, &uip_buf[UIP_LLH_LEN + UIP_IPUDPH_LEN],
+                           uip_len - UIP_IPUDPH_LEN) == NO_ERROR
+     && message->payload_len < sizeof(payload)) {
+    memcpy(payload, message->payload, message->payload_len);
+    payload[message->payload_len] = '\0';
+    sent.packets++;
+    sent.port = UIP_HTONS(UIP_UDP_BUF->destport);
+    sent.mid = message->mid;
+    sent.type = message->type;
+    sent.value = strtoul(payload, NULL, 10);
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+const struct network_driver test_net_driver = {
+  "test",
+  init,
+  input,
+  output
+};
+/*---------------------------------------------------------------------------*/
+static void
+set_endpoint(coap_endpoint_t *endpoint, uint16_t port)
+{
+  memset(endpoint, 0, sizeof(*endpoint));
+  uip_create_linklocal_allnodes_mcast(&endpoint->ipaddr);
+  endpoint->port = UIP_HTONS(port);
+}
+/*---------------------------------------------------------------------------*/
+/* Register an observer of the resource from a port of all-nodes */
+static void
+add_observer(coap_resource_t *resource, uint16_t port)
+{
+  coap_message_t request[1];
+  coap_message_t response[1];
+  coap_endpoint_t endpoint;
+  uint8_t token[2] = { port >> 8, port };
+
+  set_endpoint(&endpoint, port);
+  coap_init_message(request, COAP_TYPE_CON, COAP_GET, port);
+  coap_set_header_uri_path(request, resource->url);
+  coap_set_header_observe(request, 0);
+  coap_set_token(request, token, sizeof(token));
+  coap_set_src_endpoint(request, &endpoint);
+  coap_init_message(response, COAP_TYPE_ACK, CONTENT_2_05, port);
+  coap_observe_handler(resource, request, response);
+}
+/*---------------------------------------------------------------------------*/
+/* Acknowledge the last notification, as the observer on port would */
+static void
+ack(uint16_t port)
+{
+  coap_message_t message[1];
+  coap_endpoint_t endpoint;
+  uint8_t buffer[COAP_HEADER_LEN];
+
+  set_endpoint(&endpoint, port);
+  coap_init_message(message, COAP_TYPE_ACK, 0, sent.mid);
+  coap_receive(&endpoint, buffer, coap_serialize_message(message, buffer));
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(test_replace, "Replace an unacknowledged notification");
+UNIT_TEST(test_replace)
+{
+  UNIT_TEST_BEGIN();
+
+  /* the first one is sent now */
+  UNIT_TEST_ASSERT(first.packets == 1);
+  UNIT_TEST_ASSERT(first.port == REPLACE_PORT);
+  UNIT_TEST_ASSERT(first.type == COAP_TYPE_CON);
+  UNIT_TEST_ASSERT(first.value == 1);
+
+  /*
+   * Replaced in the same transaction, with the same retransmission state,
+   * and not sent now. The new state goes in a new MID, else the observer
+   * would take it for a duplicate of the old one.
+   */
+  UNIT_TEST_ASSERT(replaced.packets == 1);
+  UNIT_TEST_ASSERT(replaced_transaction == first_transaction);
+  UNIT_TEST_ASSERT(replaced_mid != first.mid);
+  UNIT_TEST_ASSERT(!first_mid_found);
+  UNIT_TEST_ASSERT(replaced_send_time == first_send_time);
+  UNIT_TEST_ASSERT(replaced_retransmissions == 0);
+
+  /* the retransmission carries the new state in the replaced MID */
+  UNIT_TEST_ASSERT(retransmitted.packets == 2);
+  UNIT_TEST_ASSERT(retransmitted.port == REPLACE_PORT);
+  UNIT_TEST_ASSERT(retransmitted.type == COAP_TYPE_CON);
+  UNIT_TEST_ASSERT(retransmitted.mid == replaced_mid);
+  UNIT_TEST_ASSERT(retransmitted.value == 2);
+  UNIT_TEST_ASSERT(retransmitted_transaction == first_transaction);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(test_defer, "Defer notifications");
+UNIT_TEST(test_defer)
+{
+  UNIT_TEST_BEGIN();
+
+  /* the first one after the interval is sent now */
+  UNIT_TEST_ASSERT(immediate.packets == retransmitted.packets + 1);
+  UNIT_TEST_ASSERT(immediate.port == DEFER_PORT);
+  UNIT_TEST_ASSERT(immediate.value == 11);
+
+  /* the others within the interval are sent once, with the last state */
+  UNIT_TEST_ASSERT(deferring.packets == immediate.packets);
+  UNIT_TEST_ASSERT(deferred.packets == immediate.packets + 1);
+  UNIT_TEST_ASSERT(deferred.port == DEFER_PORT);
+  UNIT_TEST_ASSERT(deferred.value == 13);
+  UNIT_TEST_ASSERT(deferred.mid != immediate.mid);
+  UNIT_TEST_ASSERT(later.packets == deferred.packets);
+  UNIT_TEST_ASSERT(acknowledged);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(coap_observe_test_process, ev, data)
+{
+  static struct etimer et;
+
+  PROCESS_BEGIN();
+
+  printf("Run unit-test\n");
+  printf("---\n");
+
+  coap_engine_init();
+  coap_activate_resource(&res_replace, "test/replace");
+  coap_activate_resource(&res_defer, "test/defer");
+  add_observer(&res_replace, REPLACE_PORT);
+  add_observer(&res_defer, DEFER_PORT);
+
+  /* past the interval since the registrations */
+  etimer_set(&et, CLOCK_SECOND * COAP_OBSERVE_MIN_INTERVAL / 1000 * 2);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+
+  /* Replacement: the observer does not acknowledge the first state */
+  value = 1;
+  coap_notify_observers(&res_replace);
+  first = sent;
+  first_transaction = coap_get_transaction_by_mid(first.mid);
+  first_send_time = first_transaction != NULL ? first_transaction->send_time : 0;
+
+  value = 2;
+  coap_notify_observers(&res_replace);
+  replaced = sent;
+  first_mid_found = coap_get_transaction_by_mid(first.mid) != NULL;
+  replaced_transaction = first_transaction;
+  if(first_transaction != NULL) {
+    replaced_mid = first_transaction->mid;
+    replaced_transaction = coap_get_transaction_by_mid(replaced_mid);
+    replaced_send_time = first_transaction->send_time;
+    replaced_retransmissions = first_transaction->retrans_counter;
+  }
+
+  etimer_set(&et, (COAP_RESPONSE_TIMEOUT * 3 / 2 + 1) * CLOCK_SECOND);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+  retransmitted = sent;
+  retransmitted_transaction = coap_get_transaction_by_mid(sent.mid);
+  ack(REPLACE_PORT);
+
+  /* Deferral: the observer acknowledges each notification */
+  value = 11;
+  coap_notify_observers(&res_defer);
+  immediate = sent;
+  ack(DEFER_PORT);
+
+  value = 12;
+  coap_notify_observers(&res_defer);
+  value = 13;
+  coap_notify_observers(&res_defer);
+  deferring = sent;
+
+  etimer_set(&et, CLOCK_SECOND * COAP_OBSERVE_MIN_INTERVAL / 1000 * 3 / 2);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+  deferred = sent;
+  ack(DEFER_PORT);
+
+  etimer_set(&et, CLOCK_SECOND * COAP_OBSERVE_MIN_INTERVAL / 1000 * 2);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+  later = sent;
+
+  acknowledged = coap_get_transaction_by_mid(sent.mid) == NULL;
+
+  UNIT_TEST_RUN(test_replace);
+  UNIT_TEST_RUN(test_defer);
+
+  printf("=check-me= DONE\n");
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,253 @@
+/*
+ * Copyright (c) 2018, RISE SICS.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Checks the congestion control of the CoAP transaction layer:
+ *         confirmable messages beyond COAP_NSTART to an endpoint wait for
+ *         an outstanding one to end, and after a timeout the next one
+ *         waits as long as COAP_PROBING_RATE asks for.
+ */
+
+#include "contiki.h"
+#include "coap-engine.h"
+#include "coap-transactions.h"
+#include "net/ipv6/uip.h"
+#include "net/netstack.h"
+#include "services/unit-test/unit-test.h"
+
+#include <stdio.h>
+#include <string.h>
+/*---------------------------------------------------------------------------*/
+#define PORT              20001
+#define OTHER_PORT        20002
+#define PROBE_PORT        20003
+
+/* A probe of 50 bytes, which take 500 ms at the probing rate */
+#define PROBE_LEN         50
+#define PROBE_HEADER_LEN  7    /* header, Uri-Path "t" and payload marker */
+#define PROBE_DELAY       (CLOCK_SECOND * PROBE_LEN / COAP_PROBING_RATE)
+
+#define MAX_PACKETS       16
+/*---------------------------------------------------------------------------*/
+PROCESS(coap_transactions_test_process, "CoAP transactions test");
+AUTOSTART_PROCESSES(&coap_transactions_test_process);
+/*---------------------------------------------------------------------------*/
+/* MIDs of the messages that reached the network driver, in order */
+static uint16_t packets[MAX_PACKETS];
+static unsigned packet_count;
+
+/* What the test process saw at each step */
+static unsigned queued_count, other_count, non_count;
+static unsigned released_count, acked_count;
+static unsigned timeout_count, probe_early_count, probe_count;
+static int timeout_callbacks;
+/*---------------------------------------------------------------------------*/
+void
+print_test_report(const unit_test_t *utp)
+{
+  printf("=check-me= ");
+  if(utp->result == unit_test_failure) {
+    printf("FAILED   - %s: exit at L%u\n", utp->descr, utp->exit_line);
+  } else {
+    printf("SUCCEEDED - %s\n", utp->descr);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+init(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+static void
+input(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t
+output(const linkaddr_t *localdest)
+{
+  static coap_message_t message[1];
+
+  if(uip_len > 0 && packet_count < MAX_PACKETS
+     && coap_parse_message(message, &uip_buf[UIP_LLH_LEN + UIP_IPUDPH_LEN],
+                           uip_len - UIP_IPUDPH_LEN) == NO_ERROR) {
+    packets[packet_count++] = message->mid;
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+const struct network_driver test_net_driver = {
+  "test",
+  init,
+  input,
+  output
+};
+/*---------------------------------------------------------------------------*/
+static void
+timeout_callback(void *data, coap_message_t *response)
+{
+  if(response == NULL) {
+    timeout_callbacks++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Open and send a request with a payload to a port of all-nodes */
+static coap_transaction_t *
+send_request(coap_message_type_t type, uint16_t mid, uint16_t port,
+             uint16_t len)
+{
+  static const uint8_t padding[PROBE_LEN];
+  coap_message_t request[1];
+  coap_endpoint_t endpoint;
+  coap_transaction_t *t;
+
+  memset(&endpoint, 0, sizeof(endpoint));
+  uip_create_linklocal_allnodes_mcast(&endpoint.ipaddr);
+  endpoint.port = UIP_HTONS(port);
+
+  t = coap_new_transaction(mid, &endpoint);
+  if(t == NULL) {
+    return NULL;
+  }
+  coap_init_message(request, type, COAP_POST, mid);
+  coap_set_header_uri_path(request, "t");
+  coap_set_payload(request, padding, len);
+  t->message_len = coap_serialize_message(request, t->message);
+  t->callback = timeout_callback;
+  coap_send_transaction(t);
+  return t;
+}
+/*---------------------------------------------------------------------------*/
+/* Send the last retransmission of a request now: it times out */
+static void
+time_out(uint16_t mid)
+{
+  coap_transaction_t *t = coap_get_transaction_by_mid(mid);
+
+  if(t != NULL) {
+    t->retrans_counter = COAP_MAX_RETRANSMIT;
+    coap_send_transaction(t);
+  }
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(test_nstart, "NSTART");
+UNIT_TEST(test_nstart)
+{
+  UNIT_TEST_BEGIN();
+
+  /* the second confirmable message to the endpoint waits */
+  UNIT_TEST_ASSERT(queued_count == 1);
+  UNIT_TEST_ASSERT(packets[0] == 1);
+
+  /* but not the ones to another endpoint, nor non-confirmable ones */
+  UNIT_TEST_ASSERT(other_count == 2);
+  UNIT_TEST_ASSERT(packets[1] == 3);
+  UNIT_TEST_ASSERT(non_count == 3);
+  UNIT_TEST_ASSERT(packets[2] == 4);
+
+  /* it is sent once the first one is acknowledged, not before */
+  UNIT_TEST_ASSERT(released_count == 3);
+  UNIT_TEST_ASSERT(acked_count == 4);
+  UNIT_TEST_ASSERT(packets[3] == 2);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(test_probing, "PROBING_RATE");
+UNIT_TEST(test_probing)
+{
+  UNIT_TEST_BEGIN();
+
+  /* the first message times out, the next one waits */
+  UNIT_TEST_ASSERT(timeout_callbacks == 1);
+  UNIT_TEST_ASSERT(timeout_count == acked_count + 2);
+  UNIT_TEST_ASSERT(packets[timeout_count - 2] == 10);
+  UNIT_TEST_ASSERT(packets[timeout_count - 1] == 10);
+
+  /* for its length divided by the probing rate */
+  UNIT_TEST_ASSERT(probe_early_count == timeout_count);
+  UNIT_TEST_ASSERT(probe_count == timeout_count + 1);
+  UNIT_TEST_ASSERT(packets[probe_count - 1] == 11);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(coap_transactions_test_process, ev, data)
+{
+  static struct etimer et;
+
+  PROCESS_BEGIN();
+
+  printf("Run unit-test\n");
+  printf("---\n");
+
+  coap_engine_init();
+
+  /* NSTART */
+  send_request(COAP_TYPE_CON, 1, PORT, 0);
+  send_request(COAP_TYPE_CON, 2, PORT, 0);
+  queued_count = packet_count;
+  send_request(COAP_TYPE_CON, 3, OTHER_PORT, 0);
+  other_count = packet_count;
+  send_request(COAP_TYPE_NON, 4, PORT, 0);
+  non_count = packet_count;
+
+  /* released on the acknowledgement, sent in the next round */
+  coap_clear_transaction(coap_get_transaction_by_mid(1));
+  released_count = packet_count;
+  etimer_set(&et, CLOCK_SECOND / 10);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+  acked_count = packet_count;
+  coap_clear_transaction(coap_get_transaction_by_mid(2));
+  coap_clear_transaction(coap_get_transaction_by_mid(3));
+
+  /* PROBING_RATE */
+  send_request(COAP_TYPE_CON, 10, PROBE_PORT, 0);
+  send_request(COAP_TYPE_CON, 11, PROBE_PORT, PROBE_LEN - PROBE_HEADER_LEN);
+  time_out(10);
+  timeout_count = packet_count;
+
+  etimer_set(&et, PROBE_DELAY / 2);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+  probe_early_count = packet_count;
+  etimer_set(&et, PROBE_DELAY);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+  probe_count = packet_count;
+  coap_clear_transaction(coap_get_transaction_by_mid(11));
+
+  UNIT_TEST_RUN(test_nstart);
+  UNIT_TEST_RUN(test_probing);
+
+  printf("=check-me= DONE\n");
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -34,4 +34,7 @@
 
 #define UNIT_TEST_PRINT_FUNCTION print_test_report
 
+#define MEMB_CONF_WITH_BITMAP 1
+#define MEMB_CONF_WITH_STATS  1
+
 #endif /* PROJECT_CONF_H_ */
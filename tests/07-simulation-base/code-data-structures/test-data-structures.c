@@ -36,6 +36,7 @@
 #include "lib/circular-list.h"
 #include "lib/dbl-list.h"
 #include "lib/dbl-circ-list.h"
+#include "lib/memb.h"
 #include "lib/random.h"
 #include "services/unit-test/unit-test.h"
 
@@ -1011,6 +1012,72 @@ UNIT_TEST(test_cdll)
   UNIT_TEST_END();
 }
 /*---------------------------------------------------------------------------*/
+/* Not a multiple of 32, to cover a partially used bitmap word */
+#define MEMB_TEST_COUNT 40
+MEMB(test_memb, demo_struct_t, MEMB_TEST_COUNT);
+
+UNIT_TEST_REGISTER(test_memb_alloc, "Memory block allocation");
+UNIT_TEST(test_memb_alloc)
+{
+  static demo_struct_t *blocks[MEMB_TEST_COUNT];
+  demo_struct_t *block;
+  int i;
+#if MEMB_WITH_STATS
+  struct memb *m;
+#endif /* MEMB_WITH_STATS */
+
+  UNIT_TEST_BEGIN();
+
+  memb_init(&test_memb);
+  UNIT_TEST_ASSERT(memb_numfree(&test_memb) == MEMB_TEST_COUNT);
+
+  /* Allocate all blocks, each one distinct and within the memory block */
+  for(i = 0; i < MEMB_TEST_COUNT; i++) {
+    blocks[i] = memb_alloc(&test_memb);
+    UNIT_TEST_ASSERT(blocks[i] != NULL);
+    UNIT_TEST_ASSERT(memb_inmemb(&test_memb, blocks[i]));
+    UNIT_TEST_ASSERT(i == 0 || blocks[i] != blocks[i - 1]);
+  }
+  UNIT_TEST_ASSERT(memb_numfree(&test_memb) == 0);
+  UNIT_TEST_ASSERT(memb_alloc(&test_memb) == NULL);
+
+  /* Freed blocks are handed out again */
+  UNIT_TEST_ASSERT(memb_free(&test_memb, blocks[33]) == 0);
+  UNIT_TEST_ASSERT(memb_free(&test_memb, blocks[5]) == 0);
+  UNIT_TEST_ASSERT(memb_numfree(&test_memb) == 2);
+  block = memb_alloc(&test_memb);
+  UNIT_TEST_ASSERT(block == blocks[5] || block == blocks[33]);
+  block = memb_alloc(&test_memb);
+  UNIT_TEST_ASSERT(block == blocks[5] || block == blocks[33]);
+  UNIT_TEST_ASSERT(memb_alloc(&test_memb) == NULL);
+
+  /* Pointers outside of the memory block or inside a block are rejected */
+  UNIT_TEST_ASSERT(memb_free(&test_memb, &elements[0]) == -1);
+  UNIT_TEST_ASSERT(memb_free(&test_memb, (char *)blocks[1] + 1) == -1);
+
+#if MEMB_WITH_STATS
+  UNIT_TEST_ASSERT(test_memb.nused == MEMB_TEST_COUNT);
+  UNIT_TEST_ASSERT(test_memb.max_used == MEMB_TEST_COUNT);
+  UNIT_TEST_ASSERT(test_memb.failures == 2);
+  for(m = memb_stats_list(); m != NULL && m != &test_memb; m = m->next);
+  UNIT_TEST_ASSERT(m == &test_memb);
+#endif /* MEMB_WITH_STATS */
+
+  for(i = 0; i < MEMB_TEST_COUNT; i++) {
+    UNIT_TEST_ASSERT(memb_free(&test_memb, blocks[i]) == 0);
+  }
+  UNIT_TEST_ASSERT(memb_numfree(&test_memb) == MEMB_TEST_COUNT);
+
+#if MEMB_WITH_STATS
+  UNIT_TEST_ASSERT(test_memb.nused == 0);
+  memb_stats_reset(&test_memb);
+  UNIT_TEST_ASSERT(test_memb.max_used == 0);
+  UNIT_TEST_ASSERT(test_memb.failures == 0);
+#endif /* MEMB_WITH_STATS */
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
 PROCESS_THREAD(data_structure_test_process, ev, data)
 {
   PROCESS_BEGIN();
@@ -1026,6 +1093,7 @@ PROCESS_THREAD(data_structure_test_process, ev, data)
   UNIT_TEST_RUN(test_csll);
   UNIT_TEST_RUN(test_dll);
   UNIT_TEST_RUN(test_cdll);
+  UNIT_TEST_RUN(test_memb_alloc);
 
   printf("=check-me= DONE\n");
 
@@ -0,0 +1,490 @@
+/*
+ * Copyright (c) 2018, RISE SICS.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Checks the registration of the LWM2M RD client with a cached
+ *         object list: the list is sent in one message when it fits one,
+ *         in Block1 blocks otherwise, and an Update carries it only when
+ *         it has changed. The server is simulated by the network driver.
+ */
+
+#include "contiki.h"
+#include "coap-engine.h"
+#include "lwm2m-engine.h"
+#include "lwm2m-object.h"
+#include "lwm2m-rd-client.h"
+#include "net/ipv6/uip.h"
+#include "net/ipv6/uip-ds6-nbr.h"
+#include "net/ipv6/uiplib.h"
+#include "net/netstack.h"
+#include "services/unit-test/unit-test.h"
+
+#include <stdio.h>
+#include <string.h>
+/*---------------------------------------------------------------------------*/
+#define MAX_INSTANCES   32
+#define SERVER_PORT     5683
+#define REPLIES         4
+#define MAX_LIST        512
+
+#define UIP_IP_BUF ((struct uip_udpip_hdr *)&uip_buf[UIP_LLH_LEN])
+/*---------------------------------------------------------------------------*/
+PROCESS(lwm2m_registration_test_process, "LWM2M registration test");
+PROCESS(reply_process, "LWM2M registration replies");
+AUTOSTART_PROCESSES(&reply_process, &lwm2m_registration_test_process);
+/*---------------------------------------------------------------------------*/
+static const lwm2m_resource_id_t resources[] = { RO(5700) };
+static lwm2m_object_instance_t instances[MAX_INSTANCES];
+static int instance_count;
+
+static coap_endpoint_t server_ep;
+
+/* Replies of the server, delivered by reply_process */
+static struct {
+  uint8_t message[COAP_MAX_HEADER_SIZE];
+  uint16_t len;
+} replies[REPLIES];
+static int reply_count;
+
+static coap_message_t message[1];
+static coap_message_t reply[1];
+static uint8_t buffer[COAP_MAX_PACKET_SIZE];
+
+/* What the server got */
+static char server_list[MAX_LIST + 1];
+static int server_list_len;
+static unsigned server_requests;
+static unsigned server_packets;
+static unsigned server_blocks;
+static unsigned server_payload;
+static int errors;
+
+/* A Register or Update, as the server and the client saw it */
+struct exchange {
+  unsigned requests;
+  unsigned packets;
+  unsigned blocks;
+  unsigned payload;
+  int list_len;
+  int list_ok;
+  lwm2m_rd_client_stats_t stats;
+};
+static lwm2m_rd_client_stats_t before;
+static struct exchange registration, same_list, small_change, large_list;
+static struct exchange large_same_list;
+/*---------------------------------------------------------------------------*/
+void
+print_test_report(const unit_test_t *utp)
+{
+  printf("=check-me= ");
+  if(utp->result == unit_test_failure) {
+    printf("FAILED   - %s: exit at L%u\n", utp->descr, utp->exit_line);
+  } else {
+    printf("SUCCEEDED - %s\n", utp->descr);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static lwm2m_status_t
+lwm2m_callback(lwm2m_object_instance_t *object, lwm2m_context_t *ctx)
+{
+  if(ctx->operation != LWM2M_OP_READ) {
+    return LWM2M_STATUS_NOT_IMPLEMENTED;
+  }
+  lwm2m_object_write_int(ctx, object->instance_id);
+  return LWM2M_STATUS_OK;
+}
+/*---------------------------------------------------------------------------*/
+static void
+init(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+static void
+input(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+static void
+add_reply(void)
+{
+  if(reply_count == REPLIES) {
+    errors++;
+    return;
+  }
+  replies[reply_count].len =
+    coap_serialize_message(reply, replies[reply_count].message);
+  reply_count++;
+  process_poll(&reply_process);
+}
+/*---------------------------------------------------------------------------*/
+/* The server, that collects the object list of Register and Update */
+static uint8_t
+output(const linkaddr_t *localdest)
+{
+  uint16_t len = uip_len - UIP_IPUDPH_LEN;
+  const char *path;
+  int path_len;
+  uint32_t block = 0;
+  uint8_t more = 0;
+  uint16_t size = 0;
+  int has_block;
+
+  if(uip_len == 0 || UIP_IP_BUF->proto != UIP_PROTO_UDP ||
+     UIP_IP_BUF->destport != UIP_HTONS(SERVER_PORT)) {
+    return 0;
+  }
+  memcpy(buffer, &uip_buf[UIP_LLH_LEN + UIP_IPUDPH_LEN], len);
+  if(coap_parse_message(message, buffer, len) != NO_ERROR ||
+     message->code != COAP_POST) {
+    errors++;
+    return 0;
+  }
+
+  server_packets++;
+  server_payload += message->payload_len;
+  has_block = coap_get_header_block1(message, &block, &more, &size, NULL);
+  if(has_block) {
+    server_blocks++;
+  }
+  if(message->payload_len > 0) {
+    if(block == 0) {
+      server_list_len = 0;
+    }
+    if(server_list_len + message->payload_len > MAX_LIST) {
+      errors++;
+      return 0;
+    }
+    memcpy(&server_list[server_list_len], message->payload,
+           message->payload_len);
+    server_list_len += message->payload_len;
+    server_list[server_list_len] = '\0';
+  }
+
+  coap_init_message(reply, COAP_TYPE_ACK, CHANGED_2_04, message->mid);
+  coap_set_token(reply, message->token, message->token_len);
+  if(has_block) {
+    coap_set_header_block1(reply, block, more, size);
+  }
+  path_len = coap_get_header_uri_path(message, &path);
+  if(more) {
+    reply->code = CONTINUE_2_31;
+  } else {
+    server_requests++;
+    if(path_len == 2 && strncmp(path, "rd", 2) == 0) {
+      reply->code = CREATED_2_01;
+      coap_set_header_location_path(reply, "rd/test");
+    }
+  }
+  add_reply();
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+const struct network_driver test_net_driver = {
+  "test",
+  init,
+  input,
+  output
+};
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(reply_process, ev, data)
+{
+  static uint8_t message[COAP_MAX_HEADER_SIZE];
+  int i;
+  uint16_t len;
+
+  PROCESS_BEGIN();
+
+  while(1) {
+    PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL);
+    for(i = 0; i < reply_count; i++) {
+      len = replies[i].len;
+      memcpy(message, replies[i].message, len);
+      coap_receive(&server_ep, message, len);
+    }
+    reply_count = 0;
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+static void
+add_instance(void)
+{
+  lwm2m_object_instance_t *instance = &instances[instance_count];
+
+  instance->object_id = 3303;
+  instance->instance_id = instance_count++;
+  instance->resource_ids = resources;
+  instance->resource_count = 1;
+  instance->callback = lwm2m_callback;
+  lwm2m_engine_add_object(instance);
+}
+/*---------------------------------------------------------------------------*/
+/* The object list of the engine, and whether the server has it */
+static int
+list_length(int *matches)
+{
+  static char list[MAX_LIST + 1];
+  lwm2m_buffer_t outbuf;
+  int len = 0;
+  int block = 0;
+  int more;
+
+  do {
+    outbuf.buffer = (uint8_t *)&list[len];
+    outbuf.size = COAP_MAX_BLOCK_SIZE;
+    outbuf.len = 0;
+    more = lwm2m_engine_set_rd_data(&outbuf, block++);
+    len += outbuf.len;
+  } while(more && len + COAP_MAX_BLOCK_SIZE <= MAX_LIST);
+  list[len] = '\0';
+
+  if(matches != NULL) {
+    *matches = strcmp(list, server_list) == 0;
+  }
+  return len;
+}
+/*---------------------------------------------------------------------------*/
+/* Add instances until the object list is longer than len */
+static void
+grow_list(int len)
+{
+  while(list_length(NULL) <= len && instance_count < MAX_INSTANCES) {
+    add_instance();
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+start_exchange(void)
+{
+  server_requests = 0;
+  server_packets = 0;
+  server_blocks = 0;
+  server_payload = 0;
+  before = *lwm2m_rd_client_get_stats();
+}
+/*---------------------------------------------------------------------------*/
+static void
+end_exchange(struct exchange *e)
+{
+  const lwm2m_rd_client_stats_t *stats = lwm2m_rd_client_get_stats();
+
+  e->requests = server_requests;
+  e->packets = server_packets;
+  e->blocks = server_blocks;
+  e->payload = server_payload;
+  e->list_len = list_length(&e->list_ok);
+  e->stats.registrations = stats->registrations - before.registrations;
+  e->stats.updates = stats->updates - before.updates;
+  e->stats.update_lists = stats->update_lists - before.update_lists;
+  e->stats.packets = stats->packets - before.packets;
+  e->stats.payload_bytes = stats->payload_bytes - before.payload_bytes;
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(test_register, "Register in one message");
+UNIT_TEST(test_register)
+{
+  UNIT_TEST_BEGIN();
+
+  /* longer than a block, but it fits a message */
+  UNIT_TEST_ASSERT(registration.list_len > COAP_MAX_BLOCK_SIZE);
+  UNIT_TEST_ASSERT(registration.list_len <= COAP_MAX_CHUNK_SIZE);
+
+  UNIT_TEST_ASSERT(registration.requests == 1);
+  UNIT_TEST_ASSERT(registration.packets == 1);
+  UNIT_TEST_ASSERT(registration.blocks == 0);
+  UNIT_TEST_ASSERT(registration.list_ok);
+
+  UNIT_TEST_ASSERT(registration.stats.registrations == 1);
+  UNIT_TEST_ASSERT(registration.stats.packets == 1);
+  UNIT_TEST_ASSERT(registration.stats.payload_bytes ==
+                   registration.list_len);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(test_same_list, "Update without a list change");
+UNIT_TEST(test_same_list)
+{
+  UNIT_TEST_BEGIN();
+
+  /* the engine reported a change, but the list is the same */
+  UNIT_TEST_ASSERT(same_list.requests == 1);
+  UNIT_TEST_ASSERT(same_list.packets == 1);
+  UNIT_TEST_ASSERT(same_list.payload == 0);
+
+  UNIT_TEST_ASSERT(same_list.stats.updates == 1);
+  UNIT_TEST_ASSERT(same_list.stats.update_lists == 0);
+  UNIT_TEST_ASSERT(same_list.stats.packets == 1);
+  UNIT_TEST_ASSERT(same_list.stats.payload_bytes == 0);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(test_list_change, "Update with a list change");
+UNIT_TEST(test_list_change)
+{
+  UNIT_TEST_BEGIN();
+
+  /* one more instance, the list still fits a message */
+  UNIT_TEST_ASSERT(small_change.list_len <= COAP_MAX_CHUNK_SIZE);
+  UNIT_TEST_ASSERT(small_change.packets == 1);
+  UNIT_TEST_ASSERT(small_change.blocks == 0);
+  UNIT_TEST_ASSERT(small_change.payload == small_change.list_len);
+  UNIT_TEST_ASSERT(small_change.list_ok);
+  UNIT_TEST_ASSERT(small_change.stats.updates == 1);
+  UNIT_TEST_ASSERT(small_change.stats.update_lists == 1);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(test_block1, "Update with a list in blocks");
+UNIT_TEST(test_block1)
+{
+  UNIT_TEST_BEGIN();
+
+  /* in blocks once it does not fit a message */
+  UNIT_TEST_ASSERT(large_list.list_len > COAP_MAX_CHUNK_SIZE);
+  UNIT_TEST_ASSERT(large_list.requests == 1);
+  UNIT_TEST_ASSERT(large_list.packets ==
+                   (large_list.list_len + COAP_MAX_BLOCK_SIZE - 1) /
+                   COAP_MAX_BLOCK_SIZE);
+  UNIT_TEST_ASSERT(large_list.blocks == large_list.packets);
+  UNIT_TEST_ASSERT(large_list.payload == large_list.list_len);
+  UNIT_TEST_ASSERT(large_list.list_ok);
+
+  UNIT_TEST_ASSERT(large_list.stats.updates == 1);
+  UNIT_TEST_ASSERT(large_list.stats.update_lists == 1);
+  UNIT_TEST_ASSERT(large_list.stats.packets == large_list.packets);
+  UNIT_TEST_ASSERT(large_list.stats.payload_bytes == large_list.list_len);
+
+  /* and left out again while it does not change */
+  UNIT_TEST_ASSERT(large_same_list.packets == 1);
+  UNIT_TEST_ASSERT(large_same_list.payload == 0);
+  UNIT_TEST_ASSERT(large_same_list.stats.update_lists == 0);
+  UNIT_TEST_ASSERT(errors == 0);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(lwm2m_registration_test_process, ev, data)
+{
+  static struct etimer timer;
+  static int waited;
+  uip_lladdr_t lladdr;
+
+  PROCESS_BEGIN();
+
+  printf("Run unit-test\n");
+  printf("---\n");
+
+  uiplib_ipaddrconv("fe80::1", &server_ep.ipaddr);
+  server_ep.port = UIP_HTONS(SERVER_PORT);
+  /* A reachable neighbor, so that no neighbor discovery is needed */
+  memset(&lladdr, 0, sizeof(lladdr));
+  lladdr.addr[0] = 1;
+  uip_ds6_nbr_add(&server_ep.ipaddr, &lladdr, 0, NBR_REACHABLE,
+                  NBR_TABLE_REASON_UNDEFINED, NULL);
+
+  lwm2m_engine_init();
+  grow_list(COAP_MAX_BLOCK_SIZE);
+
+  /* Register */
+  start_exchange();
+  lwm2m_rd_client_register_with_server(&server_ep);
+  lwm2m_rd_client_use_registration_server(1);
+  for(waited = 0; !lwm2m_rd_client_is_registered() && waited < 100; waited++) {
+    etimer_set(&timer, CLOCK_SECOND / 20);
+    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&timer));
+  }
+  end_exchange(&registration);
+
+  /* Update: the same object list, but the engine does not know that */
+  start_exchange();
+  lwm2m_engine_remove_object(&instances[0]);
+  lwm2m_engine_add_object(&instances[0]);
+  lwm2m_rd_client_update_triggered();
+  for(waited = 0; server_requests == 0 && waited < 100; waited++) {
+    etimer_set(&timer, CLOCK_SECOND / 20);
+    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&timer));
+  }
+  /* Until the client has the response */
+  etimer_set(&timer, CLOCK_SECOND / 20);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&timer));
+  end_exchange(&same_list);
+
+  /* Update: one more instance */
+  start_exchange();
+  add_instance();
+  lwm2m_rd_client_update_triggered();
+  for(waited = 0; server_requests == 0 && waited < 100; waited++) {
+    etimer_set(&timer, CLOCK_SECOND / 20);
+    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&timer));
+  }
+  etimer_set(&timer, CLOCK_SECOND / 20);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&timer));
+  end_exchange(&small_change);
+
+  /* Update: a list that does not fit a message */
+  start_exchange();
+  grow_list(COAP_MAX_CHUNK_SIZE + COAP_MAX_BLOCK_SIZE);
+  lwm2m_rd_client_update_triggered();
+  for(waited = 0; server_requests == 0 && waited < 100; waited++) {
+    etimer_set(&timer, CLOCK_SECOND / 20);
+    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&timer));
+  }
+  etimer_set(&timer, CLOCK_SECOND / 20);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&timer));
+  end_exchange(&large_list);
+
+  /* Update: that list again */
+  start_exchange();
+  lwm2m_engine_remove_object(&instances[0]);
+  lwm2m_engine_add_object(&instances[0]);
+  lwm2m_rd_client_update_triggered();
+  for(waited = 0; server_requests == 0 && waited < 100; waited++) {
+    etimer_set(&timer, CLOCK_SECOND / 20);
+    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&timer));
+  }
+  etimer_set(&timer, CLOCK_SECOND / 20);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&timer));
+  end_exchange(&large_same_list);
+
+  UNIT_TEST_RUN(test_register);
+  UNIT_TEST_RUN(test_same_list);
+  UNIT_TEST_RUN(test_list_change);
+  UNIT_TEST_RUN(test_block1);
+
+  printf("=check-me= DONE\n");
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
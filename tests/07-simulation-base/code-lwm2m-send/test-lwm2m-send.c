@@ -0,0 +1,529 @@
+/*
+ * Copyright (c) 2018, RISE SICS.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Checks the batching of LWM2M notifications and the Send
+ *         operation: changes within a window are notified and sent once,
+ *         with the values at the end of the window, a resource that fails
+ *         to read is left out of a Send, and a Send that finds no free
+ *         transaction is tried again. The server and the observers are
+ *         simulated by the network driver.
+ */
+
+#include "contiki.h"
+#include "coap-engine.h"
+#include "coap-transactions.h"
+#include "lwm2m-engine.h"
+#include "lwm2m-object.h"
+#include "lwm2m-rd-client.h"
+#include "lwm2m-send.h"
+#include "lwm2m-cbor.h"
+#include "net/ipv6/uip.h"
+#include "net/ipv6/uip-ds6-nbr.h"
+#include "net/ipv6/uiplib.h"
+#include "net/netstack.h"
+#include "services/unit-test/unit-test.h"
+
+#include <stdio.h>
+#include <string.h>
+/*---------------------------------------------------------------------------*/
+#define SENSORS         3
+#define FAILING_SENSOR  5702
+
+#define SERVER_PORT     5683
+#define OBSERVER_PORT   5684
+#define INSTANCE_OBSERVER_PORT 5685
+
+#define REPLIES         4
+
+/* Until a window has ended and its messages are acknowledged */
+#define WINDOW_WAIT     (CLOCK_SECOND * (LWM2M_SEND_WINDOW + 100) / 1000)
+
+#define UIP_IP_BUF ((struct uip_udpip_hdr *)&uip_buf[UIP_LLH_LEN])
+/*---------------------------------------------------------------------------*/
+PROCESS(lwm2m_send_test_process, "LWM2M Send test");
+PROCESS(reply_process, "LWM2M Send replies");
+AUTOSTART_PROCESSES(&reply_process, &lwm2m_send_test_process);
+/*---------------------------------------------------------------------------*/
+static const lwm2m_resource_id_t resources[SENSORS] = {
+  RO(5700), RO(5701), RO(FAILING_SENSOR)
+};
+static lwm2m_object_instance_t sensor;
+static int32_t values[SENSORS];
+/* Reading FAILING_SENSOR fails */
+static int read_fails;
+
+static coap_endpoint_t server_ep;
+static coap_endpoint_t observer_ep;
+static coap_endpoint_t instance_observer_ep;
+
+/* Replies of the server and the observers, delivered by reply_process */
+static struct {
+  coap_endpoint_t *endpoint;
+  uint8_t message[COAP_MAX_HEADER_SIZE];
+  uint16_t len;
+} replies[REPLIES];
+static int reply_count;
+
+static coap_message_t message[1];
+static coap_message_t reply[1];
+static uint8_t buffer[COAP_MAX_PACKET_SIZE];
+
+/* What the server and the observers got */
+static unsigned sends;
+static int send_records;
+static uint8_t send_payload[COAP_MAX_CHUNK_SIZE];
+static uint16_t send_payload_len;
+static unsigned notifications;
+static char notification[COAP_MAX_CHUNK_SIZE + 1];
+static unsigned instance_notifications;
+static char instance_notification[COAP_MAX_CHUNK_SIZE + 1];
+static int errors;
+
+/* What the test process saw at each step */
+static int registered;
+static unsigned notify_early, notify_count, notify_instance_count;
+static int notify_value_ok, notify_instance_ok;
+static unsigned window_early, window_sends, window_changes;
+static unsigned window_stat_sends, window_stat_resources;
+static int window_records, window_last_value, window_first_value;
+static unsigned failing_sends;
+static int failing_records, failing_values;
+static unsigned blocked_sends, blocked_failures, retried_sends;
+static int retried_value;
+/*---------------------------------------------------------------------------*/
+void
+print_test_report(const unit_test_t *utp)
+{
+  printf("=check-me= ");
+  if(utp->result == unit_test_failure) {
+    printf("FAILED   - %s: exit at L%u\n", utp->descr, utp->exit_line);
+  } else {
+    printf("SUCCEEDED - %s\n", utp->descr);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static lwm2m_status_t
+lwm2m_callback(lwm2m_object_instance_t *object, lwm2m_context_t *ctx)
+{
+  if(ctx->operation != LWM2M_OP_READ) {
+    return LWM2M_STATUS_NOT_IMPLEMENTED;
+  }
+  if(ctx->resource_id == FAILING_SENSOR && read_fails) {
+    return LWM2M_STATUS_READ_ERROR;
+  }
+  if(ctx->resource_id < 5700 || ctx->resource_id >= 5700 + SENSORS) {
+    return LWM2M_STATUS_NOT_FOUND;
+  }
+  lwm2m_object_write_int(ctx, values[ctx->resource_id - 5700]);
+  return LWM2M_STATUS_OK;
+}
+/*---------------------------------------------------------------------------*/
+static void
+init(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+static void
+input(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+static void
+add_reply(coap_endpoint_t *endpoint)
+{
+  if(reply_count == REPLIES) {
+    errors++;
+    return;
+  }
+  replies[reply_count].endpoint = endpoint;
+  replies[reply_count].len =
+    coap_serialize_message(reply, replies[reply_count].message);
+  reply_count++;
+  process_poll(&reply_process);
+}
+/*---------------------------------------------------------------------------*/
+/* Counts the SenML records of a Send */
+static int
+count_records(const uint8_t *payload, int len)
+{
+  int pos = 1;
+  int records = 0;
+  size_t size;
+
+  if(len < 2 || payload[0] != (LWM2M_CBOR_ARRAY | LWM2M_CBOR_INDEFINITE)) {
+    return -1;
+  }
+  while(pos < len && payload[pos] != LWM2M_CBOR_BREAK) {
+    size = lwm2m_cbor_item_size(&payload[pos], len - pos);
+    if(size == 0) {
+      return -1;
+    }
+    pos += size;
+    records++;
+  }
+  return pos == len - 1 ? records : -1;
+}
+/*---------------------------------------------------------------------------*/
+/* Whether the last Send has a record with the value */
+static int
+send_has_value(int32_t value)
+{
+  uint8_t item[8];
+  size_t len;
+  int i;
+
+  /* The label of the value, then the value */
+  item[0] = 2;
+  len = 1 + lwm2m_cbor_write_int(&item[1], sizeof(item) - 1, value);
+  for(i = 0; i + len <= send_payload_len; i++) {
+    if(memcmp(&send_payload[i], item, len) == 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+/* The server and the observers */
+static uint8_t
+output(const linkaddr_t *localdest)
+{
+  uint16_t len = uip_len - UIP_IPUDPH_LEN;
+  const char *path;
+  int path_len;
+
+  if(uip_len == 0 || UIP_IP_BUF->proto != UIP_PROTO_UDP) {
+    return 0;
+  }
+  memcpy(buffer, &uip_buf[UIP_LLH_LEN + UIP_IPUDPH_LEN], len);
+  if(coap_parse_message(message, buffer, len) != NO_ERROR) {
+    errors++;
+    return 0;
+  }
+
+  if(UIP_IP_BUF->destport == UIP_HTONS(SERVER_PORT)) {
+    if(message->code != COAP_POST) {
+      return 0;
+    }
+    coap_init_message(reply, COAP_TYPE_ACK, CHANGED_2_04, message->mid);
+    coap_set_token(reply, message->token, message->token_len);
+    path_len = coap_get_header_uri_path(message, &path);
+    if(path_len == 2 && strncmp(path, "rd", 2) == 0) {
+      /* Registration */
+      reply->code = CREATED_2_01;
+      coap_set_header_location_path(reply, "rd/test");
+    } else if(path_len == 2 && strncmp(path, "dp", 2) == 0) {
+      sends++;
+      send_records = count_records(message->payload, message->payload_len);
+      memcpy(send_payload, message->payload, message->payload_len);
+      send_payload_len = message->payload_len;
+    }
+    add_reply(&server_ep);
+  } else if(UIP_IP_BUF->destport == UIP_HTONS(OBSERVER_PORT) ||
+            UIP_IP_BUF->destport == UIP_HTONS(INSTANCE_OBSERVER_PORT)) {
+    if(coap_is_option(message, COAP_OPTION_OBSERVE) &&
+       message->type != COAP_TYPE_ACK) {
+      if(UIP_IP_BUF->destport == UIP_HTONS(INSTANCE_OBSERVER_PORT)) {
+        instance_notifications++;
+        memcpy(instance_notification, message->payload,
+               message->payload_len);
+        instance_notification[message->payload_len] = '\0';
+      } else {
+        notifications++;
+        memcpy(notification, message->payload, message->payload_len);
+        notification[message->payload_len] = '\0';
+      }
+    }
+    if(message->type == COAP_TYPE_CON) {
+      coap_init_message(reply, COAP_TYPE_ACK, 0, message->mid);
+      add_reply(UIP_IP_BUF->destport == UIP_HTONS(OBSERVER_PORT) ?
+                &observer_ep : &instance_observer_ep);
+    }
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+const struct network_driver test_net_driver = {
+  "test",
+  init,
+  input,
+  output
+};
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(reply_process, ev, data)
+{
+  static uint8_t message[COAP_MAX_HEADER_SIZE];
+  int i;
+  uint16_t len;
+
+  PROCESS_BEGIN();
+
+  while(1) {
+    PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL);
+    /* A reply may make the client send more */
+    for(i = 0; i < reply_count; i++) {
+      len = replies[i].len;
+      memcpy(message, replies[i].message, len);
+      coap_receive(replies[i].endpoint, message, len);
+    }
+    reply_count = 0;
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+static void
+add_endpoint(coap_endpoint_t *endpoint, const char *address, uint16_t port)
+{
+  uip_lladdr_t lladdr;
+
+  uiplib_ipaddrconv(address, &endpoint->ipaddr);
+  endpoint->port = UIP_HTONS(port);
+  /* A reachable neighbor, so that no neighbor discovery is needed */
+  memset(&lladdr, 0, sizeof(lladdr));
+  lladdr.addr[0] = port & 0xff;
+  uip_ds6_nbr_add(&endpoint->ipaddr, &lladdr, 0, NBR_REACHABLE,
+                  NBR_TABLE_REASON_UNDEFINED, NULL);
+}
+/*---------------------------------------------------------------------------*/
+static void
+observe(coap_endpoint_t *endpoint, const char *path, uint8_t token)
+{
+  uint8_t request[COAP_MAX_HEADER_SIZE];
+  coap_message_t get[1];
+
+  coap_init_message(get, COAP_TYPE_CON, COAP_GET, coap_get_mid());
+  coap_set_token(get, &token, 1);
+  coap_set_header_uri_path(get, path);
+  coap_set_header_observe(get, 0);
+  coap_receive(endpoint, request, coap_serialize_message(get, request));
+}
+/*---------------------------------------------------------------------------*/
+static void
+change(uint16_t resource_id, int32_t value)
+{
+  values[resource_id - 5700] = value;
+  lwm2m_notify_object_observers(&sensor, resource_id);
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(test_notify_window, "Notifications in a window");
+UNIT_TEST(test_notify_window)
+{
+  UNIT_TEST_BEGIN();
+
+  UNIT_TEST_ASSERT(registered);
+
+  /* nothing before the end of the window */
+  UNIT_TEST_ASSERT(notify_early == 0);
+
+  /* then one per observer, with the last values */
+  UNIT_TEST_ASSERT(notify_count == 1);
+  UNIT_TEST_ASSERT(notify_value_ok);
+  UNIT_TEST_ASSERT(notify_instance_count == 1);
+  UNIT_TEST_ASSERT(notify_instance_ok);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(test_send_window, "Send of the changes in a window");
+UNIT_TEST(test_send_window)
+{
+  UNIT_TEST_BEGIN();
+
+  UNIT_TEST_ASSERT(window_early == 0);
+  UNIT_TEST_ASSERT(window_sends == 1);
+
+  /* each resource once, with its value at the end of the window */
+  UNIT_TEST_ASSERT(window_records == 2);
+  UNIT_TEST_ASSERT(window_last_value);
+  UNIT_TEST_ASSERT(!window_first_value);
+
+  UNIT_TEST_ASSERT(window_changes == 3);
+  UNIT_TEST_ASSERT(window_stat_sends == 1);
+  UNIT_TEST_ASSERT(window_stat_resources == 2);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(test_failing_read, "Send without a failing resource");
+UNIT_TEST(test_failing_read)
+{
+  UNIT_TEST_BEGIN();
+
+  /* the resources around it are still sent together */
+  UNIT_TEST_ASSERT(failing_sends == 1);
+  UNIT_TEST_ASSERT(failing_records == 2);
+  UNIT_TEST_ASSERT(failing_values);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(test_no_transaction, "Send without a free transaction");
+UNIT_TEST(test_no_transaction)
+{
+  UNIT_TEST_BEGIN();
+
+  UNIT_TEST_ASSERT(blocked_sends == 0);
+  UNIT_TEST_ASSERT(blocked_failures == 1);
+
+  /* sent once a transaction is free again */
+  UNIT_TEST_ASSERT(retried_sends == 1);
+  UNIT_TEST_ASSERT(retried_value);
+  UNIT_TEST_ASSERT(errors == 0);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(lwm2m_send_test_process, ev, data)
+{
+  static struct etimer timer;
+  static coap_transaction_t *blocking[COAP_MAX_OPEN_TRANSACTIONS];
+  static int blocking_count;
+  static lwm2m_send_stats_t before;
+  static int waited;
+  int i;
+
+  PROCESS_BEGIN();
+
+  printf("Run unit-test\n");
+  printf("---\n");
+
+  add_endpoint(&server_ep, "fe80::1", SERVER_PORT);
+  add_endpoint(&observer_ep, "fe80::2", OBSERVER_PORT);
+  add_endpoint(&instance_observer_ep, "fe80::3", INSTANCE_OBSERVER_PORT);
+
+  lwm2m_engine_init();
+  sensor.object_id = 3303;
+  sensor.instance_id = 0;
+  sensor.resource_ids = resources;
+  sensor.resource_count = SENSORS;
+  sensor.callback = lwm2m_callback;
+  lwm2m_engine_add_object(&sensor);
+
+  lwm2m_rd_client_register_with_server(&server_ep);
+  lwm2m_rd_client_use_registration_server(1);
+  for(waited = 0; !lwm2m_rd_client_is_registered() && waited < 50; waited++) {
+    etimer_set(&timer, CLOCK_SECOND / 10);
+    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&timer));
+  }
+  registered = lwm2m_rd_client_is_registered();
+
+  observe(&instance_observer_ep, "3303/0", 1);
+  observe(&observer_ep, "3303/0/5700", 2);
+  etimer_set(&timer, CLOCK_SECOND / 10);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&timer));
+
+  /* Notifications: two changes of a resource and one of another */
+  notifications = instance_notifications = 0;
+  change(5700, 101);
+  change(5700, 102);
+  change(5701, 201);
+  notify_early = notifications + instance_notifications;
+  etimer_set(&timer, WINDOW_WAIT);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&timer));
+  notify_count = notifications;
+  notify_value_ok = strstr(notification, "102") != NULL &&
+    strstr(notification, "101") == NULL;
+  notify_instance_count = instance_notifications;
+  notify_instance_ok = strstr(instance_notification, "102") != NULL &&
+    strstr(instance_notification, "201") != NULL;
+
+  /* Send: the same, values are read at the end of the window */
+  sends = 0;
+  before = *lwm2m_send_get_stats();
+  values[0] = 111;
+  lwm2m_send_resource(&sensor, 5700);
+  values[0] = 112;
+  lwm2m_send_resource(&sensor, 5700);
+  values[1] = 211;
+  lwm2m_send_resource(&sensor, 5701);
+  window_early = sends;
+  etimer_set(&timer, WINDOW_WAIT);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&timer));
+  window_sends = sends;
+  window_records = send_records;
+  window_last_value = send_has_value(112) && send_has_value(211);
+  window_first_value = send_has_value(111);
+  window_changes = lwm2m_send_get_stats()->changes - before.changes;
+  window_stat_sends = lwm2m_send_get_stats()->sends - before.sends;
+  window_stat_resources = lwm2m_send_get_stats()->resources -
+    before.resources;
+
+  /* A resource that fails to read, between two that do not */
+  sends = 0;
+  values[0] = 121;
+  values[1] = 221;
+  read_fails = 1;
+  lwm2m_send_resource(&sensor, 5700);
+  lwm2m_send_resource(&sensor, FAILING_SENSOR);
+  lwm2m_send_resource(&sensor, 5701);
+  lwm2m_send_flush();
+  read_fails = 0;
+  etimer_set(&timer, WINDOW_WAIT);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&timer));
+  failing_sends = sends;
+  failing_records = send_records;
+  failing_values = send_has_value(121) && send_has_value(221);
+
+  /* All transactions taken */
+  sends = 0;
+  before = *lwm2m_send_get_stats();
+  for(blocking_count = 0; blocking_count < COAP_MAX_OPEN_TRANSACTIONS;
+      blocking_count++) {
+    blocking[blocking_count] =
+      coap_new_transaction(coap_get_mid(), &server_ep);
+    if(blocking[blocking_count] == NULL) {
+      break;
+    }
+  }
+  values[0] = 131;
+  lwm2m_send_resource(&sensor, 5700);
+  lwm2m_send_flush();
+  blocked_sends = sends;
+  blocked_failures = lwm2m_send_get_stats()->failures - before.failures;
+  for(i = 0; i < blocking_count; i++) {
+    coap_clear_transaction(blocking[i]);
+  }
+  etimer_set(&timer, WINDOW_WAIT);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&timer));
+  retried_sends = sends;
+  retried_value = send_has_value(131);
+
+  UNIT_TEST_RUN(test_notify_window);
+  UNIT_TEST_RUN(test_send_window);
+  UNIT_TEST_RUN(test_failing_read);
+  UNIT_TEST_RUN(test_no_transaction);
+
+  printf("=check-me= DONE\n");
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,632 @@
+/*
+ * Copyright (c) 2018, RISE SICS.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Drives the in-flight window of the MQTT engine against a broker
+ *         stand-in listening on the node itself, which takes a fixed time
+ *         to acknowledge each message. Publishes QoS 1 and QoS 2 messages,
+ *         receives QoS 1 and QoS 2 messages, lets a message go
+ *         unacknowledged, and publishes through a broker outage. The
+ *         broker checks that every message arrives once and in order,
+ *         repeated only with the DUP flag. Build with MQTT_QUEUE=0 to
+ *         check the engine without an outbound queue.
+ */
+
+#include "contiki.h"
+#include "mqtt.h"
+#include "net/ipv6/uip.h"
+#include "net/ipv6/uip-ds6.h"
+#include "net/ipv6/uiplib.h"
+#include "net/ipv6/tcp-socket.h"
+#include "net/netstack.h"
+#include "services/unit-test/unit-test.h"
+
+#include <stdio.h>
+#include <string.h>
+/*---------------------------------------------------------------------------*/
+#define BROKER_PORT     1883
+/* Time the broker takes to acknowledge a message */
+#define ACK_DELAY       (CLOCK_SECOND / 50)
+/* Time the engine waits for an acknowledgement, checked every half of it */
+#define ACK_TIMEOUT     (CLOCK_SECOND * 10)
+#define QOS1_MESSAGES   100
+#define QOS2_MESSAGES   50
+#define OUTAGE_MESSAGES 40
+#define ACK_QUEUE_LEN   128
+/*---------------------------------------------------------------------------*/
+PROCESS(mqtt_inflight_test_process, "MQTT in-flight test");
+PROCESS(broker_process, "Broker");
+AUTOSTART_PROCESSES(&broker_process, &mqtt_inflight_test_process);
+/*---------------------------------------------------------------------------*/
+/* Broker stand-in */
+static struct tcp_socket broker_socket;
+static uint8_t broker_in[MQTT_TCP_OUTPUT_BUFF_SIZE * 2];
+static uint8_t broker_out[MQTT_TCP_INPUT_BUFF_SIZE * 2];
+static uint8_t broker_rx[MQTT_TCP_OUTPUT_BUFF_SIZE * 2];
+static int broker_rx_len;
+/* Ignores everything, as if the broker had gone */
+static int broker_silent;
+
+/* Acknowledgements sent once due */
+static struct {
+  clock_time_t due;
+  uint8_t type;
+  uint16_t mid;
+} acks[ACK_QUEUE_LEN];
+static int acks_head;
+static int acks_count;
+
+/* What the broker got in the current phase */
+static uint32_t expected_seq;
+static unsigned dup_flags;
+static clock_time_t dup_time;
+static unsigned pubrels;
+static unsigned client_pubacks;
+static unsigned client_pubcomps;
+/* Messages not acknowledged yet, the most at any time */
+static unsigned outstanding;
+static unsigned max_outstanding;
+static int errors;
+
+/* Client */
+static struct mqtt_connection conn;
+static char broker_host[48];
+static uint8_t payloads[QOS1_MESSAGES][4];
+static unsigned connects;
+static unsigned disconnects;
+static unsigned subacks;
+static unsigned pubacks;
+static unsigned pubcomps;
+static unsigned received;
+static unsigned received_errors;
+static unsigned timeout_events;
+static uint16_t timeout_mid;
+static clock_time_t timeout_time;
+
+/* What the test process saw at each step */
+static unsigned qos_acked[3], qos_received[3], qos_pubrels[3];
+static unsigned qos_window[3];
+static unsigned subscribed, delivered, delivered_pubacks, delivered_pubcomps;
+static uint16_t silent_mid;
+static clock_time_t silent_start;
+static unsigned silent_acked, silent_dups, silent_received;
+#if MQTT_OUT_QUEUE_SIZE > 0
+static unsigned outage_acked, outage_received, outage_dups, outage_connects;
+#endif /* MQTT_OUT_QUEUE_SIZE > 0 */
+/*---------------------------------------------------------------------------*/
+void
+print_test_report(const unit_test_t *utp)
+{
+  printf("=check-me= ");
+  if(utp->result == unit_test_failure) {
+    printf("FAILED   - %s: exit at L%u\n", utp->descr, utp->exit_line);
+  } else {
+    printf("SUCCEEDED - %s\n", utp->descr);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+init(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+static void
+input(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t
+output(const linkaddr_t *localdest)
+{
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+const struct network_driver test_net_driver = {
+  "test",
+  init,
+  input,
+  output
+};
+/*---------------------------------------------------------------------------*/
+static void
+broker_send(const uint8_t *data, int len)
+{
+  if(tcp_socket_send(&broker_socket, data, len) != len) {
+    printf("Broker output full\n");
+    errors++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+broker_ack(uint8_t type, uint16_t mid, clock_time_t delay)
+{
+  int i;
+
+  if(acks_count == ACK_QUEUE_LEN) {
+    errors++;
+    return;
+  }
+  i = (acks_head + acks_count) % ACK_QUEUE_LEN;
+  acks[i].due = clock_time() + delay;
+  acks[i].type = type;
+  acks[i].mid = mid;
+  acks_count++;
+  process_poll(&broker_process);
+}
+/*---------------------------------------------------------------------------*/
+static void
+broker_publish(const uint8_t *data, int len)
+{
+  uint8_t qos = (data[0] >> 1) & 0x03;
+  uint16_t topic_len = (data[2] << 8) | data[3];
+  const uint8_t *p = &data[4 + topic_len];
+  uint16_t mid = 0;
+  uint32_t seq;
+
+  if(qos > 0) {
+    mid = (p[0] << 8) | p[1];
+    p += 2;
+  }
+  seq = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | (p[2] << 8) | p[3];
+
+  if(data[0] & 0x08) {
+    dup_flags++;
+    dup_time = clock_time();
+  }
+  if(seq == expected_seq) {
+    expected_seq++;
+  } else if(!(data[0] & 0x08) || seq > expected_seq) {
+    printf("Broker got %lu, expected %lu\n", (unsigned long)seq,
+           (unsigned long)expected_seq);
+    errors++;
+  }
+
+  if(qos > 0 && ++outstanding > max_outstanding) {
+    max_outstanding = outstanding;
+  }
+  if(qos == 1) {
+    broker_ack(0x40, mid, ACK_DELAY);
+  } else if(qos == 2) {
+    broker_ack(0x50, mid, ACK_DELAY);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Handles one complete packet from the client */
+static void
+broker_packet(const uint8_t *data, int len)
+{
+  static const uint8_t connack[] = { 0x20, 0x02, 0x00, 0x00 };
+  static const uint8_t pingresp[] = { 0xD0, 0x00 };
+  uint16_t mid = len >= 4 ? (data[2] << 8) | data[3] : 0;
+  uint8_t suback[5];
+
+  if(broker_silent) {
+    return;
+  }
+
+  switch(data[0] & 0xF0) {
+  case 0x10:
+    broker_send(connack, sizeof(connack));
+    break;
+  case 0x30:
+    broker_publish(data, len);
+    break;
+  case 0x40:
+    client_pubacks++;
+    break;
+  case 0x50:
+    broker_ack(0x62, mid, 0);
+    break;
+  case 0x60:
+    pubrels++;
+    broker_ack(0x70, mid, ACK_DELAY);
+    break;
+  case 0x70:
+    client_pubcomps++;
+    break;
+  case 0x80:
+    suback[0] = 0x90;
+    suback[1] = 0x03;
+    suback[2] = data[2];
+    suback[3] = data[3];
+    suback[4] = data[len - 1];
+    broker_send(suback, sizeof(suback));
+    break;
+  case 0xC0:
+    broker_send(pingresp, sizeof(pingresp));
+    break;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static int
+broker_input(struct tcp_socket *s, void *ptr, const uint8_t *data, int len)
+{
+  int pos = 0;
+  int packet_len;
+
+  if(broker_rx_len + len > sizeof(broker_rx)) {
+    errors++;
+    return 0;
+  }
+  memcpy(&broker_rx[broker_rx_len], data, len);
+  broker_rx_len += len;
+
+  /* The remaining length of our packets fits in one byte */
+  while(broker_rx_len - pos >= 2 &&
+        broker_rx_len - pos >= 2 + broker_rx[pos + 1]) {
+    packet_len = 2 + broker_rx[pos + 1];
+    broker_packet(&broker_rx[pos], packet_len);
+    pos += packet_len;
+  }
+  memmove(broker_rx, &broker_rx[pos], broker_rx_len - pos);
+  broker_rx_len -= pos;
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+broker_event(struct tcp_socket *s, void *ptr, tcp_socket_event_t event)
+{
+  if(event == TCP_SOCKET_CONNECTED || event == TCP_SOCKET_CLOSED) {
+    broker_rx_len = 0;
+    acks_count = 0;
+    outstanding = 0;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Sends the acknowledgements of the broker when they are due */
+PROCESS_THREAD(broker_process, ev, data)
+{
+  static struct etimer et;
+  uint8_t ack[4];
+
+  PROCESS_BEGIN();
+
+  tcp_socket_register(&broker_socket, NULL,
+                      broker_in, sizeof(broker_in),
+                      broker_out, sizeof(broker_out),
+                      broker_input, broker_event);
+  tcp_socket_listen(&broker_socket, BROKER_PORT);
+
+  while(1) {
+    while(acks_count > 0) {
+      if(acks[acks_head].due > clock_time()) {
+        etimer_set(&et, acks[acks_head].due - clock_time());
+        break;
+      }
+      ack[0] = acks[acks_head].type;
+      ack[1] = 2;
+      ack[2] = acks[acks_head].mid >> 8;
+      ack[3] = acks[acks_head].mid & 0xff;
+      acks_head = (acks_head + 1) % ACK_QUEUE_LEN;
+      acks_count--;
+      /* The message leaves the window with its PUBACK or PUBCOMP */
+      if((ack[0] == 0x40 || ack[0] == 0x70) && outstanding > 0) {
+        outstanding--;
+      }
+      broker_send(ack, sizeof(ack));
+    }
+    PROCESS_WAIT_EVENT();
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+/* QoS 1 PUBLISH, a QoS 2 PUBLISH twice, the second time with DUP set */
+static void
+broker_publish_to_client(void)
+{
+  static const uint8_t packets[] = {
+    0x32, 0x07, 0x00, 0x02, 'i', 'n', 0x00, 0x64, 'a',
+    0x34, 0x07, 0x00, 0x02, 'i', 'n', 0x00, 0x65, 'b',
+    0x3C, 0x07, 0x00, 0x02, 'i', 'n', 0x00, 0x65, 'b',
+  };
+
+  broker_send(packets, sizeof(packets));
+}
+/*---------------------------------------------------------------------------*/
+static void
+mqtt_event(struct mqtt_connection *m, mqtt_event_t event, void *data)
+{
+  struct mqtt_message *msg;
+
+  switch(event) {
+  case MQTT_EVENT_CONNECTED:
+    connects++;
+    break;
+  case MQTT_EVENT_DISCONNECTED:
+    disconnects++;
+    break;
+  case MQTT_EVENT_SUBACK:
+    subacks++;
+    break;
+  case MQTT_EVENT_PUBACK:
+    pubacks++;
+    break;
+  case MQTT_EVENT_PUBCOMP:
+    pubcomps++;
+    break;
+  case MQTT_EVENT_PUBLISH:
+    msg = data;
+    if(strcmp(msg->topic, "in") != 0 || msg->payload_chunk_length != 1 ||
+       msg->payload_chunk[0] != (received == 0 ? 'a' : 'b')) {
+      received_errors++;
+    }
+    received++;
+    break;
+  case MQTT_EVENT_PUBLISH_TIMEOUT_ERROR:
+    timeout_events++;
+    timeout_mid = *(uint16_t *)data;
+    timeout_time = clock_time();
+    break;
+  default:
+    break;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+set_payload(uint32_t seq)
+{
+  uint8_t *p = payloads[seq % QOS1_MESSAGES];
+
+  p[0] = seq >> 24;
+  p[1] = seq >> 16;
+  p[2] = seq >> 8;
+  p[3] = seq;
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(test_qos1, "QoS 1 through the window");
+UNIT_TEST(test_qos1)
+{
+  UNIT_TEST_BEGIN();
+
+  UNIT_TEST_ASSERT(connects >= 1);
+  UNIT_TEST_ASSERT(qos_acked[1] == QOS1_MESSAGES);
+  UNIT_TEST_ASSERT(qos_received[1] == QOS1_MESSAGES);
+  /* more than one message at a time, never more than the window */
+  UNIT_TEST_ASSERT(qos_window[1] > 1);
+  UNIT_TEST_ASSERT(qos_window[1] <= MQTT_MAX_INFLIGHT);
+  UNIT_TEST_ASSERT(qos_pubrels[1] == 0);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(test_qos2, "QoS 2 through the window");
+UNIT_TEST(test_qos2)
+{
+  UNIT_TEST_BEGIN();
+
+  UNIT_TEST_ASSERT(qos_acked[2] == QOS2_MESSAGES);
+  UNIT_TEST_ASSERT(qos_received[2] == QOS2_MESSAGES);
+  UNIT_TEST_ASSERT(qos_window[2] > 1);
+  UNIT_TEST_ASSERT(qos_window[2] <= MQTT_MAX_INFLIGHT);
+  UNIT_TEST_ASSERT(qos_pubrels[2] == QOS2_MESSAGES);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(test_receive, "QoS 1 and QoS 2 from the broker");
+UNIT_TEST(test_receive)
+{
+  UNIT_TEST_BEGIN();
+
+  UNIT_TEST_ASSERT(subscribed == 1);
+  /* the repeated QoS 2 message is delivered once */
+  UNIT_TEST_ASSERT(delivered == 2);
+  UNIT_TEST_ASSERT(received_errors == 0);
+  UNIT_TEST_ASSERT(delivered_pubacks == 1);
+  UNIT_TEST_ASSERT(delivered_pubcomps > 0);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(test_ack_timeout, "Message not acknowledged");
+UNIT_TEST(test_ack_timeout)
+{
+  UNIT_TEST_BEGIN();
+
+#if MQTT_OUT_QUEUE_SIZE > 0
+  /* sent again from the queue with DUP once the timeout is over */
+  UNIT_TEST_ASSERT(silent_dups == 1);
+  UNIT_TEST_ASSERT(dup_time - silent_start >= ACK_TIMEOUT);
+  UNIT_TEST_ASSERT(dup_time - silent_start <= ACK_TIMEOUT * 3 / 2 + CLOCK_SECOND);
+  UNIT_TEST_ASSERT(silent_received == 1);
+  UNIT_TEST_ASSERT(silent_acked == 1);
+  UNIT_TEST_ASSERT(timeout_events == 0);
+#else /* MQTT_OUT_QUEUE_SIZE > 0 */
+  /* nothing to send again, dropped with an event */
+  UNIT_TEST_ASSERT(silent_dups == 0);
+  UNIT_TEST_ASSERT(silent_acked == 0);
+  UNIT_TEST_ASSERT(timeout_events == 1);
+  UNIT_TEST_ASSERT(timeout_mid == silent_mid);
+  UNIT_TEST_ASSERT(timeout_time - silent_start >= ACK_TIMEOUT);
+  UNIT_TEST_ASSERT(conn.inflight_count == 0);
+#endif /* MQTT_OUT_QUEUE_SIZE > 0 */
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+#if MQTT_OUT_QUEUE_SIZE > 0
+UNIT_TEST_REGISTER(test_outage, "Publishing through a broker outage");
+UNIT_TEST(test_outage)
+{
+  UNIT_TEST_BEGIN();
+
+  UNIT_TEST_ASSERT(outage_connects == 2);
+  UNIT_TEST_ASSERT(outage_acked == OUTAGE_MESSAGES);
+  UNIT_TEST_ASSERT(outage_received == OUTAGE_MESSAGES);
+  UNIT_TEST_ASSERT(outage_dups > 0);
+
+  UNIT_TEST_END();
+}
+#endif /* MQTT_OUT_QUEUE_SIZE > 0 */
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(test_broker, "Every message once and in order");
+UNIT_TEST(test_broker)
+{
+  UNIT_TEST_BEGIN();
+
+  UNIT_TEST_ASSERT(errors == 0);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(mqtt_inflight_test_process, ev, data)
+{
+  static struct etimer et;
+  static uint32_t seq;
+  static unsigned messages;
+  static mqtt_qos_level_t qos;
+  uint16_t mid;
+
+  PROCESS_BEGIN();
+
+  printf("Run unit-test\n");
+  printf("---\n");
+
+  uiplib_ipaddr_snprint(broker_host, sizeof(broker_host),
+                        &uip_ds6_get_link_local(-1)->ipaddr);
+  mqtt_register(&conn, &mqtt_inflight_test_process, "inflight", mqtt_event,
+                256);
+  /* Reconnecting is up to the application, as in the examples */
+  conn.auto_reconnect = 0;
+  mqtt_connect(&conn, broker_host, BROKER_PORT, 60);
+
+  etimer_set(&et, CLOCK_SECOND * 5);
+  PROCESS_WAIT_EVENT_UNTIL(mqtt_connected(&conn) || etimer_expired(&et));
+
+  /* QoS 1 then QoS 2, as fast as the window lets them through */
+  for(qos = MQTT_QOS_LEVEL_1; qos <= MQTT_QOS_LEVEL_2; qos++) {
+    messages = qos == MQTT_QOS_LEVEL_1 ? QOS1_MESSAGES : QOS2_MESSAGES;
+    expected_seq = 0;
+    pubacks = pubcomps = pubrels = 0;
+    max_outstanding = 0;
+    etimer_set(&et, CLOCK_SECOND * 30);
+    for(seq = 0; seq < messages && !etimer_expired(&et);) {
+      set_payload(seq);
+      if(mqtt_publish(&conn, &mid, qos == MQTT_QOS_LEVEL_1 ? "q1" : "q2",
+                      payloads[seq], 4, qos, MQTT_RETAIN_OFF)
+         == MQTT_STATUS_OK) {
+        seq++;
+      } else {
+        PROCESS_WAIT_EVENT();
+      }
+    }
+    PROCESS_WAIT_EVENT_UNTIL(pubacks + pubcomps == messages ||
+                             etimer_expired(&et));
+    qos_acked[qos] = pubacks + pubcomps;
+    qos_received[qos] = expected_seq;
+    qos_pubrels[qos] = pubrels;
+    qos_window[qos] = max_outstanding;
+  }
+
+  /* Messages from the broker */
+  etimer_set(&et, CLOCK_SECOND * 5);
+  while(mqtt_subscribe(&conn, NULL, "in", MQTT_QOS_LEVEL_2) != MQTT_STATUS_OK &&
+        !etimer_expired(&et)) {
+    PROCESS_WAIT_EVENT();
+  }
+  PROCESS_WAIT_EVENT_UNTIL(subacks == 1 || etimer_expired(&et));
+  subscribed = subacks;
+  broker_publish_to_client();
+  PROCESS_WAIT_EVENT_UNTIL((client_pubacks == 1 && client_pubcomps > 0) ||
+                           etimer_expired(&et));
+  delivered = received;
+  delivered_pubacks = client_pubacks;
+  delivered_pubcomps = client_pubcomps;
+
+  /* The broker misses a message and then answers again */
+  expected_seq = 0;
+  pubacks = 0;
+  dup_flags = 0;
+  set_payload(0);
+  broker_silent = 1;
+  silent_start = clock_time();
+  mqtt_publish(&conn, &silent_mid, "lost", payloads[0], 4,
+               MQTT_QOS_LEVEL_1, MQTT_RETAIN_OFF);
+  etimer_set(&et, CLOCK_SECOND / 2);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+  broker_silent = 0;
+  etimer_set(&et, ACK_TIMEOUT * 2);
+  PROCESS_WAIT_EVENT_UNTIL(pubacks == 1 || timeout_events == 1 ||
+                           etimer_expired(&et));
+  /* Anything sent after the event */
+  etimer_set(&et, CLOCK_SECOND / 2);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+  silent_acked = pubacks;
+  silent_dups = dup_flags;
+  silent_received = expected_seq;
+
+#if MQTT_OUT_QUEUE_SIZE > 0
+  /* The broker goes silent, then drops the connection */
+  expected_seq = 0;
+  pubacks = 0;
+  dup_flags = 0;
+  broker_silent = 1;
+  for(seq = 0; seq < OUTAGE_MESSAGES; seq++) {
+    set_payload(seq);
+    if(mqtt_publish(&conn, &mid, "out", payloads[seq % QOS1_MESSAGES], 4,
+                    MQTT_QOS_LEVEL_1, MQTT_RETAIN_OFF) != MQTT_STATUS_OK) {
+      errors++;
+    }
+  }
+  etimer_set(&et, CLOCK_SECOND);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+  broker_silent = 0;
+  tcp_socket_close(&broker_socket);
+
+  /* Reconnect after a while */
+  etimer_set(&et, CLOCK_SECOND * 5);
+  PROCESS_WAIT_EVENT_UNTIL(disconnects == 1 || etimer_expired(&et));
+  etimer_set(&et, CLOCK_SECOND);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+  mqtt_connect(&conn, broker_host, BROKER_PORT, 60);
+  etimer_set(&et, CLOCK_SECOND * 30);
+  PROCESS_WAIT_EVENT_UNTIL(pubacks == OUTAGE_MESSAGES || etimer_expired(&et));
+  outage_acked = pubacks;
+  outage_received = expected_seq;
+  outage_dups = dup_flags;
+  outage_connects = connects;
+#endif /* MQTT_OUT_QUEUE_SIZE > 0 */
+
+  UNIT_TEST_RUN(test_qos1);
+  UNIT_TEST_RUN(test_qos2);
+  UNIT_TEST_RUN(test_receive);
+  UNIT_TEST_RUN(test_ack_timeout);
+#if MQTT_OUT_QUEUE_SIZE > 0
+  UNIT_TEST_RUN(test_outage);
+#endif /* MQTT_OUT_QUEUE_SIZE > 0 */
+  UNIT_TEST_RUN(test_broker);
+
+  printf("=check-me= DONE\n");
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,409 @@
+/*
+ * Copyright (c) 2018, RISE SICS.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * \file
+ *         Drives the streaming PUBLISH receive path of the MQTT engine
+ *         against a broker stand-in listening on the node itself. The broker
+ *         sends payloads larger than every buffer on the way, splits the
+ *         headers across TCP segments and packs several packets into one.
+ */
+
+#include "contiki.h"
+#include "mqtt.h"
+#include "net/ipv6/uip-ds6.h"
+#include "net/ipv6/uiplib.h"
+#include "net/ipv6/tcp-socket.h"
+#include "net/netstack.h"
+#include "services/unit-test/unit-test.h"
+
+#include <stdio.h>
+#include <string.h>
+/*---------------------------------------------------------------------------*/
+#define BROKER_PORT    1883
+#define BLOB_LENGTH    3000
+#define LONG_TOPIC_LEN (MQTT_MAX_TOPIC_LENGTH + 16)
+#define MAX_MESSAGES   4
+/*---------------------------------------------------------------------------*/
+PROCESS(mqtt_stream_test_process, "MQTT stream test");
+AUTOSTART_PROCESSES(&mqtt_stream_test_process);
+/*---------------------------------------------------------------------------*/
+/* Broker stand-in */
+static struct tcp_socket broker_socket;
+static uint8_t broker_in[MQTT_TCP_OUTPUT_BUFF_SIZE];
+static uint8_t broker_out[1024];
+static unsigned broker_pubacks;
+
+/* What the broker sends, and the length of each TCP segment of it */
+static uint8_t stream[BLOB_LENGTH + 1024];
+static uint16_t pieces[16];
+static int piece_count;
+static int next_piece;
+static int stream_pos;
+
+/* What the client got */
+static struct mqtt_connection conn;
+static char broker_host[48];
+static unsigned subacks;
+static struct {
+  char topic[MQTT_MAX_TOPIC_LENGTH + 1];
+  uint32_t length;
+  uint32_t received;
+  unsigned chunks;
+  unsigned errors;
+} messages[MAX_MESSAGES];
+static int message_count;
+static unsigned copied_chunks;
+/*---------------------------------------------------------------------------*/
+static void
+init(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+static void
+input(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t
+output(const linkaddr_t *localdest)
+{
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+const struct network_driver test_net_driver = {
+  "test",
+  init,
+  input,
+  output
+};
+/*---------------------------------------------------------------------------*/
+void
+print_test_report(const unit_test_t *utp)
+{
+  printf("=check-me= ");
+  if(utp->result == unit_test_failure) {
+    printf("FAILED   - %s: exit at L%u\n", utp->descr, utp->exit_line);
+  } else {
+    printf("SUCCEEDED - %s\n", utp->descr);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Byte at offset i of the payload of message n */
+static uint8_t
+payload_byte(int n, uint32_t i)
+{
+  return (uint8_t)(i * 7 + (i >> 8) + n);
+}
+/*---------------------------------------------------------------------------*/
+/* Appends a PUBLISH of message n to the stream */
+static int
+add_publish(int n, uint8_t fhdr, const char *topic, uint16_t mid,
+            uint32_t payload_length)
+{
+  int start = stream_pos;
+  uint16_t topic_length = strlen(topic);
+  uint32_t remaining = 2 + topic_length + payload_length + (mid ? 2 : 0);
+  uint32_t i;
+
+  stream[stream_pos++] = fhdr;
+  do {
+    stream[stream_pos] = remaining & 0x7F;
+    remaining >>= 7;
+    if(remaining > 0) {
+      stream[stream_pos] |= 0x80;
+    }
+    stream_pos++;
+  } while(remaining > 0);
+  stream[stream_pos++] = topic_length >> 8;
+  stream[stream_pos++] = topic_length & 0xFF;
+  memcpy(&stream[stream_pos], topic, topic_length);
+  stream_pos += topic_length;
+  if(mid) {
+    stream[stream_pos++] = mid >> 8;
+    stream[stream_pos++] = mid & 0xFF;
+  }
+  for(i = 0; i < payload_length; i++) {
+    stream[stream_pos++] = payload_byte(n, i);
+  }
+  return stream_pos - start;
+}
+/*---------------------------------------------------------------------------*/
+static void
+add_piece(int length)
+{
+  while(length > sizeof(broker_out)) {
+    pieces[piece_count++] = sizeof(broker_out);
+    length -= sizeof(broker_out);
+  }
+  pieces[piece_count++] = length;
+}
+/*---------------------------------------------------------------------------*/
+static void
+build_stream(void)
+{
+  char long_topic[LONG_TOPIC_LEN + 1];
+  int len;
+
+  memset(long_topic, 'x', LONG_TOPIC_LEN);
+  long_topic[LONG_TOPIC_LEN] = '\0';
+
+  /* A large QoS 0 blob, the topic length split across two segments */
+  len = add_publish(0, 0x31, "cfg/blob", 0, BLOB_LENGTH);
+  add_piece(4);
+  add_piece(100);
+  add_piece(len - 104);
+
+  /* QoS 1 with a topic that does not fit, in one segment */
+  len = add_publish(1, 0x32, long_topic, 0x1234, 600);
+  add_piece(len);
+
+  /* An empty payload and a small one, sharing a segment */
+  len = add_publish(2, 0x30, "e", 0, 0);
+  len += add_publish(3, 0x30, "s", 0, 4);
+  add_piece(len);
+}
+/*---------------------------------------------------------------------------*/
+static void
+send_next_piece(void)
+{
+  if(next_piece < piece_count) {
+    tcp_socket_send(&broker_socket, &stream[stream_pos], pieces[next_piece]);
+    stream_pos += pieces[next_piece];
+    next_piece++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Handles one complete packet from the client */
+static void
+broker_packet(const uint8_t *data, int len)
+{
+  static const uint8_t connack[] = { 0x20, 0x02, 0x00, 0x00 };
+  static const uint8_t pingresp[] = { 0xD0, 0x00 };
+  uint8_t suback[5];
+
+  switch(data[0] & 0xF0) {
+  case 0x10:
+    tcp_socket_send(&broker_socket, connack, sizeof(connack));
+    break;
+  case 0x40:
+    if(len == 4 && data[2] == 0x12 && data[3] == 0x34) {
+      broker_pubacks++;
+    }
+    break;
+  case 0x80:
+    suback[0] = 0x90;
+    suback[1] = 0x03;
+    suback[2] = data[2];
+    suback[3] = data[3];
+    suback[4] = data[len - 1];
+    tcp_socket_send(&broker_socket, suback, sizeof(suback));
+    break;
+  case 0xC0:
+    tcp_socket_send(&broker_socket, pingresp, sizeof(pingresp));
+    break;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static int
+broker_input(struct tcp_socket *s, void *ptr, const uint8_t *data, int len)
+{
+  int pos = 0;
+
+  /* The client sends small packets, one segment each */
+  while(len - pos >= 2 && len - pos >= 2 + data[pos + 1]) {
+    broker_packet(&data[pos], 2 + data[pos + 1]);
+    pos += 2 + data[pos + 1];
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+broker_event(struct tcp_socket *s, void *ptr, tcp_socket_event_t event)
+{
+  if(event == TCP_SOCKET_DATA_SENT) {
+    send_next_piece();
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+check_chunk(struct mqtt_message *msg)
+{
+  uint32_t i;
+  int n;
+
+  if(msg->first_chunk) {
+    if(message_count == MAX_MESSAGES) {
+      message_count++;
+      return;
+    }
+    n = message_count++;
+    strcpy(messages[n].topic, msg->topic);
+    messages[n].length = msg->payload_length;
+  } else if(message_count == 0 || message_count > MAX_MESSAGES) {
+    return;
+  } else {
+    n = message_count - 1;
+  }
+
+  /* Each chunk follows on from the previous one */
+  if(msg->payload_offset != messages[n].received ||
+     msg->payload_length != messages[n].length ||
+     msg->payload_left != msg->payload_length - msg->payload_offset -
+     msg->payload_chunk_length) {
+    messages[n].errors++;
+  }
+  for(i = 0; i < msg->payload_chunk_length; i++) {
+    if(msg->payload_chunk[i] != payload_byte(n, msg->payload_offset + i)) {
+      messages[n].errors++;
+      break;
+    }
+  }
+
+  /* Slices of the TCP input, not of the engine's own buffer */
+  if(msg->payload_chunk_length > 0 &&
+     msg->payload_chunk >= conn.in_packet.payload &&
+     msg->payload_chunk < conn.in_packet.payload + MQTT_INPUT_BUFF_SIZE) {
+    copied_chunks++;
+  }
+
+  messages[n].received += msg->payload_chunk_length;
+  messages[n].chunks++;
+}
+/*---------------------------------------------------------------------------*/
+static void
+mqtt_event(struct mqtt_connection *m, mqtt_event_t event, void *data)
+{
+  if(event == MQTT_EVENT_SUBACK) {
+    subacks++;
+  } else if(event == MQTT_EVENT_PUBLISH) {
+    check_chunk(data);
+  }
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(test_large_payload,
+                   "Large payload in slices of the TCP input");
+UNIT_TEST(test_large_payload)
+{
+  UNIT_TEST_BEGIN();
+
+  UNIT_TEST_ASSERT(message_count >= 1);
+  UNIT_TEST_ASSERT(strcmp(messages[0].topic, "cfg/blob") == 0);
+  UNIT_TEST_ASSERT(messages[0].length == BLOB_LENGTH);
+  UNIT_TEST_ASSERT(messages[0].received == BLOB_LENGTH);
+  UNIT_TEST_ASSERT(messages[0].errors == 0);
+  /* At least one slice per segment and per input buffer */
+  UNIT_TEST_ASSERT(messages[0].chunks >= 4);
+  UNIT_TEST_ASSERT(copied_chunks == 0);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(test_long_topic, "QoS 1 with a truncated topic");
+UNIT_TEST(test_long_topic)
+{
+  UNIT_TEST_BEGIN();
+
+  UNIT_TEST_ASSERT(message_count >= 2);
+  UNIT_TEST_ASSERT(strlen(messages[1].topic) == MQTT_MAX_TOPIC_LENGTH);
+  UNIT_TEST_ASSERT(messages[1].topic[0] == 'x');
+  UNIT_TEST_ASSERT(messages[1].length == 600);
+  UNIT_TEST_ASSERT(messages[1].received == 600);
+  UNIT_TEST_ASSERT(messages[1].errors == 0);
+  UNIT_TEST_ASSERT(broker_pubacks == 1);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(test_shared_segment, "Packets sharing a segment");
+UNIT_TEST(test_shared_segment)
+{
+  UNIT_TEST_BEGIN();
+
+  UNIT_TEST_ASSERT(message_count == 4);
+  UNIT_TEST_ASSERT(strcmp(messages[2].topic, "e") == 0);
+  UNIT_TEST_ASSERT(messages[2].length == 0);
+  UNIT_TEST_ASSERT(messages[2].chunks == 1);
+  UNIT_TEST_ASSERT(strcmp(messages[3].topic, "s") == 0);
+  UNIT_TEST_ASSERT(messages[3].received == 4);
+  UNIT_TEST_ASSERT(messages[3].chunks == 1);
+  UNIT_TEST_ASSERT(messages[3].errors == 0);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(mqtt_stream_test_process, ev, data)
+{
+  static struct etimer et;
+
+  PROCESS_BEGIN();
+
+  printf("Run unit-test\n");
+  printf("---\n");
+
+  tcp_socket_register(&broker_socket, NULL,
+                      broker_in, sizeof(broker_in),
+                      broker_out, sizeof(broker_out),
+                      broker_input, broker_event);
+  tcp_socket_listen(&broker_socket, BROKER_PORT);
+
+  uiplib_ipaddr_snprint(broker_host, sizeof(broker_host),
+                        &uip_ds6_get_link_local(-1)->ipaddr);
+  mqtt_register(&conn, &mqtt_stream_test_process, "stream", mqtt_event, 64);
+  conn.auto_reconnect = 0;
+  mqtt_connect(&conn, broker_host, BROKER_PORT, 60);
+
+  etimer_set(&et, CLOCK_SECOND * 2);
+  PROCESS_WAIT_EVENT_UNTIL(mqtt_connected(&conn) || etimer_expired(&et));
+  while(mqtt_subscribe(&conn, NULL, "#", MQTT_QOS_LEVEL_1) != MQTT_STATUS_OK &&
+        !etimer_expired(&et)) {
+    PROCESS_WAIT_EVENT();
+  }
+  PROCESS_WAIT_EVENT_UNTIL(subacks == 1 || etimer_expired(&et));
+
+  /* Send the stream, one piece once the previous one is acknowledged */
+  build_stream();
+  stream_pos = 0;
+  send_next_piece();
+
+  etimer_set(&et, CLOCK_SECOND);
+  PROCESS_WAIT_EVENT_UNTIL((message_count == MAX_MESSAGES &&
+                            broker_pubacks == 1) || etimer_expired(&et));
+
+  UNIT_TEST_RUN(test_large_payload);
+  UNIT_TEST_RUN(test_long_topic);
+  UNIT_TEST_RUN(test_shared_segment);
+
+  printf("=check-me= DONE\n");
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,409 @@
+/*
+ * Copyright (c) 2018, RISE SICS.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * \file
+ *         Feeds randomly fragmented packets to 6LoWPAN reassembly, with
+ *         fragments shuffled, duplicated and interleaved between senders,
+ *         and checks the reassembled packets and the statistics.
+ */
+
+#include "contiki.h"
+#include "net/netstack.h"
+#include "net/packetbuf.h"
+#include "net/ipv6/uip.h"
+#include "net/ipv6/sicslowpan.h"
+#include "lib/random.h"
+#include "services/unit-test/unit-test.h"
+
+#include <stdio.h>
+#include <string.h>
+/*---------------------------------------------------------------------------*/
+PROCESS(sicslowpan_reass_test_process, "6LoWPAN reassembly test");
+AUTOSTART_PROCESSES(&sicslowpan_reass_test_process);
+/*---------------------------------------------------------------------------*/
+#define NUM_ROUNDS      500
+#define MAX_PACKETS     4
+#define MAX_LEN         1280
+/* Uncompressed length of the first fragment, and of the next ones */
+#define FIRST_LEN       96
+#define NEXT_LEN        104
+#define MAX_FRAGS       (1 + (MAX_LEN - FIRST_LEN + NEXT_LEN - 1) / NEXT_LEN)
+/* Fragments of all packets, with room for duplicates */
+#define MAX_EVENTS      (2 * MAX_PACKETS * MAX_FRAGS)
+/*---------------------------------------------------------------------------*/
+struct packet {
+  linkaddr_t sender;
+  uint16_t tag;
+  uint16_t len;
+  int delivered;
+  uint8_t data[MAX_LEN];
+};
+
+static struct packet packets[MAX_PACKETS];
+static uint8_t events[MAX_EVENTS][2];
+static int num_events;
+static uint16_t next_tag;
+static int corrupted;
+static const struct sicslowpan_reass_stats *stats;
+/*---------------------------------------------------------------------------*/
+void
+print_test_report(const unit_test_t *utp)
+{
+  printf("=check-me= ");
+  if(utp->result == unit_test_failure) {
+    printf("FAILED   - %s: exit at L%u\n", utp->descr, utp->exit_line);
+  } else {
+    printf("SUCCEEDED - %s\n", utp->descr);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Called by 6LoWPAN with a reassembled packet in uip_buf */
+static void
+sniffer_input(void)
+{
+  int i;
+
+  for(i = 0; i < MAX_PACKETS; i++) {
+    if(linkaddr_cmp(&packets[i].sender, packetbuf_addr(PACKETBUF_ADDR_SENDER))) {
+      if(uip_len == packets[i].len &&
+         memcmp(&uip_buf[UIP_LLH_LEN], packets[i].data, uip_len) == 0) {
+        packets[i].delivered++;
+      } else {
+        corrupted++;
+      }
+      return;
+    }
+  }
+  corrupted++;
+}
+/*---------------------------------------------------------------------------*/
+static void
+sniffer_output(int mac_status)
+{
+}
+/*---------------------------------------------------------------------------*/
+NETSTACK_SNIFFER(reass_sniffer, sniffer_input, sniffer_output);
+/*---------------------------------------------------------------------------*/
+static void
+new_packet(struct packet *p, int sender, uint16_t len)
+{
+  int i;
+
+  memset(&p->sender, 0, sizeof(p->sender));
+  p->sender.u8[0] = sender + 1;
+  p->tag = next_tag++;
+  p->len = len;
+  p->delivered = 0;
+  for(i = 0; i < len; i++) {
+    p->data[i] = random_rand();
+  }
+  /* An invalid IP version, so that uIP drops the packet after us */
+  p->data[0] = 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+num_frags(const struct packet *p)
+{
+  return 1 + (p->len - FIRST_LEN + NEXT_LEN - 1) / NEXT_LEN;
+}
+/*---------------------------------------------------------------------------*/
+/* Input a fragment of len bytes at offset (in bytes) of a packet */
+static void
+input_range(const struct packet *p, uint16_t offset, uint16_t len)
+{
+  uint8_t *buf;
+
+  packetbuf_clear();
+  buf = packetbuf_dataptr();
+  buf[1] = p->len & 0xff;
+  buf[2] = p->tag >> 8;
+  buf[3] = p->tag & 0xff;
+  if(offset == 0) {
+    buf[0] = SICSLOWPAN_DISPATCH_FRAG1 | (p->len >> 8);
+    buf[4] = SICSLOWPAN_DISPATCH_IPV6;
+  } else {
+    buf[0] = SICSLOWPAN_DISPATCH_FRAGN | (p->len >> 8);
+    buf[4] = offset >> 3;
+  }
+  memcpy(buf + 5, p->data + offset, len);
+  packetbuf_set_datalen(5 + len);
+  packetbuf_set_addr(PACKETBUF_ADDR_SENDER, &p->sender);
+  NETSTACK_NETWORK.input();
+}
+/*---------------------------------------------------------------------------*/
+static void
+input_fragment(const struct packet *p, int frag)
+{
+  uint16_t offset;
+
+  if(frag == 0) {
+    input_range(p, 0, FIRST_LEN);
+  } else {
+    offset = FIRST_LEN + (frag - 1) * NEXT_LEN;
+    input_range(p, offset, MIN(NEXT_LEN, p->len - offset));
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Build the fragments of npackets packets in random order, with the
+   fragments of different packets interleaved. With duplicates, some
+   fragments are repeated before the last fragment of their packet.
+   Returns the number of duplicates. */
+static int
+build_events(int npackets, int duplicates)
+{
+  static uint8_t order[MAX_PACKETS][2 * MAX_FRAGS];
+  int count[MAX_PACKETS];
+  int next[MAX_PACKETS];
+  int dups = 0;
+  int i, j, k, n;
+  uint8_t tmp;
+
+  for(i = 0; i < npackets; i++) {
+    n = num_frags(&packets[i]);
+    for(j = 0; j < n; j++) {
+      order[i][j] = j;
+    }
+    for(j = n - 1; j > 0; j--) {
+      k = random_rand() % (j + 1);
+      tmp = order[i][j];
+      order[i][j] = order[i][k];
+      order[i][k] = tmp;
+    }
+    if(duplicates) {
+      /* Repeat fragments at a later position, but before the last one */
+      for(j = n - 2; j >= 0; j--) {
+        if(random_rand() % 4 == 0) {
+          k = j + 1 + random_rand() % (n - 1 - j);
+          memmove(&order[i][k + 1], &order[i][k], n - k);
+          order[i][k] = order[i][j];
+          n++;
+          dups++;
+        }
+      }
+    }
+    count[i] = n;
+    next[i] = 0;
+  }
+
+  /* Interleave the packets */
+  num_events = 0;
+  for(;;) {
+    n = 0;
+    for(i = 0; i < npackets; i++) {
+      n += next[i] < count[i];
+    }
+    if(n == 0) {
+      break;
+    }
+    k = random_rand() % n;
+    for(i = 0; i < npackets; i++) {
+      if(next[i] < count[i] && k-- == 0) {
+        events[num_events][0] = i;
+        events[num_events][1] = order[i][next[i]++];
+        num_events++;
+        break;
+      }
+    }
+  }
+  return dups;
+}
+/*---------------------------------------------------------------------------*/
+static void
+run_events(void)
+{
+  int i;
+
+  for(i = 0; i < num_events; i++) {
+    input_fragment(&packets[events[i][0]], events[i][1]);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static uint16_t
+random_len(void)
+{
+  return FIRST_LEN + 1 + random_rand() % (MAX_LEN - FIRST_LEN);
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(test_in_order, "Fragments in order");
+UNIT_TEST(test_in_order)
+{
+  int r, f;
+
+  UNIT_TEST_BEGIN();
+
+  sicslowpan_reass_stats_reset();
+  corrupted = 0;
+  for(r = 0; r < NUM_ROUNDS; r++) {
+    new_packet(&packets[0], 0, random_len());
+    for(f = 0; f < num_frags(&packets[0]); f++) {
+      input_fragment(&packets[0], f);
+    }
+    UNIT_TEST_ASSERT(packets[0].delivered == 1);
+  }
+  UNIT_TEST_ASSERT(corrupted == 0);
+  UNIT_TEST_ASSERT(stats->hits == NUM_ROUNDS);
+  UNIT_TEST_ASSERT(stats->drops == 0);
+  UNIT_TEST_ASSERT(stats->contexts == 0 && stats->buffers == 0);
+  UNIT_TEST_ASSERT(stats->peak_contexts == 1);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(test_shuffled, "Shuffled, duplicated and interleaved");
+UNIT_TEST(test_shuffled)
+{
+  int r, i;
+  unsigned long dups = 0;
+
+  UNIT_TEST_BEGIN();
+
+  sicslowpan_reass_stats_reset();
+  corrupted = 0;
+  for(r = 0; r < NUM_ROUNDS; r++) {
+    for(i = 0; i < SICSLOWPAN_CONF_REASS_CONTEXTS; i++) {
+      new_packet(&packets[i], i, random_len());
+    }
+    dups += build_events(SICSLOWPAN_CONF_REASS_CONTEXTS, 1);
+    run_events();
+    for(i = 0; i < SICSLOWPAN_CONF_REASS_CONTEXTS; i++) {
+      UNIT_TEST_ASSERT(packets[i].delivered == 1);
+    }
+  }
+  UNIT_TEST_ASSERT(corrupted == 0);
+  UNIT_TEST_ASSERT(stats->hits == NUM_ROUNDS * SICSLOWPAN_CONF_REASS_CONTEXTS);
+  UNIT_TEST_ASSERT(stats->duplicates == dups);
+  UNIT_TEST_ASSERT(stats->drops == 0 && stats->evictions == 0);
+  UNIT_TEST_ASSERT(stats->contexts == 0 && stats->buffers == 0);
+  UNIT_TEST_ASSERT(stats->peak_contexts == SICSLOWPAN_CONF_REASS_CONTEXTS);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(test_overlap, "Overlapping fragments");
+UNIT_TEST(test_overlap)
+{
+  UNIT_TEST_BEGIN();
+
+  sicslowpan_reass_stats_reset();
+  new_packet(&packets[0], 0, MAX_LEN);
+  input_fragment(&packets[0], 0);
+  input_fragment(&packets[0], 1);
+  /* Fully covered by the fragment received before */
+  input_range(&packets[0], FIRST_LEN, NEXT_LEN - 8);
+  UNIT_TEST_ASSERT(stats->duplicates == 1 && stats->contexts == 1);
+  /* Partially covered: the reassembly is aborted */
+  input_range(&packets[0], FIRST_LEN + 8, NEXT_LEN);
+  UNIT_TEST_ASSERT(stats->drops == 1);
+  UNIT_TEST_ASSERT(stats->contexts == 0 && stats->buffers == 0);
+  UNIT_TEST_ASSERT(packets[0].delivered == 0);
+
+  /* The sender can still retransmit the packet */
+  build_events(1, 0);
+  run_events();
+  UNIT_TEST_ASSERT(packets[0].delivered == 1);
+  UNIT_TEST_ASSERT(stats->hits == 1);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(test_pressure, "More senders than contexts");
+UNIT_TEST(test_pressure)
+{
+  int r, i;
+
+  UNIT_TEST_BEGIN();
+
+  sicslowpan_reass_stats_reset();
+  corrupted = 0;
+  for(r = 0; r < NUM_ROUNDS; r++) {
+    for(i = 0; i < MAX_PACKETS; i++) {
+      new_packet(&packets[i], i, random_len());
+    }
+    build_events(MAX_PACKETS, 0);
+    run_events();
+    for(i = 0; i < MAX_PACKETS; i++) {
+      UNIT_TEST_ASSERT(packets[i].delivered <= 1);
+    }
+  }
+  UNIT_TEST_ASSERT(corrupted == 0);
+  UNIT_TEST_ASSERT(stats->evictions > 0);
+  UNIT_TEST_ASSERT(stats->hits > 0);
+  UNIT_TEST_ASSERT(stats->peak_contexts == SICSLOWPAN_CONF_REASS_CONTEXTS);
+  UNIT_TEST_ASSERT(stats->peak_buffers <= SICSLOWPAN_CONF_FRAGMENT_BUFFERS);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(test_timeout, "Reassembly timeout");
+UNIT_TEST(test_timeout)
+{
+  UNIT_TEST_BEGIN();
+
+  /* The contexts left by the previous test have timed out by now */
+  UNIT_TEST_ASSERT(stats->contexts > 0);
+  sicslowpan_reass_stats_reset();
+  new_packet(&packets[0], 0, MAX_LEN);
+  input_fragment(&packets[0], 1);
+  UNIT_TEST_ASSERT(stats->timeouts > 0);
+  UNIT_TEST_ASSERT(stats->contexts == 1);
+  UNIT_TEST_ASSERT(stats->buffers == 1);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(sicslowpan_reass_test_process, ev, data)
+{
+  static struct etimer et;
+
+  PROCESS_BEGIN();
+
+  printf("Run unit-test\n");
+  printf("---\n");
+
+  random_init(0x6105);
+  netstack_sniffer_add(&reass_sniffer);
+  stats = sicslowpan_reass_stats();
+
+  UNIT_TEST_RUN(test_in_order);
+  UNIT_TEST_RUN(test_shuffled);
+  UNIT_TEST_RUN(test_overlap);
+  UNIT_TEST_RUN(test_pressure);
+
+  etimer_set(&et, 2 * SICSLOWPAN_REASS_MAXAGE * CLOCK_SECOND / 16);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+  UNIT_TEST_RUN(test_timeout);
+
+  printf("=check-me= DONE\n");
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,256 @@
+/*
+ * Copyright (c) 2018, RISE SICS.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Cross-checks the sorted schedule timeline of TSCH against a
+ *         brute-force search over all links, on random schedules.
+ */
+
+#include "contiki.h"
+#include "net/mac/tsch/tsch.h"
+#include "lib/random.h"
+#include "services/unit-test/unit-test.h"
+
+#include <stdio.h>
+/*---------------------------------------------------------------------------*/
+PROCESS(tsch_schedule_test_process, "TSCH schedule test");
+AUTOSTART_PROCESSES(&tsch_schedule_test_process);
+/*---------------------------------------------------------------------------*/
+#define NUM_ROUNDS        2000
+#define CHECKS_PER_ROUND  20
+#define MAX_HANDLE        8
+/*---------------------------------------------------------------------------*/
+/* Stubs for the parts of TSCH used by the schedule */
+const linkaddr_t tsch_broadcast_address = { { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff } };
+struct tsch_link *current_link;
+static struct tsch_neighbor stub_neighbor;
+
+int
+tsch_is_locked(void)
+{
+  return 0;
+}
+int
+tsch_get_lock(void)
+{
+  return 1;
+}
+void
+tsch_release_lock(void)
+{
+}
+struct tsch_neighbor *
+tsch_queue_add_nbr(const linkaddr_t *addr)
+{
+  return &stub_neighbor;
+}
+/*---------------------------------------------------------------------------*/
+void
+print_test_report(const unit_test_t *utp)
+{
+  printf("=check-me= ");
+  if(utp->result == unit_test_failure) {
+    printf("FAILED   - %s: exit at L%u\n", utp->descr, utp->exit_line);
+  } else {
+    printf("SUCCEEDED - %s\n", utp->descr);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* The original brute-force search over every link of every slotframe */
+static struct tsch_link *
+reference_next_active_link(struct tsch_asn_t *asn, uint16_t *time_offset,
+                           struct tsch_link **backup_link)
+{
+  uint16_t time_to_curr_best = 0;
+  struct tsch_link *curr_best = NULL;
+  struct tsch_link *curr_backup = NULL;
+  struct tsch_slotframe *sf = tsch_schedule_slotframe_head();
+
+  while(sf != NULL) {
+    uint16_t timeslot = TSCH_ASN_MOD(*asn, sf->size);
+    struct tsch_link *l = list_head(sf->links_list);
+    while(l != NULL) {
+      uint16_t time_to_timeslot =
+        l->timeslot > timeslot ?
+        l->timeslot - timeslot :
+        sf->size.val + l->timeslot - timeslot;
+      if(curr_best == NULL || time_to_timeslot < time_to_curr_best) {
+        time_to_curr_best = time_to_timeslot;
+        curr_best = l;
+        curr_backup = NULL;
+      } else if(time_to_timeslot == time_to_curr_best) {
+        struct tsch_link *new_best = NULL;
+        if((curr_best->link_options & LINK_OPTION_TX) == (l->link_options & LINK_OPTION_TX)) {
+          if(l->slotframe_handle < curr_best->slotframe_handle) {
+            new_best = l;
+          }
+        } else {
+          if(l->link_options & LINK_OPTION_TX) {
+            new_best = l;
+          }
+        }
+        if(curr_backup == NULL) {
+          if(new_best != l && (l->link_options & LINK_OPTION_RX)) {
+            curr_backup = l;
+          }
+          if(new_best != curr_best && (curr_best->link_options & LINK_OPTION_RX)) {
+            curr_backup = curr_best;
+          }
+        }
+        if(new_best != NULL) {
+          curr_best = new_best;
+        }
+      }
+      l = list_item_next(l);
+    }
+    sf = list_item_next(sf);
+  }
+  *time_offset = time_to_curr_best;
+  *backup_link = curr_backup;
+  return curr_best;
+}
+/*---------------------------------------------------------------------------*/
+static struct tsch_slotframe *
+random_slotframe(void)
+{
+  struct tsch_slotframe *sf;
+  int n = 0;
+
+  for(sf = tsch_schedule_slotframe_head(); sf != NULL;
+      sf = tsch_schedule_slotframe_next(sf)) {
+    n++;
+  }
+  if(n == 0) {
+    return NULL;
+  }
+  n = random_rand() % n;
+  for(sf = tsch_schedule_slotframe_head(); n > 0;
+      sf = tsch_schedule_slotframe_next(sf)) {
+    n--;
+  }
+  return sf;
+}
+/*---------------------------------------------------------------------------*/
+static void
+random_operation(void)
+{
+  static const uint8_t options[] = {
+    LINK_OPTION_TX,
+    LINK_OPTION_RX,
+    LINK_OPTION_TX | LINK_OPTION_SHARED,
+    LINK_OPTION_TX | LINK_OPTION_RX | LINK_OPTION_SHARED,
+  };
+  struct tsch_slotframe *sf = random_slotframe();
+  unsigned op = random_rand() % 100;
+
+  if(sf == NULL || op < 2) {
+    /* Add a slotframe, with a random free handle */
+    uint16_t handle = random_rand() % MAX_HANDLE;
+    tsch_schedule_add_slotframe(handle, 1 + random_rand() % 150);
+  } else if(op < 3) {
+    tsch_schedule_remove_slotframe(sf);
+  } else if(op < 40) {
+    tsch_schedule_remove_link_by_timeslot(sf, random_rand() % sf->size.val);
+  } else {
+    tsch_schedule_add_link(sf, options[random_rand() % sizeof(options)],
+                           LINK_TYPE_NORMAL, &tsch_broadcast_address,
+                           random_rand() % sf->size.val, random_rand() % 16);
+  }
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(test_next_active_link, "Next active link vs. brute force");
+UNIT_TEST(test_next_active_link)
+{
+  struct tsch_asn_t asn;
+  struct tsch_link *link, *backup;
+  struct tsch_link *ref_link, *ref_backup;
+  uint16_t offset, ref_offset;
+  int round, check;
+
+  UNIT_TEST_BEGIN();
+
+  tsch_schedule_init();
+
+  for(round = 0; round < NUM_ROUNDS; round++) {
+    random_operation();
+    for(check = 0; check < CHECKS_PER_ROUND; check++) {
+      TSCH_ASN_INIT(asn, random_rand() & 0xff,
+                    ((uint32_t)random_rand() << 16) | random_rand());
+      link = tsch_schedule_get_next_active_link(&asn, &offset, &backup);
+      ref_link = reference_next_active_link(&asn, &ref_offset, &ref_backup);
+      UNIT_TEST_ASSERT(link == ref_link);
+      UNIT_TEST_ASSERT(offset == ref_offset);
+      UNIT_TEST_ASSERT(backup == ref_backup);
+    }
+  }
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(test_link_by_timeslot, "Link by timeslot vs. brute force");
+UNIT_TEST(test_link_by_timeslot)
+{
+  struct tsch_slotframe *sf;
+  struct tsch_link *l;
+  uint16_t timeslot;
+
+  UNIT_TEST_BEGIN();
+
+  for(sf = tsch_schedule_slotframe_head(); sf != NULL;
+      sf = tsch_schedule_slotframe_next(sf)) {
+    for(timeslot = 0; timeslot < sf->size.val; timeslot++) {
+      for(l = list_head(sf->links_list); l != NULL; l = list_item_next(l)) {
+        if(l->timeslot == timeslot) {
+          break;
+        }
+      }
+      UNIT_TEST_ASSERT(tsch_schedule_get_link_by_timeslot(sf, timeslot) == l);
+    }
+  }
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(tsch_schedule_test_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+  printf("Run unit-test\n");
+  printf("---\n");
+
+  UNIT_TEST_RUN(test_next_active_link);
+  UNIT_TEST_RUN(test_link_by_timeslot);
+
+  printf("=check-me= DONE\n");
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,47 @@
+#!/bin/bash
+
+# Contiki directory
+CONTIKI=$1
+
+# Example code directory
+CODE_DIR=$CONTIKI/tests/07-simulation-base/code-coap-dtls/
+CODE=test-coap-dtls
+
+# Starting Contiki-NG native nodes: a server and a client
+echo "Starting native nodes"
+make -C $CODE_DIR TARGET=native > make.log 2> make.err
+$CODE_DIR/$CODE.native server > $CODE-server.log 2> $CODE-server.err &
+SPID=$!
+sleep 1
+$CODE_DIR/$CODE.native client > $CODE-client.log 2> $CODE-client.err &
+CPID=$!
+sleep 9
+
+echo "Closing native nodes"
+sleep 2
+kill -9 $CPID $SPID
+
+if grep -q "=check-me= FAILED" $CODE-server.log $CODE-client.log ||
+   ! grep -q "=check-me= DONE" $CODE-server.log ||
+   ! grep -q "=check-me= DONE" $CODE-client.log ; then
+  echo "==== make.log ====" ; cat make.log;
+  echo "==== make.err ====" ; cat make.err;
+  echo "==== $CODE-server.log ====" ; cat $CODE-server.log;
+  echo "==== $CODE-server.err ====" ; cat $CODE-server.err;
+  echo "==== $CODE-client.log ====" ; cat $CODE-client.log;
+  echo "==== $CODE-client.err ====" ; cat $CODE-client.err;
+
+  printf "%-32s TEST FAIL\n" "$CODE" | tee $CODE.testlog;
+else
+  cat $CODE-server.log $CODE-client.log > $CODE.testlog
+  printf "%-32s TEST OK\n" "$CODE" | tee $CODE.testlog;
+fi
+
+rm make.log
+rm make.err
+rm $CODE-server.log $CODE-client.log
+rm $CODE-server.err $CODE-client.err
+
+# We do not want Make to stop -> Return 0
+# The Makefile will check if a log contains FAIL at the end
+exit 0
@@ -0,0 +1,57 @@
+#!/bin/bash
+
+# Contiki directory
+CONTIKI=$1
+
+# Example code directory
+CODE_DIR=$CONTIKI/tests/07-simulation-base/code-mqtt-inflight/
+CODE=test-mqtt-inflight
+
+# Starting Contiki-NG native node, with an outbound queue
+echo "Starting native node, with an outbound queue"
+make -C $CODE_DIR TARGET=native > make.log 2> make.err
+$CODE_DIR/$CODE.native > $CODE-queue.log 2> $CODE-queue.err &
+CPID=$!
+sleep 18
+
+echo "Closing native node"
+sleep 2
+kill -9 $CPID
+
+# Again without the queue: messages that time out are dropped
+echo "Starting native node, without an outbound queue"
+make -C $CODE_DIR TARGET=native clean >> make.log 2>> make.err
+make -C $CODE_DIR TARGET=native MQTT_QUEUE=0 >> make.log 2>> make.err
+$CODE_DIR/$CODE.native > $CODE-noqueue.log 2> $CODE-noqueue.err &
+CPID=$!
+sleep 18
+
+echo "Closing native node"
+sleep 2
+kill -9 $CPID
+make -C $CODE_DIR TARGET=native clean >> make.log 2>> make.err
+
+if grep -q "=check-me= FAILED" $CODE-queue.log $CODE-noqueue.log ||
+   ! grep -q "=check-me= DONE" $CODE-queue.log ||
+   ! grep -q "=check-me= DONE" $CODE-noqueue.log ; then
+  echo "==== make.log ====" ; cat make.log;
+  echo "==== make.err ====" ; cat make.err;
+  echo "==== $CODE-queue.log ====" ; cat $CODE-queue.log;
+  echo "==== $CODE-queue.err ====" ; cat $CODE-queue.err;
+  echo "==== $CODE-noqueue.log ====" ; cat $CODE-noqueue.log;
+  echo "==== $CODE-noqueue.err ====" ; cat $CODE-noqueue.err;
+
+  printf "%-32s TEST FAIL\n" "$CODE" | tee $CODE.testlog;
+else
+  cat $CODE-queue.log $CODE-noqueue.log > $CODE.testlog
+  printf "%-32s TEST OK\n" "$CODE" | tee $CODE.testlog;
+fi
+
+rm make.log
+rm make.err
+rm $CODE-queue.log $CODE-noqueue.log
+rm $CODE-queue.err $CODE-noqueue.err
+
+# We do not want Make to stop -> Return 0
+# The Makefile will check if a log contains FAIL at the end
+exit 0